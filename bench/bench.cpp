@@ -0,0 +1,463 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+// This program benchmarks the C++ kernels in cpp_functions.so on synthetic data. It is built and
+// run with 'make bench', and it writes its results to stdout as JSON. The data is generated
+// in-process from a seed, so repeated runs with the same parameters use exactly the same input.
+//
+// Each kernel is run in its own child process, so its peak RSS is its own. Allocation counts are
+// for C++ operator new; allocations made with malloc (e.g. by minimap and miniasm) aren't counted.
+// Banded cells (the area of the DP band) are only given for the kernels with a fixed band: semi-
+// global alignment sizes each read's band from its seed chain inside the kernel, and minimap and
+// miniasm don't do DP alignment.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "consensus_align.h"
+#include "global_align.h"
+#include "memory_budget.h"
+#include "miniasm_assembly.h"
+#include "minimap_align.h"
+#include "path_align.h"
+#include "ref_seqs.h"
+#include "semi_global_align.h"
+#include "string_functions.h"
+#include "thread_pool.h"
+
+
+static std::atomic<long long> allocationCount(0);
+
+void * operator new(std::size_t size) {
+    ++allocationCount;
+    void * p = std::malloc(size == 0 ? 1 : size);
+    if (p == 0)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void * p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept {
+    std::free(p);
+}
+
+
+struct BenchParameters {
+    unsigned int seed = 0;
+    int threads = 4;
+    int genomeLength = 100000;
+    double repeatFraction = 0.1;
+    int repeatLength = 2000;
+    int readCount = 200;
+    int readLength = 5000;
+    double errorRate = 0.1;
+    int pairCount = 200;
+    int pairLength = 1000;
+    int consensusGroupSize = 10;
+};
+
+struct BenchData {
+    std::string genome;
+    std::vector<std::string> readNames, readSeqs;
+    std::vector<int> readStarts;
+    std::vector<bool> readStrands;  // true for forward
+    std::vector<std::string> pairSeqs1, pairSeqs2;
+};
+
+struct KernelResult {
+    long long reads = 0;
+    double seconds = 0.0;
+    double bandedCells = 0.0;  // 0 when the kernel has no fixed band
+    long long allocations = 0;
+};
+
+static int matchScore = 3, mismatchScore = -6, gapOpenScore = -5, gapExtensionScore = -2;
+
+
+std::string randomSeq(std::mt19937 & gen, int length) {
+    std::uniform_int_distribution<int> baseDist(0, 3);
+    std::string seq(length, 'A');
+    for (int i = 0; i < length; ++i)
+        seq[i] = "ACGT"[baseDist(gen)];
+    return seq;
+}
+
+
+// Adds substitutions, insertions and deletions (in equal proportions) at the given total rate.
+std::string mutateSeq(std::mt19937 & gen, const std::string & seq, double errorRate) {
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    std::uniform_int_distribution<int> baseDist(0, 3);
+    std::string mutated;
+    mutated.reserve(seq.length() + seq.length() / 10);
+    for (char base : seq) {
+        double r = dist(gen);
+        if (r < errorRate / 3.0)
+            continue;
+        else if (r < 2.0 * errorRate / 3.0) {
+            mutated.push_back("ACGT"[baseDist(gen)]);
+            mutated.push_back(base);
+        }
+        else if (r < errorRate)
+            mutated.push_back("ACGT"[baseDist(gen)]);
+        else
+            mutated.push_back(base);
+    }
+    return mutated;
+}
+
+
+// The genome is random sequence with diverged copies of one repeat making up the repeat
+// fraction. Reads are sampled from both strands and given errors, and the alignment pairs are a
+// random sequence and an error-containing copy of it.
+BenchData generateData(const BenchParameters & p) {
+    std::mt19937 gen(p.seed);
+    BenchData data;
+    std::string repeat = randomSeq(gen, p.repeatLength);
+    int repeatCopies = int(p.genomeLength * p.repeatFraction / p.repeatLength);
+    int uniqueLength = (p.genomeLength - repeatCopies * p.repeatLength) / (repeatCopies + 1);
+    for (int i = 0; i < repeatCopies; ++i) {
+        data.genome += randomSeq(gen, uniqueLength);
+        data.genome += mutateSeq(gen, repeat, 0.01);
+    }
+    data.genome += randomSeq(gen, p.genomeLength - int(data.genome.length()));
+
+    int readLength = std::min(p.readLength, int(data.genome.length()));
+    std::uniform_int_distribution<int> startDist(0, int(data.genome.length()) - readLength);
+    std::bernoulli_distribution strandDist(0.5);
+    for (int i = 0; i < p.readCount; ++i) {
+        int start = startDist(gen);
+        bool forward = strandDist(gen);
+        std::string seq = data.genome.substr(start, readLength);
+        if (!forward)
+            seq = getReverseComplement(seq);
+        data.readNames.push_back("read_" + std::to_string(i + 1));
+        data.readSeqs.push_back(mutateSeq(gen, seq, p.errorRate));
+        data.readStarts.push_back(start);
+        data.readStrands.push_back(forward);
+    }
+    for (int i = 0; i < p.pairCount; ++i) {
+        data.pairSeqs1.push_back(randomSeq(gen, p.pairLength));
+        data.pairSeqs2.push_back(mutateSeq(gen, data.pairSeqs1.back(), p.errorRate));
+    }
+    return data;
+}
+
+
+// The cells a banded alignment fills, which is never more than the full matrix (a band as wide as
+// the sequences covers all of it).
+double bandedCells(size_t length1, size_t length2, int bandSize) {
+    return double(dpMatrixCells((long long)length1, (long long)length2, true, bandSize));
+}
+
+
+void writeFastq(const std::string & filename, const BenchData & data) {
+    FILE * f = fopen(filename.c_str(), "w");
+    for (size_t i = 0; i < data.readSeqs.size(); ++i) {
+        std::string qual(data.readSeqs[i].length(), '+');
+        fprintf(f, "@%s\n%s\n+\n%s\n", data.readNames[i].c_str(), data.readSeqs[i].c_str(),
+                qual.c_str());
+    }
+    fclose(f);
+}
+
+
+void removeDirectory(const std::string & dirName) {
+    DIR * dir = opendir(dirName.c_str());
+    if (dir == 0)
+        return;
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != 0) {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..")
+            unlink((dirName + "/" + name).c_str());
+    }
+    closedir(dir);
+    rmdir(dirName.c_str());
+}
+
+
+/*********************
+ * Benchmark kernels *
+ *********************/
+
+double benchFullyGlobal(const BenchParameters & p, const BenchData & data) {
+    int bandSize = 50;
+    parallelFor(p.threads, p.pairCount, [&](long i, int) {
+        freeCString(fullyGlobalAlignment((char *)data.pairSeqs1[i].c_str(),
+                                         (char *)data.pairSeqs2[i].c_str(), matchScore,
+                                         mismatchScore, gapOpenScore, gapExtensionScore, true,
+                                         bandSize));
+    });
+    double cells = 0.0;
+    for (int i = 0; i < p.pairCount; ++i)
+        cells += bandedCells(data.pairSeqs1[i].length(), data.pairSeqs2[i].length(), bandSize);
+    return cells;
+}
+
+
+double benchPath(const BenchParameters & p, const BenchData & data) {
+    int bandSize = 1000;
+    parallelFor(p.threads, p.pairCount, [&](long i, int) {
+        freeCString(pathAlignment((char *)data.pairSeqs1[i].c_str(),
+                                  (char *)data.pairSeqs2[i].c_str(), matchScore, mismatchScore,
+                                  gapOpenScore, gapExtensionScore, true, bandSize));
+    });
+    double cells = 0.0;
+    for (int i = 0; i < p.pairCount; ++i)
+        cells += bandedCells(data.pairSeqs1[i].length(), data.pairSeqs2[i].length(), bandSize);
+    return cells;
+}
+
+
+// Each group is a pair's first sequence followed by its error-containing copies, so the group
+// count is the pair count divided by the group size.
+double benchConsensus(const BenchParameters & p, const BenchData & data) {
+    int groupSize = p.consensusGroupSize;
+    int groupCount = p.pairCount / groupSize;
+    unsigned int bandwidth = 1000;
+    parallelFor(p.threads, groupCount, [&](long g, int) {
+        std::mt19937 gen(p.seed + (unsigned int)g);
+        std::vector<std::string> seqs;
+        seqs.push_back(data.pairSeqs1[g]);
+        for (int i = 1; i < groupSize; ++i)
+            seqs.push_back(mutateSeq(gen, data.pairSeqs1[g], p.errorRate));
+        std::vector<char *> seqPointers, qualPointers;
+        std::string emptyQual;
+        for (auto & s : seqs) {
+            seqPointers.push_back((char *)s.c_str());
+            qualPointers.push_back((char *)emptyQual.c_str());
+        }
+        freeCString(multipleSequenceAlignment(seqPointers.data(), qualPointers.data(),
+                                              seqs.size(), bandwidth, matchScore, mismatchScore,
+                                              gapOpenScore, gapExtensionScore));
+    });
+    double cells = 0.0;
+    for (int g = 0; g < groupCount; ++g)
+        cells += (groupSize - 1) * bandedCells(p.pairLength, p.pairLength, bandwidth);
+    return cells;
+}
+
+
+// Reads are given their true location as the minimap alignment, so this measures only the
+// semi-global alignment itself.
+void benchSemiGlobal(const BenchParameters & p, const BenchData & data) {
+    SeqMap * refSeqs = newRefSeqs();
+    addRefSeq(refSeqs, (char *)"genome", (char *)data.genome.c_str());
+    int genomeLength = int(data.genome.length());
+    parallelFor(p.threads, p.readCount, [&](long i, int) {
+        int readLength = int(data.readSeqs[i].length());
+        int refStart = data.readStarts[i];
+        int refEnd = std::min(refStart + p.readLength, genomeLength);
+        std::string alignment = "0," + std::to_string(readLength) + "," +
+                                (data.readStrands[i] ? "+" : "-") + ",genome," +
+                                std::to_string(refStart) + "," + std::to_string(refEnd);
+        freeCString(semiGlobalAlignment((char *)data.readNames[i].c_str(),
+                                        (char *)data.readSeqs[i].c_str(), 0,
+                                        (char *)alignment.c_str(), refSeqs, matchScore,
+                                        mismatchScore, gapOpenScore, gapExtensionScore, 0.0,
+                                        true, 0));
+    });
+    deleteRefSeqs(refSeqs);
+}
+
+
+void benchMinimap(const BenchParameters & p, const BenchData & data, const std::string & dir) {
+    std::string refFasta = dir + "/ref.fasta";
+    std::string readsFastq = dir + "/reads.fastq";
+    FILE * f = fopen(refFasta.c_str(), "w");
+    fprintf(f, ">genome\n%s\n", data.genome.c_str());
+    fclose(f);
+    writeFastq(readsFastq, data);
+    freeCString(minimapAlignReads((char *)refFasta.c_str(), (char *)readsFastq.c_str(),
+                                  p.threads, 0, 0));
+}
+
+
+// The read overlaps are found before the timer starts, so this measures only miniasm.
+std::function<void()> prepareMiniasm(const BenchParameters & p, const BenchData & data,
+                                     const std::string & dir) {
+    std::string readsFastq = dir + "/reads.fastq";
+    std::string overlapsPaf = dir + "/overlaps.paf";
+    writeFastq(readsFastq, data);
+    char * overlaps = minimapAlignReads((char *)readsFastq.c_str(), (char *)readsFastq.c_str(),
+                                        p.threads, 0, 1);
+    FILE * f = fopen(overlapsPaf.c_str(), "w");
+    fputs(overlaps, f);
+    fclose(f);
+    freeCString(overlaps);
+    int threads = p.threads;
+    return [readsFastq, overlapsPaf, dir, threads]() {
+        miniasmAssembly((char *)readsFastq.c_str(), (char *)overlapsPaf.c_str(),
+                        (char *)dir.c_str(), 3, threads);
+    };
+}
+
+
+KernelResult runKernel(const std::string & name, const BenchParameters & p) {
+    BenchData data = generateData(p);
+    char dirTemplate[] = "/tmp/unicycler_bench_XXXXXX";
+    std::string dir = mkdtemp(dirTemplate);
+    std::function<void()> miniasm;
+    if (name == "miniasmAssembly")
+        miniasm = prepareMiniasm(p, data, dir);
+
+    KernelResult result;
+    result.reads = p.readCount;
+    long long allocationsBefore = allocationCount;
+    auto startTime = std::chrono::steady_clock::now();
+    if (name == "fullyGlobalAlignment") {
+        result.bandedCells = benchFullyGlobal(p, data);
+        result.reads = p.pairCount;
+    }
+    else if (name == "pathAlignment") {
+        result.bandedCells = benchPath(p, data);
+        result.reads = p.pairCount;
+    }
+    else if (name == "multipleSequenceAlignment") {
+        result.bandedCells = benchConsensus(p, data);
+        result.reads = (p.pairCount / p.consensusGroupSize) * p.consensusGroupSize;
+    }
+    else if (name == "semiGlobalAlignment")
+        benchSemiGlobal(p, data);
+    else if (name == "minimapAlignReads")
+        benchMinimap(p, data, dir);
+    else if (name == "miniasmAssembly")
+        miniasm();
+    auto endTime = std::chrono::steady_clock::now();
+    result.seconds = std::chrono::duration<double>(endTime - startTime).count();
+    result.allocations = allocationCount - allocationsBefore;
+    removeDirectory(dir);
+    return result;
+}
+
+
+// Runs one kernel in a child process and returns its result as a JSON object.
+std::string runKernelInChild(const std::string & name, const BenchParameters & p) {
+    std::cout << std::flush;
+    int fds[2];
+    if (pipe(fds) != 0)
+        return "";
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        KernelResult result = runKernel(name, p);
+        if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+            _exit(1);
+        _exit(0);
+    }
+    close(fds[1]);
+    KernelResult result;
+    bool gotResult = (read(fds[0], &result, sizeof(result)) == sizeof(result));
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+
+    long long peakRssKb = usage.ru_maxrss;
+#ifdef __APPLE__
+    peakRssKb /= 1024;  // bytes on macOS
+#endif
+    std::string json = "    {\"kernel\": \"" + name + "\"";
+    if (!gotResult || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return json + ", \"failed\": true}";
+    double seconds = std::max(result.seconds, 1e-9);
+    json += ", \"reads\": " + std::to_string(result.reads);
+    json += ", \"seconds\": " + std::to_string(result.seconds);
+    json += ", \"readsPerSecond\": " + std::to_string(result.reads / seconds);
+    if (result.bandedCells > 0.0) {
+        json += ", \"bandedCells\": " + std::to_string((long long)result.bandedCells);
+        json += ", \"bandedCellsPerSecond\": " + std::to_string(result.bandedCells / seconds);
+    }
+    json += ", \"peakRssKb\": " + std::to_string(peakRssKb);
+    json += ", \"allocations\": " + std::to_string(result.allocations) + "}";
+    return json;
+}
+
+
+void printUsage() {
+    std::cerr << "usage: unicycler_bench [--seed N] [--threads N] [--genome-length N]\n"
+                 "                       [--repeat-fraction F] [--repeat-length N]\n"
+                 "                       [--read-count N] [--read-length N] [--error-rate F]\n"
+                 "                       [--pair-count N] [--pair-length N] [--kernel NAME]\n";
+}
+
+
+int main(int argc, char ** argv) {
+    BenchParameters p;
+    std::vector<std::string> kernels = {"fullyGlobalAlignment", "pathAlignment",
+                                        "multipleSequenceAlignment", "semiGlobalAlignment",
+                                        "minimapAlignReads", "miniasmAssembly"};
+    std::vector<std::string> chosenKernels;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            printUsage();
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--seed") p.seed = (unsigned int)std::stoul(value);
+        else if (arg == "--threads") p.threads = std::stoi(value);
+        else if (arg == "--genome-length") p.genomeLength = std::stoi(value);
+        else if (arg == "--repeat-fraction") p.repeatFraction = std::stod(value);
+        else if (arg == "--repeat-length") p.repeatLength = std::stoi(value);
+        else if (arg == "--read-count") p.readCount = std::stoi(value);
+        else if (arg == "--read-length") p.readLength = std::stoi(value);
+        else if (arg == "--error-rate") p.errorRate = std::stod(value);
+        else if (arg == "--pair-count") p.pairCount = std::stoi(value);
+        else if (arg == "--pair-length") p.pairLength = std::stoi(value);
+        else if (arg == "--kernel") chosenKernels.push_back(value);
+        else {
+            printUsage();
+            return 1;
+        }
+    }
+    for (auto & kernel : chosenKernels) {
+        if (std::find(kernels.begin(), kernels.end(), kernel) == kernels.end()) {
+            std::cerr << "unknown kernel: " << kernel << "\n";
+            return 1;
+        }
+    }
+    if (chosenKernels.empty())
+        chosenKernels = kernels;
+
+    std::cout << "{\n  \"parameters\": {";
+    std::cout << "\"seed\": " << p.seed << ", \"threads\": " << p.threads;
+    std::cout << ", \"genomeLength\": " << p.genomeLength;
+    std::cout << ", \"repeatFraction\": " << p.repeatFraction;
+    std::cout << ", \"repeatLength\": " << p.repeatLength;
+    std::cout << ", \"readCount\": " << p.readCount << ", \"readLength\": " << p.readLength;
+    std::cout << ", \"errorRate\": " << p.errorRate << ", \"pairCount\": " << p.pairCount;
+    std::cout << ", \"pairLength\": " << p.pairLength << "},\n";
+    std::cout << "  \"kernels\": [\n";
+    for (size_t i = 0; i < chosenKernels.size(); ++i) {
+        std::cout << runKernelInChild(chosenKernels[i], p);
+        std::cout << (i + 1 < chosenKernels.size() ? ",\n" : "\n") << std::flush;
+    }
+    std::cout << "  ]\n}\n";
+    return 0;
+}
@@ -13,6 +13,8 @@ not, see <http://www.gnu.org/licenses/>.
 
 import unittest
 import os
+import copy
+import random
 import unicycler.assembly_graph
 import unicycler.misc
 import unicycler.log
@@ -1040,3 +1042,111 @@ class TestExpandRepeats(unittest.TestCase):
         path_2_sequence_after = self.graph.get_path_sequence([-7, -6, -5, 6, 8])
         self.assertEqual(path_1_sequence_before, path_1_sequence_after)
         self.assertEqual(path_2_sequence_before, path_2_sequence_after)
+
+
+def old_merge_all_possible(graph, anchor_segments, bridging_mode):
+    """
+    The original merge_all_possible, which rescans every segment after each merge.
+    """
+    if anchor_segments is not None:
+        anchor_seg_nums = set(x.number for x in anchor_segments)
+    else:
+        anchor_seg_nums = None
+    while True:
+        seg_nums = sorted(list(graph.segments.keys()))
+        for num in seg_nums:
+            path = graph.get_simple_path(num, anchor_seg_nums, bridging_mode)
+            if len(path) > 1:
+                old_merge_simple_path(graph, path)
+                break
+        else:
+            break
+    graph.renumber_segments()
+
+
+def old_merge_simple_path(graph, merge_path):
+    """
+    The original merge_simple_path, which reverse complements the merged sequence and rewrites
+    every path.
+    """
+    ag = unicycler.assembly_graph
+    start = merge_path[0]
+    end = merge_path[-1]
+    mean_depth, original_depth = graph.get_mean_path_depth(merge_path)
+    new_seg_num = graph.get_next_available_seg_number()
+    new_seg = ag.Segment(new_seg_num, mean_depth, graph.get_path_sequence(merge_path), True,
+                         original_depth=original_depth)
+    new_seg.build_other_sequence_if_necessary()
+
+    paths_copy = graph.paths.copy()
+    outgoing_links = list(graph.forward_links[end]) if end in graph.forward_links else []
+    incoming_links = list(graph.reverse_links[start]) if start in graph.reverse_links else []
+    outgoing_links = ag.find_replace_one_val_in_list(outgoing_links, start, new_seg_num)
+    outgoing_links = ag.find_replace_one_val_in_list(outgoing_links, -end, -new_seg_num)
+    incoming_links = ag.find_replace_one_val_in_list(incoming_links, end, new_seg_num)
+    incoming_links = ag.find_replace_one_val_in_list(incoming_links, -start, -new_seg_num)
+    graph.remove_segments([abs(x) for x in merge_path])
+    graph.segments[new_seg_num] = new_seg
+    for link in outgoing_links:
+        graph.add_link(new_seg_num, link)
+    for link in incoming_links:
+        graph.add_link(link, new_seg_num)
+
+    flipped_merge_path = [-x for x in reversed(merge_path)]
+    for path_name in paths_copy:
+        paths_copy[path_name] = ag.find_replace_in_list(paths_copy[path_name], merge_path,
+                                                        [new_seg_num])
+        paths_copy[path_name] = ag.find_replace_in_list(paths_copy[path_name], flipped_merge_path,
+                                                        [-new_seg_num])
+    new_paths = {}
+    for path_name, path_segments in paths_copy.items():
+        split_paths = ag.split_path_multiple(path_segments, merge_path + flipped_merge_path)
+        if len(split_paths) == 1:
+            new_paths[path_name] = split_paths[0]
+        elif len(split_paths) > 1:
+            for i, path in enumerate(split_paths):
+                new_paths[path_name + '_' + str(i + 1)] = path
+    graph.paths = new_paths
+    return new_seg_num
+
+
+class TestMergeEquivalence(unittest.TestCase):
+    """
+    Checks that merge_all_possible gives exactly the same graph as the original (slower) version,
+    on the test graphs with random links removed and random anchor segments.
+    """
+
+    def setUp(self):
+        unicycler.log.logger = unicycler.log.Log(log_filename=None, stdout_verbosity_level=0)
+        test_dir = os.path.dirname(__file__)
+        gfa_with_paths = os.path.join(test_dir, 'test_assembly_graph.gfa')
+        gfa_without_paths = os.path.join(test_dir, 'test_assembly_graph_no_paths.gfa')
+        self.graphs = [unicycler.assembly_graph.AssemblyGraph(gfa_with_paths, 25),
+                       unicycler.assembly_graph.AssemblyGraph(gfa_without_paths, 0)]
+
+    def graph_summary(self, graph):
+        segments = {num: (seg.forward_sequence, seg.reverse_sequence, seg.depth)
+                    for num, seg in graph.segments.items()}
+        links = {start: sorted(ends) for start, ends in graph.forward_links.items() if ends}
+        return segments, links, graph.paths
+
+    def test_merge_equivalence(self):
+        rand = random.Random(0)
+        for graph in self.graphs:
+            for _ in range(10):
+                test_graph = copy.deepcopy(graph)
+                links = sorted((start, end) for start, ends in test_graph.forward_links.items()
+                               for end in ends)
+                for start, end in rand.sample(links, len(links) // 10):
+                    test_graph.remove_link(start, end)
+                anchors = None
+                if rand.random() < 0.5:
+                    segments = sorted(test_graph.segments.values(), key=lambda x: x.number)
+                    anchors = rand.sample(segments, len(segments) // 2)
+                bridging_mode = rand.randint(0, 2)
+
+                new_graph, old_graph = copy.deepcopy(test_graph), copy.deepcopy(test_graph)
+                new_graph.merge_all_possible(anchors, bridging_mode)
+                old_merge_all_possible(old_graph, anchors, bridging_mode)
+                self.assertLess(len(new_graph.segments), len(test_graph.segments))
+                self.assertEqual(self.graph_summary(new_graph), self.graph_summary(old_graph))
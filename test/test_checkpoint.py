@@ -0,0 +1,122 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Unicycler
+
+This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Unicycler is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Unicycler. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import argparse
+import os
+import random
+import shutil
+import tempfile
+import unittest
+import unicycler.checkpoint
+import unicycler.log
+from unicycler.assembly_graph import AssemblyGraph
+
+
+class TestCheckpoints(unittest.TestCase):
+
+    def setUp(self):
+        unicycler.log.logger = unicycler.log.Log(log_filename=None, stdout_verbosity_level=0)
+        self.out_dir = tempfile.mkdtemp()
+        self.reads = os.path.join(self.out_dir, 'reads.fastq')
+        with open(self.reads, 'wt') as reads:
+            reads.write('@read\nACGTACGT\n+\nIIIIIIII\n')
+        self.graph_file = os.path.join(os.path.dirname(__file__), 'test_assembly_graph.gfa')
+
+    def tearDown(self):
+        shutil.rmtree(self.out_dir, ignore_errors=True)
+
+    def get_args(self, **kwargs):
+        args = argparse.Namespace(out=self.out_dir, short1=None, short2=None, unpaired=None,
+                                  long=self.reads, contamination=None,
+                                  existing_long_read_assembly=None, start_genes=None,
+                                  threads=4, verbosity=0, keep=1, mode=1)
+        for name, value in kwargs.items():
+            setattr(args, name, value)
+        return args
+
+    def test_no_checkpoint(self):
+        checkpoints = unicycler.checkpoint.Checkpoints(self.get_args())
+        self.assertEqual(checkpoints.resume(), {})
+        self.assertFalse(checkpoints.reached('short_read_graph'))
+
+    def test_save_and_resume(self):
+        graph = AssemblyGraph(self.graph_file, None)
+        anchor_segments = list(graph.segments.values())[:5]
+        counter = unicycler.checkpoint.FileCounter(start=1)
+        next(counter)
+        next(counter)
+        random.seed(0)
+        checkpoints = unicycler.checkpoint.Checkpoints(self.get_args())
+        checkpoints.save('miniasm', counter=counter, graph=graph,
+                         anchor_segments=anchor_segments, bridges=[])
+        expected_random = random.random()
+
+        checkpoints = unicycler.checkpoint.Checkpoints(self.get_args(threads=16))
+        state = checkpoints.resume()
+        self.assertTrue(checkpoints.reached('short_read_graph'))
+        self.assertTrue(checkpoints.reached('miniasm'))
+        self.assertFalse(checkpoints.reached('simple_bridges'))
+        self.assertEqual(next(state['counter']), 3)
+        self.assertEqual(len(state['graph'].segments), len(graph.segments))
+        self.assertEqual(random.random(), expected_random)
+
+        # Anchor segments must still be the graph's own segment objects.
+        restored_graph = state['graph']
+        for seg in state['anchor_segments']:
+            self.assertTrue(seg is restored_graph.segments[seg.number])
+
+    def test_changed_options_invalidate(self):
+        checkpoints = unicycler.checkpoint.Checkpoints(self.get_args())
+        checkpoints.save('short_read_graph', counter=unicycler.checkpoint.FileCounter())
+        checkpoints = unicycler.checkpoint.Checkpoints(self.get_args(mode=2))
+        self.assertEqual(checkpoints.resume(), {})
+
+    def test_ignored_options_dont_invalidate(self):
+        checkpoints = unicycler.checkpoint.Checkpoints(self.get_args(profile=False,
+                                                                     pin_threads=False))
+        checkpoints.save('short_read_graph', counter=unicycler.checkpoint.FileCounter())
+        checkpoints = unicycler.checkpoint.Checkpoints(self.get_args(profile=True,
+                                                                     pin_threads=True))
+        self.assertIn('counter', checkpoints.resume())
+
+    def test_changed_input_invalidates(self):
+        checkpoints = unicycler.checkpoint.Checkpoints(self.get_args())
+        checkpoints.save('short_read_graph', counter=unicycler.checkpoint.FileCounter())
+        with open(self.reads, 'at') as reads:
+            reads.write('@read2\nACGTACGT\n+\nIIIIIIII\n')
+        checkpoints = unicycler.checkpoint.Checkpoints(self.get_args())
+        self.assertEqual(checkpoints.resume(), {})
+
+    def test_later_checkpoint_replaces_earlier(self):
+        checkpoints = unicycler.checkpoint.Checkpoints(self.get_args())
+        checkpoints.save('short_read_graph', counter=unicycler.checkpoint.FileCounter())
+        checkpoints.save('simple_bridges', counter=unicycler.checkpoint.FileCounter())
+        self.assertFalse(os.path.isfile(checkpoints.get_filename('short_read_graph')))
+        self.assertTrue(os.path.isfile(checkpoints.get_filename('simple_bridges')))
+        checkpoints.clean_up(keep=1)
+        self.assertFalse(os.path.isdir(checkpoints.directory))
+
+    def test_failed_save_keeps_earlier(self):
+        checkpoints = unicycler.checkpoint.Checkpoints(self.get_args())
+        checkpoints.save('short_read_graph', counter=unicycler.checkpoint.FileCounter())
+        checkpoints.save('simple_bridges', unpicklable=lambda: None)
+        self.assertTrue(os.path.isfile(checkpoints.get_filename('short_read_graph')))
+        self.assertFalse(os.path.isfile(checkpoints.get_filename('simple_bridges')))
+        checkpoints = unicycler.checkpoint.Checkpoints(self.get_args())
+        self.assertIn('counter', checkpoints.resume())
+        self.assertEqual(checkpoints.resumed_stage, 'short_read_graph')
+
+    def test_disabled(self):
+        checkpoints = unicycler.checkpoint.Checkpoints(self.get_args(), enabled=False)
+        checkpoints.save('short_read_graph', counter=unicycler.checkpoint.FileCounter())
+        self.assertFalse(os.path.isdir(checkpoints.directory))
@@ -13,10 +13,41 @@ not, see <http://www.gnu.org/licenses/>.
 
 import unittest
 import os
+import gzip
+import random
+import struct
+import hashlib
+import re
+import statistics
+import subprocess
+import sys
 import unicycler.cpp_wrappers
 import unicycler.read_ref
 import unicycler.alignment
 import unicycler.misc
+import unicycler.minimap_alignment
+
+
+def random_sequence(rand, length):
+    return ''.join(rand.choice('ACGT') for _ in range(length))
+
+
+def mutate_sequence(rand, seq, rate):
+    """
+    Returns the sequence with substitutions, insertions and deletions, each at a third of the rate.
+    """
+    mutated = []
+    for base in seq:
+        x = rand.random()
+        if x < rate / 3:
+            continue
+        elif x < 2 * rate / 3:
+            mutated.append(rand.choice('ACGT'))
+        elif x < rate:
+            mutated.append(base + rand.choice('ACGT'))
+        else:
+            mutated.append(base)
+    return ''.join(mutated)
 
 
 class TestFullyGlobalAlignment(unittest.TestCase):
@@ -129,6 +160,360 @@ class TestPathAlignment(unittest.TestCase):
     pass
 
 
+class TestCigarTally(unittest.TestCase):
+    """
+    These tests check the match/mismatch/indel counts against ones worked out by hand. Each count
+    list is [matches, mismatches, insertions, deletions, raw score] for the scoring scheme
+    3,-6,-5,-2.
+    """
+    def setUp(self):
+        self.scoring_scheme = unicycler.alignment.AlignmentScoringScheme('3,-6,-5,-2')
+
+    def tally(self, read_seq, ref_seq, cigar):
+        return unicycler.cpp_wrappers.cigar_tally(read_seq, ref_seq, cigar, self.scoring_scheme)
+
+    def test_matches_and_mismatches(self):
+        self.assertEqual(self.tally('ACGTACGT', 'ACGTACGT', '8M'), [8, 0, 0, 0, 24])
+        self.assertEqual(self.tally('ACGTACGT', 'ACGAACGA', '8M'), [6, 2, 0, 0, 6])
+
+    def test_insertion(self):
+        self.assertEqual(self.tally('ACGTAACCGT', 'ACGTCCGT', '4M2I4M'), [8, 0, 2, 0, 17])
+
+    def test_deletion(self):
+        self.assertEqual(self.tally('ACGTCCGT', 'ACGTGGGCCGT', '4M3D4M'), [8, 0, 0, 3, 15])
+
+    def test_equals_and_x_ops(self):
+        """
+        = and X are counted by comparing the bases, not by trusting the CIGAR.
+        """
+        self.assertEqual(self.tally('ACGTACGT', 'ACGAACGT', '3=1X4='), [7, 1, 0, 0, 15])
+        self.assertEqual(self.tally('ACGTACGT', 'ACGAACGT', '8X'), [7, 1, 0, 0, 15])
+
+    def test_soft_clips_ignored(self):
+        self.assertEqual(self.tally('ACGT', 'ACGA', '3S4M2S'), [3, 1, 0, 0, 3])
+
+    def test_cigar_past_end_of_sequence(self):
+        self.assertEqual(self.tally('ACGT', 'ACGT', '10M'), [4, 0, 0, 0, 12])
+
+
+class TestAlignmentCounts(unittest.TestCase):
+    """
+    These tests check the counts stored in Alignment objects, made from both SAM lines and C++
+    alignment output, on both strands.
+    """
+    def setUp(self):
+        self.scoring_scheme = unicycler.alignment.AlignmentScoringScheme('3,-6,-5,-2')
+
+        # The aligned part of the read has one mismatch and a 2 bp insertion (7M2I4M) and the
+        # read has 2 bp of soft clipping on each end.
+        self.aligned_read = 'ACGTACGTTTGCA'
+        self.ref = unicycler.read_ref.Reference('ref', 'ACGAACGTGCA' + 'TTTT')
+        self.reference_dict = {'ref': self.ref}
+        self.expected = [10, 1, 2, 0, 17]
+
+    @staticmethod
+    def counts(alignment):
+        return [alignment.match_count, alignment.mismatch_count, alignment.insertion_count,
+                alignment.deletion_count, alignment.raw_score]
+
+    def sam_alignment(self, read_seq, flag, cigar):
+        read = unicycler.read_ref.Read('read', read_seq, None)
+        sam_line = '\t'.join(['read', str(flag), 'ref', '1', '60', cigar, '*', '0', '0',
+                              read_seq, '*'])
+        return unicycler.alignment.Alignment(sam_line=sam_line, read_dict={'read': read},
+                                             reference_dict=self.reference_dict,
+                                             scoring_scheme=self.scoring_scheme)
+
+    def test_fully_global_alignment_counts(self):
+        result = unicycler.cpp_wrappers.fully_global_alignment(self.aligned_read, 'ACGAACGTGCA',
+                                                                self.scoring_scheme, False, 0)
+        parts = result.split(',')
+        self.assertEqual(parts[9], '7M2I4M')
+        self.assertEqual([int(x) for x in parts[10:14]], self.expected[:4])
+        self.assertEqual(int(parts[6]), self.expected[4])
+
+    def test_sam_forward(self):
+        alignment = self.sam_alignment('GG' + self.aligned_read + 'GG', 0, '2S7M2I4M2S')
+        self.assertFalse(alignment.rev_comp)
+        self.assertEqual(self.counts(alignment), self.expected)
+
+    def test_sam_reverse(self):
+        """
+        SAM stores reverse-strand reads as their reverse complement, but the Read object has the
+        original sequence, so the tally has to flip it back.
+        """
+        read_seq = unicycler.misc.reverse_complement('CC' + self.aligned_read + 'GGG')
+        alignment = self.sam_alignment(read_seq, 16, '2S7M2I4M3S')
+        self.assertTrue(alignment.rev_comp)
+        self.assertEqual(self.counts(alignment), self.expected)
+
+    def test_sam_reverse_deletion(self):
+        read_seq = unicycler.misc.reverse_complement('ACGAACGGCA')
+        alignment = self.sam_alignment(read_seq, 16, '7M1D3M')
+        self.assertEqual(self.counts(alignment), [10, 0, 0, 1, 25])
+
+    def test_seqan_output(self):
+        """
+        Alignments made from C++ output take the counts from the output and score them, so the
+        score should be the same as the C++ one.
+        """
+        for strand in ['+', '-']:
+            read = unicycler.read_ref.Read('read', 'GG' + self.aligned_read, None)
+            seqan_output = ','.join(['ref', strand, '2', '15', '0', '11', '17', '81.196581', '0',
+                                     '2S7M2I4M', '10', '1', '2', '0'])
+            alignment = unicycler.alignment.Alignment(seqan_output=seqan_output, read=read,
+                                                      reference_dict=self.reference_dict,
+                                                      scoring_scheme=self.scoring_scheme)
+            self.assertEqual(alignment.rev_comp, strand == '-')
+            self.assertEqual(self.counts(alignment), self.expected)
+            self.assertEqual(alignment.edit_distance, 3)
+            self.assertEqual(alignment.alignment_length, 13)
+
+
+def edit_sequence(rand, seq):
+    """
+    Returns an edited copy of the sequence with substitutions and indels, along with the CIGAR
+    which aligns the copy to the original.
+    """
+    edited, ops = [], []
+    for base in seq:
+        x = rand.random()
+        if x < 0.03:
+            ops.append('D')
+            continue
+        if x < 0.06:
+            edited.append(rand.choice('ACGT'))
+            ops.append('I')
+        edited.append(rand.choice('ACGT') if x < 0.1 else base)
+        ops.append('M')
+    return ''.join(edited), cigar_from_ops(ops)
+
+
+def cigar_from_ops(ops):
+    cigar, count = [], 0
+    for i, op in enumerate(ops):
+        count += 1
+        if i == len(ops) - 1 or ops[i + 1] != op:
+            cigar.append(str(count) + op)
+            count = 0
+    return ''.join(cigar)
+
+
+def bam_record(ref_names, name, flag, ref_name, pos, cigar, seq):
+    """
+    Returns a BAM record for the given SAM columns. CIGARs with more than 65535 ops are stored in a
+    CG:B,I tag with a <read length>S<reference length>N placeholder, as samtools does.
+    """
+    op_codes = 'MIDNSHP=X'
+    cigar = [(int(x[:-1]), op_codes.index(x[-1])) for x in re.findall(r'\d+\D', cigar)]
+    seq = '' if seq == '*' else seq
+    aux = b''
+    if len(cigar) > 65535:
+        ref_length = sum(length for length, op in cigar if op in (0, 2, 3, 7, 8))
+        aux = b'CGBI' + struct.pack('<i', len(cigar)) + \
+            b''.join(struct.pack('<I', length << 4 | op) for length, op in cigar)
+        cigar = [(len(seq), 4), (ref_length, 3)]
+    bases = '=ACMGRSVTWYHKDBN'
+    packed = bytearray((len(seq) + 1) // 2)
+    for i, base in enumerate(seq):
+        packed[i // 2] |= bases.index(base) << (4 if i % 2 == 0 else 0)
+    ref_id = ref_names.index(ref_name) if ref_name in ref_names else -1
+    record = struct.pack('<iiBBHHHiiii', ref_id, pos - 1, len(name) + 1, 60, 0, len(cigar), flag,
+                         len(seq), -1, -1, 0)
+    record += name.encode() + b'\0'
+    record += b''.join(struct.pack('<I', length << 4 | op) for length, op in cigar)
+    record += bytes(packed) + b'\xff' * len(seq) + aux
+    return struct.pack('<i', len(record)) + record
+
+
+class TestSamLoader(unittest.TestCase):
+    """
+    These tests load the same alignments from SAM, gzipped SAM and BAM files and check that the C++
+    tallies agree with the Python ones.
+    """
+    def setUp(self):
+        rand = random.Random(0)
+        self.scoring_scheme = unicycler.alignment.AlignmentScoringScheme('3,-6,-5,-2')
+        ref_seq = random_sequence(rand, 80000)
+        self.reference_dict = {'ref': unicycler.read_ref.Reference('ref', ref_seq)}
+        self.read_dict = {}
+        self.records = []
+
+        def add_read(name, sequence, sam_columns):
+            self.read_dict[name] = unicycler.read_ref.Read(name, sequence, None)
+            self.records.append([name] + sam_columns)
+
+        aligned, cigar = edit_sequence(rand, ref_seq[1000:3000])
+        read = random_sequence(rand, 20) + aligned + random_sequence(rand, 30)
+        add_read('forward', read, ['0', 'ref', '1001', '20S' + cigar + '30S', read])
+
+        aligned, cigar = edit_sequence(rand, ref_seq[5000:7000])
+        read = aligned + random_sequence(rand, 10)
+        add_read('reverse', unicycler.misc.reverse_complement(read),
+                 ['16', 'ref', '5001', cigar + '10S', read])
+
+        add_read('unmapped', random_sequence(rand, 1000), ['4', '*', '0', '*', '*'])
+
+        aligned, cigar = edit_sequence(rand, ref_seq[9000:10000])
+        read = random_sequence(rand, 15) + aligned
+        add_read('hard_clipped', read, ['0', 'ref', '9001', '15H' + cigar, aligned])
+
+        aligned, cigar = edit_sequence(rand, ref_seq[12000:13000])
+        add_read('no_seq', aligned, ['0', 'ref', '12001', cigar, '*'])
+
+        # Every third reference base is deleted and every other read base is an insertion, giving
+        # over 65535 CIGAR ops.
+        ops = ['M', 'I', 'M', 'D'] * 17000
+        ref_part = ref_seq[20000:20000 + 51000]
+        aligned, ref_i = [], 0
+        for op in ops:
+            if op == 'M':
+                aligned.append(ref_part[ref_i] if rand.random() < 0.9 else rand.choice('ACGT'))
+            if op == 'I':
+                aligned.append(rand.choice('ACGT'))
+            if op != 'I':
+                ref_i += 1
+        aligned = ''.join(aligned)
+        cigar = '5S' + cigar_from_ops(ops)
+        read = random_sequence(rand, 5) + aligned
+        add_read('long_cigar', read, ['0', 'ref', '20001', cigar, read])
+
+        self.prefix = 'TEMP_' + str(os.getpid())
+        sam_text = '@SQ\tSN:ref\tLN:' + str(len(ref_seq)) + '\n' + \
+            ''.join('\t'.join(r[:4] + ['60', r[4], '*', '0', '0', r[5], '*']) + '\n'
+                    for r in self.records)
+        with open(self.prefix + '.sam', 'wt') as sam:
+            sam.write(sam_text)
+        with gzip.open(self.prefix + '.sam.gz', 'wt') as sam:
+            sam.write(sam_text)
+        header_text = b'@SQ\tSN:ref\tLN:' + str(len(ref_seq)).encode() + b'\n'
+        bam = b'BAM\1' + struct.pack('<i', len(header_text)) + header_text + \
+            struct.pack('<i', 1) + struct.pack('<i', 4) + b'ref\0' + struct.pack('<i', len(ref_seq))
+        for name, flag, ref_name, pos, cigar, seq in self.records:
+            bam += bam_record(['ref'], name, int(flag), ref_name, int(pos), cigar, seq)
+        with gzip.open(self.prefix + '.bam', 'wb') as bam_file:
+            bam_file.write(bam)
+
+    def tearDown(self):
+        for extension in ['.sam', '.sam.gz', '.bam']:
+            if os.path.isfile(self.prefix + extension):
+                os.remove(self.prefix + extension)
+
+    def load(self, extension):
+        ref_seqs_ptr = unicycler.cpp_wrappers.new_ref_seqs()
+        for name, ref in self.reference_dict.items():
+            unicycler.cpp_wrappers.add_ref_seq(ref_seqs_ptr, name, ref.sequence)
+        count, records = unicycler.cpp_wrappers.load_sam_file(self.prefix + extension,
+                                                              ref_seqs_ptr, self.scoring_scheme, 2)
+        unicycler.cpp_wrappers.delete_ref_seqs(ref_seqs_ptr)
+        return count, records
+
+    def alignment(self, sam_line, sam_tally):
+        return unicycler.alignment.Alignment(sam_line=sam_line, read_dict=self.read_dict,
+                                             reference_dict=self.reference_dict,
+                                             scoring_scheme=self.scoring_scheme,
+                                             sam_tally=sam_tally)
+
+    @staticmethod
+    def counts(alignment):
+        return [alignment.match_count, alignment.mismatch_count, alignment.insertion_count,
+                alignment.deletion_count, alignment.raw_score]
+
+    def check_records(self, extension):
+        count, records = self.load(extension)
+        self.assertEqual(count, len(self.records))
+        mapped = [x for x in self.records if x[2] != '*']
+        self.assertEqual(len(records), len(mapped))
+        tallied = {'forward', 'reverse', 'long_cigar'}
+        for (sam_line, sam_tally), expected in zip(records, mapped):
+            self.assertEqual(sam_line, '\t'.join(expected[:4] + ['60', expected[4]]))
+            if expected[0] in tallied:
+                self.assertIsNotNone(sam_tally)
+                self.assertEqual(sam_tally[0], len(self.read_dict[expected[0]].sequence))
+                self.assertEqual(self.counts(self.alignment(sam_line, sam_tally)),
+                                 self.counts(self.alignment(sam_line, None)))
+            else:
+                self.assertIsNone(sam_tally)
+        return records
+
+    def test_sam(self):
+        self.check_records('.sam')
+
+    def test_gzipped_sam(self):
+        self.assertEqual(self.check_records('.sam.gz'), self.check_records('.sam'))
+
+    def test_bam(self):
+        self.assertEqual(self.check_records('.bam'), self.check_records('.sam'))
+
+    def test_long_cigar_in_bam(self):
+        """
+        The BAM record's own CIGAR is only a placeholder, so the real one must come from its CG tag.
+        """
+        records = dict((x[0].split('\t')[0], x) for x in self.load('.bam')[1])
+        sam_line, sam_tally = records['long_cigar']
+        self.assertGreater(sam_line.split('\t')[5].count('I'), 65535 // 4)
+        self.assertNotIn('N', sam_line.split('\t')[5])
+        alignment = self.alignment(sam_line, sam_tally)
+        self.assertEqual(alignment.insertion_count, 17000)
+        self.assertEqual(alignment.deletion_count, 17000)
+
+
+class TestAlignmentBounds(unittest.TestCase):
+
+    def setUp(self):
+        test_fasta = os.path.join(os.path.dirname(__file__), 'test_cpp_wrappers.fasta')
+        fasta = unicycler.misc.load_fasta(test_fasta)
+        self.seqs = [x[1] for x in fasta]
+        self.scoring_scheme = unicycler.alignment.AlignmentScoringScheme('3,-6,-5,-2')
+
+    def check_global_bounds(self, seq_1, seq_2, band_size):
+        result = unicycler.cpp_wrappers.fully_global_alignment(seq_1, seq_2, self.scoring_scheme,
+                                                                True, band_size)
+        seqan_parts = result.split(',', 9)
+        raw_score, scaled_score = int(seqan_parts[6]), float(seqan_parts[7])
+        raw_bound, scaled_bound = \
+            unicycler.cpp_wrappers.fully_global_alignment_bounds(seq_1, seq_2,
+                                                                 self.scoring_scheme, True,
+                                                                 band_size)
+        self.assertTrue(raw_bound >= raw_score)
+        self.assertTrue(scaled_bound >= scaled_score - 0.01)
+        return raw_bound
+
+    def test_perfect_alignment(self):
+        self.assertEqual(self.check_global_bounds(self.seqs[0], self.seqs[1], 1000), 60)
+
+    def test_one_mismatch(self):
+        self.assertTrue(self.check_global_bounds(self.seqs[0], self.seqs[2], 1000) < 60)
+
+    def test_indels(self):
+        for i in range(3, 8):
+            self.check_global_bounds(self.seqs[0], self.seqs[i], 1000)
+
+    def test_shift(self):
+        self.check_global_bounds(self.seqs[8], self.seqs[10], 1000)
+        self.check_global_bounds(self.seqs[8], self.seqs[10], 10)
+
+    def test_random_seqs(self):
+        """
+        Random sequences have a large edit distance, so the bound should be far below that of a
+        perfect alignment.
+        """
+        raw_bound = self.check_global_bounds(self.seqs[11], self.seqs[12], 1000)
+        self.assertTrue(raw_bound < 3 * min(len(self.seqs[11]), len(self.seqs[12])) // 2)
+
+    def test_path_alignment_bound(self):
+        partial_seq = self.seqs[8][:2000]
+        for full_seq in [self.seqs[9], self.seqs[10], self.seqs[12]]:
+            result = unicycler.cpp_wrappers.path_alignment(partial_seq, full_seq,
+                                                           self.scoring_scheme, True, 500)
+            scaled_score = float(result.split(',', 8)[7])
+            scaled_bound = \
+                unicycler.cpp_wrappers.path_alignment_scaled_score_bound(partial_seq, full_seq,
+                                                                         self.scoring_scheme,
+                                                                         True, 500)
+            self.assertTrue(scaled_bound >= scaled_score - 0.01)
+
+
 class TestMultipleSequenceAlignment(unittest.TestCase):
 
     def setUp(self):
@@ -212,3 +597,488 @@ class TestMultipleSequenceAlignment(unittest.TestCase):
         consensus, scores = unicycler.cpp_wrappers.consensus_alignment(seqs, quals,
                                                                        self.scoring_scheme)
         self.assertEqual(consensus, self.original_seq)
+
+
+class TestMinimapReadSketches(unittest.TestCase):
+
+    def setUp(self):
+        test_dir = os.path.dirname(__file__)
+        self.ref = os.path.join(test_dir, 'test_semi_global_alignment_tough.fasta')
+        self.reads = os.path.join(test_dir, 'test_semi_global_alignment_tough.fastq')
+        self.read_sketches = unicycler.cpp_wrappers.new_read_sketches(self.reads)
+
+    def tearDown(self):
+        unicycler.cpp_wrappers.delete_read_sketches(self.read_sketches)
+
+    def test_same_as_file(self):
+        for sensitivity_level in range(4):
+            for preset in ['default', 'read vs read', 'find contigs']:
+                from_file = unicycler.cpp_wrappers.minimap_align_reads(
+                    self.ref, self.reads, 2, sensitivity_level, preset)
+                from_sketches = unicycler.cpp_wrappers.minimap_align_reads(
+                    self.ref, self.reads, 2, sensitivity_level, preset, self.read_sketches)
+                self.assertTrue(from_file)
+                self.assertEqual(from_file, from_sketches)
+
+    def test_reads_against_themselves(self):
+        from_file = unicycler.cpp_wrappers.minimap_align_reads(self.reads, self.reads, 2, 0,
+                                                               'read vs read')
+        from_sketches = unicycler.cpp_wrappers.minimap_align_reads(self.reads, self.reads, 2, 0,
+                                                                   'read vs read',
+                                                                   self.read_sketches)
+        self.assertEqual(from_file, from_sketches)
+
+
+class TestReadSimulator(unittest.TestCase):
+
+    def setUp(self):
+        self.genome = unicycler.cpp_wrappers.simulate_genome(seed=1, chromosome_length=50000,
+                                                             plasmid_count=1,
+                                                             plasmid_length=5000,
+                                                             repeat_count=3, repeat_length=1000)
+
+    def test_genome(self):
+        self.assertEqual([x[0] for x in self.genome], ['chromosome', 'plasmid_1'])
+        self.assertTrue(all(x[2] for x in self.genome))
+        self.assertEqual(self.genome, unicycler.cpp_wrappers.simulate_genome(
+            seed=1, chromosome_length=50000, plasmid_count=1, plasmid_length=5000,
+            repeat_count=3, repeat_length=1000))
+        self.assertNotEqual(self.genome, unicycler.cpp_wrappers.simulate_genome(
+            seed=2, chromosome_length=50000, plasmid_count=1, plasmid_length=5000,
+            repeat_count=3, repeat_length=1000))
+
+    def test_long_reads(self):
+        reads = unicycler.cpp_wrappers.simulate_long_reads(self.genome, [10, 20], seed=3,
+                                                           mean_length=5000.0)
+        self.assertEqual(reads, unicycler.cpp_wrappers.simulate_long_reads(
+            self.genome, [10, 20], seed=3, mean_length=5000.0))
+        lines = reads.split('\n')
+        self.assertTrue(lines[0].startswith('@read_1 '))
+        self.assertEqual(len(lines[1]), len(lines[3]))
+        total_length = sum(len(x) for x in lines[1::4])
+        genome_bases = 10 * len(self.genome[0][1]) + 20 * len(self.genome[1][1])
+        self.assertGreater(total_length, 0.8 * genome_bases)
+        self.assertLess(total_length, 1.2 * genome_bases)
+
+    def test_genome_is_platform_independent(self):
+        """
+        The genome uses no std:: distributions, so its seed gives the same sequence everywhere.
+        """
+        genome = unicycler.cpp_wrappers.simulate_genome(seed=1, chromosome_length=10000,
+                                                        plasmid_count=1, plasmid_length=2000,
+                                                        repeat_count=2, repeat_length=500)
+        self.assertEqual([len(x[1]) for x in genome], [10000, 2260])
+        self.assertEqual(hashlib.md5(''.join(x[1] for x in genome).encode()).hexdigest(),
+                         'c663de51b174bc94e1411150043f2f05')
+
+    def test_read_length_distribution(self):
+        """
+        Read lengths come from a gamma distribution with the given mean and standard deviation.
+        """
+        genome = unicycler.cpp_wrappers.simulate_genome(seed=1, chromosome_length=200000,
+                                                        plasmid_count=0, repeat_count=0)
+        for length_stdev in [1000.0, 4000.0]:
+            reads = unicycler.cpp_wrappers.simulate_long_reads(
+                genome, [100], seed=3, mean_length=5000.0, length_stdev=length_stdev,
+                mean_identity=1.0, identity_stdev=0.0)
+            lengths = [len(x) for x in reads.split('\n')[1::4]]
+            self.assertAlmostEqual(statistics.mean(lengths), 5000.0, delta=250.0)
+            self.assertAlmostEqual(statistics.stdev(lengths), length_stdev,
+                                   delta=0.1 * length_stdev)
+
+    def test_short_reads(self):
+        reads = unicycler.cpp_wrappers.simulate_short_reads(self.genome, [10, 10], seed=3,
+                                                            read_length=100, error_rate=0.0)
+        lines = reads.split('\n')
+        self.assertEqual(lines[0], '@pair_1/1')
+        self.assertEqual(lines[4], '@pair_1/2')
+        self.assertTrue(all(len(x) == 100 for x in lines[1::4]))
+        circular_genome = [x[1] + x[1][:1000] for x in self.genome]
+        for read in lines[1:200:4]:
+            self.assertTrue(any(read in x or unicycler.misc.reverse_complement(read) in x
+                                for x in circular_genome))
+
+    def test_unwritable_output(self):
+        bad_path = os.path.join('TEMP_' + str(os.getpid()) + '_missing_dir', 'reads.fastq')
+        with self.assertRaises(OSError):
+            unicycler.cpp_wrappers.simulate_long_reads(self.genome, [1], bad_path)
+        with self.assertRaises(OSError):
+            unicycler.cpp_wrappers.simulate_short_reads(self.genome, [1], bad_path + '.gz',
+                                                        bad_path)
+        self.assertFalse(os.path.exists(os.path.dirname(bad_path)))
+
+    def test_written_output(self):
+        temp_fastq = 'TEMP_' + str(os.getpid()) + '_sim.fastq.gz'
+        try:
+            count = unicycler.cpp_wrappers.simulate_long_reads(self.genome, [1], temp_fastq,
+                                                               seed=3)
+            with gzip.open(temp_fastq, 'rt') as fastq:
+                self.assertEqual(fastq.read(), unicycler.cpp_wrappers.simulate_long_reads(
+                    self.genome, [1], seed=3))
+            self.assertGreater(count, 0)
+        finally:
+            if os.path.isfile(temp_fastq):
+                os.remove(temp_fastq)
+
+
+class TestContaminationScreen(unittest.TestCase):
+
+    def setUp(self):
+        self.lambda_fasta = os.path.join(os.path.dirname(unicycler.cpp_wrappers.__file__),
+                                         'gene_data', 'lambda_phage.fasta')
+        self.lambda_seq = unicycler.misc.load_fasta(self.lambda_fasta)[0][1]
+        genome = unicycler.cpp_wrappers.simulate_genome(seed=1, chromosome_length=100000,
+                                                        plasmid_count=0)
+        self.host_seq = genome[0][1]
+        host_reads = unicycler.cpp_wrappers.simulate_long_reads(genome, [5.0], seed=2,
+                                                                mean_identity=0.95)
+        lambda_reads = unicycler.cpp_wrappers.simulate_long_reads(
+            [('lambda', self.lambda_seq, True)], [5.0], seed=3, mean_identity=0.95)
+        lambda_lines = lambda_reads.split('\n')
+        lambda_lines[0::4] = ['@lambda_' + x[1:] if x else x for x in lambda_lines[0::4]]
+        temp_name = 'TEMP_' + str(os.getpid())
+        self.temp_fastq = temp_name + '.fastq'
+        with open(self.temp_fastq, 'wt') as fastq:
+            fastq.write(host_reads + '\n'.join(lambda_lines))
+        self.host_read_count = host_reads.count('\n+\n')
+        self.lambda_read_count = lambda_reads.count('\n+\n')
+        self.host_fasta = temp_name + '_host.fasta'
+        with open(self.host_fasta, 'wt') as fasta:
+            fasta.write('>host\n' + self.host_seq + '\n')
+        self.temp_contamination_fasta = temp_name + '_contamination.fasta'
+
+    def tearDown(self):
+        for filename in [self.temp_fastq, self.host_fasta, self.temp_contamination_fasta]:
+            if os.path.isfile(filename):
+                os.remove(filename)
+
+    def test_screen(self):
+        contaminants = unicycler.cpp_wrappers.screen_contamination(self.lambda_fasta,
+                                                                   self.host_fasta,
+                                                                   self.temp_fastq, 2)
+        self.assertTrue(all(x.startswith('lambda_') for x in contaminants))
+        self.assertGreater(len(contaminants), 0.8 * self.lambda_read_count)
+        for containment, target_containment, coverage in contaminants.values():
+            self.assertTrue(0.1 <= containment <= 1.0)
+            self.assertTrue(0.0 <= target_containment <= containment / 2.0)
+            self.assertTrue(0.9 <= coverage <= 1.0)
+
+    def test_same_with_sketches(self):
+        read_sketches = unicycler.cpp_wrappers.new_read_sketches(self.temp_fastq)
+        from_sketches = unicycler.cpp_wrappers.screen_contamination(self.lambda_fasta,
+                                                                    self.host_fasta,
+                                                                    self.temp_fastq, 2,
+                                                                    read_sketches)
+        unicycler.cpp_wrappers.delete_read_sketches(read_sketches)
+        from_file = unicycler.cpp_wrappers.screen_contamination(self.lambda_fasta,
+                                                                self.host_fasta,
+                                                                self.temp_fastq, 2)
+        self.assertEqual(from_file, from_sketches)
+
+    def test_contaminant_similar_to_host(self):
+        """
+        When the contamination includes a close relative of the host (here a copy of its genome
+        with 3% differences), host reads share many minimisers with the contamination, but they
+        share more with the host, so they must not be dropped.
+        """
+        relative_seq = mutate_sequence(random.Random(0), self.host_seq, 0.03)
+        with open(self.temp_contamination_fasta, 'wt') as fasta:
+            fasta.write('>lambda\n' + self.lambda_seq + '\n')
+            fasta.write('>relative\n' + relative_seq + '\n')
+        contaminants = unicycler.cpp_wrappers.screen_contamination(self.temp_contamination_fasta,
+                                                                   self.host_fasta,
+                                                                   self.temp_fastq, 2)
+        self.assertTrue(all(x.startswith('lambda_') for x in contaminants))
+        self.assertGreater(len(contaminants), 0.8 * self.lambda_read_count)
+
+    def test_no_target_references(self):
+        """
+        Without the target references, host reads look like contamination of the close relative.
+        """
+        relative_seq = mutate_sequence(random.Random(0), self.host_seq, 0.03)
+        with open(self.temp_contamination_fasta, 'wt') as fasta:
+            fasta.write('>relative\n' + relative_seq + '\n')
+        contaminants = unicycler.cpp_wrappers.screen_contamination(self.temp_contamination_fasta,
+                                                                   'TEMP_missing.fasta',
+                                                                   self.temp_fastq, 2)
+        self.assertGreater(len(contaminants), 0.5 * self.host_read_count)
+
+
+class TestThreadPool(unittest.TestCase):
+
+    def test_sums(self):
+        for threads in [1, 2, 4, 16]:
+            for n in [1, 2, 3, 100, 12345]:
+                self.assertEqual(unicycler.cpp_wrappers.parallel_for_sum(threads, n),
+                                 n * (n - 1) // 2)
+
+    def test_zero_length_ranges(self):
+        for threads in [1, 4]:
+            self.assertEqual(unicycler.cpp_wrappers.parallel_for_sum(threads, 0), 0)
+
+    def test_repeated_calls(self):
+        """
+        The pool's threads persist between calls, so many calls in a row (with different thread
+        counts, including more threads than work) should all give the right answer.
+        """
+        for i in range(200):
+            threads = 1 + i % 8
+            n = i % 13
+            self.assertEqual(unicycler.cpp_wrappers.parallel_for_sum(threads, n),
+                             n * (n - 1) // 2)
+
+    def test_pinning(self):
+        """
+        Pinning only applies to workers started after it is turned on, and this process's pool
+        already has its workers, so the check runs in a fresh process. The process is first
+        limited to one CPU, which unpinned workers inherit and pinned workers replace with all of
+        their NUMA node's CPUs.
+        """
+        nodes = get_numa_node_cpus()
+        if not nodes:
+            self.skipTest('NUMA node layout not available')
+        one_cpu = min(os.sched_getaffinity(0))
+        pinned = get_worker_affinities(True, one_cpu)
+        self.assertEqual(len(pinned), 3)
+        for cpus in pinned:
+            self.assertIn(cpus, nodes)
+        unpinned = get_worker_affinities(False, one_cpu)
+        self.assertEqual(unpinned, [{one_cpu}] * 3)
+        if all(len(cpus) > 1 for cpus in nodes):
+            self.assertNotEqual(pinned, unpinned)
+
+
+def get_numa_node_cpus():
+    """
+    Returns the CPU set of each NUMA node, in node order.
+    """
+    nodes = []
+    while True:
+        filename = '/sys/devices/system/node/node' + str(len(nodes)) + '/cpulist'
+        if not os.path.isfile(filename):
+            return nodes
+        cpus = set()
+        with open(filename, 'rt') as cpulist:
+            for part in cpulist.read().strip().split(','):
+                if part:
+                    start, _, end = part.partition('-')
+                    cpus.update(range(int(start), int(end or start) + 1))
+        nodes.append(cpus)
+
+
+def get_worker_affinities(pin, cpu):
+    """
+    In a fresh Python process limited to the given CPU, starts the thread pool with 4 threads
+    (3 workers plus the calling thread) and returns the CPU affinity of each worker thread.
+    """
+    code = ('import os, time, unicycler.cpp_wrappers as w\n'
+            'os.sched_setaffinity(0, {' + str(cpu) + '})\n'
+            'w.set_thread_pinning(' + str(pin) + ')\n'
+            'assert w.parallel_for_sum(4, 1000) == 499500\n'
+            'time.sleep(0.2)\n'  # workers pin themselves when they start, which may be after the sum
+            'for tid in os.listdir("/proc/self/task"):\n'
+            '    if int(tid) != os.getpid():\n'
+            '        print(" ".join(str(x) for x in os.sched_getaffinity(int(tid))))\n')
+    repo_dir = os.path.dirname(os.path.dirname(os.path.abspath(unicycler.cpp_wrappers.__file__)))
+    out = subprocess.check_output([sys.executable, '-c', code], cwd=repo_dir).decode()
+    return sorted((set(int(x) for x in line.split()) for line in out.splitlines()), key=sorted)
+
+
+class TestMinimapChaining(unittest.TestCase):
+    """
+    The reference has two copies of a 3 kbp repeat, and the read spans the second copy with 1 kbp
+    of unique sequence on each side. Minimap's chaining DP should give one hit covering the whole
+    read at its true locus, and only a repeat-sized hit on the other copy.
+    """
+
+    def setUp(self):
+        rand = random.Random(0)
+        a, repeat, b, c = [random_sequence(rand, x) for x in [5000, 3000, 5000, 5000]]
+        reference = a + repeat + b + repeat + c
+        self.true_start = len(a) + len(repeat) + len(b) - 1000
+        self.true_end = self.true_start + 5000
+        read = mutate_sequence(rand, reference[self.true_start:self.true_end], 0.05)
+        self.temp_fasta = 'TEMP_' + str(os.getpid()) + '.fasta'
+        self.temp_fastq = 'TEMP_' + str(os.getpid()) + '.fastq'
+        with open(self.temp_fasta, 'wt') as fasta:
+            fasta.write('>1\n' + reference + '\n')
+        with open(self.temp_fastq, 'wt') as fastq:
+            fastq.write('@f\n' + read + '\n+\n' + 'I' * len(read) + '\n')
+            read = unicycler.misc.reverse_complement(read)
+            fastq.write('@r\n' + read + '\n+\n' + 'I' * len(read) + '\n')
+
+    def tearDown(self):
+        for f in [self.temp_fasta, self.temp_fastq]:
+            if os.path.isfile(f):
+                os.remove(f)
+
+    def test_repeat_read(self):
+        minimap_alignments = unicycler.minimap_alignment.load_minimap_alignments(
+            unicycler.cpp_wrappers.minimap_align_reads(self.temp_fasta, self.temp_fastq, 1, 0,
+                                                       'default'))
+        for read_name, strand in [('f', '+'), ('r', '-')]:
+            alignments = sorted(minimap_alignments[read_name], key=lambda x: -x.minimiser_count)
+            best = alignments[0]
+            self.assertEqual(best.read_strand, strand)
+            self.assertLess(abs(best.ref_start - self.true_start), 50)
+            self.assertLess(abs(best.ref_end - self.true_end), 50)
+            self.assertGreater(best.read_end - best.read_start, 0.95 * best.read_length)
+            for other in alignments[1:]:
+                self.assertLess(other.ref_end - other.ref_start, 3100)
+                self.assertLess(other.minimiser_count, best.minimiser_count)
+
+
+def loop_hit(read_start, read_end, strand, seg_num, ref_start, ref_end, ref_length):
+    a = unicycler.minimap_alignment.MinimapAlignment()
+    a.read_start, a.read_end, a.read_strand = read_start, read_end, strand
+    a.ref_name, a.ref_start, a.ref_end, a.ref_length = str(seg_num), ref_start, ref_end, ref_length
+    return a
+
+
+class TestSimpleLoopVotes(unittest.TestCase):
+    """
+    A simple loop: start (1) -> repeat (2) -> middle (3) -> repeat (2) -> end (4). Reads are
+    simulated through the loop a known number of times, with alignments to the start and end
+    segments at their true places, and each read should vote for its own loop count.
+    """
+
+    def setUp(self):
+        self.rand = random.Random(0)
+        self.start, self.repeat, self.middle, self.end = \
+            [random_sequence(self.rand, x) for x in [1000, 300, 400, 1000]]
+        self.scoring_scheme = unicycler.alignment.AlignmentScoringScheme('3,-6,-5,-2')
+
+    def make_read(self, loop_count, middle=True, error_rate=0.03):
+        """
+        Returns a forward-strand read through the loop and its alignments to the start and end
+        segments. The read begins halfway through the start segment and ends halfway through the
+        end segment.
+        """
+        loop_seq = (self.middle if middle else '') + self.repeat
+        start_part = mutate_sequence(self.rand, self.start[500:], error_rate)
+        loop_part = mutate_sequence(self.rand, self.repeat + loop_seq * loop_count, error_rate)
+        end_part = mutate_sequence(self.rand, self.end[:500], error_rate)
+        read = start_part + loop_part + end_part
+        end_part_start = len(start_part) + len(loop_part)
+        hits = [loop_hit(0, len(start_part), '+', 1, 500, 1000, 1000),
+                loop_hit(end_part_start, len(read), '+', 4, 0, 500, 1000)]
+        return read, hits
+
+    def get_votes(self, reads, strands, hits, middle=True, use_score_bounds=True):
+        return unicycler.cpp_wrappers.simple_loop_votes(
+            1, 4, 3 if middle else None, 2, self.start, self.end,
+            self.middle if middle else '', self.repeat, reads, strands, hits, 6, 50,
+            self.scoring_scheme, 2, use_score_bounds)
+
+    def test_forward_reads(self):
+        reads, hits = [], []
+        for loop_count in [0, 1, 2, 3, 4, 5]:
+            read, read_hits = self.make_read(loop_count)
+            reads.append(read)
+            hits.append(read_hits)
+        votes = self.get_votes(reads, ['F'] * len(reads), hits)
+        self.assertEqual(votes, [0, 1, 2, 3, 4, 5])
+
+    def test_no_middle_segment(self):
+        reads, hits = [], []
+        for loop_count in [1, 2, 3]:
+            read, read_hits = self.make_read(loop_count, middle=False)
+            reads.append(read)
+            hits.append(read_hits)
+        votes = self.get_votes(reads, ['F'] * len(reads), hits, middle=False)
+        self.assertEqual(votes, [1, 2, 3])
+
+    def test_reverse_reads(self):
+        """
+        A reverse-strand read aligns to the end segment's reverse strand first and the start
+        segment's reverse strand last.
+        """
+        reads, hits = [], []
+        for loop_count in [1, 2, 3]:
+            read, read_hits = self.make_read(loop_count)
+            read_length = len(read)
+            read = unicycler.misc.reverse_complement(read)
+            rev_hits = [loop_hit(read_length - h.read_end, read_length - h.read_start, '-',
+                                 int(h.ref_name), h.ref_start, h.ref_end, h.ref_length)
+                        for h in reversed(read_hits)]
+            reads.append(read)
+            hits.append(rev_hits)
+        votes = self.get_votes(reads, ['R'] * len(reads), hits)
+        self.assertEqual(votes, [1, 2, 3])
+
+    def test_bad_reads(self):
+        """
+        Reads without both start and end hits, or with a foreign segment between them, don't fit
+        the loop and vote -1.
+        """
+        read, read_hits = self.make_read(2)
+        foreign_hit = loop_hit(read_hits[0].read_end, read_hits[0].read_end + 100, '+', 5,
+                               0, 100, 1000)
+        hits = [read_hits[:1], read_hits[1:], [read_hits[0], foreign_hit, read_hits[1]]]
+        votes = self.get_votes([read] * 3, ['F'] * 3, hits)
+        self.assertEqual(votes, [-1, -1, -1])
+
+    def test_score_bounds_dont_change_votes(self):
+        """
+        Skipping loop counts which can't beat the best shouldn't change any read's vote, including
+        for noisy reads and reads which go through the loop more than the max tested count.
+        """
+        reads, hits, true_counts = [], [], []
+        for error_rate in [0.03, 0.1, 0.2]:
+            for loop_count in [0, 2, 4, 6, 7, 8]:
+                read, read_hits = self.make_read(loop_count, error_rate=error_rate)
+                reads.append(read)
+                hits.append(read_hits)
+                true_counts.append(loop_count)
+        strands = ['F'] * len(reads)
+        votes = self.get_votes(reads, strands, hits)
+        self.assertEqual(votes, self.get_votes(reads, strands, hits, use_score_bounds=False))
+        self.assertEqual(votes, true_counts)
+
+
+class TestMemoryBudget(unittest.TestCase):
+
+    def setUp(self):
+        rand = random.Random(0)
+        self.seq_1 = random_sequence(rand, 2000)
+        self.seq_2 = mutate_sequence(rand, self.seq_1, 0.05)
+        self.scoring_scheme = unicycler.alignment.AlignmentScoringScheme('3,-6,-5,-2')
+
+    def tearDown(self):
+        unicycler.cpp_wrappers.set_memory_budget(0)
+
+    def test_alignment_too_big_for_budget(self):
+        """
+        An unbanded 2 kbp alignment has about 4 million DP cells, which won't fit in a 1 MB budget.
+        """
+        unicycler.cpp_wrappers.set_memory_budget(1000000)
+        self.assertEqual(unicycler.cpp_wrappers.fully_global_alignment(
+            self.seq_1, self.seq_2, self.scoring_scheme, False, 0), '')
+
+        # A banded alignment is small enough to still run.
+        self.assertNotEqual(unicycler.cpp_wrappers.fully_global_alignment(
+            self.seq_1, self.seq_2, self.scoring_scheme, True, 10), '')
+
+    def test_batch_sizes_shrink(self):
+        unicycler.cpp_wrappers.set_memory_budget(100000000)
+        read_batch, index_batch = unicycler.cpp_wrappers.minimap_batch_sizes()
+        self.assertEqual(read_batch, 100000000 // 16)
+        self.assertEqual(index_batch, 10000000)  # the minimum
+
+    def test_zero_budget_restores_defaults(self):
+        unicycler.cpp_wrappers.set_memory_budget(0)
+        default_batch_sizes = unicycler.cpp_wrappers.minimap_batch_sizes()
+        default_alignment = self.align_without_time()
+        self.assertEqual(default_batch_sizes, (100000000, 4000000000))
+        self.assertGreater(len(default_alignment), 1)
+
+        unicycler.cpp_wrappers.set_memory_budget(1000000)
+        self.assertNotEqual(unicycler.cpp_wrappers.minimap_batch_sizes(), default_batch_sizes)
+        unicycler.cpp_wrappers.set_memory_budget(0)
+        self.assertEqual(unicycler.cpp_wrappers.minimap_batch_sizes(), default_batch_sizes)
+        self.assertEqual(self.align_without_time(), default_alignment)
+
+    def align_without_time(self):
+        alignment = unicycler.cpp_wrappers.fully_global_alignment(
+            self.seq_1, self.seq_2, self.scoring_scheme, False, 0).split(',')
+        return alignment[:8] + alignment[9:]  # the ninth field is the time taken
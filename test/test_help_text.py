@@ -77,6 +77,8 @@ class TestBasicHelpText(unittest.TestCase):
         self.assertFalse('--contamination' in self.stdout)
         self.assertFalse('--scores' in self.stdout)
         self.assertFalse('--low_score' in self.stdout)
+        self.assertFalse('--no_checkpoints' in self.stdout)
+        self.assertFalse('--profile' in self.stdout)
 
 
 class TestExtendedHelpText(unittest.TestCase):
@@ -126,6 +128,8 @@ class TestExtendedHelpText(unittest.TestCase):
         self.assertTrue('--contamination' in self.stdout)
         self.assertTrue('--scores' in self.stdout)
         self.assertTrue('--low_score' in self.stdout)
+        self.assertTrue('--no_checkpoints' in self.stdout)
+        self.assertTrue('--profile' in self.stdout)
 
 
 class TestEmptyCommand(unittest.TestCase):
@@ -19,6 +19,7 @@ import unicycler.log
 import unicycler.assembly_graph
 import unicycler.string_graph
 import unicycler.alignment
+import unicycler.cpp_wrappers
 
 
 def sequences_match_some_rotation(seq_1, seq_2):
@@ -156,3 +157,64 @@ class TestContigPlacement(unittest.TestCase):
                                                       unitig_graph.segments['3'].forward_sequence))
         self.assertTrue(sequences_match_some_rotation(merged_seqs[3],
                                                       unitig_graph.segments['4'].forward_sequence))
+
+
+class TestMiniasmAssembly(unittest.TestCase):
+    """
+    These tests run miniasm on simulated long reads from a small circular genome.
+    """
+
+    def setUp(self):
+        self.working_dir = 'TEMP_' + str(os.getpid())
+        if not os.path.exists(self.working_dir):
+            os.makedirs(self.working_dir)
+        self.reads = os.path.join(self.working_dir, 'reads.fastq')
+        self.overlaps = os.path.join(self.working_dir, 'overlaps.paf')
+        genome = unicycler.cpp_wrappers.simulate_genome(seed=0, chromosome_length=50000,
+                                                        plasmid_count=0, repeat_count=0)
+        unicycler.cpp_wrappers.simulate_long_reads(genome, [30], out_filename=self.reads,
+                                                   seed=0, mean_length=5000.0,
+                                                   length_stdev=2000.0, mean_identity=0.95)
+        with open(self.overlaps, 'wt') as overlaps:
+            overlaps.write(unicycler.cpp_wrappers.minimap_align_reads(self.reads, self.reads, 4,
+                                                                      0, 'read vs read'))
+
+    def tearDown(self):
+        if os.path.exists(self.working_dir):
+            shutil.rmtree(self.working_dir)
+
+    def assemble(self, reads, threads):
+        out_dir = os.path.join(self.working_dir, 'miniasm_' + str(threads))
+        os.makedirs(out_dir)
+        unicycler.cpp_wrappers.miniasm_assembly(reads, self.overlaps, out_dir, 3, threads)
+        return out_dir
+
+    def test_assembly(self):
+        out_dir = self.assemble(self.reads, 1)
+        string_graph = unicycler.string_graph.StringGraph(
+            os.path.join(out_dir, '10_final_string_graph.gfa'))
+        self.assertGreater(len(string_graph.segments), 0)
+
+    def test_missing_reads_file(self):
+        """
+        If the reads can't be loaded for the string graph sequences, no string graphs are saved
+        (so Unicycler reports a miniasm failure) and the error goes to miniasm's log.
+        """
+        out_dir = self.assemble(os.path.join(self.working_dir, 'missing.fastq'), 1)
+        self.assertFalse(any(x.endswith('.gfa') for x in os.listdir(out_dir)))
+        with open(os.path.join(out_dir, 'miniasm.out'), 'rt') as miniasm_out:
+            self.assertTrue('could not open' in miniasm_out.read())
+
+    def test_thread_count_does_not_change_graphs(self):
+        """
+        The multi-threaded miniasm steps should give exactly the same string graphs as one thread.
+        """
+        out_dir_1 = self.assemble(self.reads, 1)
+        out_dir_4 = self.assemble(self.reads, 4)
+        gfa_files = sorted(x for x in os.listdir(out_dir_1) if x.endswith('.gfa'))
+        self.assertTrue('10_final_string_graph.gfa' in gfa_files)
+        self.assertEqual(gfa_files, sorted(x for x in os.listdir(out_dir_4) if x.endswith('.gfa')))
+        for gfa_file in gfa_files:
+            with open(os.path.join(out_dir_1, gfa_file), 'rt') as gfa_1, \
+                    open(os.path.join(out_dir_4, gfa_file), 'rt') as gfa_4:
+                self.assertEqual(gfa_1.read(), gfa_4.read(), gfa_file)
@@ -0,0 +1,105 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Unicycler
+
+This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Unicycler is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Unicycler. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import json
+import os
+import threading
+import time
+import unittest
+import unicycler.profiler
+from unicycler.profiler import StageProfiler, TimedFunction
+
+
+class TestStageProfiler(unittest.TestCase):
+
+    def setUp(self):
+        self.report = 'TEMP_' + str(os.getpid()) + '_profile.json'
+
+    def tearDown(self):
+        if os.path.isfile(self.report):
+            os.remove(self.report)
+
+    def load_report(self, profiler):
+        profiler.save_report(self.report)
+        with open(self.report, 'rt') as report:
+            return json.load(report)
+
+    def test_stage_nesting(self):
+        profiler = StageProfiler(enabled=True)
+        profiler.begin_stage('a')
+        profiler.push_stage('b')
+        profiler.push_stage('c')
+        profiler.pop_stage()
+        profiler.pop_stage()
+        profiler.push_stage('d')
+        profiler.begin_stage('e')  # closes a/d and a
+        self.assertEqual([x.name for x in profiler.open_stages], ['e'])
+        report = self.load_report(profiler)
+        self.assertEqual([x['name'] for x in report['stages']], ['a', 'a/b', 'a/b/c', 'a/d', 'e'])
+
+    def test_nested_time_not_added_to_total(self):
+        profiler = StageProfiler(enabled=True)
+        profiler.begin_stage('a')
+        profiler.push_stage('b')
+        time.sleep(0.05)
+        profiler.end_stage()
+        report = self.load_report(profiler)
+        a, b = report['stages']
+        self.assertGreaterEqual(a['wall_seconds'], b['wall_seconds'])
+        self.assertEqual(report['total']['wall_seconds'], a['wall_seconds'])
+
+    def test_parallel_native_calls(self):
+        """
+        Two native calls running at the same time count once towards the stage's native wall time
+        but twice towards its summed call time.
+        """
+        profiler = StageProfiler(enabled=True)
+        function = TimedFunction('sleep', lambda: time.sleep(0.2), profiler)
+        profiler.begin_stage('a')
+        threads = [threading.Thread(target=function) for _ in range(2)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        stage = self.load_report(profiler)['stages'][0]
+        self.assertEqual(stage['native_calls']['sleep']['calls'], 2)
+        self.assertGreater(stage['native_call_seconds'], 0.38)
+        self.assertGreater(stage['native_wall_seconds'], 0.19)
+        self.assertLess(stage['native_wall_seconds'], 0.3)
+        self.assertLessEqual(stage['native_wall_seconds'], stage['wall_seconds'])
+
+    def test_sequential_native_calls(self):
+        profiler = StageProfiler(enabled=True)
+        function = TimedFunction('sleep', lambda: time.sleep(0.1), profiler)
+        profiler.begin_stage('a')
+        function()
+        time.sleep(0.1)
+        function()
+        stage = self.load_report(profiler)['stages'][0]
+        self.assertGreater(stage['native_wall_seconds'], 0.19)
+        self.assertLess(stage['native_wall_seconds'], 0.28)
+        self.assertGreater(stage['python_wall_seconds'], 0.09)
+
+    def test_disabled(self):
+        """
+        The pipeline's profiler is disabled unless --profile is used, and then records nothing.
+        """
+        self.assertFalse(unicycler.profiler.profiler.enabled)
+        profiler = StageProfiler()
+        profiler.begin_stage('a')
+        with unicycler.profiler.stage('b'):
+            pass
+        self.assertEqual(profiler.stages, [])
+        self.assertEqual(unicycler.profiler.profiler.stages, [])
+        profiler.save_report(self.report)
+        self.assertFalse(os.path.isfile(self.report))
@@ -13,6 +13,11 @@ not, see <http://www.gnu.org/licenses/>.
 
 import unittest
 import os
+import random
+import re
+import unicycler.cpp_wrappers
+import unicycler.minimap_alignment
+import unicycler.misc
 import unicycler.read_ref
 import unicycler.alignment
 import unicycler.unicycler_align
@@ -662,3 +667,220 @@ class TestToughAlignments(unittest.TestCase):
         _, read_end = alignment_2.read_start_end_positive_strand()
         self.assertEqual(read_start, 0)    # start of read
         self.assertEqual(read_end, 4144)  # end of read
+
+
+def random_sequence(rand, length):
+    return ''.join(rand.choice('ACGT') for _ in range(length))
+
+
+def substitute(rand, base):
+    return rand.choice([x for x in 'ACGT' if x != base])
+
+
+def mutate_sequence(rand, seq, rate):
+    mutated = []
+    for base in seq:
+        x = rand.random()
+        if x < rate / 3:
+            continue
+        elif x < 2 * rate / 3:
+            mutated.append(rand.choice('ACGT'))
+        elif x < rate:
+            mutated.append(base + rand.choice('ACGT'))
+        else:
+            mutated.append(base)
+    return ''.join(mutated)
+
+
+class TestFastPath(unittest.TestCase):
+    """
+    These tests check when a read range is aligned with the minimiser fast path and when it goes
+    through line tracing. The minimap hits come from minimap itself, so their concise strings have
+    the minimiser count as a seventh field.
+    """
+    def setUp(self):
+        rand = random.Random(0)
+        self.ref = random_sequence(rand, 20000)
+        self.reads = {'clean': mutate_sequence(rand, self.ref[2000:6000], 0.03),
+                      'reverse': unicycler.misc.reverse_complement(
+                          mutate_sequence(rand, self.ref[8000:12000], 0.03)),
+                      'noisy': mutate_sequence(rand, self.ref[12000:16000], 0.25),
+                      'partial': random_sequence(rand, 2000) +
+                                 mutate_sequence(rand, self.ref[15000:17000], 0.03)}
+        temp_name = 'TEMP_' + str(os.getpid())
+        self.temp_fasta = temp_name + '.fasta'
+        self.temp_fastq = temp_name + '.fastq'
+        with open(self.temp_fasta, 'wt') as fasta:
+            fasta.write('>ref\n' + self.ref + '\n')
+        with open(self.temp_fastq, 'wt') as fastq:
+            for name, seq in self.reads.items():
+                fastq.write('@' + name + '\n' + seq + '\n+\n' + 'I' * len(seq) + '\n')
+        paf = unicycler.cpp_wrappers.minimap_align_reads(self.temp_fasta, self.temp_fastq, 1, 0)
+        self.hits = {}
+        for paf_line in paf.split('\n'):
+            if paf_line:
+                hit = unicycler.minimap_alignment.MinimapAlignment(paf_line)
+                self.hits.setdefault(hit.read_name, []).append(hit)
+        self.ref_seqs_ptr = unicycler.cpp_wrappers.new_ref_seqs()
+        unicycler.cpp_wrappers.add_ref_seq(self.ref_seqs_ptr, 'ref', self.ref)
+
+    def tearDown(self):
+        unicycler.cpp_wrappers.delete_ref_seqs(self.ref_seqs_ptr)
+        if os.path.isfile(self.temp_fasta):
+            os.remove(self.temp_fasta)
+        if os.path.isfile(self.temp_fastq):
+            os.remove(self.temp_fastq)
+
+    def align(self, read_name, minimap_str):
+        """
+        Returns the alignments' details (without their times) and the verbose output.
+        """
+        results = unicycler.cpp_wrappers.semi_global_alignment(read_name, self.reads[read_name],
+                                                               3, minimap_str, self.ref_seqs_ptr,
+                                                               3, -6, -5, -2, 0.0, True,
+                                                               0).split(';')
+        return [x.split(',')[:8] for x in results[:-1]], results[-1]
+
+    def concise_strings(self, read_name):
+        strings = [x.get_concise_string() for x in self.hits[read_name]]
+        self.assertTrue(all(len(x.split(',')) == 7 for x in strings))
+        return strings
+
+    @staticmethod
+    def without_minimiser_count(concise_string):
+        return ','.join(concise_string.split(',')[:6])
+
+    def check_fast_path(self, read_name, strand):
+        minimap_str = ';'.join(self.concise_strings(read_name))
+        alignments, output = self.align(read_name, minimap_str)
+        self.assertIn('(fast path)', output)
+        self.assertNotIn('fast path failed', output)
+        self.assertEqual(len(alignments), 1)
+        self.assertEqual(alignments[0][1], strand)
+        self.assertGreaterEqual(float(alignments[0][7]), 95.0)
+
+        # Line tracing (used when there's no minimiser count) finds the same alignment.
+        line_tracing_alignments, output = \
+            self.align(read_name, self.without_minimiser_count(minimap_str))
+        self.assertNotIn('(fast path)', output)
+        self.assertEqual(alignments, line_tracing_alignments)
+
+    def test_forward_strand(self):
+        self.check_fast_path('clean', '+')
+
+    def test_reverse_strand(self):
+        self.check_fast_path('reverse', '-')
+
+    def test_sparse_minimisers(self):
+        """
+        A high-error read has too few minimisers in its hit for the fast path.
+        """
+        minimap_str = ';'.join(self.concise_strings('noisy'))
+        alignments, output = self.align('noisy', minimap_str)
+        self.assertNotIn('(fast path)', output)
+        self.assertEqual(len(alignments), 1)
+
+    def test_low_hit_coverage(self):
+        """
+        The first half of this read is unrelated to the reference, so its hit covers too little of
+        the possible overlap for the fast path.
+        """
+        minimap_str = ';'.join(self.concise_strings('partial'))
+        alignments, output = self.align('partial', minimap_str)
+        self.assertNotIn('(fast path)', output)
+        self.assertEqual(len(alignments), 1)
+
+    def test_low_score_falls_back(self):
+        """
+        If the hit claims dense minimisers but the fast alignment scores poorly, the range is
+        aligned again with line tracing.
+        """
+        hit = self.concise_strings('noisy')[0]
+        minimap_str = self.without_minimiser_count(hit) + ',1000'
+        alignments, output = self.align('noisy', minimap_str)
+        self.assertIn('(fast path)', output)
+        self.assertIn('fast path failed, using line tracing', output)
+        line_tracing_alignments, _ = self.align('noisy', self.without_minimiser_count(hit))
+        self.assertEqual(alignments, line_tracing_alignments)
+
+    def test_two_hits_in_range(self):
+        """
+        A range with more than one hit goes straight to line tracing.
+        """
+        parts = self.concise_strings('clean')[0].split(',')
+        read_start, read_end = int(parts[0]), int(parts[1])
+        ref_start, ref_end = int(parts[4]), int(parts[5])
+        read_mid, ref_mid = (read_start + read_end) // 2, (ref_start + ref_end) // 2
+        count = str(int(parts[6]) // 2)
+        hits = [[read_start, read_mid, '+', 'ref', ref_start, ref_mid, count],
+                [read_mid, read_end, '+', 'ref', ref_mid, ref_end, count]]
+        minimap_str = ';'.join(','.join(str(x) for x in hit) for hit in hits)
+        alignments, output = self.align('clean', minimap_str)
+        self.assertNotIn('(fast path)', output)
+        self.assertEqual(len(alignments), 1)
+        self.assertGreaterEqual(float(alignments[0][7]), 95.0)
+
+
+class TestBandWidening(unittest.TestCase):
+    """
+    These reads have a stretch which aligns on the main diagonal with only ~85% identity (so there
+    are no seeds), except for an exact copy of some nearby reference which makes a seed well off
+    that diagonal. The chain goes through that seed, and the best alignment through it runs along
+    the edge of the seed's band, so the band is widened.
+    """
+    @staticmethod
+    def make_read_and_ref(seed, offset, copy_length):
+        rand = random.Random(seed)
+        ref = list(random_sequence(rand, 3000))
+        for i in range(copy_length):
+            base = ref[1150 + offset + i]
+            ref[1150 + i] = substitute(rand, base) if i % 6 == 0 else base
+        ref = ''.join(ref)
+        middle = list(ref[1000:1400])
+        for i in range(0, len(middle), 7):
+            middle[i] = substitute(rand, middle[i])
+        middle = ''.join(middle)
+        middle = middle[:150] + ref[1150 + offset:1150 + offset + copy_length] + \
+            middle[150 + copy_length:]
+        return ref[:1000] + middle + ref[1400:], ref
+
+    @staticmethod
+    def align(read, ref):
+        """
+        Returns the alignment's raw score and the band size and score of each attempt.
+        """
+        ref_seqs_ptr = unicycler.cpp_wrappers.new_ref_seqs()
+        unicycler.cpp_wrappers.add_ref_seq(ref_seqs_ptr, 'ref', ref)
+
+        # The minimiser count puts this read on the fast path.
+        minimap_str = '0,' + str(len(read)) + ',+,ref,0,' + str(len(ref)) + ',200'
+        results = unicycler.cpp_wrappers.semi_global_alignment('read', read, 3, minimap_str,
+                                                               ref_seqs_ptr, 3, -6, -5, -2, 0.0,
+                                                               True, 0).split(';')
+        unicycler.cpp_wrappers.delete_ref_seqs(ref_seqs_ptr)
+        assert 'fast path' in results[-1] and len(results) == 2
+        attempts = [(int(x), int(y)) for x, y in
+                    re.findall(r'band size: (\d+), score: (-?\d+)', results[-1])]
+        return int(results[0].split(',')[6]), attempts
+
+    def test_band_widening(self):
+        raw_score, attempts = self.align(*self.make_read_and_ref(0, 58, 70))
+        self.assertEqual(len(attempts), 2)
+
+        # The first attempt uses the fixed band for the sensitivity level.
+        fixed_band_size, fixed_band_score = attempts[0]
+        widened_band_size, widened_score = attempts[1]
+        self.assertEqual(fixed_band_size, 25)
+        self.assertEqual(widened_band_size, 50)
+        self.assertGreater(widened_score, fixed_band_score + 200)
+        self.assertGreater(raw_score, fixed_band_score + 200)
+
+    def test_widening_without_improvement(self):
+        """
+        Here the widened band gives a worse chain alignment, so the fixed-band one is kept.
+        """
+        raw_score, attempts = self.align(*self.make_read_and_ref(1, 50, 80))
+        self.assertEqual(len(attempts), 2)
+        fixed_band_score, widened_score = attempts[0][1], attempts[1][1]
+        self.assertLess(widened_score, fixed_band_score)
+        self.assertEqual(raw_score, fixed_band_score)
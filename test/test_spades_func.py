@@ -13,7 +13,10 @@ not, see <http://www.gnu.org/licenses/>.
 
 import unittest
 import os
+import gzip
+import random
 import unicycler.spades_func
+import unicycler.cpp_wrappers
 
 
 class TestSPAdesFunc(unittest.TestCase):
@@ -89,3 +92,58 @@ class TestSPAdesFunc(unittest.TestCase):
                                    '--isolate', '-1', '1.fq.gz', '-2', '2.fq.gz', '--tmp-dir',
                                    'abc', '-m', '1024'])
 
+
+class TestReadProfile(unittest.TestCase):
+
+    def setUp(self):
+        self.temp_fastqs = []
+
+    def tearDown(self):
+        for f in self.temp_fastqs:
+            if os.path.isfile(f):
+                os.remove(f)
+
+    def make_fastq(self, name, read_count, lengths, gzipped=False):
+        filename = 'TEMP_' + str(os.getpid()) + '_' + name + ('.fastq.gz' if gzipped else '.fastq')
+        rand = random.Random(name)
+        open_func = gzip.open if gzipped else open
+        with open_func(filename, 'wt') as fastq:
+            for i in range(read_count):
+                length = rand.choice(lengths)
+                seq = ''.join(rand.choice('ACGT') for _ in range(length))
+                fastq.write('@read_' + str(i) + '\n' + seq + '\n+\n' + 'I' * length + '\n')
+        self.temp_fastqs.append(filename)
+        return filename
+
+    def test_estimated_count(self):
+        for gzipped in [False, True]:
+            fastq = self.make_fastq('estimate', 20000, [100, 150], gzipped)
+            count, exact, valid, lengths = unicycler.cpp_wrappers.profile_reads(fastq)
+            self.assertEqual((count, exact, valid, len(lengths)), (20000, True, True, 20000))
+            count, exact, valid, lengths = \
+                unicycler.cpp_wrappers.profile_reads(fastq, max_reads=2000, sample_size=500)
+            self.assertFalse(exact)
+            self.assertTrue(valid)
+            self.assertEqual(len(lengths), 500)
+            self.assertAlmostEqual(count, 20000, delta=1000)
+
+    def test_max_reads_covering_the_whole_file(self):
+        fastq = self.make_fastq('whole', 100, [100])
+        count, exact, _, lengths = unicycler.cpp_wrappers.profile_reads(fastq, max_reads=100)
+        self.assertEqual((count, exact, len(lengths)), (100, True, 100))
+
+    def test_files_weighted_by_read_count(self):
+        """
+        A small file of short reads should only make up its share of the combined sample, even when
+        the large file is only partly read.
+        """
+        large = self.make_fastq('large', 10000, [100])
+        small = self.make_fastq('small', 100, [50])
+        for max_reads in [0, 2000]:
+            lengths = unicycler.spades_func.get_read_lengths_of_files([large, small, None],
+                                                                      1000, max_reads)
+            self.assertAlmostEqual(len(lengths), 1000, delta=2)
+            self.assertAlmostEqual(lengths.count(50), 10, delta=1)
+        lengths = unicycler.spades_func.get_read_lengths_of_files([large, small])
+        self.assertEqual(len(lengths), 10100)
+        self.assertEqual(lengths.count(50), 100)
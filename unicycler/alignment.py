@@ -14,8 +14,15 @@ not, see <http://www.gnu.org/licenses/>.
 """
 
 import re
+import sys
 from .misc import get_nice_header, reverse_complement, float_to_str
 
+try:
+    from .cpp_wrappers import cigar_tally
+except AttributeError as att_err:
+    sys.exit('Error when importing C++ library: ' + str(att_err) + '\n'
+             'Have you successfully built the library file using make?')
+
 
 class AlignmentScoringScheme(object):
     """
@@ -51,7 +58,7 @@ class Alignment(object):
     def __init__(self,
                  sam_line=None, read_dict=None,
                  seqan_output=None, read=None,
-                 reference_dict=None, scoring_scheme=None):
+                 reference_dict=None, scoring_scheme=None, sam_tally=None):
 
         # Make sure we have the appropriate inputs for one of the two ways to construct an
         # alignment.
@@ -86,26 +93,31 @@ class Alignment(object):
         self.milliseconds = None
 
         # How some of the values are gotten depends on whether this alignment came from SAM
-        # or a Seqan alignment.
+        # or a Seqan alignment. Seqan alignments come with their error counts, but SAM alignments
+        # need to have them tallied up (unless the SAM loader already did, giving sam_tally).
         if seqan_output:
             self.setup_using_seqan_output(seqan_output, read, reference_dict)
+            self.score_from_counts(scoring_scheme)
         elif sam_line:
             self.setup_using_sam(sam_line, read_dict, reference_dict)
-
-        self.tally_up_score_and_errors(scoring_scheme)
+            self.tally_up_score_and_errors(scoring_scheme, sam_tally)
 
     def setup_using_seqan_output(self, seqan_output, read, reference_dict):
         """
         This function sets up the Alignment using the Seqan results. This kind of alignment has
         complete details about the alignment.
         """
-        seqan_parts = seqan_output.split(',', 9)
-        assert len(seqan_parts) >= 10
+        seqan_parts = seqan_output.split(',')
+        assert len(seqan_parts) >= 14
 
         self.rev_comp = (seqan_parts[1] == '-')
         self.cigar_parts = re.findall(r'\d+\w', seqan_parts[9])
         self.milliseconds = int(seqan_parts[8])
 
+        # The C++ side has already counted the matches, mismatches and indels.
+        self.match_count, self.mismatch_count, self.insertion_count, self.deletion_count = \
+            [int(x) for x in seqan_parts[10:14]]
+
         self.read = read
         self.read_start_pos = int(seqan_parts[2])
         self.read_end_pos = int(seqan_parts[3])
@@ -139,10 +151,13 @@ class Alignment(object):
         if self.ref_end_pos > len(self.ref.sequence):
             self.ref_end_pos = len(self.ref.sequence)
 
-    def tally_up_score_and_errors(self, scoring_scheme):
+    def tally_up_score_and_errors(self, scoring_scheme, sam_tally=None):
         """
         This function steps through the CIGAR string for the alignment to get the score, identity
-        and count/locations of errors.
+        and count/locations of errors. The per-base work is done in C++, using only the aligned
+        parts of the read and reference. If sam_tally (the SAM record's sequence length, its counts
+        and raw score) is given, it is used instead, as long as that sequence length matches this
+        alignment's read.
         """
         # Clear any existing tallies.
         self.match_count = 0
@@ -152,62 +167,64 @@ class Alignment(object):
         self.percent_identity = 0.0
         self.raw_score = 0
 
-        # Remove the soft clipping parts of the CIGAR string for tallying.
-        cigar_parts = self.cigar_parts[:]
-        if cigar_parts[0][-1] == 'S':
-            cigar_parts.pop(0)
-        if cigar_parts and cigar_parts[-1][-1] == 'S':
-            cigar_parts.pop()
+        cigar_parts = self.get_cigar_parts_without_clips()
         if not cigar_parts:
             return
 
-        read_len = self.read.get_length()
+        if sam_tally and sam_tally[0] == self.read.get_length():
+            self.match_count, self.mismatch_count, self.insertion_count, self.deletion_count, \
+                self.raw_score = sam_tally[1:]
+            self.set_identity_and_scaled_score(cigar_parts, scoring_scheme)
+            return
+
+        read_consumed = sum(int(x[:-1]) for x in cigar_parts if x[-1] != 'D')
+        ref_consumed = sum(int(x[:-1]) for x in cigar_parts if x[-1] != 'I')
+        read_start = self.read_start_pos
+        read_end = read_start + read_consumed
         if self.rev_comp:
-            read_seq = reverse_complement(self.read.sequence)
+            read_len = self.read.get_length()
+            read_seq = reverse_complement(self.read.sequence[max(read_len - read_end, 0):
+                                                             max(read_len - read_start, 0)])
         else:
-            read_seq = self.read.sequence
-        read_i = self.read_start_pos
+            read_seq = self.read.sequence[read_start:read_end]
+        ref_seq = self.ref.sequence[self.ref_start_pos:self.ref_start_pos + ref_consumed]
 
-        ref_len = self.ref.get_length()
-        ref_seq = self.ref.sequence
-        ref_i = self.ref_start_pos
-        align_i = 0
+        self.match_count, self.mismatch_count, self.insertion_count, self.deletion_count, \
+            self.raw_score = cigar_tally(read_seq, ref_seq, ''.join(self.cigar_parts),
+                                         scoring_scheme)
+        self.set_identity_and_scaled_score(cigar_parts, scoring_scheme)
 
+    def score_from_counts(self, scoring_scheme):
+        """
+        Sets the score, identity and edit distance for an alignment which already has its match,
+        mismatch and indel counts.
+        """
+        self.percent_identity = 0.0
+        self.raw_score = 0
+        cigar_parts = self.get_cigar_parts_without_clips()
+        if not cigar_parts:
+            return
+        self.raw_score = self.match_count * scoring_scheme.match + \
+            self.mismatch_count * scoring_scheme.mismatch
         for cigar_part in cigar_parts:
-            cigar_count = int(cigar_part[:-1])
-            cigar_type = cigar_part[-1]
-            ins_del_cigar_score = scoring_scheme.gap_open + \
-                ((cigar_count - 1) * scoring_scheme.gap_extend)
-            if cigar_type == 'I':
-                cigar_score = ins_del_cigar_score
-                self.insertion_count += cigar_count
-                read_i += cigar_count
-            elif cigar_type == 'D':
-                cigar_score = ins_del_cigar_score
-                self.deletion_count += cigar_count
-                ref_i += cigar_count
-            else:  # match/mismatch
-                cigar_score = 0
-                for _ in range(cigar_count):
-                    # If all is good with the CIGAR, then we should never end up with a sequence
-                    # index out of the sequence range. But a CIGAR error can cause this, so check
-                    # here.
-                    if read_i >= read_len or ref_i >= ref_len:
-                        break
-                    read_base = read_seq[read_i]
-                    ref_base = ref_seq[ref_i]
-                    if read_base == ref_base:
-                        self.match_count += 1
-                        cigar_score += scoring_scheme.match
-                    else:
-                        self.mismatch_count += 1
-                        cigar_score += scoring_scheme.mismatch
-                    read_i += 1
-                    ref_i += 1
-
-            self.raw_score += cigar_score
-            align_i += cigar_count
+            if cigar_part[-1] == 'I' or cigar_part[-1] == 'D':
+                self.raw_score += scoring_scheme.gap_open + \
+                    ((int(cigar_part[:-1]) - 1) * scoring_scheme.gap_extend)
+        self.set_identity_and_scaled_score(cigar_parts, scoring_scheme)
+
+    def get_cigar_parts_without_clips(self):
+        """
+        Returns the CIGAR parts with any soft clipping at the start and end removed.
+        """
+        cigar_parts = self.cigar_parts[:]
+        if cigar_parts[0][-1] == 'S':
+            cigar_parts.pop(0)
+        if cigar_parts and cigar_parts[-1][-1] == 'S':
+            cigar_parts.pop()
+        return cigar_parts
 
+    def set_identity_and_scaled_score(self, cigar_parts, scoring_scheme):
+        align_i = sum(int(x[:-1]) for x in cigar_parts)
         self.percent_identity = 100.0 * self.match_count / align_i
         self.edit_distance = self.mismatch_count + self.insertion_count + self.deletion_count
         self.alignment_length = align_i
@@ -17,11 +17,11 @@ import math
 import copy
 import os
 import itertools
+import heapq
 from collections import deque, defaultdict
 from .assembly_graph_segment import Segment
 from .misc import int_to_str, float_to_str, weighted_average_list, score_function, \
-    add_line_breaks_to_sequence, print_table, get_dim_timestamp, get_right_arrow, \
-    remove_dupes_preserve_order
+    add_line_breaks_to_sequence, print_table, get_dim_timestamp, get_right_arrow
 from .bridge_long_read import LongReadBridge
 from .bridge_miniasm import MiniasmBridge
 from . import settings
@@ -426,6 +426,7 @@ class AssemblyGraph(object):
         Deletes the given segment numbers (regardless of sign) from the paths. If this results in
         an invalid path, then the whole path is deleted.
         """
+        seg_nums = set(seg_nums)
         fixed_paths = {}
         for path_name, path in self.paths.items():
             fixed_path = [x for x in path if x not in seg_nums and -x not in seg_nums]
@@ -493,17 +494,24 @@ class AssemblyGraph(object):
             anchor_seg_nums = set(x.number for x in anchor_segments)
         else:
             anchor_seg_nums = None
-        while True:
-            # Sort the segment numbers first so we apply the merging in a consistent order.
-            seg_nums = sorted(list(self.segments.keys()))
-            for num in seg_nums:
-                path = self.get_simple_path(num, anchor_seg_nums, bridging_mode)
-                assert len(path) > 0
-                if len(path) > 1:
-                    self.merge_simple_path(path)
-                    break
-            else:
-                break
+        # Merging is always applied to the lowest-numbered segment with a simple path, so the
+        # result is consistent from one run to the next. A merge can only change the simple path
+        # of segments linked to the merged segment, so rather than rechecking every segment after
+        # each merge, only those segments (and the new merged segment) go back into the heap of
+        # candidates.
+        candidates = list(self.segments.keys())
+        heapq.heapify(candidates)
+        while candidates:
+            num = heapq.heappop(candidates)
+            if num not in self.segments:
+                continue
+            path = self.get_simple_path(num, anchor_seg_nums, bridging_mode)
+            assert len(path) > 0
+            if len(path) > 1:
+                new_seg_num = self.merge_simple_path(path)
+                heapq.heappush(candidates, new_seg_num)
+                for neighbour in self.get_connected_segments(new_seg_num):
+                    heapq.heappush(candidates, neighbour)
         self.renumber_segments()
 
     def merge_simple_path(self, merge_path):
@@ -521,11 +529,13 @@ class AssemblyGraph(object):
             if [s_2] != self.forward_links[s_1]:
                 raise BadPath(str(merge_path) + ' is not a simple path')
 
+        # The merged reverse sequence is built from the segments' reverse sequences (the flipped
+        # path), which is cheaper than reverse complementing the merged forward sequence.
         new_seg_num = self.get_next_available_seg_number()
-        merged_forward_seq = self.get_path_sequence(merge_path)
-        new_seg = Segment(new_seg_num, mean_depth, merged_forward_seq, True,
+        flipped_merge_path = [-x for x in reversed(merge_path)]
+        new_seg = Segment(new_seg_num, mean_depth, self.get_path_sequence(merge_path), True,
                           original_depth=original_depth)
-        new_seg.build_other_sequence_if_necessary()
+        new_seg.add_sequence(self.get_path_sequence(flipped_merge_path), False)
 
         # Save some info that we'll need, and then delete the old segments.
         paths_copy = self.paths.copy()
@@ -549,18 +559,21 @@ class AssemblyGraph(object):
         for link in incoming_links:
             self.add_link(link, new_seg_num)
 
-        # Merge the segments in any paths.
-        flipped_merge_path = [-x for x in reversed(merge_path)]
-        for path_name in paths_copy:
-            paths_copy[path_name] = find_replace_in_list(paths_copy[path_name], merge_path,
-                                                         [new_seg_num])
-            paths_copy[path_name] = find_replace_in_list(paths_copy[path_name], flipped_merge_path,
-                                                         [-new_seg_num])
-
-        # If any paths still contain the original segments, then split those paths into pieces,
-        # removing the original segments.
+        # Merge the segments in any paths. Paths which don't use any of the merged segments are
+        # left as they are.
+        merged_seg_nums = set(abs(x) for x in merge_path)
         new_paths = {}
         for path_name, path_segments in paths_copy.items():
+            if not any(abs(x) in merged_seg_nums for x in path_segments):
+                if len(path_segments) > 1:
+                    new_paths[path_name] = path_segments
+                continue
+            path_segments = find_replace_in_list(path_segments, merge_path, [new_seg_num])
+            path_segments = find_replace_in_list(path_segments, flipped_merge_path,
+                                                 [-new_seg_num])
+
+            # If the path still contains the original segments, then split it into pieces,
+            # removing the original segments.
             split_paths = split_path_multiple(path_segments, merge_path + flipped_merge_path)
             if len(split_paths) == 1:
                 new_paths[path_name] = split_paths[0]
@@ -1090,7 +1103,11 @@ class AssemblyGraph(object):
         """
         Gets a linear (i.e. not circular) path sequence from the graph.
         """
-        path_sequence = ''
+        # The pieces are gathered in a list and joined once at the end, and only the last overlap's
+        # worth of sequence is kept for checking, so long paths don't repeatedly copy the growing
+        # sequence.
+        sequence_parts = []
+        path_end = ''
         prev_segment_number = None
         for i, seg_num in enumerate(path_segments):
             segment = self.segments[abs(seg_num)]
@@ -1099,18 +1116,23 @@ class AssemblyGraph(object):
             else:
                 seg_sequence = segment.reverse_sequence
             if i == 0:
-                path_sequence = seg_sequence
+                new_part = seg_sequence
             else:
                 if seg_num not in self.forward_links[prev_segment_number]:
                     raise BadPath(str(path_segments) + ' is not a valid path')
-                if self.overlap > 0 and \
-                        path_sequence[-self.overlap:] != seg_sequence[:self.overlap]:
+                if self.overlap > 0 and path_end != seg_sequence[:self.overlap]:
                     raise BadOverlaps('overlaps do not match when merging ' +
                                       str(prev_segment_number) + ' and ' + str(seg_num) +
                                       ' in path ' + str(path_segments))
-                path_sequence += seg_sequence[self.overlap:]
+                new_part = seg_sequence[self.overlap:]
+            sequence_parts.append(new_part)
+            if self.overlap > 0:
+                if len(new_part) >= self.overlap:
+                    path_end = new_part[-self.overlap:]
+                else:
+                    path_end = (path_end + new_part)[-self.overlap:]
             prev_segment_number = seg_num
-        return path_sequence
+        return ''.join(sequence_parts)
 
     def apply_bridges(self, bridges, verbosity, min_bridge_qual):
         """
@@ -1128,7 +1150,10 @@ class AssemblyGraph(object):
         right_bridged = set()
         left_bridged = set()
         seg_nums_used_in_bridges = []
-        applied_bridges = []
+
+        # Applied bridges are indexed by the segments in their paths, so checking a new bridge
+        # against them doesn't require a scan of every applied bridge.
+        applied_bridges_by_seg_num = defaultdict(list)
 
         # Sort bridges first by type: LongReadBridge, SpadesContigBridge and then
         # LoopUnrollingBridge. Then sort by quality so within each type we apply the best bridges
@@ -1164,17 +1189,9 @@ class AssemblyGraph(object):
                 # bridge that happens to start or end in this bridge. That arrangement (two bridges,
                 # each of which end inside the other's path) can break up the graph if they are
                 # both applied, so don't apply this bridge if such a case exists.
-                bridges_using_this_segment = []
-                if abs(bridge.start_segment) in seg_nums_used_in_bridges:
-                    for applied_bridge in applied_bridges:
-                        segs_in_applied_bridge_path = set(abs(x) for x in applied_bridge.graph_path)
-                        if abs(bridge.start_segment) in segs_in_applied_bridge_path:
-                            bridges_using_this_segment.append(applied_bridge)
-                if abs(bridge.end_segment) in seg_nums_used_in_bridges:
-                    for applied_bridge in applied_bridges:
-                        segs_in_applied_bridge_path = set(abs(x) for x in applied_bridge.graph_path)
-                        if abs(bridge.end_segment) in segs_in_applied_bridge_path:
-                            bridges_using_this_segment.append(applied_bridge)
+                bridges_using_this_segment = \
+                    applied_bridges_by_seg_num.get(abs(bridge.start_segment), []) + \
+                    applied_bridges_by_seg_num.get(abs(bridge.end_segment), [])
                 if bridges_using_this_segment:
                     segs_in_path = set(abs(x) for x in bridge.graph_path)
                     for bridge_using_this_segment in bridges_using_this_segment:
@@ -1192,8 +1209,8 @@ class AssemblyGraph(object):
                 # high enough for this bridge to be applicable.
                 if bridge.quality >= min_bridge_qual:
                     self.apply_bridge(bridge, right_bridged, left_bridged, seg_nums_used_in_bridges)
-                    seg_nums_used_in_bridges = remove_dupes_preserve_order(seg_nums_used_in_bridges)
-                    applied_bridges.append(bridge)
+                    for seg_num in set(abs(x) for x in bridge.graph_path):
+                        applied_bridges_by_seg_num[seg_num].append(bridge)
                     if verbosity > 1:
                         bridge_application_table_row.append('applied')
                     bridge_application_table.append(bridge_application_table_row)
@@ -25,7 +25,6 @@ import sys
 import math
 from collections import defaultdict
 import itertools
-from multiprocessing.dummy import Pool as ThreadPool
 from .minimap_alignment import align_long_reads_to_assembly_graph, build_start_end_overlap_sets
 from .misc import print_table, get_right_arrow, float_to_str
 from .bridge_common import get_bridge_str, get_mean_depth, get_depth_agreement_factor
@@ -33,7 +32,7 @@ from . import log
 from . import settings
 
 try:
-    from .cpp_wrappers import fully_global_alignment
+    from .cpp_wrappers import simple_loop_votes
 except AttributeError as att_err:
     sys.exit('Error when importing C++ library: ' + str(att_err) + '\n'
              'Have you successfully built the library file using make?')
@@ -111,7 +110,7 @@ class SimpleLongReadBridge(object):
 
 
 def create_simple_long_read_bridges(graph, out_dir, keep, threads, read_dict, long_read_filename,
-                                    scoring_scheme, anchor_segments):
+                                    scoring_scheme, anchor_segments, read_sketches=None):
     """
     Create and return simple long read bridges.
     """
@@ -124,7 +123,7 @@ def create_simple_long_read_bridges(graph, out_dir, keep, threads, read_dict, lo
     if not os.path.exists(bridging_dir):
         os.makedirs(bridging_dir)
     minimap_alignments = align_long_reads_to_assembly_graph(graph, long_read_filename,
-                                                            bridging_dir, threads)
+                                                            bridging_dir, threads, read_sketches)
     start_overlap_reads, end_overlap_reads = build_start_end_overlap_sets(minimap_alignments)
     bridges = simple_bridge_two_way_junctions(graph, start_overlap_reads, end_overlap_reads,
                                               minimap_alignments, anchor_segments)
@@ -332,23 +331,22 @@ def simple_bridge_loops(graph, start_overlap_reads, end_overlap_reads, minimap_a
         best_repeat_guess = max(1, best_repeat_guess)
         max_tested_loop_count = (best_repeat_guess + 1) * 2
 
-        # Use a simple loop if we only have one thread.
-        if threads == 1:
-            for read, strand in zip(all_reads, strands):
-                vote = get_read_loop_vote(start, end, middle, repeat, strand, minimap_alignments,
-                                          read, read_dict, graph, max_tested_loop_count,
-                                          scoring_scheme)
-                votes[vote] += 1
-
-        # Use a thread pool if we have more than one thread.
+        # The reads are aligned against each loop count in C++, where they are run in parallel.
+        if middle is None:
+            middle_seq = ''
         else:
-            pool = ThreadPool(threads)
-            arg_list = []
-            for read, strand in zip(all_reads, strands):
-                arg_list.append((start, end, middle, repeat, strand, minimap_alignments,
-                                 read, read_dict, graph, max_tested_loop_count, scoring_scheme))
-            for vote in pool.imap_unordered(get_read_loop_vote_one_arg, arg_list):
-                votes[vote] += 1
+            middle_seq = graph.seq_from_signed_seg_num(middle)
+        read_votes = simple_loop_votes(start, end, middle, repeat,
+                                       graph.seq_from_signed_seg_num(start),
+                                       graph.seq_from_signed_seg_num(end), middle_seq,
+                                       graph.seq_from_signed_seg_num(repeat),
+                                       [read_dict[x].sequence for x in all_reads], strands,
+                                       [minimap_alignments[x] for x in all_reads],
+                                       max_tested_loop_count,
+                                       settings.SIMPLE_REPEAT_BRIDGING_BAND_SIZE, scoring_scheme,
+                                       threads)
+        for vote in read_votes:
+            votes[vote] += 1
 
         # Format the vote totals nicely for the table.
         vote_str = ''
@@ -398,124 +396,3 @@ def simple_bridge_loops(graph, start_overlap_reads, end_overlap_reads, minimap_a
                     alignments='RRRRRLRR', left_align_header=False, bottom_align_header=False,
                     sub_colour={'bad reads': 'red', 'no reads': 'red', 'tie vote': 'red'}, indent=0)
     return bridges
-
-
-def get_read_loop_vote_one_arg(all_args):
-    start, end, middle, repeat, strand, minimap_alignments, read, read_dict, graph, \
-        max_tested_loop_count, scoring_scheme = all_args
-    return get_read_loop_vote(start, end, middle, repeat, strand, minimap_alignments, read,
-                              read_dict, graph, max_tested_loop_count, scoring_scheme)
-
-
-def get_read_loop_vote(start, end, middle, repeat, strand, minimap_alignments, read, read_dict,
-                       graph, max_tested_loop_count, scoring_scheme):
-    if strand == 'F':
-        s, e, m, r = start, end, middle, repeat
-    else:  # strand == 'R'
-        if middle is None:
-            s, e, m, r = -end, -start, None, -repeat
-        else:
-            s, e, m, r = -end, -start, -middle, -repeat
-    alignments = minimap_alignments[read]
-
-    last_index_of_start = -1
-    for i, a in enumerate(alignments):
-        if a.get_signed_ref_name() == str(s):
-            last_index_of_start = i
-    first_index_of_end = -1
-    for i in range(last_index_of_start + 1, len(alignments)):
-        a = alignments[i]
-        if a.get_signed_ref_name() == str(e):
-            first_index_of_end = i
-            break
-
-    # We should now have the indices of the alignments around the repeat.
-    if last_index_of_start == -1 or first_index_of_end == -1:
-        return -1  # vote for bad read
-
-    # If there are any alignments in between the start and end segments, they are only
-    # allowed to be the middle or repeat segments.
-    bad_middle = False
-    for i in range(last_index_of_start + 1, first_index_of_end):
-        ref_name = alignments[i].get_signed_ref_name()
-        if m is None:
-            if ref_name != str(r):
-                bad_middle = True
-        else:
-            if ref_name != str(m) and ref_name != str(r):
-                bad_middle = True
-    if bad_middle:
-        return -1  # vote for bad read
-
-    start_alignment = alignments[last_index_of_start]
-    end_alignment = alignments[first_index_of_end]
-
-    # Now that we have the alignments, we can extract the relevant part of the read...
-    read_start_pos, read_end_pos = start_alignment.read_start, end_alignment.read_end
-    read_seq = read_dict[read].sequence[read_start_pos:read_end_pos]
-
-    # ... and the relevant parts of the start/end segments.
-    if start_alignment.read_strand == '+':
-        start_seg_start_pos = start_alignment.ref_start
-    else:  # start_alignment.read_strand == '-'
-        start_seg_start_pos = start_alignment.ref_length - start_alignment.ref_end
-    if end_alignment.read_strand == '+':
-        end_seg_end_pos = end_alignment.ref_end
-    else:  # end_alignment.read_strand == '-'
-        end_seg_end_pos = end_alignment.ref_length - end_alignment.ref_start
-    start_seg_seq = graph.seq_from_signed_seg_num(s)[start_seg_start_pos:]
-    end_seg_seq = graph.seq_from_signed_seg_num(e)[:end_seg_end_pos]
-
-    if m is None:
-        middle_seq = ''
-    else:
-        middle_seq = graph.seq_from_signed_seg_num(m)
-    repeat_seq = graph.seq_from_signed_seg_num(r)
-
-    best_score = None
-    best_count = None
-
-    loop_count, fail_to_improve_count = 0, 0
-    prev_test_seq_score = None
-    while True:
-        test_seq = start_seg_seq + repeat_seq
-        for _ in range(loop_count):
-            test_seq += middle_seq + repeat_seq
-        test_seq += end_seg_seq
-        alignment_result = fully_global_alignment(read_seq, test_seq, scoring_scheme, True,
-                                                  settings.SIMPLE_REPEAT_BRIDGING_BAND_SIZE)
-        if alignment_result:
-            seqan_parts = alignment_result.split(',', 9)
-            test_seq_score = int(seqan_parts[6])
-            if best_score is None or test_seq_score > best_score:
-                best_score = test_seq_score
-                best_count = loop_count
-        else:
-            test_seq_score = 0
-
-        # Break when we've hit the max loop count. But if the max is our best, then we keep
-        # trying higher.
-        if loop_count >= max_tested_loop_count and loop_count != best_count:
-            break
-
-        # Just in case to prevent an infinite loop.
-        if loop_count > max_tested_loop_count * 10:
-            break
-
-        # If the score fails to increase a few times in a row, we can assume that we're getting
-        # further from the correct answer and can break the loop to save time.
-        if prev_test_seq_score is not None and test_seq_score <= prev_test_seq_score:
-            fail_to_improve_count += 1
-        else:
-            fail_to_improve_count = 0
-        if fail_to_improve_count > 3:
-            break
-
-        loop_count += 1
-        prev_test_seq_score = test_seq_score
-
-    # This read now casts its vote for the best repeat count!
-    if best_count is not None:
-        return best_count
-    else:
-        return -1  # vote for bad read
@@ -0,0 +1,174 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Unicycler
+
+This module contains functions for saving and restoring the state of the Unicycler pipeline at
+stage boundaries, so an interrupted run can resume where it left off.
+
+This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Unicycler is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Unicycler. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import hashlib
+import os
+import pickle
+import random
+import shutil
+import sys
+from . import log
+from . import settings
+from .version import __version__
+
+
+# The pipeline stages which can be checkpointed, in the order they are run. A checkpoint for a
+# stage holds the complete pipeline state at the end of that stage.
+STAGES = ['short_read_graph', 'miniasm', 'simple_bridges', 'long_read_alignment',
+          'long_read_bridges', 'bridged']
+
+# Options which don't change the assembly result, so changing them doesn't invalidate checkpoints.
+IGNORED_OPTIONS = {'out', 'threads', 'verbosity', 'keep', 'no_checkpoints', 'help_all',
+                   'profile', 'pin_threads'}
+
+
+class FileCounter(object):
+    """
+    This class numbers the intermediate files in chronological order. It is used instead of
+    itertools.count because it can be pickled in a checkpoint.
+    """
+    def __init__(self, start=1):
+        self.value = start
+
+    def __iter__(self):
+        return self
+
+    def __next__(self):
+        value = self.value
+        self.value += 1
+        return value
+
+
+class Checkpoints(object):
+    """
+    This class saves the pipeline state after each stage and finds the latest usable checkpoint
+    when Unicycler is rerun in the same output directory. Checkpoints are only used if the input
+    files and options are the same as when they were made.
+    """
+    def __init__(self, args, enabled=True):
+        self.args = args
+        self.enabled = enabled
+        self.directory = os.path.join(args.out, 'checkpoints')
+        self.resumed_stage = None
+        self.key = None
+
+    def resume(self):
+        """
+        Returns the state dictionary from the latest valid checkpoint, or an empty dictionary if
+        there isn't one.
+        """
+        if not self.enabled or not os.path.isdir(self.directory):
+            return {}
+        for stage in reversed(STAGES):
+            filename = self.get_filename(stage)
+            if not os.path.isfile(filename):
+                continue
+            try:
+                with open(filename, 'rb') as checkpoint_file:
+                    header = pickle.load(checkpoint_file)
+                    if header.get('key') != self.get_key():
+                        continue
+                    state = pickle.load(checkpoint_file)
+            except (OSError, EOFError, pickle.UnpicklingError, AttributeError, ImportError):
+                continue
+            self.resumed_stage = stage
+            random.setstate(header['random_state'])
+            log.log('\nResuming from checkpoint (' + stage.replace('_', ' ') + '):\n  ' +
+                    filename)
+            return state
+        return {}
+
+    def reached(self, stage):
+        """
+        Returns whether the resumed checkpoint already covers the given stage.
+        """
+        if self.resumed_stage is None:
+            return False
+        return STAGES.index(stage) <= STAGES.index(self.resumed_stage)
+
+    def save(self, stage, **state):
+        """
+        Saves the state at the end of a stage. The file is written to a temporary name first so
+        an interrupted save never leaves a truncated checkpoint behind.
+        """
+        if not self.enabled or self.reached(stage):
+            return
+        if not os.path.exists(self.directory):
+            os.makedirs(self.directory)
+        header = {'key': self.get_key(), 'stage': stage, 'random_state': random.getstate()}
+        filename = self.get_filename(stage)
+        temp_filename = filename + '.incomplete'
+        old_limit = sys.getrecursionlimit()
+        sys.setrecursionlimit(max(old_limit, settings.CHECKPOINT_RECURSION_LIMIT))
+        try:
+            with open(temp_filename, 'wb') as checkpoint_file:
+                pickle.dump(header, checkpoint_file, protocol=pickle.HIGHEST_PROTOCOL)
+                pickle.dump(state, checkpoint_file, protocol=pickle.HIGHEST_PROTOCOL)
+            os.replace(temp_filename, filename)
+        except (OSError, pickle.PicklingError, RecursionError, AttributeError, TypeError):
+            log.log('\nWarning: could not save checkpoint for ' + stage.replace('_', ' '), 2)
+            if os.path.isfile(temp_filename):
+                os.remove(temp_filename)
+            return
+        finally:
+            sys.setrecursionlimit(old_limit)
+
+        # Earlier checkpoints are superseded by this one.
+        for earlier_stage in STAGES[:STAGES.index(stage)]:
+            earlier_filename = self.get_filename(earlier_stage)
+            if os.path.isfile(earlier_filename):
+                os.remove(earlier_filename)
+
+    def clean_up(self, keep):
+        if keep < 3 and os.path.isdir(self.directory):
+            shutil.rmtree(self.directory, ignore_errors=True)
+
+    def get_filename(self, stage):
+        return os.path.join(self.directory, stage + '.pickle')
+
+    def get_key(self):
+        """
+        The checkpoint key is a hash of the input files' contents, the assembly-affecting options
+        and the Unicycler version. It is computed once, when first needed.
+        """
+        if self.key is None:
+            key_hash = hashlib.blake2b(digest_size=20)
+            key_hash.update(__version__.encode())
+            for name, value in sorted(vars(self.args).items()):
+                if name not in IGNORED_OPTIONS:
+                    key_hash.update((name + '=' + repr(value) + '\n').encode())
+            for filename in get_input_files(self.args):
+                key_hash.update(filename.encode())
+                key_hash.update(get_file_hash(filename).encode())
+            self.key = key_hash.hexdigest()
+        return self.key
+
+
+def get_input_files(args):
+    filenames = [args.short1, args.short2, args.unpaired, args.long, args.contamination,
+                 args.existing_long_read_assembly, args.start_genes]
+    return [x for x in filenames if x and os.path.isfile(x)]
+
+
+def get_file_hash(filename):
+    file_hash = hashlib.blake2b(digest_size=20)
+    with open(filename, 'rb') as f:
+        while True:
+            chunk = f.read(settings.CHECKPOINT_HASH_CHUNK_SIZE)
+            if not chunk:
+                break
+            file_hash.update(chunk)
+    return file_hash.hexdigest()
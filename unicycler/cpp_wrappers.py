@@ -16,7 +16,7 @@ not, see <http://www.gnu.org/licenses/>.
 
 import os
 from ctypes import CDLL, cast, c_char_p, c_int, c_uint, c_ulong, c_double, c_void_p, c_bool, \
-    c_float, POINTER
+    c_float, c_long, c_longlong, POINTER
 from .misc import quit_with_error
 
 
@@ -56,6 +56,60 @@ def semi_global_alignment(read_name, read_sequence, verbosity, minimap_alignment
 
 
 
+# This function tallies up the matches, mismatches, insertions and deletions of an alignment given
+# as a CIGAR (e.g. one loaded from a SAM file), along with its raw score.
+C_LIB.cigarTally.argtypes = [c_char_p,  # Aligned part of the read sequence
+                             c_char_p,  # Aligned part of the reference sequence
+                             c_char_p,  # CIGAR
+                             c_int,     # Match score
+                             c_int,     # Mismatch score
+                             c_int,     # Gap open score
+                             c_int]     # Gap extension score
+C_LIB.cigarTally.restype = c_void_p     # Comma-delimited counts and score
+
+def cigar_tally(read_seq, ref_seq, cigar, scoring_scheme):
+    ptr = C_LIB.cigarTally(read_seq.encode('utf-8'), ref_seq.encode('utf-8'),
+                           cigar.encode('utf-8'), scoring_scheme.match, scoring_scheme.mismatch,
+                           scoring_scheme.gap_open, scoring_scheme.gap_extend)
+    return [int(x) for x in c_string_to_python_string(ptr).split(',')]
+
+
+
+# This function loads a SAM or BAM file's alignments, tallying up their matches, mismatches and
+# indels using multiple threads.
+C_LIB.loadSamAlignments.argtypes = [c_char_p,  # SAM/BAM filename
+                                    c_void_p,  # SeqMap pointer of reference sequences
+                                    c_int,     # Match score
+                                    c_int,     # Mismatch score
+                                    c_int,     # Gap open score
+                                    c_int,     # Gap extension score
+                                    c_int]     # Threads
+C_LIB.loadSamAlignments.restype = c_void_p     # Record count and one line per mapped record
+
+def load_sam_file(sam_filename, ref_seqs_ptr, scoring_scheme, threads):
+    """
+    Returns the number of alignment records in the file and a list of (sam_line, tally) tuples for
+    the mapped records. sam_line has the record's first six SAM columns and tally is the sequence
+    length, match/mismatch/insertion/deletion counts and raw score, or None if the record wasn't
+    tallied in C++.
+    """
+    ptr = C_LIB.loadSamAlignments(sam_filename.encode('utf-8'), ref_seqs_ptr,
+                                  scoring_scheme.match, scoring_scheme.mismatch,
+                                  scoring_scheme.gap_open, scoring_scheme.gap_extend, threads)
+    lines = c_string_to_python_string(ptr).split('\n')
+    records = []
+    for line in lines[1:]:
+        if not line:
+            continue
+        sam_line, seq_length, tally = line.rsplit('\t', 2)
+        if tally == '*':
+            records.append((sam_line, None))
+        else:
+            records.append((sam_line, [int(seq_length)] + [int(x) for x in tally.split(',')]))
+    return int(lines[0]), records
+
+
+
 # This function does an exhaustive semi-global alignment (nothing fancy, only suitable for short
 # sequences).
 C_LIB.semiGlobalAlignmentExhaustive.argtypes = [c_char_p,  # Sequence 1
@@ -118,6 +172,48 @@ def path_alignment(partial_seq, full_seq, scoring_scheme, use_banding, band_size
 
 
 
+# These functions give upper bounds on the scores of the two alignment functions above. They use a
+# bit-parallel edit distance, which is much faster than the alignments themselves, so candidates
+# which can't beat the best alignment can be skipped.
+C_LIB.fullyGlobalAlignmentBounds.argtypes = [c_char_p,  # Sequence 1
+                                             c_char_p,  # Sequence 2
+                                             c_int,  # Match score
+                                             c_int,  # Mismatch score
+                                             c_int,  # Gap open score
+                                             c_int,  # Gap extension score
+                                             c_bool,  # Use banding
+                                             c_int]  # Band size
+C_LIB.fullyGlobalAlignmentBounds.restype = c_void_p  # Raw and scaled score bounds
+
+def fully_global_alignment_bounds(sequence_1, sequence_2, scoring_scheme, use_banding, band_size):
+    ptr = C_LIB.fullyGlobalAlignmentBounds(sequence_1.encode('utf-8'),
+                                           sequence_2.encode('utf-8'),
+                                           scoring_scheme.match, scoring_scheme.mismatch,
+                                           scoring_scheme.gap_open, scoring_scheme.gap_extend,
+                                           use_banding, band_size)
+    raw_bound, scaled_bound = c_string_to_python_string(ptr).split(',')
+    return int(raw_bound), float(scaled_bound)
+
+C_LIB.pathAlignmentScaledScoreBound.argtypes = [c_char_p,  # Sequence 1
+                                                c_char_p,  # Sequence 2
+                                                c_int,  # Match score
+                                                c_int,  # Mismatch score
+                                                c_int,  # Gap open score
+                                                c_int,  # Gap extension score
+                                                c_bool,  # Use banding
+                                                c_int]  # Band size
+C_LIB.pathAlignmentScaledScoreBound.restype = c_double  # Scaled score bound
+
+def path_alignment_scaled_score_bound(partial_seq, full_seq, scoring_scheme, use_banding,
+                                      band_size):
+    return C_LIB.pathAlignmentScaledScoreBound(partial_seq.encode('utf-8'),
+                                               full_seq.encode('utf-8'),
+                                               scoring_scheme.match, scoring_scheme.mismatch,
+                                               scoring_scheme.gap_open, scoring_scheme.gap_extend,
+                                               use_banding, band_size)
+
+
+
 # This function cleans up the heap memory for the C strings returned by the other C functions. It
 # must be called after them.
 C_LIB.freeCString.argtypes = [c_void_p]
@@ -258,17 +354,71 @@ C_LIB.minimapAlignReads.argtypes = [c_char_p,  # Reference FASTA filename
                                     c_int]     # Settings preset
 C_LIB.minimapAlignReads.restype = c_void_p     # String describing alignments
 
+C_LIB.minimapAlignReadsWithSketches.argtypes = [c_char_p,  # Reference FASTA filename
+                                               c_char_p,  # Reads FASTQ filename
+                                               c_void_p,  # ReadSketches pointer
+                                               c_int,     # Threads
+                                               c_int,     # Sensitivity level
+                                               c_int]     # Settings preset
+C_LIB.minimapAlignReadsWithSketches.restype = c_void_p    # String describing alignments
+
 def minimap_align_reads(reference_fasta, reads_fastq, threads, sensitivity_level,
-                        preset_name='default'):
+                        preset_name='default', read_sketches=None):
+    """
+    If a read sketch cache (from new_read_sketches) is given for the reads file, the reads'
+    minimisers are reused from it instead of being read and sketched again.
+    """
     preset = 0  # default
     if preset_name == 'read vs read':
         preset = 1
     elif preset_name == 'find contigs':
         preset = 2
-    ptr = C_LIB.minimapAlignReads(reference_fasta.encode('utf-8'), reads_fastq.encode('utf-8'),
-                                  threads, sensitivity_level, preset)
+    if read_sketches is not None:
+        ptr = C_LIB.minimapAlignReadsWithSketches(reference_fasta.encode('utf-8'),
+                                                  reads_fastq.encode('utf-8'), read_sketches,
+                                                  threads, sensitivity_level, preset)
+    else:
+        ptr = C_LIB.minimapAlignReads(reference_fasta.encode('utf-8'),
+                                      reads_fastq.encode('utf-8'), threads, sensitivity_level,
+                                      preset)
     return c_string_to_python_string(ptr)
 
+C_LIB.newReadSketches.argtypes = [c_char_p]  # Reads FASTQ filename
+C_LIB.newReadSketches.restype = c_void_p     # ReadSketches pointer
+
+def new_read_sketches(reads_fastq):
+    return C_LIB.newReadSketches(reads_fastq.encode('utf-8'))
+
+C_LIB.deleteReadSketches.argtypes = [c_void_p]
+C_LIB.deleteReadSketches.restype = None
+
+def delete_read_sketches(read_sketches_ptr):
+    C_LIB.deleteReadSketches(read_sketches_ptr)
+
+# This function screens long reads against a contamination FASTA using minimisers, so clear
+# contaminants can be dropped before alignment.
+C_LIB.screenContamination.argtypes = [c_char_p,  # Contamination FASTA filename
+                                      c_char_p,  # Target references FASTA filename
+                                      c_char_p,  # Reads FASTQ filename
+                                      c_void_p,  # ReadSketches pointer (or None)
+                                      c_int]     # Threads
+C_LIB.screenContamination.restype = c_void_p     # String of contaminant reads
+
+def screen_contamination(contamination_fasta, target_fasta, reads_fastq, threads,
+                         read_sketches=None):
+    """
+    Returns a dictionary of the reads which are clearly contaminants, where key = read name and
+    value = (containment, target containment, coverage).
+    """
+    ptr = C_LIB.screenContamination(contamination_fasta.encode('utf-8'),
+                                    target_fasta.encode('utf-8'), reads_fastq.encode('utf-8'),
+                                    read_sketches, threads)
+    contaminants = {}
+    for line in c_string_to_python_string(ptr).splitlines():
+        name, containment, target_containment, coverage = line.split('\t')
+        contaminants[name] = (float(containment), float(target_containment), float(coverage))
+    return contaminants
+
 C_LIB.minimapAlignReadsWithSettings.argtypes = [c_char_p,  # Reference FASTA filename
                                                 c_char_p,  # Reads FASTQ filename
                                                 c_int,     # Threads
@@ -298,12 +448,13 @@ def minimap_align_reads_with_settings(reference_fasta, reads_fastq, threads, all
 C_LIB.miniasmAssembly.argtypes = [c_char_p,  # Reads FASTQ filename
                                   c_char_p,  # Overlaps PAF filename
                                   c_char_p,  # Output GFA filename
-                                  c_int]     # Min depth
+                                  c_int,     # Min depth
+                                  c_int]     # Threads
 C_LIB.miniasmAssembly.restype = None         # No return value (function creates GFA files)
 
-def miniasm_assembly(reads_fastq, overlaps_paf, output_gfa, min_depth):
+def miniasm_assembly(reads_fastq, overlaps_paf, output_gfa, min_depth, threads):
     C_LIB.miniasmAssembly(reads_fastq.encode('utf-8'), overlaps_paf.encode('utf-8'),
-                          output_gfa.encode('utf-8'), min_depth)
+                          output_gfa.encode('utf-8'), min_depth, threads)
 
 
 
@@ -355,3 +506,225 @@ def end_seq_alignment(sequence_1, sequence_2, scoring_scheme):
     return C_LIB.endAlignment(sequence_1.encode('utf-8'), sequence_2.encode('utf-8'),
                               scoring_scheme.match, scoring_scheme.mismatch,
                               scoring_scheme.gap_open, scoring_scheme.gap_extend)
+
+
+# This function counts the reads in a FASTQ file and gets their lengths (all of them, or a seeded
+# reservoir sample). If max_reads is more than 0, it stops after that many reads and estimates the
+# count.
+C_LIB.profileReads.argtypes = [c_char_p,    # Read filename
+                               c_longlong,  # Max reads (0 for all)
+                               c_int]       # Length sample size (0 for all)
+C_LIB.profileReads.restype = c_void_p       # String with count, exact, valid and lengths
+
+def profile_reads(reads_filename, max_reads=0, sample_size=0):
+    """
+    Returns the read count, whether the count is exact, whether the file is a properly formatted
+    FASTQ and a list of read lengths.
+    """
+    ptr = C_LIB.profileReads(reads_filename.encode('utf-8'), max_reads, sample_size)
+    header, lengths = c_string_to_python_string(ptr).split('\n')[:2]
+    count, exact, valid = [int(x) for x in header.split(',')]
+    lengths = [int(x) for x in lengths.split(',')] if lengths else []
+    return count, bool(exact), bool(valid), lengths
+
+
+# This function gets the simple loop votes for all reads spanning a loop: the number of times each
+# read goes through the loop (or -1 for reads that don't fit the loop).
+C_LIB.simpleLoopVotes.argtypes = [c_int,             # Start segment
+                                  c_int,             # End segment
+                                  c_int,             # Middle segment (0 for none)
+                                  c_int,             # Repeat segment
+                                  c_char_p,          # Start segment sequence
+                                  c_char_p,          # End segment sequence
+                                  c_char_p,          # Middle segment sequence
+                                  c_char_p,          # Repeat segment sequence
+                                  c_int,             # Read count
+                                  POINTER(c_char_p), # Read sequences
+                                  c_char_p,          # Read strands ('F' or 'R')
+                                  POINTER(c_int),    # Hit offsets (read count + 1)
+                                  POINTER(c_int),    # Hit signed segment numbers
+                                  POINTER(c_int),    # Hit read starts
+                                  POINTER(c_int),    # Hit read ends
+                                  POINTER(c_int),    # Hit ref starts
+                                  POINTER(c_int),    # Hit ref ends
+                                  POINTER(c_int),    # Hit ref lengths
+                                  c_int,             # Max tested loop count
+                                  c_int,             # Band size
+                                  c_bool,            # Skip loop counts which can't beat the best
+                                  c_int,             # Match score
+                                  c_int,             # Mismatch score
+                                  c_int,             # Gap open score
+                                  c_int,             # Gap extension score
+                                  c_int]             # Threads
+C_LIB.simpleLoopVotes.restype = c_void_p             # String of comma-delimited votes
+
+def simple_loop_votes(start, end, middle, repeat, start_seq, end_seq, middle_seq, repeat_seq,
+                      read_seqs, strands, read_alignments, max_tested_loop_count, band_size,
+                      scoring_scheme, threads, use_score_bounds=True):
+    """
+    The reads' alignments are given as one list of MinimapAlignment objects per read, and the
+    segment sequences are for the loop's forward strand. With use_score_bounds, loop counts whose
+    score bound shows they can't beat the best so far aren't aligned.
+    """
+    read_count = len(read_seqs)
+    if not read_count:
+        return []
+    hit_offsets = [0]
+    hit_segs, hit_read_starts, hit_read_ends = [], [], []
+    hit_ref_starts, hit_ref_ends, hit_ref_lengths = [], [], []
+    for alignments in read_alignments:
+        for a in alignments:
+            hit_segs.append(int(a.ref_name) * (-1 if a.read_strand == '-' else 1))
+            hit_read_starts.append(a.read_start)
+            hit_read_ends.append(a.read_end)
+            hit_ref_starts.append(a.ref_start)
+            hit_ref_ends.append(a.ref_end)
+            hit_ref_lengths.append(a.ref_length)
+        hit_offsets.append(len(hit_segs))
+
+    # noinspection PyCallingNonCallable
+    read_seqs = (c_char_p * read_count)(*[x.encode('utf-8') for x in read_seqs])
+    int_arrays = [(c_int * len(x))(*x) for x in [hit_offsets, hit_segs, hit_read_starts,
+                                                 hit_read_ends, hit_ref_starts, hit_ref_ends,
+                                                 hit_ref_lengths]]
+    ptr = C_LIB.simpleLoopVotes(start, end, 0 if middle is None else middle, repeat,
+                                start_seq.encode('utf-8'), end_seq.encode('utf-8'),
+                                middle_seq.encode('utf-8'), repeat_seq.encode('utf-8'),
+                                read_count, read_seqs, ''.join(strands).encode('utf-8'),
+                                *int_arrays, max_tested_loop_count, band_size,
+                                use_score_bounds, scoring_scheme.match, scoring_scheme.mismatch,
+                                scoring_scheme.gap_open, scoring_scheme.gap_extend, threads)
+    return [int(x) for x in c_string_to_python_string(ptr).split(',')]
+
+
+# These functions make a random genome and simulated reads from it, for testing at scale. The same
+# seed always gives the same genome and reads.
+C_LIB.simulateGenome.argtypes = [c_uint,    # Seed
+                                 c_int,     # Chromosome length
+                                 c_int,     # Plasmid count
+                                 c_int,     # Plasmid length
+                                 c_int,     # Repeat count
+                                 c_int,     # Repeat length
+                                 c_double,  # Repeat divergence
+                                 c_bool]    # Circular
+C_LIB.simulateGenome.restype = c_void_p     # FASTA string
+
+C_LIB.simulateLongReads.argtypes = [c_uint,             # Seed
+                                    POINTER(c_char_p),  # Sequences
+                                    POINTER(c_int),     # Circular (1 or 0)
+                                    POINTER(c_double),  # Depths
+                                    c_int,              # Sequence count
+                                    c_int,              # Platform (0 for ONT, 1 for PacBio)
+                                    c_double,           # Mean read length
+                                    c_double,           # Read length stdev
+                                    c_double,           # Mean read identity
+                                    c_double,           # Read identity stdev
+                                    c_char_p]           # Output filename (empty for string)
+C_LIB.simulateLongReads.restype = c_void_p              # Read count or FASTQ string
+
+C_LIB.simulateShortReads.argtypes = [c_uint,             # Seed
+                                     POINTER(c_char_p),  # Sequences
+                                     POINTER(c_int),     # Circular (1 or 0)
+                                     POINTER(c_double),  # Depths
+                                     c_int,              # Sequence count
+                                     c_int,              # Read length
+                                     c_double,           # Insert size mean
+                                     c_double,           # Insert size stdev
+                                     c_double,           # Error rate
+                                     c_char_p,           # Output filename 1 (empty for string)
+                                     c_char_p]           # Output filename 2
+C_LIB.simulateShortReads.restype = c_void_p              # Pair count or interleaved FASTQ
+
+def simulate_genome(seed=0, chromosome_length=1000000, plasmid_count=2, plasmid_length=20000,
+                    repeat_count=10, repeat_length=5000, repeat_divergence=0.01, circular=True):
+    """
+    Returns the genome as a list of (name, sequence, circular) tuples.
+    """
+    ptr = C_LIB.simulateGenome(seed, chromosome_length, plasmid_count, plasmid_length,
+                               repeat_count, repeat_length, repeat_divergence, circular)
+    genome = []
+    for record in c_string_to_python_string(ptr).split('>')[1:]:
+        header, sequence = record.strip().split('\n')
+        genome.append((header.split()[0], sequence, header.endswith('circular=true')))
+    return genome
+
+
+def simulation_arrays(genome, depths):
+    sequences = [x[1].encode('utf-8') for x in genome]
+    # noinspection PyCallingNonCallable
+    return ((c_char_p * len(genome))(*sequences),
+            (c_int * len(genome))(*[1 if x[2] else 0 for x in genome]),
+            (c_double * len(genome))(*depths))
+
+
+def simulate_long_reads(genome, depths, out_filename='', seed=0, platform='ont',
+                        mean_length=10000.0, length_stdev=8000.0, mean_identity=0.9,
+                        identity_stdev=0.03):
+    """
+    The genome is a list of (name, sequence, circular) tuples and depths has one depth per
+    sequence. If out_filename is given, the reads are saved there and the read count is returned,
+    otherwise the reads are returned as a FASTQ string. Raises OSError if the file can't be written.
+    """
+    sequences, circular, depths = simulation_arrays(genome, depths)
+    ptr = C_LIB.simulateLongReads(seed, sequences, circular, depths, len(genome),
+                                  1 if platform == 'pacbio' else 0, mean_length, length_stdev,
+                                  mean_identity, identity_stdev, out_filename.encode('utf-8'))
+    result = c_string_to_python_string(ptr)
+    if out_filename and int(result) < 0:
+        raise OSError('could not write simulated reads to ' + out_filename)
+    return int(result) if out_filename else result
+
+
+def simulate_short_reads(genome, depths, out_filename_1='', out_filename_2='', seed=0,
+                         read_length=150, insert_mean=400.0, insert_stdev=50.0, error_rate=0.005):
+    """
+    If output filenames are given, the read pairs are saved there and the pair count is returned,
+    otherwise the pairs are returned as an interleaved FASTQ string. Raises OSError if the files
+    can't be written.
+    """
+    sequences, circular, depths = simulation_arrays(genome, depths)
+    ptr = C_LIB.simulateShortReads(seed, sequences, circular, depths, len(genome), read_length,
+                                   insert_mean, insert_stdev, error_rate,
+                                   out_filename_1.encode('utf-8'), out_filename_2.encode('utf-8'))
+    result = c_string_to_python_string(ptr)
+    if out_filename_1 and int(result) < 0:
+        raise OSError('could not write simulated reads to ' + out_filename_1 + ' and ' +
+                      out_filename_2)
+    return int(result) if out_filename_1 else result
+
+
+# This function sets the memory budget (in bytes, 0 for no limit) which the C++ code uses to size
+# minimap batches, DP alignments and consensus bands, and to limit how many big alignments run at
+# once.
+C_LIB.setMemoryBudget.argtypes = [c_longlong]  # Memory budget in bytes
+C_LIB.setMemoryBudget.restype = None
+
+def set_memory_budget(budget_bytes):
+    C_LIB.setMemoryBudget(budget_bytes)
+
+
+# This function gives minimap's read batch and index batch sizes (in bases) for the current
+# memory budget.
+C_LIB.minimapReadBatchSize.argtypes = []
+C_LIB.minimapReadBatchSize.restype = c_longlong   # Read batch size
+C_LIB.minimapIndexBatchSize.argtypes = []
+C_LIB.minimapIndexBatchSize.restype = c_longlong  # Index batch size
+
+def minimap_batch_sizes():
+    return C_LIB.minimapReadBatchSize(), C_LIB.minimapIndexBatchSize()
+
+
+# These functions control and check the C++ code's shared worker thread pool. Pinning only applies
+# to pool threads started after it is set, so it should be set before any multi-threaded work.
+C_LIB.setThreadPinning.argtypes = [c_bool]  # Whether to pin pool threads to NUMA nodes
+C_LIB.setThreadPinning.restype = None
+
+def set_thread_pinning(pin):
+    C_LIB.setThreadPinning(pin)
+
+C_LIB.parallelForSum.argtypes = [c_int,   # Threads
+                                 c_long]  # Range size
+C_LIB.parallelForSum.restype = c_longlong  # Sum of the range (-1 if the pool misbehaved)
+
+def parallel_for_sum(threads, n):
+    return C_LIB.parallelForSum(threads, n)
@@ -0,0 +1,43 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CONTAMINATION_SCREEN_H
+#define CONTAMINATION_SCREEN_H
+
+#include <stdint.h>
+#include <string>
+#include <unordered_set>
+#include "minimap_align.h"
+
+
+// The minimiser hashes of a FASTA (the contamination or the target references), for scoring how
+// much of each read they contain.
+class MinimiserSketch {
+public:
+    MinimiserSketch() : m_k(0) {}
+    MinimiserSketch(const mm_sketch_set_t * sketchSet);
+    void scoreRead(const mm_sketch_set_t * reads, uint32_t i,
+                   double & containment, double & coverage) const;
+    double getContainment(const mm_sketch_set_t * reads, uint32_t i) const;
+
+private:
+    int m_k;
+    std::unordered_set<uint32_t> m_hashes;
+};
+
+
+// Functions that are called by the Python script must have C linkage, not C++ linkage.
+extern "C" {
+    char * screenContamination(char * contaminationFasta, char * targetFasta, char * readsFastq,
+                               ReadSketches * readSketches, int n_threads);
+}
+
+#endif // CONTAMINATION_SCREEN_H
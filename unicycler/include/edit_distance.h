@@ -0,0 +1,28 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef EDIT_DISTANCE_H
+#define EDIT_DISTANCE_H
+
+#include <string>
+
+
+int bandedEditDistance(const std::string & s1, const std::string & s2,
+                       int lowerDiagonal, int upperDiagonal, bool freeEndGapsInS2);
+
+int rawScoreUpperBound(int editDistance, int length1, int length2,
+                       int matchScore, int mismatchScore, int gapOpenScore, int gapExtensionScore);
+
+double scaledScoreUpperBound(int maxMatches, int minEdits,
+                             int matchScore, int mismatchScore, int gapOpenScore,
+                             int gapExtensionScore);
+
+#endif // EDIT_DISTANCE_H
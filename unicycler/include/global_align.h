@@ -24,6 +24,10 @@ extern "C" {
     char * fullyGlobalAlignment(char * s1, char * s2,
                                 int matchScore, int mismatchScore, int gapOpenScore, int gapExtensionScore,
                                 bool useBanding=false, int bandSize=1000);
+
+    char * fullyGlobalAlignmentBounds(char * s1, char * s2,
+                                      int matchScore, int mismatchScore, int gapOpenScore,
+                                      int gapExtensionScore, bool useBanding, int bandSize);
 }
 
 
@@ -31,5 +35,9 @@ ScoredAlignment * fullyGlobalAlignment(std::string s1, std::string s2,
                                        int matchScore, int mismatchScore, int gapOpenScore, int gapExtensionScore,
                                        bool useBanding=false, int bandSize=1000);
 
+void fullyGlobalAlignmentBounds(std::string & s1, std::string & s2,
+                                int matchScore, int mismatchScore, int gapOpenScore,
+                                int gapExtensionScore, bool useBanding, int bandSize,
+                                int & rawBound, double & scaledBound);
 
 #endif // GLOBAL_ALIGN_H
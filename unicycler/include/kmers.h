@@ -16,8 +16,8 @@
 #include <cmath>
 #include <unordered_map>
 #include <vector>
+#include <memory>
 #include "settings.h"
-#include <mutex>
 
 typedef std::unordered_map<std::string, std::vector<int> > KmerPosMap;
 
@@ -30,22 +30,36 @@ public:
 };
 
 
+// A sequence, and the positions of each of its k-mers, held in a KmerPositions object.
+struct KmerPositionsEntry {
+    std::string name;
+    std::string sequence;
+    KmerPosMap kmerPositions;
+};
+
+
 // KmerPositions is a class that holds maps of k-mer positions for named sequences. It exists so we
-// don't have to repeatedly find the same k-mer sets over and over.
+// don't have to repeatedly find the same k-mer sets over and over. Each sequence gets an integer
+// handle when it is added. The object is meant to be filled first and read afterwards: lookups
+// take no lock, so a filled object can be shared read-only between threads. Entries are never
+// replaced or removed (adding a name twice keeps the first entry), so the pointers it returns stay
+// valid for its lifetime.
 class KmerPositions {
 public:
     KmerPositions() {}
-    ~KmerPositions();
-    void addPositions(std::string & name, std::string & sequence, int kSize);
-    KmerPosMap * getKmerPositions(std::string & name);
-    std::string * getSequence(std::string & name);
-    std::vector<std::string> getAllNames();
-    int getLength(std::string & name);
+    int addPositions(std::string & name, std::string & sequence, int kSize);
+    int getHandle(std::string & name) const;
+    KmerPosMap * getKmerPositions(int handle) const {return &m_entries[handle]->kmerPositions;}
+    std::string * getSequence(int handle) const {return &m_entries[handle]->sequence;}
+    int getLength(int handle) const {return int(m_entries[handle]->sequence.length());}
+    KmerPosMap * getKmerPositions(std::string & name) const;
+    std::string * getSequence(std::string & name) const;
+    int getLength(std::string & name) const;
+    std::vector<std::string> getAllNames() const;
 
 private:
-    std::unordered_map<std::string, KmerPosMap *> m_kmerPositions;
-    std::unordered_map<std::string, std::string> m_sequences;
-    std::mutex m_mutex;
+    std::vector<std::unique_ptr<KmerPositionsEntry> > m_entries;
+    std::unordered_map<std::string, int> m_handles;
 };
 
 KmerPositions * newKmerPositions();
@@ -0,0 +1,45 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef LOOP_VOTES_H
+#define LOOP_VOTES_H
+
+#include <string>
+#include <vector>
+
+
+// Functions that are called by the Python script must have C linkage, not C++ linkage.
+extern "C" {
+    char * simpleLoopVotes(int startSeg, int endSeg, int middleSeg, int repeatSeg,
+                           char * startSeqC, char * endSeqC, char * middleSeqC, char * repeatSeqC,
+                           int readCount, char ** readSeqs, char * readStrands, int hitOffsets[],
+                           int hitSegs[], int hitReadStarts[], int hitReadEnds[],
+                           int hitRefStarts[], int hitRefEnds[], int hitRefLengths[],
+                           int maxTestedLoopCount, int bandSize, bool useScoreBounds,
+                           int matchScore, int mismatchScore, int gapOpenScore,
+                           int gapExtensionScore, int threads);
+}
+
+// The start, end, middle and repeat segment numbers and sequences for one strand of a loop.
+struct LoopStrand {
+    int s, e, m, r;
+    std::string startSeq, endSeq, middleSeq, repeatSeq;
+};
+
+int getReadLoopVote(LoopStrand & loop, std::string readSeq, int hitCount, int * hitSegs,
+                    int * hitReadStarts, int * hitReadEnds, int * hitRefStarts, int * hitRefEnds,
+                    int * hitRefLengths, int maxTestedLoopCount, int bandSize,
+                    bool useScoreBounds, int matchScore, int mismatchScore, int gapOpenScore,
+                    int gapExtensionScore);
+
+std::string pythonSlice(const std::string & s, int start, int end);
+
+#endif // LOOP_VOTES_H
@@ -0,0 +1,40 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+
+// Functions that are called by the Python script must have C linkage, not C++ linkage.
+extern "C" {
+    void setMemoryBudget(long long bytes);
+    long long getMemoryBudget();
+}
+
+long long budgetedCount(long long defaultCount, long long bytesEach, long long minimumCount);
+
+bool fitsInMemoryBudget(long long bytes);
+
+long long dpMatrixCells(long long length1, long long length2, bool useBanding, int bandSize);
+
+// While one of these exists, its bytes count against the memory budget. Creating one waits until
+// there is room in the budget, so big alignments on different threads take turns instead of all
+// running at once. A reservation bigger than the whole budget waits until it can run alone.
+class MemoryReservation {
+public:
+    MemoryReservation(long long bytes);
+    ~MemoryReservation();
+private:
+    long long m_bytes;
+};
+
+
+#endif // MEMORY_BUDGET_H
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include <string>
+#include <vector>
 
 #pragma GCC diagnostic ignored "-Wsign-compare"
 
@@ -63,20 +64,27 @@ typedef struct {
 void ma_opt_init(ma_opt_t *opt);
 sdict_t *prefilter_contained_reads(const char *fn, int min_span, int min_match, int max_hang, float int_frac);
 ma_hit_t *read_hits_file(const char *fn, int min_span, int min_match, sdict_t *d, size_t *n, int bi_dir, const sdict_t *excl);
-ma_sub_t *filter_reads_using_depth(int min_dp, float min_iden, int end_clip, size_t n, const ma_hit_t *a, const sdict_t *read_dict);
-size_t filter_hits_using_span(const ma_sub_t *reg, int min_span, size_t n, ma_hit_t *a);
-size_t filter_hits_using_overhang(const ma_sub_t *sub, int max_hang, int min_ovlp, size_t n, ma_hit_t *a, float *cov);
+ma_sub_t *filter_reads_using_depth(int min_dp, float min_iden, int end_clip, size_t n, const ma_hit_t *a, const sdict_t *read_dict, int n_threads);
+size_t filter_hits_using_span(const ma_sub_t *reg, int min_span, size_t n, ma_hit_t *a, int n_threads);
+size_t filter_hits_using_span_and_overhang(const ma_sub_t *sub, int min_span, int max_hang, int min_ovlp, size_t n, ma_hit_t *a, float *cov, int n_threads);
 void merge_subreads(size_t n_sub, ma_sub_t *a, const ma_sub_t *b);
 void save_read_names(size_t n, const ma_hit_t *a, const sdict_t *d, ma_sub_t *sub, std::string all_read_list);
-size_t remove_contained_reads(int max_hang, float int_frac, int min_ovlp, sdict_t *d, ma_sub_t *sub, size_t n, ma_hit_t *a, std::string contained_read_list);
+size_t remove_contained_reads(int max_hang, float int_frac, int min_ovlp, sdict_t *d, ma_sub_t *sub, size_t n, ma_hit_t *a, std::string contained_read_list, int n_threads);
 std::string get_read_name(const sdict_t *read_dict, int id);
 bool is_read_illumina_contig(const sdict_t *read_dict, int id);
 void ma_hit_mark_unused(sdict_t *read_dict, int n, const ma_hit_t *a);
 
 asg_t *make_string_graph(int max_hang, float int_frac, int min_ovlp, sdict_t const *d, ma_sub_t const *sub, unsigned long n_hits, ma_hit_t const *hit);
-void save_string_graph(const asg_t *g, const sdict_t *d, const ma_sub_t *sub, std::string graph_filename, const char *reads_filename);
+// RRW: the sequences of the reads used in a string graph (trimmed to their subread range), indexed
+// by read ID. They are loaded from the reads file once and then used for every saved graph,
+// instead of decompressing the whole file again for each one. It takes one byte per stored base
+// and isn't counted against the memory budget.
+typedef std::vector<std::string> ma_read_store_t;
+int load_read_store(const asg_t *g, const sdict_t *d, const ma_sub_t *sub, const char *reads_filename, ma_read_store_t &store);
+
+void save_string_graph(const asg_t *g, const sdict_t *d, const ma_sub_t *sub, std::string graph_filename, const ma_read_store_t &store);
 ma_ug_t *make_unitig_graph(asg_t *g);
-int generate_unitig_seqs(ma_ug_t *g, const sdict_t *d, const ma_sub_t *sub, const char *fn);
+int generate_unitig_seqs(ma_ug_t *g, const ma_read_store_t &store, int n_threads);
 void save_unitig_graph(const ma_ug_t *ug, const sdict_t *d, const ma_sub_t *sub, std::string graph_filename);
 void destroy_unitig_graph(ma_ug_t *ug);
 
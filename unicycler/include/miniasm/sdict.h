@@ -8,10 +8,13 @@ typedef struct {
 	uint32_t len, aux:31, del:1;
 } sd_seq_t;
 
+// RRW: names are interned into an arena of large blocks (void *a) rather than strdup'd one by
+// one, so a dictionary of millions of reads costs a handful of allocations. Blocks are never
+// moved, so the name pointers in seq stay valid for the life of the dictionary.
 typedef struct {
 	uint32_t n_seq, m_seq;
 	sd_seq_t *seq;
-	void *h;
+	void *h, *a;
 } sdict_t;
 
 sdict_t *init_seq_dict(void);
@@ -16,4 +16,14 @@ void bseq_close(bseq_file_t *fp);
 bseq1_t *bseq_read(bseq_file_t *fp, int chunk_size, int *n_);
 int bseq_eof(bseq_file_t *fp);
 
+// RRW: the read-ahead reader used by bseq_open(), which decompresses in a background thread. It can
+// be given to KSEQ_INIT(bseq_reader_t*, bseq_reader_read) by code that needs more than bseq1_t.
+struct bseq_reader_s;
+typedef struct bseq_reader_s bseq_reader_t;
+
+bseq_reader_t *bseq_reader_open(const char *fn);
+void bseq_reader_close(bseq_reader_t *r);
+int bseq_reader_read(bseq_reader_t *r, void *buf, int len);
+double bseq_reader_ratio(bseq_reader_t *r); // compressed size / decompressed size, so far
+
 #endif
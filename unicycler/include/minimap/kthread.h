@@ -0,0 +1,14 @@
+#ifndef KTHREAD_H
+#define KTHREAD_H
+
+// run func(data, i, tid) for every i in [0, n) using up to n_threads threads; tid is in
+// [0, n_threads) and is unique among the threads working on one kt_for() call
+void kt_for(int n_threads, void (*func)(void*,long,int), void *data, long n);
+
+// run an n_steps pipeline with n_threads workers; see kthread.cpp for the step semantics
+void kt_pipeline(int n_threads, void *(*func)(void*, int, void*), void *shared_data, int n_steps);
+
+// pin kt_for() pool workers (those started after this call) to NUMA nodes; Linux only
+void kt_pool_pin_threads(int pin);
+
+#endif
@@ -8,12 +8,16 @@
 #include "bseq.h"
 
 #define MM_IDX_DEF_B    14
+#define MM_IDX_AUTO_B   0 // RRW: choose the number of buckets from the number of minimizers
 #define MM_DEREP_Q50    5.0
+#define MM_CHAIN_MAX_ITER 50
 
 #define MM_F_WITH_REP  0x1
 #define MM_F_NO_SELF   0x2
 #define MM_F_NO_ISO    0x4
 #define MM_F_AVA       0x8
+#define MM_F_CHAIN     0x10 // RRW: chaining DP instead of Hough intervals + LIS
+#define MM_F_AVA_RID   0x20 // RRW: for MM_F_AVA/MM_F_NO_SELF, the query file is the indexed file, so compare IDs not names
 
 typedef struct {
  	uint64_t x, y;
@@ -38,6 +42,7 @@ typedef struct {
 	float freq_thres;
 	int32_t *len;    // length of each reference sequence
 	char **name; // TODO: if this uses too much RAM, switch one concatenated string
+	uint32_t rid0;   // RRW: file index of the first sequence, when a file is indexed in several batches
 } mm_idx_t;
 
 typedef struct {
@@ -55,8 +60,21 @@ typedef struct {
 	int sdust_thres;  // score threshold for SDUST; 0 to disable
 	int flag;    // see MM_F_* macros
 	float merge_frac; // merge two chains if merge_frac fraction of minimzers are shared between the chains
+	int pipeline_depth; // number of batches in flight in mm_map_file() (read, map and output overlap)
 } mm_mapopt_t;
 
+// RRW: minimizers of every sequence in a file, computed once so the file can be mapped against
+// several indices without being re-read or re-sketched. Each minimizer is packed into 64 bits as
+// hash<<32 | lastPos<<1 | strand, so the k-mer size must be 16 or less.
+typedef struct {
+	int w, k;
+	uint32_t n;        // number of sequences
+	char **name;
+	int32_t *len;
+	uint64_t *offset;  // minimizers of sequence i are a[offset[i]] to a[offset[i+1]-1]
+	uint64_t *a;
+} mm_sketch_set_t;
+
 extern int mm_verbose;
 extern double mm_realtime0;
 
@@ -70,6 +88,10 @@ typedef struct mm_tbuf_s mm_tbuf_t;
 // compute minimizers
 void mm_sketch(const char *str, int len, int w, int k, uint32_t rid, mm128_v *p);
 
+// sketch every sequence in a file; returns NULL if the file can't be opened or k > 16
+mm_sketch_set_t *mm_sketch_file(const char *fn, int w, int k, int n_threads, int tbatch_size);
+void mm_sketch_set_destroy(mm_sketch_set_t *s);
+
 // minimizer indexing
 mm_idx_t *mm_idx_init(int w, int k, int b);
 void mm_idx_destroy(mm_idx_t *mi);
@@ -88,8 +110,10 @@ void mm_mapopt_init(mm_mapopt_t *opt);
 mm_tbuf_t *mm_tbuf_init(void);
 void mm_tbuf_destroy(mm_tbuf_t *b);
 const mm_reg1_t *mm_map(const mm_idx_t *mi, int l_seq, const char *seq, int *n_regs, mm_tbuf_t *b, const mm_mapopt_t *opt, const char *name);
+const mm_reg1_t *mm_map_mini(const mm_idx_t *mi, int l_seq, const char *seq, int *n_regs, mm_tbuf_t *b, const mm_mapopt_t *opt, const char *name, int64_t qid);
 
 int mm_map_file(const mm_idx_t *idx, const char *fn, const mm_mapopt_t *opt, int n_threads, int tbatch_size);
+int mm_map_sketches(const mm_idx_t *idx, const mm_sketch_set_t *s, const mm_mapopt_t *opt, int n_threads, int tbatch_size);
 
 // private functions (may be moved to a "mmpriv.h" in future)
 double cputime(void);
@@ -15,6 +15,27 @@
 #include "minimap/minimap.h"
 #include "minimap/kseq.h"
 #include <string>
+#include <map>
+#include <mutex>
+#include <utility>
+
+
+// This class caches the minimizers of a long read file, so the reads don't need to be read and
+// sketched again for each minimap alignment against a new reference. One sketch set is kept per
+// window/k-mer size, each taking 8 bytes per minimizer plus the read names. This memory isn't
+// counted against the memory budget, so the cache should be deleted after its last use.
+class ReadSketches {
+public:
+    ReadSketches(std::string readsFilename) : m_readsFilename(readsFilename) {}
+    ~ReadSketches();
+    mm_sketch_set_t * getSketchSet(int w, int k, int n_threads, int tbatch_size);
+
+private:
+    std::string m_readsFilename;
+    std::map<std::pair<int, int>, mm_sketch_set_t *> m_sketchSets;
+    std::mutex m_mutex;
+};
+
 
 // Functions that are called by the Python script must have C linkage, not C++ linkage.
 extern "C" {
@@ -22,10 +43,22 @@ extern "C" {
     char * minimapAlignReads(char * referenceFasta, char * readsFastq, int n_threads,
                              int sensitivityLevel, int preset);
 
+    char * minimapAlignReadsWithSketches(char * referenceFasta, char * readsFastq,
+                                         ReadSketches * readSketches, int n_threads,
+                                         int sensitivityLevel, int preset);
+
+    ReadSketches * newReadSketches(char * readsFastq);
+
+    void deleteReadSketches(ReadSketches * readSketches);
+
     char * minimapAlignReadsWithSettings(char * referenceFasta, char * readsFastq, int n_threads,
                                          bool allVsAll, int kmerSize, int minimiserSize,
                                          float mergeFrac, int minMatchLength, int maxGap,
                                          int bandwidth, int minMinimiserCount);
+
+    long long minimapReadBatchSize();
+
+    long long minimapIndexBatchSize();
 }
 
 #endif // MINIMAP_ALIGN_H
@@ -0,0 +1,80 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef READ_SIMULATOR_H
+#define READ_SIMULATOR_H
+
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+
+// Functions that are called by the Python script must have C linkage, not C++ linkage.
+extern "C" {
+
+    char * simulateGenome(unsigned int seed, int chromosomeLength, int plasmidCount,
+                          int plasmidLength, int repeatCount, int repeatLength,
+                          double repeatDivergence, bool circular);
+
+    char * simulateLongReads(unsigned int seed, char * sequences[], int circular[],
+                             double depths[], int sequenceCount, int platform, double meanLength,
+                             double lengthStdev, double meanIdentity, double identityStdev,
+                             char * outputFilename);
+
+    char * simulateShortReads(unsigned int seed, char * sequences[], int circular[],
+                              double depths[], int sequenceCount, int readLength,
+                              double insertMean, double insertStdev, double errorRate,
+                              char * outputFilename1, char * outputFilename2);
+}
+
+// The relative rates of substitutions, insertions and deletions for a long read platform, plus
+// how much more likely a deletion is inside a homopolymer.
+struct ErrorProfile {
+    double substitution, insertion, deletion, homopolymerDeletion;
+};
+
+ErrorProfile getErrorProfile(int platform);
+
+// Reads go either to a (possibly gzipped) FASTQ file or, if there is no file, to a string. If the
+// file can't be opened or written, m_failed is set and later writes are dropped.
+class FastqWriter {
+public:
+    FastqWriter(std::string filename);
+    ~FastqWriter();
+    void write(const std::string & name, const std::string & seq, const std::string & qual);
+    bool close();
+    std::string m_output;
+    long long m_count;
+    bool m_failed;
+private:
+    gzFile m_file;
+};
+
+std::string getFragment(const std::string & sequence, bool circular, int start, int length,
+                        bool forward);
+
+std::string getQualityString(int length, double errorRate);
+
+std::string addLongReadErrors(std::mt19937 & gen, const std::string & fragment,
+                              double errorRate, ErrorProfile & profile);
+
+std::string mutateSequence(std::mt19937 & gen, const std::string & seq, double divergence);
+
+double randomUnit(std::mt19937 & gen);
+int randomInt(std::mt19937 & gen, int n);
+bool randomCoinFlip(std::mt19937 & gen);
+char randomBase(std::mt19937 & gen);
+std::string randomSequence(std::mt19937 & gen, int length);
+double randomNormal(std::mt19937 & gen, double mean, double stdev);
+double randomGamma(std::mt19937 & gen, double shape, double scale);
+
+#endif // READ_SIMULATOR_H
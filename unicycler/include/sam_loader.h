@@ -0,0 +1,53 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SAM_LOADER_H
+#define SAM_LOADER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "ref_seqs.h"
+
+
+// One alignment record from a SAM or BAM file, with its CIGAR packed (see parseCigar).
+struct SamRecord {
+    std::string readName;
+    int flag;
+    std::string refName;
+    long long refPos;  // 1-based, as in SAM
+    int mappingQuality;
+    std::string cigarString;
+    std::vector<uint32_t> cigar;
+    std::string seq;
+};
+
+// Functions that are called by the Python script must have C linkage, not C++ linkage.
+extern "C" {
+    char * loadSamAlignments(char * filename, SeqMap * refSeqs,
+                             int matchScore, int mismatchScore, int gapOpenScore,
+                             int gapExtensionScore, int threads);
+}
+
+bool parseSamLine(const char * line, size_t length, SamRecord & record, size_t & prefixLength);
+
+bool parseBamRecord(const char * data, size_t length, const std::vector<std::string> & refNames,
+                    SamRecord & record);
+
+bool getBamLongCigar(const char * aux, size_t length, std::vector<uint32_t> & cigar);
+
+size_t bamAuxValueSize(char type);
+
+std::string tallySamRecord(SamRecord & record, SeqMap * refSeqs,
+                           int matchScore, int mismatchScore, int gapOpenScore,
+                           int gapExtensionScore);
+
+#endif // SAM_LOADER_H
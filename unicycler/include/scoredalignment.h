@@ -14,6 +14,8 @@
 
 
 #include <string>
+#include <vector>
+#include <cstdint>
 #include <seqan/basic.h>
 #include <seqan/align.h>
 
@@ -45,6 +47,10 @@ public:
     int m_refStartPos;
     int m_refEndPos;
     std::string m_cigar;
+    int m_matchCount;
+    int m_mismatchCount;
+    int m_insertionCount;
+    int m_deletionCount;
     int m_rawScore;
     double m_scaledScore;
     int m_milliseconds;
@@ -60,4 +66,29 @@ private:
 
 long long getTime();
 
+// CIGARs can be held packed as in BAM files: each operation is its length shifted left by four
+// bits, plus the operation's index in CIGAR_OPS.
+#define CIGAR_OPS "MIDNSHP=X"
+std::vector<uint32_t> parseCigar(const char * cigar, size_t length);
+std::string cigarToString(const uint32_t * cigar, size_t cigarLength);
+
+// Tallies up an alignment's matches, mismatches, insertions, deletions and raw score (in that
+// order in counts) the same way ScoredAlignment does. The sequences start where the alignment
+// starts, and soft clips at either end of the CIGAR are skipped.
+void tallyCigar(const char * readSeq, size_t readLength, const char * refSeq, size_t refLength,
+                const uint32_t * cigar, size_t cigarLength,
+                int matchScore, int mismatchScore, int gapOpenScore, int gapExtensionScore,
+                long long * counts);
+
+
+// Functions that are called by the Python script must have C linkage, not C++ linkage.
+extern "C" {
+
+    // Tallies up an alignment (given as its read and reference sequences and CIGAR) the same way
+    // ScoredAlignment does. Soft clips at either end of the CIGAR are skipped. Returns a string
+    // of match, mismatch, insertion and deletion counts followed by the raw score.
+    char * cigarTally(char * readSeqC, char * refSeqC, char * cigarC,
+                      int matchScore, int mismatchScore, int gapOpenScore, int gapExtensionScore);
+}
+
 #endif // ALIGNMENT_H
@@ -49,6 +49,15 @@ struct Point {
 typedef std::unordered_set<Point> PointSet;
 typedef std::vector<Point> PointVector;
 
+// A minimap hit for a read, with its read positions on the strand that aligns to the reference.
+struct MinimapHit {
+    int readStart, readEnd;
+    int refStart, refEnd;
+    int minimiserCount;
+};
+
+typedef std::unordered_map<std::string, std::vector<MinimapHit> > MinimapHitMap;
+
 
 // Functions that are called by the Python script must have C linkage, not C++ linkage.
 extern "C" {
@@ -70,6 +79,27 @@ std::vector<ScoredAlignment *> alignReadToReferenceRange(SeqMap * refSeqs, std::
                                                          int sensitivityLevel,
                                                          int verbosity, std::string & output);
 
+ScoredAlignment * minimapHitAlignment(SeqMap * refSeqs, std::string refName,
+                                      StartEndRange refRange, int refLen, std::string readName,
+                                      char readStrand, MinimapHit & hit, std::string * readSeq,
+                                      int matchScore, int mismatchScore, int gapOpenScore,
+                                      int gapExtensionScore, int sensitivityLevel, int verbosity,
+                                      std::string & output);
+
+PointVector getConsistentAnchors(PointVector & anchors);
+
+bool minimapHitSuitsFastPath(MinimapHit & hit, int readLen, int refLen);
+
+ScoredAlignment * bandedSeedChainAlignment(String<TSeed> & seedChain, std::string * readSeq,
+                                           std::string & trimmedRefSeq, std::string readName,
+                                           char readStrand, std::string refName, int refLen,
+                                           int refStart, long long startTime, int bandSize,
+                                           int matchScore, int mismatchScore, int gapOpenScore,
+                                           int gapExtensionScore, int verbosity,
+                                           std::string & output, bool & tooBig);
+
+int getBandSize(int sensitivityLevel);
+
 std::pair<int,int> getRefRange(int refStart, int refEnd, int refLen,
                                int readStart, int readEnd, int readLen, bool posStrand);
 
@@ -109,9 +139,29 @@ struct PointCloud
 
 typedef KDTreeSingleIndexAdaptor<L1_Adaptor<int, PointCloud>, PointCloud, 2> my_kd_tree_t;
 
+// Containers used while aligning a read to a reference range. Each thread keeps one of these (see
+// getAlignmentScratch) and clears it between uses, so the memory is reused. The KD-trees stay
+// bound to their clouds and are rebuilt in place with buildIndex().
+struct AlignmentScratch {
+    AlignmentScratch();
+    std::vector<CommonKmer> commonKmers;
+    PointSet usedPoints;
+    PointCloud cloud;
+    PointCloud startingCloud;
+    my_kd_tree_t index;
+    my_kd_tree_t startingIndex;
+    PointVector nearbyPoints;
+    PointSet pointsNearLine;
+};
+
+AlignmentScratch & getAlignmentScratch();
+
 PointVector radiusSearchAroundPoint(Point point, int radius, PointCloud & cloud,
                                     my_kd_tree_t & index);
 
+void radiusSearchAroundPoint(Point point, int radius, PointCloud & cloud, my_kd_tree_t & index,
+                             PointVector & points);
+
 Point getHighestDensityPoint(int densityRadius, PointCloud & cloud, my_kd_tree_t & index,
                              std::string & trimmedRefSeq, std::string * readSeq);
 
@@ -163,4 +213,9 @@ double variance(std::vector<double> & v);
 
 long long getMaxSeedChainGapArea(String<TSeed> & seedChain, int readLen, int trimmedRefLen);
 
+int getAdaptiveBandSize(String<TSeed> & seedChain, int maxBand);
+
+bool alignmentHitsBandEdge(Align<Dna5String, ArrayGaps> & alignment, String<TSeed> & seedChain,
+                           int bandSize);
+
 #endif // SEMI_GLOBAL_ALIGN_H
@@ -14,6 +14,11 @@
 #define LEVEL_2_MINIMAP_KMER_SIZE 13
 #define LEVEL_3_MINIMAP_KMER_SIZE 12
 
+// When mapping long reads to the graph (minimap's default preset), hits are grouped into regions
+// with a chaining DP instead of Hough intervals + LIS. This gives fewer, longer regions for
+// indel-rich reads and so narrower reference ranges for the semi-global alignment.
+#define MINIMAP_CHAINING_DP true
+
 #define LEVEL_0_KMER_SIZE 10
 #define LEVEL_1_KMER_SIZE 10
 #define LEVEL_2_KMER_SIZE 9
@@ -24,6 +29,16 @@
 #define LEVEL_2_BAND_SIZE 75
 #define LEVEL_3_BAND_SIZE 100
 
+// A seed chain's band is at least MIN_ADAPTIVE_BAND_SIZE, widened by how far its seeds stray from
+// the diagonals their neighbours predict (the ADAPTIVE_BAND_PERCENTILE of seeds) and by the
+// chain's indel drift over the gaps between seeds, up to the sensitivity level's band size
+// (above). If the alignment runs along the band's edge, the band is doubled (up to
+// MAX_ADAPTIVE_BAND_SIZE) and the alignment redone, at most MAX_BAND_WIDENINGS times.
+#define MIN_ADAPTIVE_BAND_SIZE 10
+#define MAX_ADAPTIVE_BAND_SIZE 200
+#define ADAPTIVE_BAND_PERCENTILE 0.9
+#define MAX_BAND_WIDENINGS 2
+
 // The min line trace count controls how many line tracings will definitely be tried for each
 // alignment. If more than 1, then additional line tracings will be tried, even if the first one
 // looked good.
@@ -72,7 +87,60 @@
 // the alignment (because it would take too long and probably not be good anyway).
 #define MAX_BANDED_ALIGNMENT_GAP_AREA 100000000
 
+// A read range with a single minimap hit which covers most of the possible overlap
+// (FAST_PATH_MIN_HIT_COVERAGE) with dense minimisers (FAST_PATH_MIN_MINIMISERS_PER_KB) is first
+// aligned with the fast path: the read's and reference's minimisers (using minimap's k-mer and
+// window sizes) are matched up, the matches near the hit are used as seeds and line tracing is
+// skipped. A match is used if it is within FAST_PATH_MAX_ANCHOR_DEVIATION of the hit's line and
+// within FAST_PATH_MAX_ANCHOR_DIAGONAL_DEVIATION of the median diagonal of the matches around it
+// (FAST_PATH_ANCHOR_NEIGHBOURS on each side). Minimisers occurring more than
+// FAST_PATH_MAX_MINIMISER_OCCURRENCES times are skipped. If the alignment's scaled score is below
+// FAST_PATH_MIN_SCALED_SCORE, the range is aligned with the full line tracing path instead.
+#define FAST_PATH_KMER_SIZE 15
+#define FAST_PATH_WINDOW_SIZE 10
+#define FAST_PATH_MIN_HIT_COVERAGE 0.9
+#define FAST_PATH_MIN_MINIMISERS_PER_KB 60.0
+#define FAST_PATH_MAX_ANCHOR_DEVIATION 100
+#define FAST_PATH_ANCHOR_NEIGHBOURS 5
+#define FAST_PATH_MAX_ANCHOR_DIAGONAL_DEVIATION 10
+#define FAST_PATH_MAX_MINIMISER_OCCURRENCES 10
+#define FAST_PATH_MIN_SCALED_SCORE 95.0
+
+// Before alignment, reads are screened against the contamination FASTA's minimisers. A read is
+// dropped as a contaminant if at least CONTAMINATION_SCREEN_MIN_CONTAINMENT of its minimisers are
+// in the contamination, runs of those minimisers (broken by gaps of more than
+// CONTAMINATION_SCREEN_MAX_GAP bp) cover at least CONTAMINATION_SCREEN_MIN_COVERAGE of the read,
+// and its fraction of minimisers in the contamination is at least
+// CONTAMINATION_SCREEN_MIN_CONTAINMENT_RATIO times its fraction in the target references. Reads
+// with less are aligned as usual, so only clear contaminants are dropped.
+#define CONTAMINATION_SCREEN_MIN_CONTAINMENT 0.1
+#define CONTAMINATION_SCREEN_MIN_COVERAGE 0.9
+#define CONTAMINATION_SCREEN_MIN_CONTAINMENT_RATIO 2.0
+#define CONTAMINATION_SCREEN_MAX_GAP 500
+
 // When searching for a line tracing starting point, neighbouring points too far from the diagonal
 // are penalised. This controls how far a point can be from the diagonal before its contribution
 // drops to 0.
 #define SCORE_DISTANCE_FROM_DIAGONAL 5.0
+
+// Seed for the reservoir sampling of read lengths in profileReads, so a given read file always
+// gives the same sample (and therefore the same k-mer range).
+#define READ_PROFILE_SEED 0
+
+// When a memory budget is set (setMemoryBudget), DP alignments are assumed to use this many bytes
+// per matrix cell, and minimap is assumed to use this many bytes per base in a read batch and in
+// an index batch. These estimates size the alignments and batches to fit the budget. The budget
+// doesn't cover the long read minimiser cache (ReadSketches) or miniasm's read store, which both
+// grow with the long read input and are freed once their step is done.
+#define DP_CELL_BYTES 16
+#define MINIMAP_READ_BATCH_BYTES_PER_BASE 16
+#define MINIMAP_INDEX_BATCH_BYTES_PER_BASE 32
+
+// However small the memory budget, minimap batches and consensus bands won't go below these.
+#define MIN_MINIMAP_READ_BATCH_SIZE 1000000
+#define MIN_MINIMAP_INDEX_BATCH_SIZE 10000000
+#define MIN_CONSENSUS_BANDWIDTH 50
+
+// SAM/BAM files are loaded in blocks of about this many (decompressed) bytes. The records in each
+// block are parsed and tallied in parallel.
+#define SAM_LOADER_BLOCK_BYTES 16777216
@@ -0,0 +1,40 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <functional>
+
+
+// Runs func(i, threadIndex) for every i in [0, n) using up to threadCount threads from the
+// process-wide worker pool (the same pool minimap's kt_for uses, so no threads are created per
+// call). threadIndex is less than threadCount and is unique among the threads working on one
+// parallelFor call, so it can be used to index per-call, per-thread scratch space.
+void parallelFor(int threadCount, long n, const std::function<void(long, int)> & func);
+
+
+// Functions that are called by the Python script must have C linkage, not C++ linkage.
+extern "C" {
+
+    // If pin is true, the pool's worker threads are pinned to NUMA nodes, round-robin. This can
+    // help on multi-socket machines but hurts when other jobs share the node, so it is off by
+    // default. It only applies to workers started after the call, so it should be set before any
+    // multi-threaded work.
+    void setThreadPinning(bool pin);
+
+    // Sums i over [0, n) with parallelFor, as a check of the pool. Returns -1 if a thread index
+    // was out of range or shared by two threads at once.
+    long long parallelForSum(int threadCount, long n);
+}
+
+
+#endif // THREAD_POOL_H
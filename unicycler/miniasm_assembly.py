@@ -29,6 +29,7 @@ from .string_graph import StringGraph, StringGraphSegment, \
 from .read_ref import load_references, load_long_reads
 from .unicycler_align import semi_global_align_long_reads
 from . import log
+from . import profiler
 from . import settings
 
 try:
@@ -48,7 +49,8 @@ class MiniasmFailure(Exception):
 
 
 def make_miniasm_string_graph(graph, read_dict, long_read_filename, scoring_scheme, read_nicknames,
-                              counter, args, anchor_segments, existing_long_read_assembly):
+                              counter, args, anchor_segments, existing_long_read_assembly,
+                              read_sketches=None):
     log.log_section_header('Assembling contigs and long reads with miniasm')
     if graph is not None:
         log.log_explanation('Unicycler uses miniasm to construct a string graph assembly using '
@@ -87,7 +89,7 @@ def make_miniasm_string_graph(graph, read_dict, long_read_filename, scoring_sche
     miniasm_read_list = os.path.join(miniasm_dir, 'all_reads.txt')
 
     assembly_read_names = get_miniasm_assembly_reads(graph, read_dict, long_read_filename,
-                                                     miniasm_dir, args.threads)
+                                                     miniasm_dir, args.threads, read_sketches)
 
     # TO DO: identify chimeric reads and throw them out. This was part of miniasm, but it was
     # removed due to 'not working as intended', so I pulled it out of my miniasm as well.
@@ -129,7 +131,8 @@ def make_miniasm_string_graph(graph, read_dict, long_read_filename, scoring_sche
     # Now actually do the miniasm assembly, which will create a GFA file of the string graph.
     log.log('Assembling reads with miniasm... ', end='')
     min_depth = 3
-    miniasm_assembly(assembly_reads_filename, mappings_filename, miniasm_dir, min_depth)
+    miniasm_assembly(assembly_reads_filename, mappings_filename, miniasm_dir, min_depth,
+                     args.threads)
     if not os.path.isfile(string_graph_filename):
         log.log(red('failed'))
         raise MiniasmFailure('miniasm failed to generate a string graph')
@@ -191,9 +194,10 @@ def make_miniasm_string_graph(graph, read_dict, long_read_filename, scoring_sche
                 log.log('')
                 unitig_graph = StringGraph(existing_long_read_assembly)
             else:
-                polish_unitigs_with_racon(unitig_graph, miniasm_dir, read_dict, graph,
-                                          args.racon_path, args.threads, scoring_scheme,
-                                          seg_nums_to_bridge)
+                with profiler.stage('polishing'):
+                    polish_unitigs_with_racon(unitig_graph, miniasm_dir, read_dict, graph,
+                                              args.racon_path, args.threads, scoring_scheme,
+                                              seg_nums_to_bridge)
                 unitig_graph.save_to_gfa(racon_polished_filename)
                 if not short_reads_available and args.keep > 0:
                     unitig_graph.save_to_gfa(gfa_path(args.out, next(counter),
@@ -214,10 +218,12 @@ def make_miniasm_string_graph(graph, read_dict, long_read_filename, scoring_sche
     return unitig_graph
 
 
-def get_miniasm_assembly_reads(graph, read_dict, long_read_filename, miniasm_dir, threads):
+def get_miniasm_assembly_reads(graph, read_dict, long_read_filename, miniasm_dir, threads,
+                               read_sketches=None):
     if graph is not None:  # hybrid assembly
         minimap_alignments = align_long_reads_to_assembly_graph(graph, long_read_filename,
-                                                                miniasm_dir, threads)
+                                                                miniasm_dir, threads,
+                                                                read_sketches)
         miniasm_assembly_reads = []
         for read_name, alignments in minimap_alignments.items():
             if any(a.overlaps_reference() for a in alignments):
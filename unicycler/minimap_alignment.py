@@ -71,8 +71,13 @@ class MinimapAlignment(object):
             self.read_end_gap = self.read_length - self.read_end
 
     def get_concise_string(self):
+        """
+        The minimiser count is included so the C++ alignment code can judge whether the hit is
+        clean enough for its fast path.
+        """
         return ','.join([str(x) for x in [self.read_start, self.read_end, self.read_strand,
-                                          self.ref_name, self.ref_start, self.ref_end]])
+                                          self.ref_name, self.ref_start, self.ref_end,
+                                          self.minimiser_count]])
 
     def __repr__(self):
         return str(self.read_start) + '-' + str(self.read_end) + '(' + self.read_strand + '):' + \
@@ -138,16 +143,18 @@ def alignments_overlap(a, other, allowed_overlap):
     return any(range_overlap(adjusted_start, a.read_end, x.read_start, x.read_end) for x in other)
 
 
-def align_long_reads_to_assembly_graph(graph, long_read_filename, working_dir, threads):
+def align_long_reads_to_assembly_graph(graph, long_read_filename, working_dir, threads,
+                                       read_sketches=None):
     """
     Aligns all long reads to all graph segments and returns a dictionary of alignments (key =
-    read name, value = list of MinimapAlignment objects).
+    read name, value = list of MinimapAlignment objects). The optional read_sketches lets
+    repeated calls share the long reads' minimisers.
     """
     segments_fasta = os.path.join(working_dir, 'all_segments.fasta')
     log.log('Aligning long reads to graph using minimap', 1)
     graph.save_to_fasta(segments_fasta, verbosity=2)
     minimap_alignments_str = minimap_align_reads(segments_fasta, long_read_filename, threads, 3,
-                                                 'default')
+                                                 'default', read_sketches)
     minimap_alignments = \
         load_minimap_alignments(minimap_alignments_str, filter_overlaps=True,
                                 allowed_overlap=settings.ALLOWED_MINIMAP_OVERLAP,
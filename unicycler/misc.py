@@ -39,6 +39,19 @@ REV_COMP_DICT = {'A': 'T', 'T': 'A', 'G': 'C', 'C': 'G',
                  'd': 'h', 'h': 'd', 'n': 'n',
                  '.': '.', '-': '-', '?': '?'}
 
+
+
+class RevCompTable(dict):
+    """
+    A str.translate table built from REV_COMP_DICT. Unknown characters complement to N, like they
+    do in complement_base.
+    """
+    def __missing__(self, key):
+        return 'N'
+
+
+REV_COMP_TABLE = RevCompTable((ord(k), v) for k, v in REV_COMP_DICT.items())
+
 RANDOM_SEQ_DICT = {0: 'A', 1: 'C', 2: 'G', 3: 'T'}
 
 
@@ -154,7 +167,7 @@ def reverse_complement(seq):
     """
     Given a DNA sequences, this function returns the reverse complement sequence.
     """
-    return ''.join([complement_base(x) for x in seq][::-1])
+    return seq.translate(REV_COMP_TABLE)[::-1]
 
 
 def complement_base(base):
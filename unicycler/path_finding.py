@@ -20,7 +20,8 @@ from .misc import weighted_average, reverse_complement, get_num_agreement
 from . import settings
 
 try:
-    from .cpp_wrappers import fully_global_alignment, path_alignment
+    from .cpp_wrappers import fully_global_alignment, path_alignment, \
+        fully_global_alignment_bounds, path_alignment_scaled_score_bound
 except AttributeError as e:
     sys.exit('Error when importing C++ library: ' + str(e) + '\n'
              'Have you successfully built the library file using make?')
@@ -59,31 +60,53 @@ def get_best_paths_for_seq(graph, start_seg, end_seg, target_length, sequence, s
     # Sort by length discrepancy from the target so the closest length matches come first.
     paths = sorted(paths, key=lambda x: abs(target_length - graph.get_bridge_path_length(x)))
 
-    # We now align the consensus to each of the possible paths.
-    paths_and_scores = []
-    for path in paths:
-        path_len = graph.get_bridge_path_length(path)
-        length_discrepancy = abs(path_len - target_length)
-
-        # If there is a consensus sequence, then we actually do an alignment against the path.
-        if sequence:
+    # If there is a consensus sequence, then we actually do an alignment against the paths. Upper
+    # bounds on each path's scores come cheaply from the edit distance, so we align the paths in
+    # order of their raw score bound and stop once no remaining path could have the best raw score.
+    # The rest are only aligned if they could still pass the scaled score filter below.
+    if sequence:
+        paths_and_scores = []
+        skipped_paths = []
+        path_bounds = []
+        for i, path in enumerate(paths):
             path_seq = graph.get_path_sequence(path)
-            alignment_result = fully_global_alignment(sequence, path_seq, scoring_scheme,
-                                                      True, 1000)
-            if not alignment_result:
+            raw_bound, scaled_bound = fully_global_alignment_bounds(sequence, path_seq,
+                                                                    scoring_scheme, True, 1000)
+            path_bounds.append((i, path, path_seq, raw_bound, scaled_bound))
+        path_bounds = sorted(path_bounds, key=lambda x: -x[3])
+        best_raw_score = None
+        for i, path, path_seq, raw_bound, scaled_bound in path_bounds:
+            if best_raw_score is not None and raw_bound < best_raw_score:
+                skipped_paths.append((i, path, path_seq, scaled_bound))
                 continue
-
-            seqan_parts = alignment_result.split(',', 9)
-            raw_score = int(seqan_parts[6])
-            scaled_score = float(seqan_parts[7])
-
-        # If there isn't a consensus sequence (i.e. the start and end overlap), then each
-        # path is only scored on how well its length agrees with the target length.
-        else:
+            path_and_scores = align_to_path(graph, i, path, path_seq, target_length, sequence,
+                                            scoring_scheme)
+            if path_and_scores is not None:
+                paths_and_scores.append(path_and_scores)
+                if best_raw_score is None or path_and_scores[2] > best_raw_score:
+                    best_raw_score = path_and_scores[2]
+        if paths_and_scores:
+            best_scaled_score = min(paths_and_scores, key=lambda x: (-x[2], x[3], -x[4]))[4]
+            for i, path, path_seq, scaled_bound in skipped_paths:
+                if scaled_bound >= best_scaled_score * 0.95:
+                    path_and_scores = align_to_path(graph, i, path, path_seq, target_length,
+                                                    sequence, scoring_scheme)
+                    if path_and_scores is not None:
+                        paths_and_scores.append(path_and_scores)
+
+        # Restore the length discrepancy order, so ties are broken the same way as if every path
+        # had been aligned.
+        paths_and_scores = [x[1:] for x in sorted(paths_and_scores, key=lambda x: x[0])]
+
+    # If there isn't a consensus sequence (i.e. the start and end overlap), then each path is only
+    # scored on how well its length agrees with the target length.
+    else:
+        paths_and_scores = []
+        for path in paths:
+            path_len = graph.get_bridge_path_length(path)
+            length_discrepancy = abs(path_len - target_length)
             raw_score = get_num_agreement(path_len, target_length) * 100.0
-            scaled_score = 100.0
-
-        paths_and_scores.append((path, raw_score, length_discrepancy, scaled_score))
+            paths_and_scores.append((path, raw_score, length_discrepancy, 100.0))
 
     # Sort the paths from highest to lowest quality.
     paths_and_scores = sorted(paths_and_scores, key=lambda x: (-x[1], x[2], -x[3]))
@@ -97,6 +120,21 @@ def get_best_paths_for_seq(graph, start_seg, end_seg, target_length, sequence, s
     return paths_and_scores, progressive_path_search
 
 
+def align_to_path(graph, i, path, path_seq, target_length, sequence, scoring_scheme):
+    """
+    Aligns the sequence to the path and returns a tuple of the path's index, the path, its raw
+    score, its length discrepancy and its scaled score (or None if the alignment failed).
+    """
+    alignment_result = fully_global_alignment(sequence, path_seq, scoring_scheme, True, 1000)
+    if not alignment_result:
+        return None
+    seqan_parts = alignment_result.split(',', 9)
+    raw_score = int(seqan_parts[6])
+    scaled_score = float(seqan_parts[7])
+    length_discrepancy = abs(graph.get_bridge_path_length(path) - target_length)
+    return i, path, raw_score, length_discrepancy, scaled_score
+
+
 def all_paths(graph, start, end, min_length, max_length):
     """
     Returns a list of all paths which connect the starting segment to the ending segment and
@@ -328,14 +366,30 @@ def cull_paths(graph, paths, sequence, scoring_scheme, expected_scaled_score, cu
     scored_paths = []
     shortest_len = min(graph.get_path_length(x[1:]) for x in paths)
     seq_after_common_path = sequence[seq_align_start:]
+    # A path whose scaled score bound (from the edit distance) is well below the best score so far
+    # can't survive the cull, so it isn't aligned. The skip threshold is no higher than the one in
+    # the wrong turn check below, so skipped paths still count as bad scores there.
+    skip_fraction = min(cull_score_fraction, 0.95)
+    best_score_so_far = None
+    lowest_skipped_bound = None
     for path in paths:
         path_seq_after_common_path = \
             graph.get_path_sequence(path[1:])[path_align_start:shortest_len]
+        if best_score_so_far is not None:
+            scaled_bound = path_alignment_scaled_score_bound(path_seq_after_common_path,
+                                                             seq_after_common_path,
+                                                             scoring_scheme, True, 500)
+            if scaled_bound < best_score_so_far * skip_fraction:
+                if lowest_skipped_bound is None or scaled_bound < lowest_skipped_bound:
+                    lowest_skipped_bound = scaled_bound
+                continue
         alignment_result = path_alignment(path_seq_after_common_path, seq_after_common_path,
                                           scoring_scheme, True, 500)
         if alignment_result:
             scaled_score = float(alignment_result.split(',', 8)[7])
             scored_paths.append((path, scaled_score))
+            if best_score_so_far is None or scaled_score > best_score_so_far:
+                best_score_so_far = scaled_score
 
     scored_paths = sorted(scored_paths, key=lambda x: x[1], reverse=True)
     if not scored_paths:
@@ -346,6 +400,8 @@ def cull_paths(graph, paths, sequence, scoring_scheme, expected_scaled_score, cu
     # expectation and isn't that much better than the worst one.
     best_score = scored_paths[0][1]
     worst_score = scored_paths[-1][1]
+    if lowest_skipped_bound is not None:
+        worst_score = min(worst_score, lowest_skipped_bound)
     if best_score < 0.9 * expected_scaled_score and best_score * 0.95 < worst_score:
         return []
 
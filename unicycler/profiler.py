@@ -0,0 +1,249 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Unicycler
+
+This module contains a profiler which records the time and memory used by each stage of the
+Unicycler pipeline, including how much of the time was spent in the C++ library.
+
+This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Unicycler is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Unicycler. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import json
+import os
+import resource
+import sys
+import threading
+import time
+from contextlib import contextmanager
+
+
+class StageRecord(object):
+    """
+    This class holds the measurements for one stage of the pipeline.
+    """
+    def __init__(self, name, native_wall):
+        self.name = name
+        self.start_wall = time.perf_counter()
+        self.start_cpu = time.process_time()
+        self.start_child_cpu = get_child_cpu_time()
+        self.start_native_wall = native_wall
+        self.wall_seconds = 0.0
+        self.cpu_seconds = 0.0
+        self.child_cpu_seconds = 0.0
+        self.native_wall_seconds = 0.0
+        self.peak_rss_kb = 0
+        self.native_calls = {}  # C++ function name -> [call count, summed seconds]
+
+    def finish(self, native_wall):
+        self.wall_seconds = time.perf_counter() - self.start_wall
+        self.cpu_seconds = time.process_time() - self.start_cpu
+        self.child_cpu_seconds = get_child_cpu_time() - self.start_child_cpu
+        self.native_wall_seconds = native_wall - self.start_native_wall
+
+    def to_dict(self):
+        native_call_seconds = sum(x[1] for x in self.native_calls.values())
+        return {'name': self.name,
+                'wall_seconds': round(self.wall_seconds, 3),
+                'cpu_seconds': round(self.cpu_seconds, 3),
+                'child_cpu_seconds': round(self.child_cpu_seconds, 3),
+                'peak_rss_mb': round(self.peak_rss_kb / 1024, 1),
+                'native_wall_seconds': round(self.native_wall_seconds, 3),
+                'python_wall_seconds': round(self.wall_seconds - self.native_wall_seconds, 3),
+                'native_call_seconds': round(native_call_seconds, 3),
+                'native_calls': {name: {'calls': x[0], 'seconds': round(x[1], 3)}
+                                 for name, x in sorted(self.native_calls.items())}}
+
+
+class TimedFunction(object):
+    """
+    This class wraps a ctypes function so the profiler can count and time calls to it.
+    """
+    def __init__(self, name, function, stage_profiler):
+        self.name = name
+        self.function = function
+        self.stage_profiler = stage_profiler
+
+    def __call__(self, *args):
+        start = self.stage_profiler.native_call_started()
+        try:
+            return self.function(*args)
+        finally:
+            self.stage_profiler.native_call_finished(self.name, start)
+
+
+class StageProfiler(object):
+    """
+    This class records the wall time, CPU time, peak RSS and C++ library usage of each pipeline
+    stage. Stages started with begin_stage follow one another, and a stage can contain nested
+    stages (using the stage context manager).
+
+    Native wall time is the time when at least one thread was in a C++ function, so it doesn't
+    double count parallel calls. Native call seconds are summed over all calls (and so can exceed
+    the wall time when calls run in parallel). CPU time includes all threads, and child CPU time
+    is for external tools (SPAdes, Racon, BLAST).
+
+    The profiler starts disabled, and while disabled its stage functions do nothing, so the C++
+    calls aren't wrapped and no report is saved. Unicycler enables it with --profile.
+    """
+    def __init__(self, enabled=False):
+        self.enabled = enabled
+        self.lock = threading.Lock()
+        self.open_stages = []
+        self.stages = []
+        self.instrumented = False
+        self.active_native_calls = 0
+        self.native_wall = 0.0
+        self.native_wall_start = 0.0
+
+    def enable(self):
+        self.enabled = True
+        self.instrument()
+
+    def instrument(self):
+        """
+        Replaces each of the C++ library's functions (which ctypes caches as attributes once set
+        up in cpp_wrappers) with a timed wrapper.
+        """
+        if self.instrumented:
+            return
+        self.instrumented = True
+        from .cpp_wrappers import C_LIB
+        for name, function in list(vars(C_LIB).items()):
+            if isinstance(function, C_LIB._FuncPtr):
+                setattr(C_LIB, name, TimedFunction(name, function, self))
+
+    def get_native_wall(self):
+        if self.active_native_calls > 0:
+            return self.native_wall + time.perf_counter() - self.native_wall_start
+        return self.native_wall
+
+    def native_call_started(self):
+        with self.lock:
+            start = time.perf_counter()
+            if self.active_native_calls == 0:
+                self.native_wall_start = start
+            self.active_native_calls += 1
+            return start
+
+    def native_call_finished(self, name, start):
+        with self.lock:
+            end = time.perf_counter()
+            self.active_native_calls -= 1
+            if self.active_native_calls == 0:
+                self.native_wall += end - self.native_wall_start
+            if self.open_stages:
+                calls = self.open_stages[-1].native_calls.setdefault(name, [0, 0.0])
+                calls[0] += 1
+                calls[1] += end - start
+
+    def update_peak_rss(self):
+        peak_rss_kb = get_peak_rss_kb()
+        for stage in self.open_stages:
+            stage.peak_rss_kb = max(stage.peak_rss_kb, peak_rss_kb)
+
+    def push_stage(self, name):
+        if not self.enabled:
+            return
+        with self.lock:
+            self.update_peak_rss()
+            reset_peak_rss()
+            if self.open_stages:
+                name = self.open_stages[-1].name + '/' + name
+            stage = StageRecord(name, self.get_native_wall())
+            self.open_stages.append(stage)
+            self.stages.append(stage)
+
+    def pop_stage(self):
+        if not self.enabled:
+            return
+        with self.lock:
+            self.update_peak_rss()
+            self.open_stages.pop().finish(self.get_native_wall())
+
+    def begin_stage(self, name):
+        self.end_stage()
+        self.push_stage(name)
+
+    def end_stage(self):
+        while self.open_stages:
+            self.pop_stage()
+
+    def save_report(self, filename):
+        if not self.enabled:
+            return
+        self.end_stage()
+        stages = [x.to_dict() for x in self.stages]
+        top_level = [x for x in stages if '/' not in x['name']]
+        total = {'wall_seconds': round(sum(x['wall_seconds'] for x in top_level), 3),
+                 'cpu_seconds': round(sum(x['cpu_seconds'] for x in top_level), 3),
+                 'child_cpu_seconds': round(sum(x['child_cpu_seconds'] for x in top_level), 3),
+                 'peak_rss_mb': max([x['peak_rss_mb'] for x in top_level], default=0.0),
+                 'native_wall_seconds': round(sum(x['native_wall_seconds']
+                                                  for x in top_level), 3)}
+        with open(filename, 'wt') as report:
+            json.dump({'total': total, 'stages': stages}, report, indent=2)
+            report.write('\n')
+
+
+def get_child_cpu_time():
+    times = os.times()
+    return times.children_user + times.children_system
+
+
+def get_peak_rss_kb():
+    """
+    On Linux, this reads the high water mark (which reset_peak_rss can reset), so the peak is for
+    the current stage. Elsewhere it is the peak for the whole run so far.
+    """
+    try:
+        with open('/proc/self/status', 'rt') as status:
+            for line in status:
+                if line.startswith('VmHWM:'):
+                    return int(line.split()[1])
+    except (OSError, ValueError, IndexError):
+        pass
+    peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    return peak // 1024 if sys.platform == 'darwin' else peak  # bytes on macOS
+
+
+def reset_peak_rss():
+    try:
+        with open('/proc/self/clear_refs', 'wt') as clear_refs:
+            clear_refs.write('5')
+    except OSError:
+        pass
+
+
+# This is the one and only instance of the StageProfiler class.
+profiler = StageProfiler()
+
+
+def enable():
+    profiler.enable()
+
+
+def begin_stage(name):
+    profiler.begin_stage(name)
+
+
+def end_stage():
+    profiler.end_stage()
+
+
+@contextmanager
+def stage(name):
+    profiler.push_stage(name)
+    try:
+        yield
+    finally:
+        profiler.pop_stage()
+
+
+def save_report(filename):
+    profiler.save_report(filename)
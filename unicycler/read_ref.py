@@ -281,6 +281,10 @@ class Read(object):
 
         self.alignments = []
 
+        # Set when the read was found to be contamination before alignment (so it has no
+        # alignments to contamination references).
+        self.screened_as_contamination = False
+
     def __repr__(self):
         return self.name + ' (' + str(len(self.sequence)) + ' bp)'
 
@@ -384,10 +388,13 @@ class Read(object):
 
     def mostly_aligns_to_contamination(self):
         """
-        Returns true if 50% or more of the alignments are to contaminant sequences.
+        Returns true if 50% or more of the alignments are to contaminant sequences, or if the read
+        was screened out as contamination before alignment.
         """
         if len(self.sequence) == 0:
             return False
+        if self.screened_as_contamination:
+            return True
         if not self.alignments:
             return False
         contamination_alignment_length = sum(x.get_aligned_read_length() for x in self.alignments
@@ -174,3 +174,19 @@ REQUIRED_MINIASM_ASSEMBLY_SIZE_FOR_BRIDGING = 0.5
 MAX_MINIASM_DEAD_END_TRIM_SIZE = 100
 
 MAX_SIMPLE_LOOP_SIZE = 10000
+
+# Pipeline checkpoints are pickled, and deeply linked objects (e.g. long chains of string graph
+# segments) can exceed Python's default recursion limit. The limit is raised to this value while
+# a checkpoint is being saved.
+CHECKPOINT_RECURSION_LIMIT = 100000
+
+# Input files are hashed (to validate checkpoints) in chunks of this many bytes.
+CHECKPOINT_HASH_CHUNK_SIZE = 1048576
+
+# The SPAdes k-mer range and the fallback insert size are chosen from the short read lengths. To
+# keep this fast on large read sets, only the first READ_PROFILE_MAX_READS reads of each file are
+# looked at (the rest of the file's reads are counted by estimate) and a seeded random sample of at
+# most READ_LENGTH_SAMPLE_SIZE lengths is taken across all of the files, with each file contributing
+# in proportion to its read count.
+READ_LENGTH_SAMPLE_SIZE = 1000000
+READ_PROFILE_MAX_READS = 2000000
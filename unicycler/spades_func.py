@@ -15,14 +15,23 @@ not, see <http://www.gnu.org/licenses/>.
 
 import os
 import subprocess
-import gzip
+import random
 import shutil
 import statistics
+import sys
+from concurrent.futures import ThreadPoolExecutor
 
-from .misc import round_to_nearest_odd, get_compression_type, int_to_str, quit_with_error, \
+from .misc import round_to_nearest_odd, int_to_str, quit_with_error, \
     bold, dim, print_table, get_left_arrow, float_to_str
 from .assembly_graph import AssemblyGraph
 from . import log
+from . import settings
+
+try:
+    from .cpp_wrappers import profile_reads
+except AttributeError as att_err:
+    sys.exit('Error when importing C++ library: ' + str(att_err) + '\n'
+             'Have you successfully built the library file using make?')
 
 
 class BadFastq(Exception):
@@ -204,8 +213,9 @@ def run_spades_all_kmers(read_files, spades_dir, kmers, threads, spades_path, sp
     else:
         # If we couldn't get the insert size from the SPAdes output (e.g. it was an
         # unpaired-reads-only assembly), we'll use the read length instead.
-        read_lengths = get_read_lengths(short1) + get_read_lengths(short2) + \
-                       get_read_lengths(unpaired)
+        read_lengths = get_read_lengths_of_files([short1, short2, unpaired],
+                                                 settings.READ_LENGTH_SAMPLE_SIZE,
+                                                 settings.READ_PROFILE_MAX_READS)
         insert_size_mean = statistics.mean(read_lengths)
         insert_size_deviation = max(statistics.stdev(read_lengths), 1.0)
 
@@ -283,13 +293,16 @@ def check_fastqs(short1, short2, short_unpaired):
     using_paired_reads = bool(short1) and bool(short2)
     using_unpaired_reads = bool(short_unpaired)
     if using_paired_reads:
+        with ThreadPoolExecutor(max_workers=2) as executor:
+            future_1 = executor.submit(get_read_count, short1)
+            future_2 = executor.submit(get_read_count, short2)
         count_1, count_2 = 0, 0
         try:
-            count_1 = get_read_count(short1)
+            count_1 = future_1.result()
         except BadFastq:
             quit_with_error('this read file is not a properly formatted FASTQ: ' + short1)
         try:
-            count_2 = get_read_count(short2)
+            count_2 = future_2.result()
         except BadFastq:
             quit_with_error('this read file is not a properly formatted FASTQ: ' + short2)
         if count_1 != count_2:
@@ -357,8 +370,10 @@ def get_kmer_range(given_kmers, reads_1_filename, reads_2_filename, unpaired_rea
 
     # If the code got here, then the k-mer range doesn't already exist and we'll create one by
     # examining the read lengths.
-    read_lengths = get_read_lengths(reads_1_filename) + get_read_lengths(reads_2_filename) + \
-        get_read_lengths(unpaired_reads_filename)
+    read_lengths = get_read_lengths_of_files([reads_1_filename, reads_2_filename,
+                                              unpaired_reads_filename],
+                                             settings.READ_LENGTH_SAMPLE_SIZE,
+                                             settings.READ_PROFILE_MAX_READS)
     read_lengths = sorted(read_lengths)
     median_read_length = read_lengths[len(read_lengths) // 2 - 1]
     max_kmer = round_to_nearest_odd(max_kmer_frac * median_read_length)
@@ -392,24 +407,14 @@ def get_kmer_range(given_kmers, reads_1_filename, reads_2_filename, unpaired_rea
     return kmer_range
 
 
-def get_read_lengths(reads_filename):
+def get_read_lengths(reads_filename, sample_size=0):
     """
-    Returns a list of the read lengths for the given read file.
+    Returns a list of the read lengths for the given read file. If sample_size is more than 0, the
+    list is a seeded random sample of at most that many lengths.
     """
     if reads_filename is None:
         return []
-    if get_compression_type(reads_filename) == 'gz':
-        open_func = gzip.open
-    else:  # plain text
-        open_func = open
-    with open_func(reads_filename, 'rb') as reads:
-        read_lengths = []
-        i = 0
-        for line in reads:
-            if i % 4 == 1:
-                read_lengths.append(len(line.strip()))
-            i += 1
-    return read_lengths
+    return profile_reads(reads_filename, sample_size=sample_size)[3]
 
 
 def get_read_count(reads_filename):
@@ -418,24 +423,47 @@ def get_read_count(reads_filename):
     """
     if reads_filename is None:
         return 0
-    if get_compression_type(reads_filename) == 'gz':
-        open_func = gzip.open
-    else:  # plain text
-        open_func = open
-    with open_func(reads_filename, 'rb') as reads:
-        read_count = 0
-        i = 0
-        for line in reads:
-            if i % 4 == 0:
-                try:
-                    assert line.startswith(b'@')
-                except AssertionError:
-                    raise BadFastq
-                read_count += 1
-            i += 1
+    read_count, _, valid, _ = profile_reads(reads_filename, sample_size=1)
+    if not valid:
+        raise BadFastq
     return read_count
 
 
+def get_read_lengths_of_files(reads_filenames, sample_size=0, max_reads=0):
+    """
+    Returns the read lengths of all of the given read files combined. The files are read in
+    parallel, as the C++ profiler releases the GIL while it decompresses and parses.
+
+    If max_reads is more than 0, only that many reads are looked at in each file. If sample_size is
+    more than 0, the result is a seeded random sample of at most that many lengths. Either way, each
+    file's share of the result is in proportion to its (possibly estimated) read count, so a small
+    file doesn't count for more than its reads.
+    """
+    with ThreadPoolExecutor(max_workers=max(len(reads_filenames), 1)) as executor:
+        profiles = executor.map(lambda f: profile_reads(f, max_reads, sample_size)
+                                if f is not None else (0, True, True, []), reads_filenames)
+    profiles = [(count, lengths) for count, _, _, lengths in profiles if count > 0 and lengths]
+    if not profiles:
+        return []
+    total_count = sum(count for count, _ in profiles)
+
+    # The largest combined sample for which every file can supply its share.
+    combined_size = min(len(lengths) * total_count / count for count, lengths in profiles)
+    if sample_size > 0:
+        combined_size = min(combined_size, sample_size)
+
+    rand = random.Random(0)
+    read_lengths = []
+    for count, lengths in profiles:
+        share = int(round(combined_size * count / total_count))
+        share = min(share, len(lengths))
+        if share == len(lengths):
+            read_lengths += lengths
+        else:
+            read_lengths += rand.sample(lengths, share)
+    return read_lengths
+
+
 def count_segments_in_gfa(fastg_file):
     seq_count = 0
     with open(fastg_file, 'rt') as fastg:
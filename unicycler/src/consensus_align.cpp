@@ -11,6 +11,7 @@
 
 #include "consensus_align.h"
 
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <cmath>
@@ -20,6 +21,7 @@
 #include <seqan/graph_msa.h>
 #include "semi_global_align.h"
 #include "string_functions.h"
+#include "memory_budget.h"
 
 using namespace seqan;
 
@@ -55,6 +57,19 @@ char * multipleSequenceAlignment(char * sequences[], char * qualities[], unsigne
     msaOpt.pairwiseAlignmentMethod = 2; // banded
     msaOpt.bandWidth = bandwidth;
 
+    // With a memory budget, the band is narrowed so one pairwise alignment's DP matrix fits, and
+    // the consensus's memory (the alignment graph is roughly a DP matrix for each sequence) is
+    // reserved before it runs.
+    long long maxLength = 0, totalLength = 0;
+    for (auto const & s : ungappedSequences) {
+        maxLength = std::max(maxLength, (long long)s.length());
+        totalLength += s.length();
+    }
+    long long maxBandCells = budgetedCount((long long)bandwidth * 2 + 1, DP_CELL_BYTES * maxLength,
+                                           MIN_CONSENSUS_BANDWIDTH * 2 + 1);
+    msaOpt.bandWidth = (unsigned int)((maxBandCells - 1) / 2);
+    MemoryReservation reservation(totalLength * (2 * msaOpt.bandWidth + 1) * DP_CELL_BYTES);
+
     globalMsaAlignment(gAlign, sequenceSet, sequenceNames, msaOpt);
     convertAlignment(gAlign, align);
 
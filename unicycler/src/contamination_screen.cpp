@@ -0,0 +1,144 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#include "contamination_screen.h"
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+#include "string_functions.h"
+#include "thread_pool.h"
+#include "settings.h"
+
+
+MinimiserSketch::MinimiserSketch(const mm_sketch_set_t * sketchSet) :
+    m_k(sketchSet->k) {
+    uint64_t minimiserCount = sketchSet->offset[sketchSet->n];
+    m_hashes.reserve(minimiserCount);
+    for (uint64_t j = 0; j < minimiserCount; ++j)
+        m_hashes.insert(uint32_t(sketchSet->a[j] >> 32));
+}
+
+
+// Scores read i of the sketch set against this sketch. The containment is the fraction of the
+// read's minimisers found in the sketch. The coverage is the fraction of the read's bases in runs
+// of those minimisers, where a run ends at a gap of more than CONTAMINATION_SCREEN_MAX_GAP bases
+// between them.
+void MinimiserSketch::scoreRead(const mm_sketch_set_t * reads, uint32_t i,
+                                double & containment, double & coverage) const {
+    containment = 0.0;
+    coverage = 0.0;
+    uint64_t start = reads->offset[i], end = reads->offset[i+1];
+    int readLength = reads->len[i];
+    if (end == start || readLength <= 0)
+        return;
+
+    std::vector<int> hitPositions;
+    for (uint64_t j = start; j < end; ++j) {
+        if (m_hashes.find(uint32_t(reads->a[j] >> 32)) != m_hashes.end())
+            hitPositions.push_back(int((uint32_t(reads->a[j]) >> 1)));
+    }
+    containment = double(hitPositions.size()) / double(end - start);
+    if (hitPositions.empty())
+        return;
+
+    // Each hit covers its k-mer, which ends at the hit's position.
+    std::sort(hitPositions.begin(), hitPositions.end());
+    long long coveredBases = 0;
+    int runStart = hitPositions[0] - m_k + 1, runEnd = hitPositions[0] + 1;
+    for (size_t j = 1; j < hitPositions.size(); ++j) {
+        int kmerStart = hitPositions[j] - m_k + 1;
+        if (kmerStart - runEnd > CONTAMINATION_SCREEN_MAX_GAP) {
+            coveredBases += runEnd - runStart;
+            runStart = kmerStart;
+        }
+        runEnd = hitPositions[j] + 1;
+    }
+    coveredBases += runEnd - runStart;
+    coverage = std::min(1.0, double(coveredBases) / double(readLength));
+}
+
+
+// Returns the fraction of read i's minimisers which are in this sketch.
+double MinimiserSketch::getContainment(const mm_sketch_set_t * reads, uint32_t i) const {
+    uint64_t start = reads->offset[i], end = reads->offset[i+1];
+    if (end == start)
+        return 0.0;
+    uint64_t hits = 0;
+    for (uint64_t j = start; j < end; ++j) {
+        if (m_hashes.find(uint32_t(reads->a[j] >> 32)) != m_hashes.end())
+            ++hits;
+    }
+    return double(hits) / double(end - start);
+}
+
+
+// This function screens long reads for known contamination (e.g. lambda phage) before they are
+// aligned. It returns one line per read which is clearly a contaminant: the read name, its
+// containment in the contamination, its containment in the target references and its coverage,
+// tab-delimited. A read is a contaminant if at least CONTAMINATION_SCREEN_MIN_CONTAINMENT of its
+// minimisers are in the contamination, runs of them cover at least
+// CONTAMINATION_SCREEN_MIN_COVERAGE of the read, and its contamination containment is at least
+// CONTAMINATION_SCREEN_MIN_CONTAINMENT_RATIO times its target containment (so reads from a target
+// which resembles the contamination aren't dropped). The minimisers use minimap's level 0 k-mer
+// and window sizes, so if readSketches is given its cached read minimisers are used.
+char * screenContamination(char * contaminationFasta, char * targetFasta, char * readsFastq,
+                           ReadSketches * readSketches, int n_threads) {
+    int k = LEVEL_0_MINIMAP_KMER_SIZE;
+    int w = int(.6666667 * k + .499);  // 2/3 of k
+    int tbatch_size = int(minimapReadBatchSize());
+
+    mm_sketch_set_t * contaminationSketchSet = mm_sketch_file(contaminationFasta, w, k, n_threads,
+                                                              tbatch_size);
+    if (contaminationSketchSet == 0)
+        return cppStringToCString("");
+    MinimiserSketch contamination(contaminationSketchSet);
+    mm_sketch_set_destroy(contaminationSketchSet);
+
+    // If the target references can't be read, every read's target containment is zero.
+    MinimiserSketch target;
+    mm_sketch_set_t * targetSketchSet = mm_sketch_file(targetFasta, w, k, n_threads, tbatch_size);
+    if (targetSketchSet != 0) {
+        target = MinimiserSketch(targetSketchSet);
+        mm_sketch_set_destroy(targetSketchSet);
+    }
+
+    mm_sketch_set_t * reads = 0;
+    bool ownReads = false;
+    if (readSketches != 0)
+        reads = readSketches->getSketchSet(w, k, n_threads, tbatch_size);
+    if (reads == 0) {
+        reads = mm_sketch_file(readsFastq, w, k, n_threads, tbatch_size);
+        ownReads = true;
+    }
+    if (reads == 0)
+        return cppStringToCString("");
+
+    std::vector<double> containments(reads->n), targetContainments(reads->n), coverages(reads->n);
+    parallelFor(n_threads, reads->n, [&](long i, int) {
+        contamination.scoreRead(reads, uint32_t(i), containments[i], coverages[i]);
+        if (containments[i] >= CONTAMINATION_SCREEN_MIN_CONTAINMENT)
+            targetContainments[i] = target.getContainment(reads, uint32_t(i));
+    });
+
+    std::stringstream output;
+    for (uint32_t i = 0; i < reads->n; ++i) {
+        if (containments[i] >= CONTAMINATION_SCREEN_MIN_CONTAINMENT &&
+                coverages[i] >= CONTAMINATION_SCREEN_MIN_COVERAGE &&
+                containments[i] >= CONTAMINATION_SCREEN_MIN_CONTAINMENT_RATIO *
+                                   targetContainments[i])
+            output << reads->name[i] << "\t" << containments[i] << "\t" << targetContainments[i]
+                   << "\t" << coverages[i] << "\n";
+    }
+    if (ownReads)
+        mm_sketch_set_destroy(reads);
+    return cppStringToCString(output.str());
+}
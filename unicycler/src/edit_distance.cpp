@@ -0,0 +1,154 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#include "edit_distance.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <math.h>
+#include <vector>
+
+
+// Bases are compared the way Seqan's Dna5 compares them: case doesn't matter and anything other
+// than A, C, G or T is an N (which matches other Ns).
+static int getDna5Code(char base) {
+    switch (base) {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default: return 4;
+    }
+}
+
+
+// Advances one 64-row block of Myers' bit-vector algorithm by one column (the multi-word version
+// described by Hyyro). P and M are the block's positive and negative vertical deltas, hin is the
+// horizontal delta entering the block's top and the returned value is the horizontal delta leaving
+// its outBit row.
+static int advanceBlock(uint64_t & P, uint64_t & M, uint64_t eq, int hin, uint64_t outBit) {
+    uint64_t xv = eq | M;
+    if (hin < 0)
+        eq |= 1;
+    uint64_t xh = (((eq & P) + P) ^ P) | eq;
+    uint64_t ph = M | ~(xh | P);
+    uint64_t mh = P & xh;
+    int hout = 0;
+    if (ph & outBit)
+        hout = 1;
+    else if (mh & outBit)
+        hout = -1;
+    ph <<= 1;
+    mh <<= 1;
+    if (hin < 0)
+        mh |= 1;
+    else if (hin > 0)
+        ph |= 1;
+    P = mh | ~(xv | ph);
+    M = ph & xv;
+    return hout;
+}
+
+
+// This function returns the edit distance (unit cost substitutions and indels) between s1 and s2,
+// only looking at DP cells within the band (diagonal = s1 position - s2 position, as in Seqan). It
+// uses Myers' bit-parallel algorithm, 64 rows of s1 per word, so it is much faster than an affine
+// alignment. Cells just outside the band may still contribute, so the result can be lower than the
+// banded edit distance but never higher: any alignment within the band has at least this many
+// edits. If freeEndGapsInS2 is true, s1 is aligned to the best prefix of s2.
+int bandedEditDistance(const std::string & s1, const std::string & s2,
+                       int lowerDiagonal, int upperDiagonal, bool freeEndGapsInS2) {
+    int n = int(s1.length());
+    int m = int(s2.length());
+    if (n == 0)
+        return freeEndGapsInS2 ? 0 : m;
+    if (m == 0)
+        return n;
+
+    // The band must contain both the start and end of the alignment.
+    lowerDiagonal = std::min(lowerDiagonal, std::min(0, n - m));
+    upperDiagonal = std::max(upperDiagonal, std::max(0, n - m));
+
+    int blockCount = (n + 63) / 64;
+    std::vector<uint64_t> peq(5 * size_t(blockCount), 0);
+    for (int i = 0; i < n; ++i)
+        peq[size_t(getDna5Code(s1[i])) * blockCount + i / 64] |= uint64_t(1) << (i % 64);
+
+    // Each block's score is the DP value at its bottom row (row n for the last block).
+    std::vector<uint64_t> P(size_t(blockCount), ~uint64_t(0)), M(size_t(blockCount), 0);
+    std::vector<int> score(size_t(blockCount), 0);
+    std::vector<uint64_t> outBit(size_t(blockCount), uint64_t(1) << 63);
+    outBit[blockCount - 1] = uint64_t(1) << ((n - 1) % 64);
+    auto bottomRow = [&](int b) { return std::min(64 * (b + 1), n); };
+
+    int firstBlock = 0, lastBlock = 0;
+    score[0] = bottomRow(0);
+    int best = n;  // aligning s1 to none of s2
+    for (int v = 1; v <= m; ++v) {
+
+        // Rows v + lowerDiagonal to v + upperDiagonal are in the band for this column. Blocks are
+        // added below as the band moves down, starting as though reached by vertical steps.
+        int rowLo = std::max(1, v + lowerDiagonal - 1);
+        int rowHi = std::min(n, v + upperDiagonal);
+        int newLastBlock = (rowHi - 1) / 64;
+        while (lastBlock < newLastBlock) {
+            ++lastBlock;
+            score[lastBlock] = score[lastBlock - 1] + bottomRow(lastBlock) - bottomRow(lastBlock - 1);
+        }
+        firstBlock = std::min(std::max(firstBlock, (rowLo - 1) / 64), lastBlock);
+
+        const uint64_t * eq = peq.data() + size_t(getDna5Code(s2[v - 1])) * blockCount;
+        int hin = 1;  // the top row's value goes up by one per column
+        for (int b = firstBlock; b <= lastBlock; ++b) {
+            hin = advanceBlock(P[b], M[b], eq[b], hin, outBit[b]);
+            score[b] += hin;
+        }
+        if (lastBlock == blockCount - 1)
+            best = std::min(best, score[lastBlock]);
+    }
+    return freeEndGapsInS2 ? best : score[blockCount - 1];
+}
+
+
+// This function gives the highest raw score a global alignment between sequences of the given
+// lengths could have if it needs at least editDistance edits. The length difference must be made
+// up with gaps, and each further edit costs at least a mismatch or half of an extra
+// insertion/deletion pair, whichever is cheaper. Gap opens are ignored, so the bound is loose for
+// gappy alignments, but it is never lower than the real score.
+int rawScoreUpperBound(int editDistance, int length1, int length2,
+                       int matchScore, int mismatchScore, int gapOpenScore, int gapExtensionScore) {
+    int gapScore = std::max(gapOpenScore, gapExtensionScore);
+    int lengthDifference = std::abs(length1 - length2);
+    double bound = double(matchScore) * std::min(length1, length2) +
+                   double(gapScore) * lengthDifference;
+    int extraEdits = std::max(0, editDistance - lengthDifference);
+    double costPerEdit = std::min(double(matchScore - mismatchScore),
+                                  (matchScore - 2.0 * gapScore) / 2.0);
+    bound -= extraEdits * std::max(costPerEdit, 0.0);
+    return int(floor(bound));
+}
+
+
+// This function gives the highest scaled score (as in ScoredAlignment) an alignment with at most
+// maxMatches matches and at least minEdits edits could have. A match column scores best and an
+// edit column at best scores as a gap extension, so the bound comes from the most matches and the
+// fewest edits.
+double scaledScoreUpperBound(int maxMatches, int minEdits,
+                             int matchScore, int mismatchScore, int gapOpenScore,
+                             int gapExtensionScore) {
+    double matchGain = matchScore - mismatchScore;
+    double editGain = std::max(0, std::max(gapOpenScore, gapExtensionScore) - mismatchScore);
+    if (matchGain <= 0.0 || editGain >= matchGain || maxMatches + minEdits <= 0)
+        return 100.0;
+    return 100.0 * (matchGain * maxMatches + editGain * minEdits) /
+           (matchGain * (maxMatches + minEdits));
+}
@@ -13,6 +13,8 @@
 
 #include <seqan/align.h>
 #include "semi_global_align.h"
+#include "memory_budget.h"
+#include "edit_distance.h"
 
 
 
@@ -52,6 +54,14 @@ ScoredAlignment * fullyGlobalAlignment(std::string s1, std::string s2,
     assignSource(row(alignment, 1), sequenceV);
     Score<int, Simple> scoringScheme(matchScore, mismatchScore, gapExtensionScore, gapOpenScore);
 
+    // The DP matrix's memory is reserved from the budget, and an alignment too big for the
+    // budget fails.
+    long long dpBytes = dpMatrixCells(s1.length(), s2.length(), useBanding, bandSize) *
+                        DP_CELL_BYTES;
+    if (!fitsInMemoryBudget(dpBytes))
+        return 0;
+    MemoryReservation reservation(dpBytes);
+
     AlignConfig<false, false, false, false> alignConfig;
     if (useBanding) {
         int lowerDiagonal = -bandSize;
@@ -90,3 +100,38 @@ ScoredAlignment * fullyGlobalAlignment(std::string s1, std::string s2,
 }
 
 
+// This function returns upper bounds on the raw and scaled scores that fullyGlobalAlignment would
+// give (comma-delimited). They come from the banded edit distance, which is much faster than the
+// alignment, so candidates which can't beat the best alignment so far can be skipped.
+char * fullyGlobalAlignmentBounds(char * s1, char * s2,
+                                  int matchScore, int mismatchScore, int gapOpenScore,
+                                  int gapExtensionScore, bool useBanding, int bandSize) {
+    std::string sequence1(s1);
+    std::string sequence2(s2);
+    int rawBound;
+    double scaledBound;
+    fullyGlobalAlignmentBounds(sequence1, sequence2, matchScore, mismatchScore, gapOpenScore,
+                               gapExtensionScore, useBanding, bandSize, rawBound, scaledBound);
+    return cppStringToCString(std::to_string(rawBound) + "," + std::to_string(scaledBound));
+}
+
+void fullyGlobalAlignmentBounds(std::string & s1, std::string & s2,
+                                int matchScore, int mismatchScore, int gapOpenScore,
+                                int gapExtensionScore, bool useBanding, int bandSize,
+                                int & rawBound, double & scaledBound) {
+    int length1 = int(s1.length()), length2 = int(s2.length());
+
+    // This matches the band used in fullyGlobalAlignment.
+    int lowerDiagonal = -length2, upperDiagonal = length1;
+    if (useBanding) {
+        lowerDiagonal = -bandSize - std::max(0, length2 - length1);
+        upperDiagonal = bandSize + std::max(0, length1 - length2);
+    }
+    int editDistance = bandedEditDistance(s1, s2, lowerDiagonal, upperDiagonal, false);
+    rawBound = rawScoreUpperBound(editDistance, length1, length2, matchScore, mismatchScore,
+                                  gapOpenScore, gapExtensionScore);
+    scaledBound = scaledScoreUpperBound(std::min(length1, length2),
+                                        std::max(editDistance, std::abs(length1 - length2)),
+                                        matchScore, mismatchScore, gapOpenScore,
+                                        gapExtensionScore);
+}
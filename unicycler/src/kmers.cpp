@@ -19,69 +19,69 @@ CommonKmer::CommonKmer(int hPosition, int vPosition) :
 }
 
 
-// This is the destructor for KmerPositions. It cleans up all the KmerPosMaps which were allocated
-// on the heap.
-KmerPositions::~KmerPositions() {
-    for (std::unordered_map<std::string, KmerPosMap *>::iterator i = m_kmerPositions.begin(); i != m_kmerPositions.end(); ++i)
-        delete i->second;
-}
-
 // Returns a vector all of k-mer position names (should be exact the same as the the sequence names).
-std::vector<std::string> KmerPositions::getAllNames() {
+std::vector<std::string> KmerPositions::getAllNames() const {
     std::vector<std::string> returnVector;
-    m_mutex.lock();
-    for (std::unordered_map<std::string, KmerPosMap *>::iterator i = m_kmerPositions.begin(); i != m_kmerPositions.end(); ++i)
-        returnVector.push_back(i->first);
-    m_mutex.unlock();
+    for (auto const & entry : m_entries)
+        returnVector.push_back(entry->name);
     return returnVector;
 }
 
+// Returns the handle for the sequence with the given name, or -1 if it isn't present.
+int KmerPositions::getHandle(std::string & name) const {
+    auto i = m_handles.find(name);
+    if (i == m_handles.end())
+        return -1;
+    return i->second;
+}
+
 // Returns the length of the sequence with the given name.
-int KmerPositions::getLength(std::string & name) {
-    int returnedLength = 0;
-    m_mutex.lock();
-    if (m_sequences.find(name) != m_sequences.end())
-        returnedLength = m_sequences[name].length();
-    m_mutex.unlock();
-    return returnedLength;
+int KmerPositions::getLength(std::string & name) const {
+    int handle = getHandle(name);
+    if (handle < 0)
+        return 0;
+    return getLength(handle);
 }
 
-// This function adds a sequence to the KmerPositions object. It creates a new KmerPosMap on the
-// heap (will be deleted in destructor), fills it up and adds it to m_kmerPositions.
-void KmerPositions::addPositions(std::string & name, std::string & sequence, int kSize) {
-    KmerPosMap * posMap = new KmerPosMap();
-    int kCount = sequence.size() - kSize + 1;
-    for (int i = 0; i < kCount; ++i) {
-        std::string kmer = sequence.substr(i, kSize);
-        if (posMap->find(kmer) == posMap->end())
-            (*posMap)[kmer] = std::vector<int>();
-        (*posMap)[kmer].push_back(i);
-    }
-
-    m_mutex.lock();
-    m_sequences[name] = sequence;
-    m_kmerPositions[name] = posMap;
-    m_mutex.unlock();
+// This function adds a sequence to the KmerPositions object and returns its handle. A name can
+// only be added once: adding it again leaves the existing entry (and any pointers into it)
+// untouched and returns its handle. This must not be called while other threads are reading from
+// the object.
+int KmerPositions::addPositions(std::string & name, std::string & sequence, int kSize) {
+    int handle = getHandle(name);
+    if (handle >= 0)
+        return handle;
+
+    std::unique_ptr<KmerPositionsEntry> entry(new KmerPositionsEntry());
+    entry->name = name;
+    entry->sequence = sequence;
+    KmerPosMap & posMap = entry->kmerPositions;
+    int kCount = int(sequence.size()) - kSize + 1;
+    if (kCount > 0)
+        posMap.reserve(kCount);
+    for (int i = 0; i < kCount; ++i)
+        posMap[sequence.substr(i, kSize)].push_back(i);
+
+    handle = int(m_entries.size());
+    m_entries.push_back(std::move(entry));
+    m_handles[name] = handle;
+    return handle;
 }
 
 // This function retrieves a KmerPosMap from the object using the name as a key. If the name isn't
 // in the map, it returns 0.
-KmerPosMap * KmerPositions::getKmerPositions(std::string & name) {
-    KmerPosMap * returnedMap = 0;
-    m_mutex.lock();
-    if (m_kmerPositions.find(name) != m_kmerPositions.end())
-        returnedMap =  m_kmerPositions[name];
-    m_mutex.unlock();
-    return returnedMap;
+KmerPosMap * KmerPositions::getKmerPositions(std::string & name) const {
+    int handle = getHandle(name);
+    if (handle < 0)
+        return 0;
+    return getKmerPositions(handle);
 }
 
-std::string * KmerPositions::getSequence(std::string & name) {
-    std::string * returnedSequence = 0;
-    m_mutex.lock();
-    if (m_kmerPositions.find(name) != m_kmerPositions.end())
-        returnedSequence = &(m_sequences[name]);
-    m_mutex.unlock();
-    return returnedSequence;
+std::string * KmerPositions::getSequence(std::string & name) const {
+    int handle = getHandle(name);
+    if (handle < 0)
+        return 0;
+    return getSequence(handle);
 }
 
 KmerPositions * newKmerPositions() {
@@ -0,0 +1,201 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#include "loop_votes.h"
+
+#include "global_align.h"
+#include "string_functions.h"
+#include "thread_pool.h"
+
+
+// This function gives the simple loop votes for all reads spanning one loop. A read's alignments
+// (hits) are given as integer arrays, with the hits for read i at indices hitOffsets[i] to
+// hitOffsets[i+1]. Hit segment numbers are negative when the read aligned to the segment's
+// reverse strand. The returned string has one vote per read (in read order), comma-delimited,
+// where a vote is the best loop count or -1 for a read that doesn't fit the loop.
+char * simpleLoopVotes(int startSeg, int endSeg, int middleSeg, int repeatSeg,
+                       char * startSeqC, char * endSeqC, char * middleSeqC, char * repeatSeqC,
+                       int readCount, char ** readSeqs, char * readStrands, int hitOffsets[],
+                       int hitSegs[], int hitReadStarts[], int hitReadEnds[],
+                       int hitRefStarts[], int hitRefEnds[], int hitRefLengths[],
+                       int maxTestedLoopCount, int bandSize, bool useScoreBounds,
+                       int matchScore, int mismatchScore, int gapOpenScore,
+                       int gapExtensionScore, int threads) {
+
+    // The segment sequences are prepared once for both strands and shared by all reads. A
+    // middleSeg of 0 means the loop has no middle segment.
+    LoopStrand forward, reverse;
+    forward.s = startSeg;
+    forward.e = endSeg;
+    forward.m = middleSeg;
+    forward.r = repeatSeg;
+    forward.startSeq = startSeqC;
+    forward.endSeq = endSeqC;
+    forward.middleSeq = middleSeqC;
+    forward.repeatSeq = repeatSeqC;
+    reverse.s = -endSeg;
+    reverse.e = -startSeg;
+    reverse.m = -middleSeg;
+    reverse.r = -repeatSeg;
+    reverse.startSeq = getReverseComplement(forward.endSeq);
+    reverse.endSeq = getReverseComplement(forward.startSeq);
+    reverse.middleSeq = getReverseComplement(forward.middleSeq);
+    reverse.repeatSeq = getReverseComplement(forward.repeatSeq);
+
+    std::vector<int> votes(readCount, -1);
+    parallelFor(threads, readCount, [&](long i, int) {
+        LoopStrand & loop = (readStrands[i] == 'F') ? forward : reverse;
+        int offset = hitOffsets[i];
+        votes[i] = getReadLoopVote(loop, readSeqs[i], hitOffsets[i+1] - offset, hitSegs + offset,
+                                   hitReadStarts + offset, hitReadEnds + offset,
+                                   hitRefStarts + offset, hitRefEnds + offset,
+                                   hitRefLengths + offset, maxTestedLoopCount, bandSize,
+                                   useScoreBounds, matchScore, mismatchScore, gapOpenScore,
+                                   gapExtensionScore);
+    });
+
+    std::string returnString;
+    for (int i = 0; i < readCount; ++i) {
+        if (i > 0)
+            returnString += ",";
+        returnString += std::to_string(votes[i]);
+    }
+    return cppStringToCString(returnString);
+}
+
+
+// This function finds the read's alignments on either side of the repeat, then globally aligns
+// the read between them to the loop traversed different numbers of times. It returns the loop
+// count which aligned best, or -1 for a read that doesn't fit the loop.
+int getReadLoopVote(LoopStrand & loop, std::string readSeq, int hitCount, int * hitSegs,
+                    int * hitReadStarts, int * hitReadEnds, int * hitRefStarts, int * hitRefEnds,
+                    int * hitRefLengths, int maxTestedLoopCount, int bandSize,
+                    bool useScoreBounds, int matchScore, int mismatchScore, int gapOpenScore,
+                    int gapExtensionScore) {
+    int lastIndexOfStart = -1;
+    for (int i = 0; i < hitCount; ++i) {
+        if (hitSegs[i] == loop.s)
+            lastIndexOfStart = i;
+    }
+    int firstIndexOfEnd = -1;
+    for (int i = lastIndexOfStart + 1; i < hitCount; ++i) {
+        if (hitSegs[i] == loop.e) {
+            firstIndexOfEnd = i;
+            break;
+        }
+    }
+    if (lastIndexOfStart == -1 || firstIndexOfEnd == -1)
+        return -1;
+
+    // If there are any alignments in between the start and end segments, they are only allowed
+    // to be the middle or repeat segments.
+    for (int i = lastIndexOfStart + 1; i < firstIndexOfEnd; ++i) {
+        if (hitSegs[i] != loop.r && (loop.m == 0 || hitSegs[i] != loop.m))
+            return -1;
+    }
+
+    // Extract the relevant part of the read and the relevant parts of the start/end segments.
+    int s = lastIndexOfStart, e = firstIndexOfEnd;
+    readSeq = pythonSlice(readSeq, hitReadStarts[s], hitReadEnds[e]);
+    int startSegStartPos, endSegEndPos;
+    if (hitSegs[s] > 0)
+        startSegStartPos = hitRefStarts[s];
+    else
+        startSegStartPos = hitRefLengths[s] - hitRefEnds[s];
+    if (hitSegs[e] > 0)
+        endSegEndPos = hitRefEnds[e];
+    else
+        endSegEndPos = hitRefLengths[e] - hitRefStarts[e];
+    std::string startSegSeq = pythonSlice(loop.startSeq, startSegStartPos, loop.startSeq.length());
+    std::string endSegSeq = pythonSlice(loop.endSeq, 0, endSegEndPos);
+    std::string loopSeq = loop.middleSeq + loop.repeatSeq;
+
+    int bestScore = 0, bestCount = -1;
+    int loopCount = 0, failToImproveCount = 0;
+    int prevTestSeqScore = 0;
+    bool havePrevScore = false;
+    std::string testSeq;
+    while (true) {
+        testSeq.clear();
+        testSeq.reserve(startSegSeq.length() + loop.repeatSeq.length() +
+                        loopCount * loopSeq.length() + endSegSeq.length());
+        testSeq += startSegSeq;
+        testSeq += loop.repeatSeq;
+        for (int i = 0; i < loopCount; ++i)
+            testSeq += loopSeq;
+        testSeq += endSegSeq;
+
+        // If the edit distance shows that this loop count can't beat the best so far, it isn't
+        // aligned.
+        int testSeqScore = 0;
+        bool canBeatBest = true;
+        if (useScoreBounds && bestCount != -1) {
+            int rawBound;
+            double scaledBound;
+            fullyGlobalAlignmentBounds(readSeq, testSeq, matchScore, mismatchScore, gapOpenScore,
+                                       gapExtensionScore, true, bandSize, rawBound, scaledBound);
+            if (rawBound <= bestScore)
+                canBeatBest = false;
+        }
+        ScoredAlignment * alignment = 0;
+        if (canBeatBest)
+            alignment = fullyGlobalAlignment(readSeq, testSeq, matchScore, mismatchScore,
+                                             gapOpenScore, gapExtensionScore, true, bandSize);
+        if (alignment != 0) {
+            testSeqScore = alignment->m_rawScore;
+            if (bestCount == -1 || testSeqScore > bestScore) {
+                bestScore = testSeqScore;
+                bestCount = loopCount;
+            }
+            delete alignment;
+        }
+
+        // Break when we've hit the max loop count. But if the max is our best, then we keep
+        // trying higher.
+        if (loopCount >= maxTestedLoopCount && loopCount != bestCount)
+            break;
+
+        // Just in case to prevent an infinite loop.
+        if (loopCount > maxTestedLoopCount * 10)
+            break;
+
+        // If the score fails to increase a few times in a row, we can assume that we're getting
+        // further from the correct answer and can break the loop to save time. A loop count which
+        // was skipped because it can't beat the best counts as a failure, but as its score isn't
+        // known, the next loop count is compared to the last aligned one.
+        if (!canBeatBest)
+            ++failToImproveCount;
+        else {
+            if (havePrevScore && testSeqScore <= prevTestSeqScore)
+                ++failToImproveCount;
+            else
+                failToImproveCount = 0;
+            prevTestSeqScore = testSeqScore;
+            havePrevScore = true;
+        }
+        if (failToImproveCount > 3)
+            break;
+
+        ++loopCount;
+    }
+    return bestCount;
+}
+
+
+// Returns s[start:end] with Python's slicing rules for non-negative indices.
+std::string pythonSlice(const std::string & s, int start, int end) {
+    int length = int(s.length());
+    if (end > length)
+        end = length;
+    if (start >= end)
+        return "";
+    return s.substr(start, end - start);
+}
@@ -0,0 +1,81 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#include "memory_budget.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <condition_variable>
+#include <mutex>
+
+
+// A budget of 0 means there is no limit.
+static std::atomic<long long> memoryBudget(0);
+static long long reservedBytes = 0;
+static std::mutex reservationMutex;
+static std::condition_variable reservationReleased;
+
+
+void setMemoryBudget(long long bytes) {
+    memoryBudget = std::max(bytes, 0LL);
+    reservationReleased.notify_all();
+}
+
+long long getMemoryBudget() {
+    return memoryBudget;
+}
+
+
+// Returns how many items (bases, cells, etc.) of the given size fit in the budget, but no more
+// than the default (which is also used when there is no budget) and no less than the minimum.
+long long budgetedCount(long long defaultCount, long long bytesEach, long long minimumCount) {
+    long long budget = memoryBudget;
+    if (budget == 0)
+        return defaultCount;
+    return std::min(defaultCount, std::max(minimumCount, budget / bytesEach));
+}
+
+bool fitsInMemoryBudget(long long bytes) {
+    long long budget = memoryBudget;
+    return budget == 0 || bytes <= budget;
+}
+
+
+// Returns the number of cells in a DP matrix for two sequences. For banded alignments, the band
+// is widened by the length difference (as in fullyGlobalAlignment).
+long long dpMatrixCells(long long length1, long long length2, bool useBanding, int bandSize) {
+    long long cells = length1 * length2;
+    if (useBanding) {
+        long long lengthDifference = std::abs(length1 - length2);
+        cells = std::min(cells, std::min(length1, length2) * (2 * bandSize + 1 + lengthDifference));
+    }
+    return cells;
+}
+
+
+MemoryReservation::MemoryReservation(long long bytes) :
+    m_bytes(bytes) {
+    std::unique_lock<std::mutex> lock(reservationMutex);
+    reservationReleased.wait(lock, [&] {
+        long long budget = memoryBudget;
+        return budget == 0 || reservedBytes == 0 || reservedBytes + m_bytes <= budget;
+    });
+    reservedBytes += m_bytes;
+}
+
+MemoryReservation::~MemoryReservation() {
+    {
+        std::lock_guard<std::mutex> lock(reservationMutex);
+        reservedBytes -= m_bytes;
+    }
+    reservationReleased.notify_all();
+}
@@ -15,6 +15,7 @@
 #include "miniasm/kvec.h"
 #include "miniasm/sdict.h"
 #include "miniasm/kseq.h"
+#include "thread_pool.h"
 
 KSEQ_INIT(gzFile, gzread)
 
@@ -59,7 +60,37 @@ asg_t *make_string_graph(int max_hang, float int_frac, int min_ovlp, sdict_t con
     return g;
 }
 
-void save_string_graph(const asg_t *g, const sdict_t *read_dict, const ma_sub_t *subreads, std::string graph_filename, const char *reads_filename)
+// RRW: Only the reads which are part of an edge in the graph are loaded. The graph-cleaning steps
+// only delete arcs, so the store loaded for the first string graph covers all of the later ones.
+int load_read_store(const asg_t *g, const sdict_t *read_dict, const ma_sub_t *subreads, const char *reads_filename, ma_read_store_t &store)
+{
+    vector<bool> used(read_dict->n_seq, false);
+    for (uint32_t i = 0; i < g->n_arc; ++i) {
+        const asg_arc_t *p = &g->arc[i];
+        used[p->ul >> 33] = true;
+        used[p->v >> 1] = true;
+    }
+
+    store.assign(read_dict->n_seq, string());
+    gzFile reads_file = reads_filename && strcmp(reads_filename, "-")? gzopen(reads_filename, "r") : gzdopen(fileno(stdin), "r");
+    if (reads_file == 0) return -1;
+    kseq_t *ks = kseq_init(reads_file);
+    while (kseq_read(ks) >= 0) {
+        int32_t id = sd_get(read_dict, ks->name.s);
+        if (id < 0 || !used[id]) continue;
+        if (subreads) {
+            const ma_sub_t *subread = &subreads[id];
+            if (subread->s > ks->seq.l) continue;
+            store[id].assign(ks->seq.s + subread->s, min((size_t)(subread->e - subread->s), ks->seq.l - subread->s));
+        } else
+            store[id].assign(ks->seq.s, ks->seq.l);
+    }
+    kseq_destroy(ks);
+    gzclose(reads_file);
+    return 0;
+}
+
+void save_string_graph(const asg_t *g, const sdict_t *read_dict, const ma_sub_t *subreads, std::string graph_filename, const ma_read_store_t &store)
 {
     FILE *fp = fopen(graph_filename.c_str(), "w");
 
@@ -74,40 +105,17 @@ void save_string_graph(const asg_t *g, const sdict_t *read_dict, const ma_sub_t
         used_read_indices.insert(target_i);
     }
 
-//    // Also include any reads which are contigs.
-//    for (size_t i = 0; i < read_dict->n_seq; ++i) {
-//        if (is_read_illumina_contig(read_dict, i))
-//            used_read_indices.insert(i);
-//    }
-
-    unordered_set<string> used_read_names;
-    for (set<size_t>::iterator it = used_read_indices.begin(); it != used_read_indices.end(); ++it)
-        used_read_names.insert(string(read_dict->seq[*it].name));
-
-    // Now we can load in the sequences for the reads that we need.
-    unordered_map<string,string> read_seqs;
-    gzFile reads_file = reads_filename && strcmp(reads_filename, "-")? gzopen(reads_filename, "r") : gzdopen(fileno(stdin), "r");
-    kseq_t *ks = kseq_init(reads_file);
-    while (kseq_read(ks) >= 0) {
-        string read_name = ks->name.s;
-        if (used_read_names.find(read_name) != used_read_names.end())  // if the read is used
-            read_seqs[read_name] = ks->seq.s;
-    }
-
     // Now we print the segment (S) lines.
     for (set<size_t>::iterator it = used_read_indices.begin(); it != used_read_indices.end(); ++it) {
         string read_name = read_dict->seq[*it].name;
-        string read_seq = read_seqs[read_name];
         if (subreads) {
             const ma_sub_t *subread = &subreads[*it];
             read_name += ':';
             read_name += to_string(subread->s + 1);
             read_name += '-';
             read_name += to_string(subread->e);
-            u_int32_t len = subread->e - subread->s;
-            read_seq = read_seq.substr(subread->s, len);
         }
-        fprintf(fp, "S\t%s\t%s\n", read_name.c_str(), read_seq.c_str());
+        fprintf(fp, "S\t%s\t%s\n", read_name.c_str(), store[*it].c_str());
     }
 
     // Then we print the link (L) lines.
@@ -310,53 +318,30 @@ static char comp_tab[] = { // complement base
 };
 
 
-int generate_unitig_seqs(ma_ug_t *g, const sdict_t *d, const ma_sub_t *sub, const char *reads_filename)
+// RRW: Read sequences come from the read store (already trimmed to their subreads), so unitigs
+// are independent of each other and are filled in parallel.
+int generate_unitig_seqs(ma_ug_t *g, const ma_read_store_t &store, int n_threads)
 {
-    gzFile fp = reads_filename && strcmp(reads_filename, "-")? gzopen(reads_filename, "r") : gzdopen(fileno(stdin), "r");
-    if (fp == 0) return -1;
-    kseq_t *ks = kseq_init(fp);
-
-    utg_intv_t *tmp = (utg_intv_t*)calloc(d->n_seq, sizeof(utg_intv_t));
-    for (uint32_t i = 0; i < g->u.n; ++i) {
+    parallelFor(n_threads, g->u.n, [&](long i, int) {
         ma_utg_t *u = &g->u.a[i];
-        uint32_t l = 0;
         u->s = (char*)calloc(1, u->len + 1);
         memset(u->s, 'N', u->len);
+        uint32_t l = 0;
         for (uint32_t j = 0; j < u->n; ++j) {
-            utg_intv_t *t = &tmp[u->a[j]>>33];
-            assert(t->len == 0);
-            t->utg = i, t->ori = u->a[j]>>32&1;
-            t->start = l, t->len = (uint32_t)u->a[j];
-            l += t->len;
-        }
-    }
-
-    while (kseq_read(ks) >= 0) {
-        int32_t id;
-        utg_intv_t *t;
-        ma_utg_t *u;
-        id = sd_get(d, ks->name.s);
-        if (id < 0 || tmp[id].len == 0) continue;
-        t = &tmp[id];
-        u = &g->u.a[t->utg];
-        if (sub) {
-            assert(sub[id].e - sub[id].s <= ks->seq.l);
-            memmove(ks->seq.s, ks->seq.s + sub[id].s, sub[id].e - sub[id].s);
-            ks->seq.l = sub[id].e - sub[id].s;
-        }
-        if (!t->ori) { // forward strand
-            for (uint32_t i = 0; i < t->len; ++i)
-                u->s[t->start + i] = ks->seq.s[i];
-        } else {
-            for (uint32_t i = 0; i < t->len; ++i) {
-                int c = (uint8_t)ks->seq.s[ks->seq.l - 1 - i];
-                u->s[t->start + i] = c >= 128? 'N' : comp_tab[c];
+            const string &seq = store[u->a[j]>>33];
+            uint32_t len = (uint32_t)u->a[j];
+            if (len > seq.size()) len = seq.size();
+            if (!(u->a[j]>>32&1)) { // forward strand
+                for (uint32_t k = 0; k < len; ++k)
+                    u->s[l + k] = seq[k];
+            } else {
+                for (uint32_t k = 0; k < len; ++k) {
+                    int c = (uint8_t)seq[seq.size() - 1 - k];
+                    u->s[l + k] = c >= 128? 'N' : comp_tab[c];
+                }
             }
+            l += (uint32_t)u->a[j];
         }
-    }
-    free(tmp);
-
-    kseq_destroy(ks);
-    gzclose(fp);
+    });
     return 0;
 }
@@ -6,6 +6,8 @@
 #include <fstream>
 #include <set>
 #include <limits>
+#include <vector>
+#include <string.h>
 
 #pragma GCC diagnostic ignored "-Wpragmas"
 #pragma GCC diagnostic ignored "-Wunknown-warning-option"
@@ -19,6 +21,7 @@
 #include "miniasm/sys.h"
 #include "miniasm/miniasm.h"
 #include "miniasm/ksort.h"
+#include "thread_pool.h"
 
 #define ma_hit_key(a) ((a).qns)
 KRADIX_SORT_INIT(hit, ma_hit_t, ma_hit_key, 8)
@@ -34,6 +37,43 @@ void ma_hit_sort(size_t n, ma_hit_t *a)
     radix_sort_hit(a, a + n);
 }
 
+// RRW: the hit filters below are parallelised over blocks of the (query-sorted) hit array. Each
+// block is compacted in place by one thread, then the kept hits are moved down in block order, so
+// the result is the same as a serial pass.
+#define MA_HIT_BLOCK 65536
+
+template<typename F>
+static size_t compact_hits(int n_threads, size_t n, ma_hit_t *a, F keep)
+{
+    size_t n_blocks = (n + MA_HIT_BLOCK - 1) / MA_HIT_BLOCK;
+    vector<size_t> kept(n_blocks);
+    parallelFor(n_threads, n_blocks, [&](long b, int) {
+        size_t start = b * MA_HIT_BLOCK, end = std::min(start + MA_HIT_BLOCK, n), m = start;
+        for (size_t i = start; i < end; ++i)
+            if (keep(&a[i], b))
+                a[m++] = a[i];
+        kept[b] = m - start;
+    });
+    size_t m = 0;
+    for (size_t b = 0; b < n_blocks; ++b) {
+        if (m != b * MA_HIT_BLOCK)
+            memmove(&a[m], &a[b * MA_HIT_BLOCK], kept[b] * sizeof(ma_hit_t));
+        m += kept[b];
+    }
+    return m;
+}
+
+// RRW: returns the index of the first hit for each query, plus n at the end.
+static vector<size_t> get_query_starts(size_t n, const ma_hit_t *a)
+{
+    vector<size_t> starts;
+    for (size_t i = 0; i < n; ++i)
+        if (i == 0 || a[i].qns>>32 != a[i-1].qns>>32)
+            starts.push_back(i);
+    starts.push_back(n);
+    return starts;
+}
+
 void ma_hit_mark_unused(sdict_t *read_dict, size_t n, const ma_hit_t *a)
 {
     size_t i;
@@ -89,16 +129,19 @@ ma_hit_t *read_hits_file(const char *fn, int min_span, int min_match, sdict_t *r
         ++tot;
         if (r.qe - r.qs < min_span || r.te - r.ts < min_span || r.ml < min_match) continue;
         if (excl && (sd_get(excl, r.qn) >= 0 || sd_get(excl, r.tn) >= 0)) continue;
+        // RRW: each name is looked up once and its ID reused for the reverse-direction hit.
+        uint32_t qn = sd_put(read_dict, r.qn, r.ql);
+        uint32_t tn = sd_put(read_dict, r.tn, r.tl);
         kv_pushp(ma_hit_t, h, &p);
-        p->qns = (uint64_t)sd_put(read_dict, r.qn, r.ql)<<32 | r.qs;
+        p->qns = (uint64_t)qn<<32 | r.qs;
         p->qe = r.qe;
-        p->tn = sd_put(read_dict, r.tn, r.tl);
+        p->tn = tn;
         p->ts = r.ts, p->te = r.te, p->rev = r.rev, p->ml = r.ml, p->bl = r.bl;
-        if (bi_dir && p->qns>>32 != p->tn) {
+        if (bi_dir && qn != tn) {
             kv_pushp(ma_hit_t, h, &p);
-            p->qns = (uint64_t)sd_put(read_dict, r.tn, r.tl)<<32 | r.ts;
+            p->qns = (uint64_t)tn<<32 | r.ts;
             p->qe = r.te;
-            p->tn = sd_put(read_dict, r.qn, r.ql);
+            p->tn = qn;
             p->ts = r.qs, p->te = r.qe, p->rev = r.rev, p->ml = r.ml, p->bl = r.bl;
         }
     }
@@ -117,197 +160,213 @@ string get_read_name(const sdict_t *read_dict, int id) {
 }
 
 bool is_read_illumina_contig(const sdict_t *read_dict, int id) {
-    return get_read_name(read_dict, id).find("CONTIG_") == 0;
+    return strncmp(read_dict->seq[id].name, "CONTIG_", 7) == 0;
 }
 
-ma_sub_t *filter_reads_using_depth(int min_dp, float min_iden, int end_clip, size_t n, const ma_hit_t *a, const sdict_t *read_dict)
+ma_sub_t *filter_reads_using_depth(int min_dp, float min_iden, int end_clip, size_t n, const ma_hit_t *a, const sdict_t *read_dict, int n_threads)
 {
     size_t num_reads = read_dict->n_seq;
-
-    size_t j, n_remained = 0;
-    kvec_t(uint32_t) b = {0,0,0};
-    ma_sub_t *subreads = 0;
-
-    subreads = (ma_sub_t*)calloc(num_reads, sizeof(ma_sub_t));
-    for (size_t i = 1, last = 0; i <= n; ++i) {
-
-        // We've come to a new query sequence.
-        if (i == n || a[i].qns>>32 != a[i-1].qns>>32) {
-            size_t start, end;
-            int query_i = int(a[i-1].qns>>32);
-
-            ma_sub_t max, max2;
-            kv_resize(uint32_t, b, i - last);
-            b.n = 0;
-
-            // Collect all starts and ends.
-            for (j = last; j < i; ++j) {
-                uint32_t qs, qe;
-                int target_i = a[j].tn;
-
-                // skip self match
-                if (target_i == query_i || a[j].ml < a[j].bl * min_iden)
-                    continue;
-
-                qs = (uint32_t)a[j].qns + end_clip;
-                qe = a[j].qe - end_clip;
-
-                if (qe > qs) {
+    ma_sub_t *subreads = (ma_sub_t*)calloc(num_reads, sizeof(ma_sub_t));
+
+    // RRW: each query's hits are a contiguous range of the sorted hit array, so queries are
+    // processed in parallel, each thread with its own start/end buffer.
+    vector<size_t> query_starts = get_query_starts(n, a);
+    vector<uint32_v> buffers(n_threads, uint32_v{0,0,0});
+    vector<size_t> remained(n_threads, 0);
+    parallelFor(n_threads, query_starts.size() - 1, [&](long q, int t) {
+        size_t j, start = 0, end = 0, last = query_starts[q], i = query_starts[q+1];
+        int query_i = int(a[last].qns>>32);
+
+        ma_sub_t max, max2;
+        uint32_v &b = buffers[t];
+        kv_resize(uint32_t, b, i - last);
+        b.n = 0;
+
+        // Collect all starts and ends.
+        for (j = last; j < i; ++j) {
+            uint32_t qs, qe;
+            int target_i = a[j].tn;
+
+            // skip self match
+            if (target_i == query_i || a[j].ml < a[j].bl * min_iden)
+                continue;
+
+            qs = (uint32_t)a[j].qns + end_clip;
+            qe = a[j].qe - end_clip;
+
+            if (qe > qs) {
+                kv_push(uint32_t, b, qs<<1);
+                kv_push(uint32_t, b, qe<<1|1);
+
+                // If the query is a read and the target is an Illumina contig, then we add
+                // the start/end coordinates two more times. This is because Illumina contigs
+                // carry a lot of weight and should count more than alignments to other reads.
+                // E.g. one Illumina contig alignment is enough to get a read over a min depth
+                // of 3.
+                if (!is_read_illumina_contig(read_dict, query_i) && is_read_illumina_contig(read_dict, target_i)) {
+                    kv_push(uint32_t, b, qs<<1);
+                    kv_push(uint32_t, b, qe<<1|1);
                     kv_push(uint32_t, b, qs<<1);
                     kv_push(uint32_t, b, qe<<1|1);
-
-                    // If the query is a read and the target is an Illumina contig, then we add
-                    // the start/end coordinates two more times. This is because Illumina contigs
-                    // carry a lot of weight and should count more than alignments to other reads.
-                    // E.g. one Illumina contig alignment is enough to get a read over a min depth
-                    // of 3.
-                    if (!is_read_illumina_contig(read_dict, query_i) && is_read_illumina_contig(read_dict, target_i)) {
-                        kv_push(uint32_t, b, qs<<1);
-                        kv_push(uint32_t, b, qe<<1|1);
-                        kv_push(uint32_t, b, qs<<1);
-                        kv_push(uint32_t, b, qe<<1|1);
-                    }
                 }
             }
+        }
 
-            // If the read is an Illumina contig, then we may not have alignments to the middle of
-            // the read. So we don't do the normal miniasm stuff but instead only clip off unaligned
-            // parts from its ends.
-            if (is_read_illumina_contig(read_dict, query_i)) {
+        // If the read is an Illumina contig, then we may not have alignments to the middle of
+        // the read. So we don't do the normal miniasm stuff but instead only clip off unaligned
+        // parts from its ends.
+        if (is_read_illumina_contig(read_dict, query_i)) {
 
-                // If the Illumina contig has no alignments, then we just include the whole thing.
-                if (b.n == 0) {
-                    subreads[query_i].s = 0;
-                    subreads[query_i].e = read_dict->seq[query_i].len;
-                }
-                // If the read has alignments, we use those to clip off unaligned parts.
-                else {
-                    uint32_t min_start = numeric_limits<uint32_t>::max();
-                    uint32_t max_end = 0;
-                    for (j = 0; j < b.n; ++j) {
-                        if (b.a[j] & 1) {  // is an end position
-                            uint32_t read_end = b.a[j] >> 1;
-                            max_end = std::max(read_end, max_end);
-                        } else {  // is a start position
-                            uint32_t read_start = b.a[j] >> 1;
-                            min_start = std::min(read_start, min_start);
-                        }
+            // If the Illumina contig has no alignments, then we just include the whole thing.
+            if (b.n == 0) {
+                subreads[query_i].s = 0;
+                subreads[query_i].e = read_dict->seq[query_i].len;
+            }
+            // If the read has alignments, we use those to clip off unaligned parts.
+            else {
+                uint32_t min_start = numeric_limits<uint32_t>::max();
+                uint32_t max_end = 0;
+                for (j = 0; j < b.n; ++j) {
+                    if (b.a[j] & 1) {  // is an end position
+                        uint32_t read_end = b.a[j] >> 1;
+                        max_end = std::max(read_end, max_end);
+                    } else {  // is a start position
+                        uint32_t read_start = b.a[j] >> 1;
+                        min_start = std::min(read_start, min_start);
                     }
-                    subreads[query_i].s = min_start - end_clip;
-                    subreads[query_i].e = max_end + end_clip;
                 }
-                subreads[query_i].del = 0;
-                ++n_remained;
+                subreads[query_i].s = min_start - end_clip;
+                subreads[query_i].e = max_end + end_clip;
             }
+            subreads[query_i].del = 0;
+            ++remained[t];
+        }
 
-            // If the read isn't a contig (i.e. it's a normal read) then we do the standard miniasm
-            // behaviour: clip the read to the best depth region.
-            else {
-                ks_introsort_uint32_t(b.n, b.a);
-                max.s = max.e = max.del = max2.s = max2.e = max2.del = 0;
-                int dp;
-                for (j = 0, dp = 0; j < b.n; ++j) {
-                    int old_dp = dp;
-                    if (b.a[j]&1)
-                        --dp;
-                    else
-                        ++dp;
-
-                    // If we've just exceeded the minimum depth, set the start.
-                    if (old_dp < min_dp && dp >= min_dp) {
-                        start = b.a[j]>>1;
-
-                    // If we've just dropped below the minimum depth, set the end.
-                    } else if (old_dp >= min_dp && dp < min_dp) {
-                        end = b.a[j]>>1;
-                        int len = int(end - start);
-
-                        // Is this depth region a new best?
-                        if (len > max.e - max.s) {
-                            max2 = max;
-                            max.s = u_int32_t(start);
-                            max.e = u_int32_t(end);
-                        }
-                        // Is it a new second-best region? Not sure why we care...
-                        else if (len > max2.e - max2.s) {
-                            max2.s = u_int32_t(start);
-                            max2.e = u_int32_t(end);
-                        }
+        // If the read isn't a contig (i.e. it's a normal read) then we do the standard miniasm
+        // behaviour: clip the read to the best depth region.
+        else {
+            ks_introsort_uint32_t(b.n, b.a);
+            max.s = max.e = max.del = max2.s = max2.e = max2.del = 0;
+            int dp;
+            for (j = 0, dp = 0; j < b.n; ++j) {
+                int old_dp = dp;
+                if (b.a[j]&1)
+                    --dp;
+                else
+                    ++dp;
+
+                // If we've just exceeded the minimum depth, set the start.
+                if (old_dp < min_dp && dp >= min_dp) {
+                    start = b.a[j]>>1;
+
+                // If we've just dropped below the minimum depth, set the end.
+                } else if (old_dp >= min_dp && dp < min_dp) {
+                    end = b.a[j]>>1;
+                    int len = int(end - start);
+
+                    // Is this depth region a new best?
+                    if (len > max.e - max.s) {
+                        max2 = max;
+                        max.s = u_int32_t(start);
+                        max.e = u_int32_t(end);
+                    }
+                    // Is it a new second-best region? Not sure why we care...
+                    else if (len > max2.e - max2.s) {
+                        max2.s = u_int32_t(start);
+                        max2.e = u_int32_t(end);
                     }
                 }
-                if (max.e - max.s > 0) {
-                    assert(query_i < num_reads);
-                    subreads[query_i].s = max.s - end_clip;
-                    subreads[query_i].e = max.e + end_clip;
-                    subreads[query_i].del = 0;
-                    ++n_remained;
-                }
-                else
-                    subreads[query_i].del = 1;
             }
+            if (max.e - max.s > 0) {
+                assert(query_i < num_reads);
+                subreads[query_i].s = max.s - end_clip;
+                subreads[query_i].e = max.e + end_clip;
+                subreads[query_i].del = 0;
+                ++remained[t];
+            }
+            else
+                subreads[query_i].del = 1;
+        }
 
 
-            last = i;
-        }
+    });
+    size_t n_remained = 0;
+    for (int t = 0; t < n_threads; ++t) {
+        n_remained += remained[t];
+        free(buffers[t].a);
     }
-    free(b.a);
     std::cerr << "[M::" << __func__ << "::" << sys_timestamp() << "] " << n_remained << " query sequences remain after sub\n";
     return subreads;
 }
 
-size_t filter_hits_using_span(const ma_sub_t *subreads, int min_span, size_t n, ma_hit_t *a)
+// RRW: cuts a hit down to the subreads of its query and target, returning false if what remains
+// is shorter than min_span.
+static inline bool cut_hit_to_subreads(const ma_sub_t *subreads, int min_span, ma_hit_t *p)
 {
-    size_t i, m;
-    for (i = m = 0; i < n; ++i) {
-        ma_hit_t *p = &a[i];
-        const ma_sub_t *rq = &subreads[p->qns>>32], *rt = &subreads[p->tn];
-        int qs, qe, ts, te;
-        if (rq->del || rt->del) continue;
-        if (p->rev) {
-            qs = p->te < rt->e? (uint32_t)p->qns : (uint32_t)p->qns + (p->te - rt->e);
-            qe = p->ts > rt->s? p->qe : p->qe - (rt->s - p->ts);
-            ts = p->qe < rq->e? p->ts : p->ts + (p->qe - rq->e);
-            te = (uint32_t)p->qns > rq->s? p->te : p->te - (rq->s - (uint32_t)p->qns);
-        } else {
-            qs = p->ts > rt->s? (uint32_t)p->qns : (uint32_t)p->qns + (rt->s - p->ts);
-            qe = p->te < rt->e? p->qe : p->qe - (p->te - rt->e);
-            ts = (uint32_t)p->qns > rq->s? p->ts : p->ts + (rq->s - (uint32_t)p->qns);
-            te = p->qe < rq->e? p->te : p->te - (p->qe - rq->e);
-        }
-        qs = (qs > rq->s? qs : rq->s) - rq->s;
-        qe = (qe < rq->e? qe : rq->e) - rq->s;
-        ts = (ts > rt->s? ts : rt->s) - rt->s;
-        te = (te < rt->e? te : rt->e) - rt->s;
-        if (qe - qs >= min_span && te - ts >= min_span) {
-            double r = (double)((qe - qs) + (te - ts)) / ((p->qe - (uint32_t)p->qns) + (p->te - p->ts));
-            p->bl = (int)(p->bl * r + .499);
-            p->ml = (int)(p->ml * r + .499);
-            p->qns = p->qns>>32<<32 | qs, p->qe = qe, p->ts = ts, p->te = te;
-            a[m++] = *p;
-        }
+    const ma_sub_t *rq = &subreads[p->qns>>32], *rt = &subreads[p->tn];
+    int qs, qe, ts, te;
+    if (rq->del || rt->del) return false;
+    if (p->rev) {
+        qs = p->te < rt->e? (uint32_t)p->qns : (uint32_t)p->qns + (p->te - rt->e);
+        qe = p->ts > rt->s? p->qe : p->qe - (rt->s - p->ts);
+        ts = p->qe < rq->e? p->ts : p->ts + (p->qe - rq->e);
+        te = (uint32_t)p->qns > rq->s? p->te : p->te - (rq->s - (uint32_t)p->qns);
+    } else {
+        qs = p->ts > rt->s? (uint32_t)p->qns : (uint32_t)p->qns + (rt->s - p->ts);
+        qe = p->te < rt->e? p->qe : p->qe - (p->te - rt->e);
+        ts = (uint32_t)p->qns > rq->s? p->ts : p->ts + (rq->s - (uint32_t)p->qns);
+        te = p->qe < rq->e? p->te : p->te - (p->qe - rq->e);
+    }
+    qs = (qs > rq->s? qs : rq->s) - rq->s;
+    qe = (qe < rq->e? qe : rq->e) - rq->s;
+    ts = (ts > rt->s? ts : rt->s) - rt->s;
+    te = (te < rt->e? te : rt->e) - rt->s;
+    if (qe - qs >= min_span && te - ts >= min_span) {
+        double r = (double)((qe - qs) + (te - ts)) / ((p->qe - (uint32_t)p->qns) + (p->te - p->ts));
+        p->bl = (int)(p->bl * r + .499);
+        p->ml = (int)(p->ml * r + .499);
+        p->qns = p->qns>>32<<32 | qs, p->qe = qe, p->ts = ts, p->te = te;
+        return true;
     }
+    return false;
+}
+
+size_t filter_hits_using_span(const ma_sub_t *subreads, int min_span, size_t n, ma_hit_t *a, int n_threads)
+{
+    size_t m = compact_hits(n_threads, n, a, [&](ma_hit_t *p, long) {
+        return cut_hit_to_subreads(subreads, min_span, p);
+    });
     std::cerr << "[M::" << __func__ << "::" << sys_timestamp() << "] " << m << " hits remain after cut\n";
     return m;
 }
 
-size_t filter_hits_using_overhang(const ma_sub_t *subreads, int max_hang, int min_ovlp, size_t n, ma_hit_t *a, float *cov)
+// RRW: this does the span filter and then miniasm's overhang filter in the same pass over the hits.
+size_t filter_hits_using_span_and_overhang(const ma_sub_t *subreads, int min_span, int max_hang, int min_ovlp, size_t n, ma_hit_t *a, float *cov, int n_threads)
 {
-    size_t i, m;
-    asg_arc_t t;
+    size_t i, m, n_blocks = (n + MA_HIT_BLOCK - 1) / MA_HIT_BLOCK;
+    vector<size_t> block_span_count(n_blocks, 0);
+    vector<uint64_t> block_dp(n_blocks, 0);
     uint64_t tot_dp = 0, tot_len = 0;
-    for (i = m = 0; i < n; ++i) {
-        ma_hit_t *h = &a[i];
+    m = compact_hits(n_threads, n, a, [&](ma_hit_t *h, long b) {
+        if (!cut_hit_to_subreads(subreads, min_span, h)) return false;
+        ++block_span_count[b];
         const ma_sub_t *sq = &subreads[h->qns>>32], *st = &subreads[h->tn];
-        int r;
-        if (sq->del || st->del) continue;
-        r = ma_hit2arc(h, sq->e - sq->s, st->e - st->s, max_hang, .5, min_ovlp, &t);
-        if (r >= 0 || r == MA_HT_QCONT || r == MA_HT_TCONT)
-            a[m++] = *h, tot_dp += r >= 0? r : r == MA_HT_QCONT? sq->e - sq->s : st->e - st->s;
-    }
+        asg_arc_t t;
+        int r = ma_hit2arc(h, sq->e - sq->s, st->e - st->s, max_hang, .5, min_ovlp, &t);
+        if (r >= 0 || r == MA_HT_QCONT || r == MA_HT_TCONT) {
+            block_dp[b] += r >= 0? r : r == MA_HT_QCONT? sq->e - sq->s : st->e - st->s;
+            return true;
+        }
+        return false;
+    });
+    size_t span_count = 0;
+    for (size_t b = 0; b < n_blocks; ++b)
+        span_count += block_span_count[b], tot_dp += block_dp[b];
     for (i = 1; i <= m; ++i)
         if (i == m || a[i].qns>>32 != a[i-1].qns>>32)
             tot_len += subreads[a[i-1].qns>>32].e - subreads[a[i-1].qns>>32].s;
     *cov = (double)tot_dp / tot_len;
+    std::cerr << "[M::" << __func__ << "::" << sys_timestamp() << "] " << span_count << " hits remain after cut\n";
     std::cerr << "[M::" << __func__ << "::" << sys_timestamp() << "] " << m << " hits remain after filtering; crude coverage after filtering: " << *cov << "\n";
     return m;
 }
@@ -345,30 +404,39 @@ void save_read_names(size_t n, const ma_hit_t *a, const sdict_t *read_dict, ma_s
     all_list_file.close();
 }
 
-size_t remove_contained_reads(int max_hang, float int_frac, int min_ovlp, sdict_t *read_dict, ma_sub_t *subreads, size_t n, ma_hit_t *a, string contained_read_list)
+size_t remove_contained_reads(int max_hang, float int_frac, int min_ovlp, sdict_t *read_dict, ma_sub_t *subreads, size_t n, ma_hit_t *a, string contained_read_list, int n_threads)
 {
     set<string> contained_read_names;
 
-    int32_t *map, r;
+    int32_t *map;
     size_t i, m, old_n_seq = read_dict->n_seq;
-    asg_arc_t t;
-    for (i = m = 0; i < n; ++i) {
-        ma_hit_t *h = &a[i];
-
-        int query_i = int(h->qns>>32);
-        int target_i = h->tn;
-        ma_sub_t *query_subread = &subreads[query_i];
-        ma_sub_t *target_subread = &subreads[target_i];
 
-        r = ma_hit2arc(h, query_subread->e - query_subread->s, target_subread->e - target_subread->s, max_hang, int_frac, min_ovlp, &t);
-
-        if (r == MA_HT_QCONT) {  // If the query is contained in the target
-            query_subread->del = 1;
-            contained_read_names.insert(get_read_name(read_dict, query_i));
+    // RRW: hits are checked for containment in parallel, with each thread collecting the
+    // contained reads it finds. They are marked as deleted afterwards.
+    vector<vector<int> > contained(n_threads);
+    parallelFor(n_threads, (n + MA_HIT_BLOCK - 1) / MA_HIT_BLOCK, [&](long b, int t) {
+        size_t end = std::min((size_t)(b + 1) * MA_HIT_BLOCK, n);
+        asg_arc_t arc;
+        for (size_t j = b * MA_HIT_BLOCK; j < end; ++j) {
+            ma_hit_t *h = &a[j];
+
+            int query_i = int(h->qns>>32);
+            int target_i = h->tn;
+            ma_sub_t *query_subread = &subreads[query_i];
+            ma_sub_t *target_subread = &subreads[target_i];
+
+            int r = ma_hit2arc(h, query_subread->e - query_subread->s, target_subread->e - target_subread->s, max_hang, int_frac, min_ovlp, &arc);
+
+            if (r == MA_HT_QCONT)  // If the query is contained in the target
+                contained[t].push_back(query_i);
+            else if (r == MA_HT_TCONT)  // If the target is contained in the query
+                contained[t].push_back(target_i);
         }
-        else if (r == MA_HT_TCONT) {  // If the target is contained in the query
-            target_subread->del = 1;
-            contained_read_names.insert(get_read_name(read_dict, target_i));
+    });
+    for (int t = 0; t < n_threads; ++t) {
+        for (size_t j = 0; j < contained[t].size(); ++j) {
+            subreads[contained[t][j]].del = 1;
+            contained_read_names.insert(get_read_name(read_dict, contained[t][j]));
         }
     }
 
@@ -388,15 +456,13 @@ size_t remove_contained_reads(int max_hang, float int_frac, int min_ovlp, sdict_
         if (map[i] >= 0)
             subreads[map[i]] = subreads[i];
     }
-    for (i = m = 0; i < n; ++i) {
-        ma_hit_t *h = &a[i];
+    m = compact_hits(n_threads, n, a, [&](ma_hit_t *h, long) {
         int32_t qn = map[h->qns>>32], tn = map[h->tn];
-        if (qn >= 0 && tn >= 0) {
-            a[i].qns = (uint64_t)qn<<32 | (uint32_t)a[i].qns;
-            a[i].tn = tn;
-            a[m++] = a[i];
-        }
-    }
+        if (qn < 0 || tn < 0) return false;
+        h->qns = (uint64_t)qn<<32 | (uint32_t)h->qns;
+        h->tn = tn;
+        return true;
+    });
     free(map);
     std::cerr << "[M::" << __func__ << "::" << sys_timestamp() << "] " << read_dict->n_seq << " sequences and " << m << " hits remain after containment removal\n";
 
@@ -5,24 +5,76 @@
 #include "miniasm/sdict.h"
 #include "miniasm/khash.h"
 
-KHASH_MAP_INIT_STR(str, uint32_t)
+// RRW: hash keys carry their string's hash, which is computed once per lookup and never again
+// when the table grows. Equal hashes are checked before the string comparison.
+typedef struct {
+	const char *s;
+	khint_t hash;
+} sd_key_t;
+
+#define sd_key_hash(a) ((a).hash)
+#define sd_key_eq(a, b) ((a).hash == (b).hash && strcmp((a).s, (b).s) == 0)
+KHASH_INIT(str, sd_key_t, uint32_t, 1, sd_key_hash, sd_key_eq)
 typedef khash_t(str) shash_t;
 
+static inline sd_key_t sd_key(const char *name)
+{
+	sd_key_t key;
+	key.s = name, key.hash = __ac_X31_hash_string(name);
+	return key;
+}
+
+#define SD_ARENA_BLOCK 0x100000
+
+typedef struct {
+	size_t n_block, m_block;
+	char **block;
+	size_t used, size; // of the last block
+} sd_arena_t;
+
+static char *sd_arena_strdup(sd_arena_t *a, const char *name)
+{
+	size_t l = strlen(name) + 1;
+	char *p;
+	if (a->n_block == 0 || a->used + l > a->size) {
+		if (a->n_block == a->m_block) {
+			a->m_block = a->m_block? a->m_block<<1 : 16;
+			a->block = (char**)realloc(a->block, a->m_block * sizeof(char*));
+		}
+		a->size = l > SD_ARENA_BLOCK? l : SD_ARENA_BLOCK;
+		a->block[a->n_block++] = (char*)malloc(a->size);
+		a->used = 0;
+	}
+	p = a->block[a->n_block - 1] + a->used;
+	memcpy(p, name, l);
+	a->used += l;
+	return p;
+}
+
+static void sd_arena_destroy(sd_arena_t *a)
+{
+	size_t i;
+	if (a == 0) return;
+	for (i = 0; i < a->n_block; ++i)
+		free(a->block[i]);
+	free(a->block);
+	free(a);
+}
+
 sdict_t *init_seq_dict(void)
 {
 	sdict_t *d;
 	d = (sdict_t*)calloc(1, sizeof(sdict_t));
 	d->h = kh_init(str);
+	d->a = calloc(1, sizeof(sd_arena_t));
 	return d;
 }
 
 void destroy_seq_dict(sdict_t *d)
 {
-	uint32_t i;
 	if (d == 0) return;
 	if (d->h) kh_destroy(str, (shash_t*)d->h);
-	for (i = 0; i < d->n_seq; ++i)
-		free(d->seq[i].name);
+	sd_arena_destroy((sd_arena_t*)d->a);
 	free(d->seq);
 	free(d);
 }
@@ -32,7 +84,7 @@ int32_t sd_put(sdict_t *d, const char *name, uint32_t len)
 	shash_t *h = (shash_t*)d->h;
 	khint_t k;
 	int absent;
-	k = kh_put(str, h, name, &absent);
+	k = kh_put(str, h, sd_key(name), &absent);
 	if (absent) {
 		sd_seq_t *s;
 		if (d->n_seq == d->m_seq) {
@@ -41,7 +93,7 @@ int32_t sd_put(sdict_t *d, const char *name, uint32_t len)
 		}
 		s = &d->seq[d->n_seq];
 		s->len = len, s->aux = 0, s->del = 0;
-		kh_key(h, k) = s->name = strdup(name);
+		kh_key(h, k).s = s->name = sd_arena_strdup((sd_arena_t*)d->a, name);
 		kh_val(h, k) = d->n_seq++;
 	} // TODO: test if len is the same;
 	return kh_val(h, k);
@@ -51,7 +103,7 @@ int32_t sd_get(const sdict_t *d, const char *name)
 {
 	shash_t *h = (shash_t*)d->h;
 	khint_t k;
-	k = kh_get(str, h, name);
+	k = kh_get(str, h, sd_key(name));
 	return k == kh_end(h)? -1 : kh_val(h, k);
 }
 
@@ -61,10 +113,11 @@ void sd_hash(sdict_t *d)
 	shash_t *h;
 	if (d->h) return;
 	d->h = h = kh_init(str);
+	kh_resize(str, h, d->n_seq);
 	for (i = 0; i < d->n_seq; ++i) {
 		int absent;
 		khint_t k;
-		k = kh_put(str, h, d->seq[i].name, &absent);
+		k = kh_put(str, h, sd_key(d->seq[i].name), &absent);
 		kh_val(h, k) = i;
 	}
 }
@@ -78,8 +131,7 @@ int32_t *sd_squeeze(sdict_t *d)
 	}
 	map = (int32_t*)calloc(d->n_seq, 4);
 	for (i = j = 0; i < d->n_seq; ++i) {
-		if (d->seq[i].del) {
-			free(d->seq[i].name);
+		if (d->seq[i].del) { // the name stays in the arena until the dictionary is destroyed
 			map[i] = -1;
 		} else d->seq[j] = d->seq[i], map[i] = j++;
 	}
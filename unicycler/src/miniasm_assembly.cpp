@@ -31,7 +31,7 @@
 using namespace std;
 
 
-void miniasmAssembly(char * reads, char * overlaps, char * outputDir, int min_dp) {
+void miniasmAssembly(char * reads, char * overlaps, char * outputDir, int min_dp, int threads) {
     string paf_filename(overlaps);     // Input PAF mapping
     string reads_filename(reads);      // Input long reads
     string outdir(outputDir);          // Output directory
@@ -99,13 +99,11 @@ void miniasmAssembly(char * reads, char * overlaps, char * outputDir, int min_dp
     // Toss out reads which fail to meet the read depth threshold. It creates a sub object
     // which stores the start and end positions of a read which have met the min depth. This
     // first pass looks at the entire mappings (not clipped off at all).
-    subreads = filter_reads_using_depth(min_dp, min_iden, 0, num_hits, hits, read_dict);
+    subreads = filter_reads_using_depth(min_dp, min_iden, 0, num_hits, hits, read_dict, threads);
 
-    // Toss out hits which fail to meet the minimum span threshold.
-    num_hits = filter_hits_using_span(subreads, min_span, num_hits, hits);
-
-    // Toss out hits which have too much overhang.
-    num_hits = filter_hits_using_overhang(subreads, int(max_hang * 1.5), int(min_ovlp * 0.5), num_hits, hits, &cov);
+    // Toss out hits which fail to meet the minimum span threshold, and then those which have too
+    // much overhang. Both filters are applied in a single pass over the hits.
+    num_hits = filter_hits_using_span_and_overhang(subreads, min_span, int(max_hang * 1.5), int(min_ovlp * 0.5), num_hits, hits, &cov, threads);
     std::cerr << "\n";
 
     cerr << "===> Step 3: 2-pass (fine) read selection <===\n";
@@ -114,19 +112,19 @@ void miniasmAssembly(char * reads, char * overlaps, char * outputDir, int min_dp
     // Toss out reads which fail to meet the read depth threshold again.
     // This second pass trims the mappings down making it harder to meet the threshold (i.e.
     // the trimmed mapping must meet the depth threshold).
-    subreads_2 = filter_reads_using_depth(min_dp, min_iden, min_span/2, num_hits, hits, read_dict);
+    subreads_2 = filter_reads_using_depth(min_dp, min_iden, min_span/2, num_hits, hits, read_dict, threads);
 
     // Filter hits using the minimum span threshold again. Since we just did a more stringent
     // run through filter_reads_using_depth, this can toss out more alignments than our first call to this
     // function.
-    num_hits = filter_hits_using_span(subreads_2, min_span, num_hits, hits);
+    num_hits = filter_hits_using_span(subreads_2, min_span, num_hits, hits, threads);
 
     merge_subreads(read_dict->n_seq, subreads, subreads_2);
     free(subreads_2);
     save_read_names(num_hits, hits, read_dict, subreads, all_read_list);
 
     // Toss out contained reads (this is a big one and gets rid of a lot).
-    num_hits = remove_contained_reads(max_hang, int_frac, min_ovlp, read_dict, subreads, num_hits, hits, contained_read_list);
+    num_hits = remove_contained_reads(max_hang, int_frac, min_ovlp, read_dict, subreads, num_hits, hits, contained_read_list, threads);
     std::cerr << "\n";
 
     hits = (ma_hit_t*)realloc(hits, num_hits * sizeof(ma_hit_t));
@@ -134,19 +132,32 @@ void miniasmAssembly(char * reads, char * overlaps, char * outputDir, int min_dp
 
     cerr << "===> Step 4: graph cleaning <===\n";
     string_graph = make_string_graph(max_hang, int_frac, min_ovlp, read_dict, subreads, num_hits, hits);
-    save_string_graph(string_graph, read_dict, subreads, raw_string_graph, reads_filename.c_str());
+    ma_read_store_t read_store;
+    if (load_read_store(string_graph, read_dict, subreads, reads_filename.c_str(), read_store) != 0) {
+        // No string graphs are saved, so the caller sees that the assembly failed.
+        cerr << "Error: could not open " << reads_filename << "\n";
+        destroy_string_graph(string_graph);
+        free(subreads); free(hits);
+        destroy_seq_dict(read_dict);
+        if (excluded_reads)
+            destroy_seq_dict(excluded_reads);
+        std::cerr.rdbuf(old);
+        outFile.close();
+        return;
+    }
+    save_string_graph(string_graph, read_dict, subreads, raw_string_graph, read_store);
     std::cerr << "\n";
 
     cerr << "===> Step 4.1: transitive reduction <===\n";
     asg_arc_del_trans(string_graph, gap_fuzz);
-    save_string_graph(string_graph, read_dict, subreads, transitive_reduction_string_graph, reads_filename.c_str());
+    save_string_graph(string_graph, read_dict, subreads, transitive_reduction_string_graph, read_store);
     std::cerr << "\n";
 
     cerr << "===> Step 4.2: initial tip cutting and bubble popping <===\n";
     cut_tips(string_graph, max_ext);
-    save_string_graph(string_graph, read_dict, subreads, tip_cut_string_graph, reads_filename.c_str());
+    save_string_graph(string_graph, read_dict, subreads, tip_cut_string_graph, read_store);
     pop_bubbles(string_graph, bub_dist);
-    save_string_graph(string_graph, read_dict, subreads, bubble_pop_string_graph, reads_filename.c_str());
+    save_string_graph(string_graph, read_dict, subreads, bubble_pop_string_graph, read_store);
     std::cerr << "\n";
 
     cerr << "===> Step 4.3: cutting short overlaps (%d rounds in total) <===\n";
@@ -157,7 +168,7 @@ void miniasmAssembly(char * reads, char * overlaps, char * outputDir, int min_dp
             pop_bubbles(string_graph, bub_dist);
         }
     }
-    save_string_graph(string_graph, read_dict, subreads, cut_overlaps_string_graph_1, reads_filename.c_str());
+    save_string_graph(string_graph, read_dict, subreads, cut_overlaps_string_graph_1, read_store);
     std::cerr << "\n";
 
     cerr << "===> Step 4.4: removing short internal sequences and bi-loops <===\n";
@@ -165,7 +176,7 @@ void miniasmAssembly(char * reads, char * overlaps, char * outputDir, int min_dp
     cut_biloops(string_graph, max_ext);
     cut_tips(string_graph, max_ext);
     pop_bubbles(string_graph, bub_dist);
-    save_string_graph(string_graph, read_dict, subreads, remove_internal_string_graph, reads_filename.c_str());
+    save_string_graph(string_graph, read_dict, subreads, remove_internal_string_graph, read_store);
     std::cerr << "\n";
 
     cerr << "===> Step 4.5: aggressively cutting short overlaps <===\n";
@@ -173,10 +184,10 @@ void miniasmAssembly(char * reads, char * overlaps, char * outputDir, int min_dp
         cut_tips(string_graph, max_ext);
         pop_bubbles(string_graph, bub_dist);
     }
-    save_string_graph(string_graph, read_dict, subreads, cut_overlaps_string_graph_2, reads_filename.c_str());
+    save_string_graph(string_graph, read_dict, subreads, cut_overlaps_string_graph_2, read_store);
     std::cerr << "\n";
 
-    save_string_graph(string_graph, read_dict, subreads, final_string_graph, reads_filename.c_str());
+    save_string_graph(string_graph, read_dict, subreads, final_string_graph, read_store);
     destroy_string_graph(string_graph);
 
     // Clean up!
@@ -1,28 +1,155 @@
 #include <zlib.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include "minimap/bseq.h"
 #include "minimap/kseq.h"
-KSEQ_INIT(gzFile, gzread)
+
+/****************************
+ * Read-ahead decompression *
+ ***************************/
+
+// RRW: a background thread decompresses (or just reads, for plain files) the input into a ring of
+// blocks, so decompression runs in parallel with FASTA/FASTQ parsing in the calling thread.
+
+#define BSEQ_BLOCK_SIZE 0x100000
+#define BSEQ_N_BLOCKS   8
+
+struct bseq_reader_s {
+	gzFile fp;
+	pthread_t tid;
+	pthread_mutex_t mutex;
+	pthread_cond_t cv;
+	unsigned char *block[BSEQ_N_BLOCKS];
+	int len[BSEQ_N_BLOCKS];
+	int head, tail, n_full; // blocks are filled at _tail_ and consumed from _head_
+	int pos;                // consumer's position in the head block
+	int eof, stop;
+	uint64_t n_in, n_out;   // compressed bytes consumed and bytes produced so far
+};
+
+static void *bseq_reader_worker(void *data)
+{
+	bseq_reader_t *r = (bseq_reader_t*)data;
+	for (;;) {
+		int l;
+		pthread_mutex_lock(&r->mutex);
+		while (r->n_full == BSEQ_N_BLOCKS && !r->stop)
+			pthread_cond_wait(&r->cv, &r->mutex);
+		if (r->stop) {
+			pthread_mutex_unlock(&r->mutex);
+			break;
+		}
+		pthread_mutex_unlock(&r->mutex);
+		l = gzread(r->fp, r->block[r->tail], BSEQ_BLOCK_SIZE); // the consumer never touches this block while it's not full
+		pthread_mutex_lock(&r->mutex);
+		r->len[r->tail] = l > 0? l : 0;
+		r->n_out += r->len[r->tail];
+		r->n_in = gzoffset(r->fp);
+		r->tail = (r->tail + 1) % BSEQ_N_BLOCKS;
+		++r->n_full;
+		if (l < BSEQ_BLOCK_SIZE) r->eof = 1; // gzread() only returns a short block at the end or on an error
+		pthread_cond_broadcast(&r->cv);
+		pthread_mutex_unlock(&r->mutex);
+		if (r->eof) break;
+	}
+	return 0;
+}
+
+static bseq_reader_t *bseq_reader_init(gzFile fp)
+{
+	int i;
+	bseq_reader_t *r = (bseq_reader_t*)calloc(1, sizeof(bseq_reader_t));
+	r->fp = fp;
+	for (i = 0; i < BSEQ_N_BLOCKS; ++i)
+		r->block[i] = (unsigned char*)malloc(BSEQ_BLOCK_SIZE);
+	pthread_mutex_init(&r->mutex, 0);
+	pthread_cond_init(&r->cv, 0);
+	pthread_create(&r->tid, 0, bseq_reader_worker, r);
+	return r;
+}
+
+void bseq_reader_close(bseq_reader_t *r)
+{
+	int i;
+	pthread_mutex_lock(&r->mutex);
+	r->stop = 1;
+	pthread_cond_broadcast(&r->cv);
+	pthread_mutex_unlock(&r->mutex);
+	pthread_join(r->tid, 0);
+	pthread_mutex_destroy(&r->mutex);
+	pthread_cond_destroy(&r->cv);
+	for (i = 0; i < BSEQ_N_BLOCKS; ++i) free(r->block[i]);
+	gzclose(r->fp);
+	free(r);
+}
+
+// Fills _buf_ completely unless the end of the input is reached (kseq treats a short read as EOF).
+int bseq_reader_read(bseq_reader_t *r, void *buf, int len)
+{
+	int copied = 0;
+	while (copied < len) {
+		int n;
+		pthread_mutex_lock(&r->mutex);
+		while (r->n_full == 0 && !r->eof)
+			pthread_cond_wait(&r->cv, &r->mutex);
+		if (r->n_full == 0) { // end of input
+			pthread_mutex_unlock(&r->mutex);
+			break;
+		}
+		pthread_mutex_unlock(&r->mutex);
+		n = r->len[r->head] - r->pos;
+		if (n > len - copied) n = len - copied;
+		memcpy((unsigned char*)buf + copied, r->block[r->head] + r->pos, n);
+		copied += n, r->pos += n;
+		if (r->pos == r->len[r->head]) { // this block is used up; give it back to the reader thread
+			pthread_mutex_lock(&r->mutex);
+			r->head = (r->head + 1) % BSEQ_N_BLOCKS;
+			--r->n_full;
+			r->pos = 0;
+			pthread_cond_broadcast(&r->cv);
+			pthread_mutex_unlock(&r->mutex);
+		}
+	}
+	return copied;
+}
+
+bseq_reader_t *bseq_reader_open(const char *fn)
+{
+	gzFile f;
+	f = fn && strcmp(fn, "-")? gzopen(fn, "r") : gzdopen(fileno(stdin), "r");
+	if (f == 0) return 0;
+	return bseq_reader_init(f);
+}
+
+double bseq_reader_ratio(bseq_reader_t *r)
+{
+	double ratio;
+	pthread_mutex_lock(&r->mutex);
+	ratio = r->n_out? (double)r->n_in / r->n_out : 0.;
+	pthread_mutex_unlock(&r->mutex);
+	return ratio;
+}
+
+KSEQ_INIT(bseq_reader_t*, bseq_reader_read)
 
 extern unsigned char seq_nt4_table[256];
 
 struct bseq_file_s {
 	int is_eof;
-	gzFile fp;
+	bseq_reader_t *fp;
 	kseq_t *ks;
 };
 
 bseq_file_t *bseq_open(const char *fn)
 {
 	bseq_file_t *fp;
-	gzFile f;
-	f = fn && strcmp(fn, "-")? gzopen(fn, "r") : gzdopen(fileno(stdin), "r");
-	if (f == 0) return 0;
+	bseq_reader_t *r = bseq_reader_open(fn);
+	if (r == 0) return 0;
 	fp = (bseq_file_t*)calloc(1, sizeof(bseq_file_t));
-	fp->fp = f;
+	fp->fp = r;
 	fp->ks = kseq_init(fp->fp);
 	return fp;
 }
@@ -30,7 +157,7 @@ bseq_file_t *bseq_open(const char *fn)
 void bseq_close(bseq_file_t *fp)
 {
 	kseq_destroy(fp->ks);
-	gzclose(fp->fp);
+	bseq_reader_close(fp->fp);
 	free(fp);
 }
 
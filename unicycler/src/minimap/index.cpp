@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include <limits>
 
 #pragma GCC diagnostic ignored "-Wsign-compare"
@@ -11,14 +12,13 @@
 #include "minimap/minimap.h"
 #include "minimap/kvec.h"
 #include "minimap/khash.h"
+#include "minimap/kthread.h"
 
 #define idx_hash(a) ((a)>>1)
 #define idx_eq(a, b) ((a)>>1 == (b)>>1)
 KHASH_INIT(idx, uint64_t, uint64_t, 1, idx_hash, idx_eq)
 typedef khash_t(idx) idxhash_t;
 
-void kt_for(int n_threads, void (*func)(void*,long,int), void *data, long n);
-
 mm_idx_t *mm_idx_init(int w, int k, int b)
 {
 	mm_idx_t *mi;
@@ -156,16 +156,95 @@ static void mm_idx_post(mm_idx_t *mi, int n_threads)
 	kt_for(n_threads, worker_post, mi, 1<<mi->b);
 }
 
+/******************************
+ * Adaptive number of buckets *
+ ******************************/
+
+// RRW: MM_IDX_DEF_B buckets suits a whole genome, but Unicycler indexes anything from a small
+// assembly graph (many near-empty buckets) to all of the long reads (very large buckets). When
+// mm_idx_gen() is given MM_IDX_AUTO_B, minimizers are collected into MM_IDX_DEF_B buckets and
+// then moved to the number of buckets that gives about MM_IDX_BUCKET_SIZE minimizers each.
+
+#define MM_IDX_MIN_B       10
+#define MM_IDX_MAX_B       20
+#define MM_IDX_BUCKET_SIZE 1024
+
+static int mm_idx_choose_b(const mm_idx_t *mi)
+{
+	uint64_t n = 0;
+	int i, b;
+	for (i = 0; i < 1<<mi->b; ++i) n += mi->B[i].a.n;
+	for (b = MM_IDX_MIN_B; b < MM_IDX_MAX_B && n>>b > MM_IDX_BUCKET_SIZE; ++b);
+	return b < mi->k * 2? b : mi->k * 2;
+}
+
+typedef struct {
+	mm_idx_t *mi;
+	mm_idx_bucket_t *B; // new buckets
+	int b;              // new b
+} rebucket_t;
+
+// fewer buckets: new bucket _j_ takes old buckets j, j + 2^b, j + 2*2^b, ...
+static void worker_merge(void *data, long j, int tid)
+{
+	rebucket_t *r = (rebucket_t*)data;
+	mm128_v *p = &r->B[j].a;
+	long i;
+	size_t n = 0;
+	for (i = j; i < 1<<r->mi->b; i += 1L<<r->b) n += r->mi->B[i].a.n;
+	if (n == 0) return;
+	kv_resize(mm128_t, *p, n);
+	for (i = j; i < 1<<r->mi->b; i += 1L<<r->b) {
+		mm128_v *q = &r->mi->B[i].a;
+		memcpy(p->a + p->n, q->a, q->n * sizeof(mm128_t));
+		p->n += q->n;
+		free(q->a);
+		q->n = q->m = 0, q->a = 0;
+	}
+}
+
+// more buckets: old bucket _i_ is divided between new buckets i, i + 2^old_b, i + 2*2^old_b, ...
+static void worker_split(void *data, long i, int tid)
+{
+	rebucket_t *r = (rebucket_t*)data;
+	mm128_v *q = &r->mi->B[i].a;
+	int old_b = r->mi->b, n_sub = 1<<(r->b - old_b);
+	uint64_t mask = (1ULL<<r->b) - 1;
+	size_t j, *cnt;
+	if (q->n == 0) return;
+	cnt = (size_t*)calloc(n_sub, sizeof(size_t));
+	for (j = 0; j < q->n; ++j) ++cnt[(q->a[j].x & mask) >> old_b];
+	for (j = 0; j < n_sub; ++j)
+		if (cnt[j]) kv_resize(mm128_t, r->B[i + (j << old_b)].a, cnt[j]);
+	for (j = 0; j < q->n; ++j) {
+		mm128_v *p = &r->B[q->a[j].x & mask].a;
+		p->a[p->n++] = q->a[j];
+	}
+	free(cnt);
+	free(q->a);
+	q->n = q->m = 0, q->a = 0;
+}
+
+// move the collected (not yet sorted) minimizers to 2^b buckets
+static void mm_idx_set_b(mm_idx_t *mi, int b, int n_threads)
+{
+	rebucket_t r;
+	if (b == mi->b) return;
+	r.mi = mi, r.b = b;
+	r.B = (mm_idx_bucket_t*)calloc(1<<b, sizeof(mm_idx_bucket_t));
+	if (b < mi->b) kt_for(n_threads, worker_merge, &r, 1<<b);
+	else kt_for(n_threads, worker_split, &r, 1<<mi->b);
+	free(mi->B);
+	mi->B = r.B, mi->b = b;
+}
+
 /******************
  * Generate index *
  ******************/
 
-#include <string.h>
 #include <zlib.h>
 #include "minimap/bseq.h"
 
-void kt_pipeline(int n_threads, void *(*func)(void*, int, void*), void *shared_data, int n_steps);
-
 typedef struct {
 	int tbatch_size, n_processed, keep_name;
 	bseq_file_t *fp;
@@ -244,12 +323,14 @@ mm_idx_t *mm_idx_gen(bseq_file_t *fp, int w, int k, int b, int tbatch_size, int
 	pl.ibatch_size = ibatch_size;
 	pl.fp = fp;
 	if (pl.fp == 0) return 0;
-	pl.mi = mm_idx_init(w, k, b);
+	pl.mi = mm_idx_init(w, k, b == MM_IDX_AUTO_B? MM_IDX_DEF_B : b);
 
 	kt_pipeline(n_threads < 3? n_threads : 3, worker_pipeline, &pl, 3);
 	if (mm_verbose >= 3)
 		fprintf(stdout, "[M::%s::%.3f*%.2f] collected minimizers\n", __func__, realtime() - mm_realtime0, cputime() / (realtime() - mm_realtime0));
 
+	if (b == MM_IDX_AUTO_B)
+		mm_idx_set_b(pl.mi, mm_idx_choose_b(pl.mi), n_threads);
 	mm_idx_post(pl.mi, n_threads);
 	if (mm_verbose >= 3)
 		fprintf(stdout, "[M::%s::%.3f*%.2f] sorted minimizers\n", __func__, realtime() - mm_realtime0, cputime() / (realtime() - mm_realtime0));
@@ -263,7 +344,7 @@ mm_idx_t *mm_idx_build(const char *fn, int w, int k, int n_threads) // a simpler
 	mm_idx_t *mi;
 	fp = bseq_open(fn);
 	if (fp == 0) return 0;
-	mi = mm_idx_gen(fp, w, k, MM_IDX_DEF_B, 1<<18, n_threads, std::numeric_limits<uint64_t>::max(), 1);
+	mi = mm_idx_gen(fp, w, k, MM_IDX_AUTO_B, 1<<18, n_threads, std::numeric_limits<uint64_t>::max(), 1);
 	mm_idx_set_max_occ(mi, 0.001);
 	bseq_close(fp);
 	return mi;
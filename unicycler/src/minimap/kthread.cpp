@@ -1,62 +1,207 @@
 #include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <unistd.h>
+#include "minimap/kthread.h"
+
+// Each participant's range of a kt_for() loop is handed out in about this many chunks.
+#define KT_FOR_CHUNKS_PER_THREAD 8
 
 /************
  * kt_for() *
  ************/
 
-struct kt_for_t;
+// RRW: kt_for() originally created and joined n_threads threads on every call. It now runs on a
+// process-wide pool of persistent workers. Each participant starts with its own contiguous range
+// of indices (processed in chunks for locality) and steals chunks from the fullest remaining
+// range when it runs out. The calling thread always takes part, so a kt_for() call completes even
+// when every pool worker is busy elsewhere (e.g. nested or concurrent calls).
 
 typedef struct {
-	struct kt_for_t *t;
-	long i;
-} ktf_worker_t;
-
-typedef struct kt_for_t {
-	int n_threads;
-	long n;
-	ktf_worker_t *w;
+	volatile long next, end;
+} ktf_range_t;
+
+typedef struct ktf_job_s {
 	void (*func)(void*,long,int);
 	void *data;
-} kt_for_t;
+	long chunk;
+	int n_slots, next_slot; // slot 0 belongs to the caller
+	int active;             // pool workers currently in this job
+	ktf_range_t *r;
+	struct ktf_job_s *next;
+} ktf_job_t;
+
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t job_cv, done_cv;
+	ktf_job_t *jobs; // jobs which still have unclaimed slots
+	int n_workers, pin;
+} ktf_pool_t;
 
-static inline long steal_work(kt_for_t *t)
+static ktf_pool_t kt_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0 };
+
+static void ktf_run_slot(ktf_job_t *job, int slot)
 {
-	int i, min_i = -1;
-	long k, min = LONG_MAX;
-	for (i = 0; i < t->n_threads; ++i)
-		if (min > t->w[i].i) min = t->w[i].i, min_i = i;
-	k = __sync_fetch_and_add(&t->w[min_i].i, t->n_threads);
-	return k >= t->n? -1 : k;
+	long i, j, end;
+	for (;;) { // our own range first
+		ktf_range_t *r = &job->r[slot];
+		i = __sync_fetch_and_add(&r->next, job->chunk);
+		if (i >= r->end) break;
+		end = i + job->chunk < r->end? i + job->chunk : r->end;
+		for (j = i; j < end; ++j) job->func(job->data, j, slot);
+	}
+	for (;;) { // then steal from whichever range has the most left
+		int k, max_k = -1;
+		long left, max_left = 0;
+		for (k = 0; k < job->n_slots; ++k) {
+			left = job->r[k].end - job->r[k].next;
+			if (left > max_left) max_left = left, max_k = k;
+		}
+		if (max_k < 0) break;
+		i = __sync_fetch_and_add(&job->r[max_k].next, job->chunk);
+		if (i >= job->r[max_k].end) continue;
+		end = i + job->chunk < job->r[max_k].end? i + job->chunk : job->r[max_k].end;
+		for (j = i; j < end; ++j) job->func(job->data, j, slot);
+	}
 }
 
-static void *ktf_worker(void *data)
+#ifdef __linux__
+// Pins a worker to the CPUs of one NUMA node, chosen round-robin by worker number. Does nothing if
+// the node layout can't be read.
+static void ktf_pin_worker(int worker)
 {
-	ktf_worker_t *w = (ktf_worker_t*)data;
-	long i;
+	char fn[64], list[4096];
+	int n_nodes = 0, node, a, b, n;
+	const char *p;
+	FILE *fp;
+	cpu_set_t set;
 	for (;;) {
-		i = __sync_fetch_and_add(&w->i, w->t->n_threads);
-		if (i >= w->t->n) break;
-		w->t->func(w->t->data, i, w - w->t->w);
+		snprintf(fn, sizeof(fn), "/sys/devices/system/node/node%d/cpulist", n_nodes);
+		if (access(fn, R_OK) != 0) break;
+		++n_nodes;
+	}
+	if (n_nodes == 0) return;
+	node = worker % n_nodes;
+	snprintf(fn, sizeof(fn), "/sys/devices/system/node/node%d/cpulist", node);
+	if ((fp = fopen(fn, "r")) == 0) return;
+	if (fgets(list, sizeof(list), fp) == 0) list[0] = 0;
+	fclose(fp);
+	CPU_ZERO(&set);
+	for (p = list, n = 0; sscanf(p, "%d%n", &a, &n) == 1; ) { // e.g. "0-7,16-23"
+		p += n, b = a;
+		if (*p == '-' && sscanf(p + 1, "%d%n", &b, &n) == 1) p += n + 1;
+		for (; a <= b && a < CPU_SETSIZE; ++a) CPU_SET(a, &set);
+		if (*p != ',') break;
+		++p;
+	}
+	if (CPU_COUNT(&set) > 0)
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+}
+#endif
+
+static void *ktf_pool_worker(void *data)
+{
+	ktf_pool_t *pool = &kt_pool;
+	int slot;
+	ktf_job_t *job;
+#ifdef __linux__
+	if (pool->pin) ktf_pin_worker((int)(long)data);
+#else
+	(void)data;
+#endif
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		while (pool->jobs == 0)
+			pthread_cond_wait(&pool->job_cv, &pool->mutex);
+		job = pool->jobs;
+		slot = job->next_slot++;
+		if (job->next_slot == job->n_slots) pool->jobs = job->next; // all slots taken
+		++job->active;
+		pthread_mutex_unlock(&pool->mutex);
+		ktf_run_slot(job, slot);
+		pthread_mutex_lock(&pool->mutex);
+		if (--job->active == 0) pthread_cond_broadcast(&pool->done_cv);
+	}
+	return 0;
+}
+
+// A forked child only inherits the thread that called fork(), so it starts with an empty pool.
+static void ktf_pool_prepare_fork(void) { pthread_mutex_lock(&kt_pool.mutex); }
+static void ktf_pool_parent_fork(void) { pthread_mutex_unlock(&kt_pool.mutex); }
+static void ktf_pool_child_fork(void)
+{
+	kt_pool.n_workers = 0, kt_pool.jobs = 0;
+	pthread_mutex_unlock(&kt_pool.mutex);
+}
+
+static void ktf_pool_register_atfork(void)
+{
+	pthread_atfork(ktf_pool_prepare_fork, ktf_pool_parent_fork, ktf_pool_child_fork);
+}
+
+// Starts more pool workers if fewer than n exist. Must be called with the pool mutex held.
+static void ktf_pool_grow(ktf_pool_t *pool, int n)
+{
+	static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+	pthread_attr_t attr;
+	if (pool->n_workers >= n) return;
+	pthread_once(&atfork_once, ktf_pool_register_atfork);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	while (pool->n_workers < n) {
+		pthread_t tid;
+		if (pthread_create(&tid, &attr, ktf_pool_worker, (void*)(long)pool->n_workers) != 0) break;
+		++pool->n_workers;
 	}
-	while ((i = steal_work(w->t)) >= 0)
-		w->t->func(w->t->data, i, w - w->t->w);
-	pthread_exit(0);
+	pthread_attr_destroy(&attr);
+}
+
+// If enabled, pool workers started from now on are pinned to NUMA nodes (Linux only).
+void kt_pool_pin_threads(int pin)
+{
+	pthread_mutex_lock(&kt_pool.mutex);
+	kt_pool.pin = pin;
+	pthread_mutex_unlock(&kt_pool.mutex);
 }
 
 void kt_for(int n_threads, void (*func)(void*,long,int), void *data, long n)
 {
 	int i;
-	kt_for_t t;
-	pthread_t *tid;
-	t.func = func, t.data = data, t.n_threads = n_threads, t.n = n;
-	t.w = (ktf_worker_t*)alloca(n_threads * sizeof(ktf_worker_t));
-	tid = (pthread_t*)alloca(n_threads * sizeof(pthread_t));
+	ktf_job_t job, **q;
+	ktf_pool_t *pool = &kt_pool;
+	if (n <= 0) return;
+	if (n_threads > n) n_threads = n;
+	if (n_threads <= 1) {
+		for (i = 0; i < n; ++i) func(data, i, 0);
+		return;
+	}
+	job.func = func, job.data = data;
+	job.n_slots = n_threads, job.next_slot = 1, job.active = 0, job.next = 0;
+	job.chunk = n / ((long)n_threads * KT_FOR_CHUNKS_PER_THREAD);
+	if (job.chunk < 1) job.chunk = 1;
+	job.r = (ktf_range_t*)alloca(n_threads * sizeof(ktf_range_t));
 	for (i = 0; i < n_threads; ++i)
-		t.w[i].t = &t, t.w[i].i = i;
-	for (i = 0; i < n_threads; ++i) pthread_create(&tid[i], 0, ktf_worker, &t.w[i]);
-	for (i = 0; i < n_threads; ++i) pthread_join(tid[i], 0);
+		job.r[i].next = n * i / n_threads, job.r[i].end = n * (i + 1) / n_threads;
+
+	pthread_mutex_lock(&pool->mutex);
+	ktf_pool_grow(pool, n_threads - 1);
+	for (q = &pool->jobs; *q; q = &(*q)->next);
+	*q = &job;
+	pthread_cond_broadcast(&pool->job_cv);
+	pthread_mutex_unlock(&pool->mutex);
+
+	ktf_run_slot(&job, 0);
+
+	// No more work is left, so withdraw the job (if any slots are unclaimed) and wait for the
+	// workers still finishing their last chunk.
+	pthread_mutex_lock(&pool->mutex);
+	for (q = &pool->jobs; *q; q = &(*q)->next)
+		if (*q == &job) { *q = job.next; break; }
+	while (job.active > 0)
+		pthread_cond_wait(&pool->done_cv, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
 }
 
 /*****************
@@ -112,7 +257,7 @@ static void *ktp_worker(void *data)
 		pthread_cond_broadcast(&p->cv);
 		pthread_mutex_unlock(&p->mutex);
 	}
-	pthread_exit(0);
+	return 0;
 }
 
 void kt_pipeline(int n_threads, void *(*func)(void*, int, void*), void *shared_data, int n_steps)
@@ -137,9 +282,13 @@ void kt_pipeline(int n_threads, void *(*func)(void*, int, void*), void *shared_d
 		w->index = aux.index++;
 	}
 
+	// RRW: pipeline workers block while waiting for each other's steps, so they can't share the
+	// kt_for() pool without risking deadlock. They still get dedicated threads, but the calling
+	// thread now acts as the first worker.
 	tid = (pthread_t*)alloca(n_threads * sizeof(pthread_t));
-	for (i = 0; i < n_threads; ++i) pthread_create(&tid[i], 0, ktp_worker, &aux.workers[i]);
-	for (i = 0; i < n_threads; ++i) pthread_join(tid[i], 0);
+	for (i = 1; i < n_threads; ++i) pthread_create(&tid[i], 0, ktp_worker, &aux.workers[i]);
+	ktp_worker(&aux.workers[0]);
+	for (i = 1; i < n_threads; ++i) pthread_join(tid[i], 0);
 
 	pthread_mutex_destroy(&aux.mutex);
 	pthread_cond_destroy(&aux.cv);
@@ -3,8 +3,10 @@
 #include <stdio.h>
 #include <iostream>
 #include <limits>
+#include <string>
 
 #include "minimap/bseq.h"
+#include "minimap/kthread.h"
 #include "minimap/kvec.h"
 #include "minimap/minimap.h"
 #include "minimap/sdust.h"
@@ -24,6 +26,7 @@ void mm_mapopt_init(mm_mapopt_t *opt)
 	opt->sdust_thres = 0;
 	opt->flag = MM_F_WITH_REP;
 	opt->merge_frac = .5;
+	opt->pipeline_depth = 3;
 }
 
 /****************************
@@ -41,6 +44,11 @@ struct mm_tbuf_s { // per-thread buffer
 	uint32_t n, m;
 	uint64_t *a;
 	size_t *b, *p;
+	// the following are for chaining (MM_F_CHAIN)
+	mm128_v anc;
+	int32_t *f, *t;
+	uint64_t *srt;
+	size_t m_dp;
 	// final output
 	kvec_t(mm_reg1_t) reg;
 };
@@ -58,6 +66,7 @@ void mm_tbuf_destroy(mm_tbuf_t *b)
 	if (b == 0) return;
 	free(b->mini.a); free(b->coef.a); free(b->intv.a); free(b->reg.a); free(b->reg2mini.a); free(b->rep_aux.a);
 	free(b->a); free(b->b); free(b->p);
+	free(b->anc.a); free(b->f); free(b->t); free(b->srt);
 	sdust_buf_destroy(b->sdb);
 	free(b);
 }
@@ -97,6 +106,38 @@ static void drop_rep(mm_tbuf_t *b, int min_cnt)
 	b->reg.n = n;
 }
 
+// add a region made from _n_ hits (minimizer index<<32 | reference position), in query order
+static void push_reg(mm_tbuf_t *b, int rid, int rev, int k, int n, const uint64_t *v)
+{
+	int j;
+	uint32_t lq = 0, lr = 0, eq = 0, er = 0, sq = 0, sr = 0;
+	mm_reg1_t *r;
+	kv_pushp(mm_reg1_t, b->reg, &r);
+	r->rid = rid, r->rev = rev, r->cnt = n, r->rep = 0;
+	r->qs = ((uint32_t)b->mini.a[v[0]>>32].y>>1) - (k - 1);
+	r->qe = ((uint32_t)b->mini.a[v[n-1]>>32].y>>1) + 1;
+	r->rs = rev? (uint32_t)v[n-1] : (uint32_t)v[0];
+	r->re = rev? (uint32_t)v[0] : (uint32_t)v[n-1];
+	r->rs -= k - 1;
+	r->re += 1;
+	for (j = 0; j < n; ++j) { // count the number of times each minimizer is used
+		int jj = v[j]>>32;
+		b->mini.a[jj].y += 1ULL<<32;
+		kv_push(uint32_t, b->reg2mini, jj); // keep minimizer<=>reg mapping for derep
+	}
+	for (j = 0; j < n; ++j) { // compute ->len
+		uint32_t q = ((uint32_t)b->mini.a[v[j]>>32].y>>1) - (k - 1);
+		uint32_t r = (uint32_t)v[j];
+		r = !rev? r - (k - 1) : (0x80000000U - r);
+		if (r > er) lr += er - sr, sr = r, er = sr + k;
+		else er = r + k;
+		if (q > eq) lq += eq - sq, sq = q, eq = sq + k;
+		else eq = q + k;
+	}
+	lr += er - sr, lq += eq - sq;
+	r->len = lr < lq? lr : lq;
+}
+
 static void proc_intv(mm_tbuf_t *b, int which, int k, int min_cnt, int max_gap)
 {
 	int i, j, l_lis, rid = -1, rev = 0, start = b->intv.a[which].y, end = start + b->intv.a[which].x;
@@ -121,49 +162,111 @@ static void proc_intv(mm_tbuf_t *b, int which, int k, int min_cnt, int max_gap)
 	// find the longest increasing sequence
 	l_lis = rev? ks_lis_low32gt(b->n, b->a, b->b, b->p) : ks_lis_low32lt(b->n, b->a, b->b, b->p); // LIS
 	if (l_lis < min_cnt) return;
+	for (i = 0; i < l_lis; ++i) // gather the LIS to the front of _a_ (b->b[i] >= i, so this is safe in place)
+		b->a[i] = b->a[b->b[i]];
 	for (i = 1, j = 1; i < l_lis; ++i) // squeeze out minimizaers reused in the LIS sequence
-		if (b->a[b->b[i]]>>32 != b->a[b->b[i-1]]>>32)
-			b->a[b->b[j++]] = b->a[b->b[i]];
+		if (b->a[i]>>32 != b->a[i-1]>>32)
+			b->a[j++] = b->a[i];
 	l_lis = j;
 	if (l_lis < min_cnt) return;
 
 	// convert LISes to regions; possibly break an LIS at a long gaps
 	for (i = 1, start = 0; i <= l_lis; ++i) {
-		int32_t qgap = i == l_lis? 0 : ((uint32_t)b->mini.a[b->a[b->b[i]]>>32].y>>1) - ((uint32_t)b->mini.a[b->a[b->b[i-1]]>>32].y>>1);
-		if (i == l_lis || (qgap > max_gap && abs((int32_t)b->a[b->b[i]] - (int32_t)b->a[b->b[i-1]]) > max_gap)) {
-			if (i - start >= min_cnt) {
-				uint32_t lq = 0, lr = 0, eq = 0, er = 0, sq = 0, sr = 0;
-				mm_reg1_t *r;
-				kv_pushp(mm_reg1_t, b->reg, &r);
-				r->rid = rid, r->rev = rev, r->cnt = i - start, r->rep = 0;
-				r->qs = ((uint32_t)b->mini.a[b->a[b->b[start]]>>32].y>>1) - (k - 1);
-				r->qe = ((uint32_t)b->mini.a[b->a[b->b[i-1]]>>32].y>>1) + 1;
-				r->rs = rev? (uint32_t)b->a[b->b[i-1]] : (uint32_t)b->a[b->b[start]];
-				r->re = rev? (uint32_t)b->a[b->b[start]] : (uint32_t)b->a[b->b[i-1]];
-				r->rs -= k - 1;
-				r->re += 1;
-				for (j = start; j < i; ++j) { // count the number of times each minimizer is used
-					int jj = b->a[b->b[j]]>>32;
-					b->mini.a[jj].y += 1ULL<<32;
-					kv_push(uint32_t, b->reg2mini, jj); // keep minimizer<=>reg mapping for derep
-				}
-				for (j = start; j < i; ++j) { // compute ->len
-					uint32_t q = ((uint32_t)b->mini.a[b->a[b->b[j]]>>32].y>>1) - (k - 1);
-					uint32_t r = (uint32_t)b->a[b->b[j]];
-					r = !rev? r - (k - 1) : (0x80000000U - r);
-					if (r > er) lr += er - sr, sr = r, er = sr + k;
-					else er = r + k;
-					if (q > eq) lq += eq - sq, sq = q, eq = sq + k;
-					else eq = q + k;
-				}
-				lr += er - sr, lq += eq - sq;
-				r->len = lr < lq? lr : lq;
-			}
+		int32_t qgap = i == l_lis? 0 : ((uint32_t)b->mini.a[b->a[i]>>32].y>>1) - ((uint32_t)b->mini.a[b->a[i-1]>>32].y>>1);
+		if (i == l_lis || (qgap > max_gap && abs((int32_t)b->a[i] - (int32_t)b->a[i-1]) > max_gap)) {
+			if (i - start >= min_cnt)
+				push_reg(b, rid, rev, k, i - start, b->a + start);
 			start = i;
 		}
 	}
 }
 
+static inline int ilog2_32(uint32_t v)
+{
+	int l = 0;
+	while (v >>= 1) ++l;
+	return l;
+}
+
+// RRW: an alternative to Hough intervals + LIS, used when MM_F_CHAIN is set. Hits are sorted by
+// reference position and chained with a gap-cost DP (as in minimap2) which looks back at most
+// MM_CHAIN_MAX_ITER hits. Unlike an interval of width _radius_, a chain can drift along the
+// diagonal, so indel-rich reads give fewer, longer regions.
+static void chain_hits(mm_tbuf_t *b, int radius, int k, int min_cnt, int max_gap)
+{
+	mm128_v *c = &b->coef;
+	mm128_t *a;
+	int64_t i, j, n = c->n;
+
+	if (n > b->m_dp) {
+		b->m_dp = n;
+		kv_roundup32(b->m_dp);
+		b->f = (int32_t*)realloc(b->f, b->m_dp * sizeof(int32_t));
+		b->t = (int32_t*)realloc(b->t, b->m_dp * sizeof(int32_t));
+		b->srt = (uint64_t*)realloc(b->srt, b->m_dp * 8);
+	}
+	if (n > b->m) {
+		b->m = n;
+		kv_roundup32(b->m);
+		b->a = (uint64_t*)realloc(b->a, b->m * 8);
+		b->b = (size_t*)realloc(b->b, b->m * sizeof(size_t));
+		b->p = (size_t*)realloc(b->p, b->m * sizeof(size_t));
+	}
+
+	// anchors: x = strand<<63 | rid<<32 | reference position; y = minimizer index<<32 | query position
+	kv_resize(mm128_t, b->anc, n);
+	a = b->anc.a;
+	for (i = 0; i < n; ++i) {
+		uint32_t mj = c->a[i].y>>32;
+		a[i].x = (c->a[i].x>>63<<63) | (c->a[i].x<<1>>33<<32) | (uint32_t)c->a[i].y;
+		a[i].y = (uint64_t)mj<<32 | ((uint32_t)b->mini.a[mj].y>>1);
+	}
+	radix_sort_128x(a, a + n);
+
+	// fill the score (f) and backtrack (t) arrays
+	for (i = 0; i < n; ++i) {
+		int rev = a[i].x>>63;
+		int32_t qi = (int32_t)a[i].y, max_f = k, max_j = -1;
+		int64_t st = i > MM_CHAIN_MAX_ITER? i - MM_CHAIN_MAX_ITER : 0;
+		for (j = i - 1; j >= st; --j) {
+			int32_t dr, dq, dd, sc;
+			if (a[j].x>>32 != a[i].x>>32 || a[i].x - a[j].x > (uint64_t)max_gap) break;
+			dr = (int32_t)(a[i].x - a[j].x);
+			dq = rev? (int32_t)a[j].y - qi : qi - (int32_t)a[j].y;
+			if (dr == 0 || dq <= 0 || dq > max_gap) continue;
+			dd = dr > dq? dr - dq : dq - dr;
+			if (dd > radius) continue;
+			sc = dr < dq? dr : dq;
+			if (sc > k) sc = k;
+			sc = b->f[j] + sc - (dd? (int32_t)(.01 * k * dd) + (ilog2_32(dd)>>1) : 0);
+			if (sc > max_f) max_f = sc, max_j = j;
+		}
+		b->f[i] = max_f, b->t[i] = max_j;
+	}
+
+	// backtrack from the best chain ends; each hit belongs to at most one chain
+	for (i = 0; i < n; ++i) b->srt[i] = (uint64_t)b->f[i]<<32 | i;
+	radix_sort_64(b->srt, b->srt + n);
+	for (i = n - 1; i >= 0; --i) {
+		int64_t e = (uint32_t)b->srt[i];
+		int rev = a[e].x>>63, cnt = 0;
+		if (b->f[e] < 0) continue; // already used
+		for (j = e; j >= 0 && b->f[j] >= 0; j = b->t[j]) {
+			b->a[cnt++] = a[j].y>>32<<32 | (uint32_t)a[j].x;
+			b->f[j] = -1;
+		}
+		if (cnt < min_cnt) continue;
+		if (!rev) { // hits were collected in descending reference order; put them in query order
+			int64_t l, r;
+			for (l = 0, r = cnt - 1; l < r; ++l, --r) {
+				uint64_t tmp = b->a[l];
+				b->a[l] = b->a[r], b->a[r] = tmp;
+			}
+		}
+		push_reg(b, a[e].x<<1>>33, rev, k, cnt, b->a);
+	}
+}
+
 // merge or add a Hough interval; only used by get_reg()
 static inline void push_intv(mm128_v *intv, int start, int end, float merge_frac)
 {
@@ -211,6 +314,13 @@ static void get_reg(mm_tbuf_t *b, int radius, int k, int min_cnt, int max_gap, f
 		c->n = j;
 	}
 
+	b->reg2mini.n = 0;
+	if (flag&MM_F_CHAIN) {
+		chain_hits(b, radius, k, min_cnt, max_gap);
+		if (!(flag&MM_F_WITH_REP)) drop_rep(b, min_cnt);
+		return;
+	}
+
 	// identify (possibly overlapping) intervals within _radius_; an interval is a cluster of hits
 	b->intv.n = 0;
 	for (i = 1; i < c->n; ++i) {
@@ -225,7 +335,6 @@ static void get_reg(mm_tbuf_t *b, int radius, int k, int min_cnt, int max_gap, f
 	radix_sort_128x(b->intv.a, b->intv.a + b->intv.n);
 
 	// generate hits, starting from the largest interval
-	b->reg2mini.n = 0;
 	for (i = b->intv.n - 1; i >= 0; --i) proc_intv(b, i, k, min_cnt, max_gap);
 
 	// post repeat removal
@@ -234,12 +343,22 @@ static void get_reg(mm_tbuf_t *b, int radius, int k, int min_cnt, int max_gap, f
 
 const mm_reg1_t *mm_map(const mm_idx_t *mi, int l_seq, const char *seq, int *n_regs, mm_tbuf_t *b, const mm_mapopt_t *opt, const char *name)
 {
+	b->mini.n = 0;
+	mm_sketch(seq, l_seq, mi->w, mi->k, 0, &b->mini);
+	return mm_map_mini(mi, l_seq, seq, n_regs, b, opt, name, -1);
+}
+
+// RRW: the body of mm_map() after sketching, split out so reads sketched earlier (see
+// mm_sketch_set_t) can be mapped without their sequence. _seq_ may be NULL, in which case SDUST
+// masking is skipped. _qid_ is the query's index in its file, or -1 if unknown; see MM_F_AVA_RID.
+const mm_reg1_t *mm_map_mini(const mm_idx_t *mi, int l_seq, const char *seq, int *n_regs, mm_tbuf_t *b, const mm_mapopt_t *opt, const char *name, int64_t qid)
+{
+	int use_rid = qid >= 0 && (opt->flag&MM_F_AVA_RID);
 	int j, n_dreg = 0, u = 0;
 	const uint64_t *dreg = 0;
 
-	b->mini.n = b->coef.n = 0;
-	mm_sketch(seq, l_seq, mi->w, mi->k, 0, &b->mini);
-	if (opt->sdust_thres > 0)
+	b->coef.n = 0;
+	if (seq && opt->sdust_thres > 0)
 		dreg = sdust_core((const uint8_t*)seq, l_seq, opt->sdust_thres, 64, &n_dreg, b->sdb);
 	for (j = 0; j < b->mini.n; ++j) {
 		int k, n;
@@ -264,10 +383,16 @@ const mm_reg1_t *mm_map(const mm_idx_t *mi, int l_seq, const char *seq, int *n_r
 		for (k = 0; k < n; ++k) {
 			int32_t rpos = (uint32_t)r[k] >> 1;
 			mm128_t *p;
-			if (name && (opt->flag&MM_F_NO_SELF) && mi->name && strcmp(name, mi->name[r[k]>>32]) == 0 && rpos == qpos)
-				continue;
-			if (name && (opt->flag&MM_F_AVA) && mi->name && strcmp(name, mi->name[r[k]>>32]) > 0)
-				continue;
+			if (use_rid) { // same tests as below, but comparing sequence IDs instead of names
+				int64_t rid = mi->rid0 + (r[k]>>32);
+				if ((opt->flag&MM_F_NO_SELF) && qid == rid && rpos == qpos) continue;
+				if ((opt->flag&MM_F_AVA) && qid > rid) continue;
+			} else {
+				if (name && (opt->flag&MM_F_NO_SELF) && mi->name && strcmp(name, mi->name[r[k]>>32]) == 0 && rpos == qpos)
+					continue;
+				if (name && (opt->flag&MM_F_AVA) && mi->name && strcmp(name, mi->name[r[k]>>32]) > 0)
+					continue;
+			}
 			kv_pushp(mm128_t, b->coef, &p);
 			if ((r[k]&1) == strand) { // forward strand
 				p->x = (uint64_t)r[k] >> 32 << 32 | (0x80000000U + rpos - qpos);
@@ -289,9 +414,6 @@ const mm_reg1_t *mm_map(const mm_idx_t *mi, int l_seq, const char *seq, int *n_r
  * Multi-threaded mapping *
  **************************/
 
-void kt_for(int n_threads, void (*func)(void*,long,int), void *data, long n);
-void kt_pipeline(int n_threads, void *(*func)(void*, int, void*), void *shared_data, int n_steps);
-
 typedef struct {
 	int batch_size, n_processed, n_threads;
 	const mm_mapopt_t *opt;
@@ -303,28 +425,56 @@ typedef struct {
 	const pipeline_t *p;
     int n_seq;
 	bseq1_t *seq;
-	int *n_reg;
-	mm_reg1_t **reg;
+	std::string *out; // PAF lines for each sequence, formatted by the mapping threads
 	mm_tbuf_t **buf;
 } step_t;
 
+// RRW: I changed this code from using printf to cout, because I redirected cout to an
+// ostringstream so I can capture it for return to Python. The PAF lines are now built in the
+// mapping threads, so the output step only has to write finished strings to cout in order.
+static void format_regs(std::string &out, const char *qname, int qlen, int n_regs, const mm_reg1_t *regs, const mm_idx_t *mi, const mm_mapopt_t *opt)
+{
+	int j;
+	for (j = 0; j < n_regs; ++j) {
+		const mm_reg1_t *r = &regs[j];
+		if (r->len < opt->min_match)
+			continue;
+		out += qname; out += '\t';
+		out += std::to_string(qlen); out += '\t';
+		out += std::to_string(r->qs); out += '\t';
+		out += std::to_string(r->qe); out += '\t';
+		out += "+-"[r->rev]; out += '\t';
+		if (mi->name)
+			out += mi->name[r->rid];
+		else
+			out += std::to_string(r->rid + 1);
+		out += '\t';
+		out += std::to_string(mi->len[r->rid]); out += '\t';
+		out += std::to_string(r->rs); out += '\t';
+		out += std::to_string(r->re); out += '\t';
+		out += std::to_string(r->len); out += '\t';
+		out += std::to_string(r->re - r->rs > r->qe - r->qs? r->re - r->rs : r->qe - r->qs); out += '\t';
+		out += "255\t";
+		out += "cm:i:"; out += std::to_string(r->cnt); out += '\n';
+	}
+}
+
 static void worker_for(void *_data, long i, int tid) // kt_for() callback
 {
     step_t *step = (step_t*)_data;
 	const mm_reg1_t *regs;
 	int n_regs;
 
-	regs = mm_map(step->p->mi, step->seq[i].l_seq, step->seq[i].seq, &n_regs, step->buf[tid], step->p->opt, step->seq[i].name);
-	step->n_reg[i] = n_regs;
-	if (n_regs > 0) {
-		step->reg[i] = (mm_reg1_t*)malloc(n_regs * sizeof(mm_reg1_t));
-		memcpy(step->reg[i], regs, n_regs * sizeof(mm_reg1_t));
-	}
+	step->buf[tid]->mini.n = 0;
+	mm_sketch(step->seq[i].seq, step->seq[i].l_seq, step->p->mi->w, step->p->mi->k, 0, &step->buf[tid]->mini);
+	regs = mm_map_mini(step->p->mi, step->seq[i].l_seq, step->seq[i].seq, &n_regs, step->buf[tid], step->p->opt, step->seq[i].name, step->seq[i].rid);
+	format_regs(step->out[i], step->seq[i].name, step->seq[i].l_seq, n_regs, regs, step->p->mi, step->p->opt);
+	free(step->seq[i].seq); step->seq[i].seq = 0; // the sequence isn't needed after mapping
 }
 
 static void *worker_pipeline(void *shared, int step, void *in)
 {
-	int i, j;
+	int i;
     pipeline_t *p = (pipeline_t*)shared;
     if (step == 0) { // step 0: read sequences
         step_t *s;
@@ -337,54 +487,23 @@ static void *worker_pipeline(void *shared, int step, void *in)
 			s->buf = (mm_tbuf_t**)calloc(p->n_threads, sizeof(mm_tbuf_t*));
 			for (i = 0; i < p->n_threads; ++i)
 				s->buf[i] = mm_tbuf_init();
-			s->n_reg = (int*)calloc(s->n_seq, sizeof(int));
-			s->reg = (mm_reg1_t**)calloc(s->n_seq, sizeof(mm_reg1_t*));
+			s->out = new std::string[s->n_seq];
 			return s;
 		} else free(s);
-    } else if (step == 1) { // step 1: map
-		kt_for(p->n_threads, worker_for, in, ((step_t*)in)->n_seq);
-		return in;
-    } else if (step == 2) { // step 2: output
+    } else if (step == 1) { // step 1: map and format
         step_t *s = (step_t*)in;
-		const mm_idx_t *mi = p->mi;
+		kt_for(p->n_threads, worker_for, s, s->n_seq);
 		for (i = 0; i < p->n_threads; ++i) mm_tbuf_destroy(s->buf[i]);
 		free(s->buf);
+		return s;
+    } else if (step == 2) { // step 2: output, in input order
+        step_t *s = (step_t*)in;
 		for (i = 0; i < s->n_seq; ++i) {
-			bseq1_t *t = &s->seq[i];
-			for (j = 0; j < s->n_reg[i]; ++j) {
-				mm_reg1_t *r = &s->reg[i][j];
-				if (r->len < p->opt->min_match)
-				    continue;
-
-				// RRW: I changed this code from using printf to cout, because I redirected cout
-				// to an ostringstream so I can capture it for return to Python.
-				std::cout << t->name << "\t";
-				std::cout << t->l_seq << "\t";
-				std::cout << r->qs << "\t";
-				std::cout << r->qe << "\t";
-				std::cout << "+-"[r->rev] << "\t";
-				if (mi->name)
-    				std::cout << mi->name[r->rid] << "\t";
-    			else
-				    std::cout << (r->rid + 1) << "\t";
-				std::cout << mi->len[r->rid] << "\t";
-				std::cout << r->rs << "\t";
-				std::cout << r->re << "\t";
-				std::cout << r->len << "\t";
-				std::cout << (r->re - r->rs > r->qe - r->qs? r->re - r->rs : r->qe - r->qs) << "\t";
-				std::cout << "255" << "\t";
-				std::cout << "cm:i:" << r->cnt << "\n";
-
-//				printf("%s\t%d\t%d\t%d\t%c\t", t->name, t->l_seq, r->qs, r->qe, "+-"[r->rev]);
-//				if (mi->name) fputs(mi->name[r->rid], stdout);
-//				else printf("%d", r->rid + 1);
-//				printf("\t%d\t%d\t%d\t%d\t%d\t255\tcm:i:%d\n", mi->len[r->rid], r->rs, r->re, r->len,
-//						r->re - r->rs > r->qe - r->qs? r->re - r->rs : r->qe - r->qs, r->cnt);
-			}
-			free(s->reg[i]);
-			free(s->seq[i].seq); free(s->seq[i].name);
+			std::cout << s->out[i];
+			free(s->seq[i].name);
 		}
-		free(s->reg); free(s->n_reg); free(s->seq);
+		delete[] s->out;
+		free(s->seq);
 		free(s);
 	}
     return 0;
@@ -398,7 +517,70 @@ int mm_map_file(const mm_idx_t *idx, const char *fn, const mm_mapopt_t *opt, int
 	if (pl.fp == 0) return -1;
 	pl.opt = opt, pl.mi = idx;
 	pl.n_threads = n_threads, pl.batch_size = tbatch_size;
-	kt_pipeline(n_threads == 1? 1 : 2, worker_pipeline, &pl, 3);
+	// RRW: with a depth of 3, reading the next batch, mapping the current one and writing the
+	// previous one can all happen at the same time.
+	kt_pipeline(n_threads == 1? 1 : opt->pipeline_depth, worker_pipeline, &pl, 3);
 	bseq_close(pl.fp);
 	return 0;
 }
+
+/*************************************
+ * Mapping of pre-sketched sequences *
+ ************************************/
+
+typedef struct {
+	const mm_sketch_set_t *s;
+	const mm_idx_t *mi;
+	const mm_mapopt_t *opt;
+	uint32_t start; // index of the first sequence in this batch
+	std::string *out;
+	mm_tbuf_t **buf;
+} sketch_step_t;
+
+static void sketch_worker_for(void *_data, long i, int tid) // kt_for() callback
+{
+	sketch_step_t *step = (sketch_step_t*)_data;
+	const mm_sketch_set_t *s = step->s;
+	mm_tbuf_t *b = step->buf[tid];
+	uint32_t id = step->start + i;
+	uint64_t j;
+	const mm_reg1_t *regs;
+	int n_regs;
+
+	b->mini.n = 0;
+	kv_resize(mm128_t, b->mini, s->offset[id+1] - s->offset[id]);
+	for (j = s->offset[id]; j < s->offset[id+1]; ++j) {
+		mm128_t *p = &b->mini.a[b->mini.n++];
+		p->x = s->a[j] >> 32, p->y = (uint32_t)s->a[j];
+	}
+	regs = mm_map_mini(step->mi, s->len[id], 0, &n_regs, b, step->opt, s->name[id], id);
+	format_regs(step->out[i], s->name[id], s->len[id], n_regs, regs, step->mi, step->opt);
+}
+
+// Gives the same output as mm_map_file() on the sketched file, except that SDUST masking isn't
+// available because the sequences are no longer present.
+int mm_map_sketches(const mm_idx_t *idx, const mm_sketch_set_t *s, const mm_mapopt_t *opt, int n_threads, int tbatch_size)
+{
+	sketch_step_t step;
+	uint32_t i, end;
+	int j;
+	if (s->w != idx->w || s->k != idx->k) return -1;
+	memset(&step, 0, sizeof(sketch_step_t));
+	step.s = s, step.mi = idx, step.opt = opt;
+	step.buf = (mm_tbuf_t**)calloc(n_threads, sizeof(mm_tbuf_t*));
+	for (j = 0; j < n_threads; ++j)
+		step.buf[j] = mm_tbuf_init();
+	for (step.start = 0; step.start < s->n; step.start = end) {
+		int64_t size = 0;
+		for (end = step.start; end < s->n && size < tbatch_size; ++end)
+			size += s->len[end];
+		step.out = new std::string[end - step.start];
+		kt_for(n_threads, sketch_worker_for, &step, end - step.start);
+		for (i = 0; i < end - step.start; ++i)
+			std::cout << step.out[i];
+		delete[] step.out;
+	}
+	for (j = 0; j < n_threads; ++j) mm_tbuf_destroy(step.buf[j]);
+	free(step.buf);
+	return 0;
+}
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <limits>
 
+#include "minimap/kthread.h"
 #include "minimap/kvec.h"
 #include "minimap/minimap.h"
 
@@ -102,3 +103,77 @@ void mm_sketch(const char *str, int len, int w, int k, uint32_t rid, mm128_v *p)
 	if (min.x != std::numeric_limits<uint64_t>::max())
 		kv_push(mm128_t, *p, min);
 }
+
+/*************************************
+ * Sketching all sequences in a file *
+ ************************************/
+
+typedef struct {
+	int w, k;
+	bseq1_t *seq;
+	mm128_v *mini;
+} sketch_step_t;
+
+static void sketch_worker(void *_data, long i, int) // kt_for() callback
+{
+	sketch_step_t *step = (sketch_step_t*)_data;
+	if (step->seq[i].l_seq > 0)
+		mm_sketch(step->seq[i].seq, step->seq[i].l_seq, step->w, step->k, 0, &step->mini[i]);
+}
+
+mm_sketch_set_t *mm_sketch_file(const char *fn, int w, int k, int n_threads, int tbatch_size)
+{
+	bseq_file_t *fp;
+	mm_sketch_set_t *s;
+	size_t m_seq = 0, m_a = 0;
+	uint64_t n_a = 0;
+	if (k > 16) return 0;
+	fp = bseq_open(fn);
+	if (fp == 0) return 0;
+	s = (mm_sketch_set_t*)calloc(1, sizeof(mm_sketch_set_t));
+	s->w = w, s->k = k;
+	for (;;) {
+		int i, n_seq;
+		sketch_step_t step;
+		step.seq = bseq_read(fp, tbatch_size, &n_seq);
+		if (step.seq == 0) break;
+		step.w = w, step.k = k;
+		step.mini = (mm128_v*)calloc(n_seq, sizeof(mm128_v));
+		kt_for(n_threads, sketch_worker, &step, n_seq);
+		if (s->n + n_seq + 1 > m_seq) {
+			while (s->n + n_seq + 1 > m_seq) m_seq = m_seq? m_seq<<1 : 256;
+			s->name = (char**)realloc(s->name, m_seq * sizeof(char*));
+			s->len = (int32_t*)realloc(s->len, m_seq * sizeof(int32_t));
+			s->offset = (uint64_t*)realloc(s->offset, m_seq * sizeof(uint64_t));
+		}
+		for (i = 0; i < n_seq; ++i) {
+			size_t j;
+			mm128_v *p = &step.mini[i];
+			if (n_a + p->n > m_a) {
+				while (n_a + p->n > m_a) m_a = m_a? m_a<<1 : 1<<20;
+				s->a = (uint64_t*)realloc(s->a, m_a * sizeof(uint64_t));
+			}
+			for (j = 0; j < p->n; ++j)
+				s->a[n_a++] = p->a[j].x << 32 | (uint32_t)p->a[j].y;
+			s->name[s->n] = step.seq[i].name; // the sketch set takes ownership of the name
+			s->len[s->n] = step.seq[i].l_seq;
+			s->offset[s->n++] = n_a - p->n;
+			free(p->a); free(step.seq[i].seq);
+		}
+		free(step.mini); free(step.seq);
+	}
+	bseq_close(fp);
+	if (s->offset == 0) s->offset = (uint64_t*)malloc(sizeof(uint64_t));
+	s->offset[s->n] = n_a;
+	s->a = (uint64_t*)realloc(s->a, (n_a? n_a : 1) * sizeof(uint64_t)); // trim the unused capacity
+	return s;
+}
+
+void mm_sketch_set_destroy(mm_sketch_set_t *s)
+{
+	uint32_t i;
+	if (s == 0) return;
+	for (i = 0; i < s->n; ++i) free(s->name[i]);
+	free(s->name); free(s->len); free(s->offset); free(s->a);
+	free(s);
+}
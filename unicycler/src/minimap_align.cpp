@@ -13,20 +13,44 @@
 
 #include <assert.h>
 #include <zlib.h>
+#include <string.h>
 #include <iostream>
 #include <sstream>
 #include <minimap/minimap.h>
 
 #pragma GCC diagnostic ignored "-Wunused-function"
 
+#include "memory_budget.h"
 #include "string_functions.h"
 #include "settings.h"
 
 KSEQ_INIT(gzFile, gzread)
 
 
+// Minimap's read batch and index batch sizes (in bases) are its defaults, shrunk to fit the memory
+// budget if one is set.
+long long minimapReadBatchSize() {
+    return budgetedCount(100000000, MINIMAP_READ_BATCH_BYTES_PER_BASE, MIN_MINIMAP_READ_BATCH_SIZE);
+}
+
+long long minimapIndexBatchSize() {
+    return budgetedCount(4000000000LL, MINIMAP_INDEX_BATCH_BYTES_PER_BASE,
+                         MIN_MINIMAP_INDEX_BATCH_SIZE);
+}
+
+
 char * minimapAlignReads(char * referenceFasta, char * readsFastq, int n_threads,
                          int sensitivityLevel, int preset) {
+    return minimapAlignReadsWithSketches(referenceFasta, readsFastq, 0, n_threads,
+                                         sensitivityLevel, preset);
+}
+
+
+// If readSketches is given, the reads' minimizers are taken from it (computing them on first
+// use) instead of reading and sketching the reads file again.
+char * minimapAlignReadsWithSketches(char * referenceFasta, char * readsFastq,
+                                     ReadSketches * readSketches, int n_threads,
+                                     int sensitivityLevel, int preset) {
     // The k-mer size depends on the sensitivity level.
     int k = LEVEL_0_MINIMAP_KMER_SIZE;
     if (sensitivityLevel == 1)
@@ -41,15 +65,19 @@ char * minimapAlignReads(char * referenceFasta, char * readsFastq, int n_threads
     mm_verbose = 0;
     mm_mapopt_t opt;
     mm_mapopt_init(&opt);
-	int tbatch_size = 100000000;
-	uint64_t ibatch_size = 4000000000ULL;
+	int tbatch_size = int(minimapReadBatchSize());
+	uint64_t ibatch_size = minimapIndexBatchSize();
 	float f = 0.001;
 
     // preset of 0 is default settings.
+    if (preset == 0 && MINIMAP_CHAINING_DP)
+        opt.flag |= MM_F_CHAIN;
 
     // preset of 1 is for mapping reads against themselves: -Sw5 -L100 -m0
     if (preset == 1) {
         opt.flag |= MM_F_AVA | MM_F_NO_SELF;
+        if (strcmp(referenceFasta, readsFastq) == 0)
+            opt.flag |= MM_F_AVA_RID;
         opt.min_match = 100;
         opt.merge_frac = 0.0;
         w = 5;
@@ -61,20 +89,30 @@ char * minimapAlignReads(char * referenceFasta, char * readsFastq, int n_threads
         w = 5;
     }
 
+    mm_sketch_set_t * sketches = 0;
+    if (readSketches != 0)
+        sketches = readSketches->getSketchSet(w, k, n_threads, tbatch_size);
+
     // Redirect minimap's output to a stringstream, instead of outputting it to stdout.
     // http://stackoverflow.com/questions/5419356/redirect-stdout-stderr-to-a-string
     std::stringstream outputBuffer;
     std::streambuf * old = std::cout.rdbuf(outputBuffer.rdbuf());
 
 	bseq_file_t *fp = bseq_open(referenceFasta);
+	uint32_t refCount = 0;
 	for (;;) {
 		mm_idx_t *mi = 0;
 		if (!bseq_eof(fp))
-			mi = mm_idx_gen(fp, w, k, MM_IDX_DEF_B, tbatch_size, n_threads, ibatch_size, 1);
+			mi = mm_idx_gen(fp, w, k, MM_IDX_AUTO_B, tbatch_size, n_threads, ibatch_size, 1);
 		if (mi == 0)
 		    break;
+		mi->rid0 = refCount;
+		refCount += mi->n;
 		mm_idx_set_max_occ(mi, f);
-		mm_map_file(mi, readsFastq, &opt, n_threads, tbatch_size);
+		if (sketches != 0)
+		    mm_map_sketches(mi, sketches, &opt, n_threads, tbatch_size);
+		else
+		    mm_map_file(mi, readsFastq, &opt, n_threads, tbatch_size);
 		mm_idx_destroy(mi);
 	}
 	bseq_close(fp);
@@ -86,7 +124,6 @@ char * minimapAlignReads(char * referenceFasta, char * readsFastq, int n_threads
 }
 
 
-
 char * minimapAlignReadsWithSettings(char * referenceFasta, char * readsFastq, int n_threads,
                                      bool allVsAll, int kmerSize, int minimiserSize,
                                      float mergeFrac, int minMatchLength, int maxGap,
@@ -94,12 +131,14 @@ char * minimapAlignReadsWithSettings(char * referenceFasta, char * readsFastq, i
     mm_verbose = 0;
     mm_mapopt_t opt;
     mm_mapopt_init(&opt);
-    int tbatch_size = 100000000;
-    uint64_t ibatch_size = 4000000000ULL;
+    int tbatch_size = int(minimapReadBatchSize());
+    uint64_t ibatch_size = minimapIndexBatchSize();
     float f = 0.001;
 
     if (allVsAll)
         opt.flag |= MM_F_AVA | MM_F_NO_SELF;
+    if (allVsAll && strcmp(referenceFasta, readsFastq) == 0)
+        opt.flag |= MM_F_AVA_RID;
 
     opt.min_match = minMatchLength;
     opt.merge_frac = mergeFrac;
@@ -111,13 +150,16 @@ char * minimapAlignReadsWithSettings(char * referenceFasta, char * readsFastq, i
     std::streambuf * old = std::cout.rdbuf(outputBuffer.rdbuf());
 
     bseq_file_t *fp = bseq_open(referenceFasta);
+    uint32_t refCount = 0;
     for (;;) {
         mm_idx_t *mi = 0;
         if (!bseq_eof(fp))
-            mi = mm_idx_gen(fp, minimiserSize, kmerSize, MM_IDX_DEF_B, tbatch_size, n_threads,
+            mi = mm_idx_gen(fp, minimiserSize, kmerSize, MM_IDX_AUTO_B, tbatch_size, n_threads,
                             ibatch_size, 1);
         if (mi == 0)
             break;
+        mi->rid0 = refCount;
+        refCount += mi->n;
         mm_idx_set_max_occ(mi, f);
         mm_map_file(mi, readsFastq, &opt, n_threads, tbatch_size);
         mm_idx_destroy(mi);
@@ -127,4 +169,37 @@ char * minimapAlignReadsWithSettings(char * referenceFasta, char * readsFastq, i
     std::cout.rdbuf(old);
 
     return cppStringToCString(outputBuffer.str());
-}
\ No newline at end of file
+}
+
+
+ReadSketches::~ReadSketches() {
+    for (auto & sketchSet : m_sketchSets)
+        mm_sketch_set_destroy(sketchSet.second);
+}
+
+
+// Returns the reads' minimizers for the given window and k-mer sizes, sketching the reads file
+// the first time they are requested. Returns null if the reads can't be cached this way, in which
+// case the caller should map from the file instead.
+mm_sketch_set_t * ReadSketches::getSketchSet(int w, int k, int n_threads, int tbatch_size) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::pair<int, int> key(w, k);
+    auto existing = m_sketchSets.find(key);
+    if (existing != m_sketchSets.end())
+        return existing->second;
+    mm_sketch_set_t * sketchSet = mm_sketch_file(m_readsFilename.c_str(), w, k, n_threads,
+                                                 tbatch_size);
+    if (sketchSet != 0)
+        m_sketchSets[key] = sketchSet;
+    return sketchSet;
+}
+
+
+ReadSketches * newReadSketches(char * readsFastq) {
+    return new ReadSketches(readsFastq);
+}
+
+
+void deleteReadSketches(ReadSketches * readSketches) {
+    delete readSketches;
+}
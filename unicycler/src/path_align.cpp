@@ -13,6 +13,8 @@
 
 #include <seqan/align.h>
 #include "semi_global_align.h"
+#include "memory_budget.h"
+#include "edit_distance.h"
 
 
 char * pathAlignment(char * s1, char * s2,
@@ -53,6 +55,14 @@ ScoredAlignment * pathAlignment(std::string s1, std::string s2,
     assignSource(row(alignment, 1), sequenceV);
     Score<int, Simple> scoringScheme(matchScore, mismatchScore, gapExtensionScore, gapOpenScore);
 
+    // The DP matrix's memory is reserved from the budget, and an alignment too big for the
+    // budget fails.
+    long long dpBytes = dpMatrixCells(s1.length(), s2.length(), useBanding, bandSize) *
+                        DP_CELL_BYTES;
+    if (!fitsInMemoryBudget(dpBytes))
+        return 0;
+    MemoryReservation reservation(dpBytes);
+
     AlignConfig<false, false, true, false> alignConfig;
     int score;
     if (useBanding) {
@@ -92,3 +102,25 @@ ScoredAlignment * pathAlignment(std::string s1, std::string s2,
 }
 
 
+// This function returns an upper bound on the scaled score that pathAlignment would give. It comes
+// from the banded edit distance between s1 and the best prefix of s2, which is much faster than
+// the alignment, so paths which can't score well enough can be skipped.
+double pathAlignmentScaledScoreBound(char * s1, char * s2,
+                                     int matchScore, int mismatchScore, int gapOpenScore,
+                                     int gapExtensionScore, bool useBanding, int bandSize) {
+    std::string sequence1(s1);
+    std::string sequence2(s2);
+    int length1 = int(sequence1.length()), length2 = int(sequence2.length());
+
+    // This matches the band used in pathAlignment.
+    int lowerDiagonal = -length2, upperDiagonal = length1;
+    if (useBanding) {
+        lowerDiagonal = -bandSize;
+        upperDiagonal = bandSize + std::max(0, length1 - length2);
+    }
+    int editDistance = bandedEditDistance(sequence1, sequence2, lowerDiagonal, upperDiagonal,
+                                          true);
+    return scaledScoreUpperBound(std::min(length1, length2),
+                                 std::max(editDistance, length1 - length2),
+                                 matchScore, mismatchScore, gapOpenScore, gapExtensionScore);
+}
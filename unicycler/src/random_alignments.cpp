@@ -18,10 +18,10 @@
 #include <algorithm>
 #include <utility>
 #include <random>
-#include <thread>
 
 #include "semi_global_align.h"
 #include "global_align.h"
+#include "thread_pool.h"
 
 
 
@@ -208,23 +208,18 @@ char * simulateDepths(int alignmentLengths[], int alignmentCount, int refLength,
     std::vector<int> maxDepthCounts;
     std::mutex mut;
 
-    std::vector<std::thread *> threads;
+    // The iterations are split into one share per thread, run on the shared worker pool.
     int iterationsPerThread = iterations / threadCount;
     int iterationsInFirstThread = iterations - (iterationsPerThread * (threadCount - 1));
-    for (int i = 0; i < threadCount; ++i) {
+    parallelFor(threadCount, threadCount, [&](long i, int) {
         int iterationsThisThread;
         if (i == 0)
             iterationsThisThread = iterationsInFirstThread;
         else
             iterationsThisThread = iterationsPerThread;
-        std::thread * thread = new std::thread(simulateDepthsOneThread, alignmentLengths, alignmentCount, refLength, iterationsThisThread,
-                                               &minDepthCounts, &maxDepthCounts, &mut);
-        threads.push_back(thread);
-    }
-    for (int i = 0; i < threadCount; ++i) {
-        threads[i]->join();
-        delete threads[i];
-    }
+        simulateDepthsOneThread(alignmentLengths, alignmentCount, refLength, iterationsThisThread,
+                                &minDepthCounts, &maxDepthCounts, &mut);
+    });
 
 
     std::vector<double> minDepthDistribution;
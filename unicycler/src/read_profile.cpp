@@ -0,0 +1,104 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#include "read_profile.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "minimap/bseq.h"
+#include "minimap/kseq.h"
+#include "string_functions.h"
+#include "settings.h"
+
+KSTREAM_INIT(bseq_reader_t*, bseq_reader_read, 65536)
+
+
+// This function reads a FASTQ file (which can be gzipped) and returns a string with the read count
+// and read lengths. The first line of the returned string has three comma-delimited values: the
+// read count, whether the count is exact (1) or estimated (0), and whether the file was a properly
+// formatted FASTQ (1 or 0). The second line has the read lengths, comma-delimited.
+//
+// The file is read as four-line records, and any record which doesn't start with '@' makes the file
+// invalid. If maxReads is more than 0, only that many reads are looked at and the total count is
+// estimated from how far through the file they went. If sampleSize is more than 0, the lengths are
+// a reservoir sample of at most that many reads (seeded, so the same file always gives the same
+// sample), otherwise every read's length is given.
+char * profileReads(char * filename, long long maxReads, int sampleSize) {
+    bseq_reader_t * reader = bseq_reader_open(filename);
+    if (reader == 0)
+        return cppStringToCString("0,1,0\n");
+    kstream_t * ks = ks_init(reader);
+    kstring_t line = {0, 0, 0};
+
+    std::mt19937 gen(READ_PROFILE_SEED);
+    std::vector<int> lengths;
+    long long count = 0, lineNum = 0;
+    double parsedBytes = 0.0;
+    bool fastq = true, exact = true;
+    while (ks_getuntil(ks, KS_SEP_LINE, &line, 0) >= 0) {
+        parsedBytes += line.l + 1.0;
+        int linePos = int(lineNum % 4);
+        ++lineNum;
+        if (linePos == 0) {
+            if (line.l == 0 || line.s[0] != '@') {
+                fastq = false;
+                break;
+            }
+            ++count;
+        }
+        else if (linePos == 1) {
+            int length = int(line.l);
+            if (sampleSize <= 0 || (long long)lengths.size() < sampleSize)
+                lengths.push_back(length);
+            else {
+                std::uniform_int_distribution<long long> dist(0, count - 1);
+                long long j = dist(gen);
+                if (j < sampleSize)
+                    lengths[size_t(j)] = length;
+            }
+        }
+        else if (linePos == 3 && maxReads > 0 && count >= maxReads) {
+            exact = ks_getuntil(ks, KS_SEP_LINE, &line, 0) < 0;
+            break;
+        }
+    }
+
+    // If we stopped early, estimate the total count from the file size and how much of the
+    // (decompressed) file the reads we saw took up.
+    if (!exact) {
+        double ratio = bseq_reader_ratio(reader);
+        FILE * f = fopen(filename, "rb");
+        if (f != 0 && ratio > 0.0 && parsedBytes > 0.0) {
+            fseek(f, 0, SEEK_END);
+            double fileSize = double(ftell(f));
+            double estimate = count * (fileSize / ratio) / parsedBytes;
+            if (estimate > count)
+                count = (long long)(estimate + 0.5);
+        }
+        if (f != 0)
+            fclose(f);
+    }
+    free(line.s);
+    ks_destroy(ks);
+    bseq_reader_close(reader);
+
+    std::string returnString = std::to_string(count) + "," + std::to_string(int(exact)) + "," +
+                               std::to_string(int(fastq)) + "\n";
+    for (size_t i = 0; i < lengths.size(); ++i) {
+        if (i > 0)
+            returnString += ",";
+        returnString += std::to_string(lengths[i]);
+    }
+    returnString += "\n";
+    return cppStringToCString(returnString);
+}
@@ -0,0 +1,336 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#include "read_simulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include "string_functions.h"
+
+
+// This function makes a random genome: a chromosome containing diverged copies of a repeat, plus
+// some plasmids. The plasmid lengths vary from half to one and a half times plasmidLength. The
+// genome is returned as a FASTA string, with the circularity in each sequence's header. The same
+// seed always gives the same genome.
+char * simulateGenome(unsigned int seed, int chromosomeLength, int plasmidCount,
+                      int plasmidLength, int repeatCount, int repeatLength,
+                      double repeatDivergence, bool circular) {
+    std::mt19937 gen(seed);
+
+    std::string repeat = randomSequence(gen, repeatLength);
+    repeatCount = std::min(repeatCount, chromosomeLength / std::max(repeatLength, 1));
+    int uniqueLength = chromosomeLength - repeatCount * repeatLength;
+    std::string chromosome;
+    chromosome.reserve(chromosomeLength + repeatCount * repeatLength / 10);
+    for (int i = 0; i < repeatCount; ++i) {
+        int gapLength = uniqueLength / (repeatCount + 1);
+        chromosome += randomSequence(gen, gapLength);
+        std::string copy = mutateSequence(gen, repeat, repeatDivergence);
+        chromosome += randomCoinFlip(gen) ? copy : getReverseComplement(copy);
+    }
+    chromosome += randomSequence(gen, chromosomeLength - int(chromosome.length()));
+
+    std::string circularStr = circular ? "true" : "false";
+    std::string fasta = ">chromosome length=" + std::to_string(chromosome.length()) +
+                        " circular=" + circularStr + "\n" + chromosome + "\n";
+    for (int i = 0; i < plasmidCount; ++i) {
+        int length = int(plasmidLength * (0.5 + randomUnit(gen)));
+        std::string plasmid = randomSequence(gen, length);
+        fasta += ">plasmid_" + std::to_string(i + 1) + " length=" +
+                 std::to_string(plasmid.length()) + " circular=" + circularStr + "\n" +
+                 plasmid + "\n";
+    }
+    return cppStringToCString(fasta);
+}
+
+
+// This function makes ONT-like (platform 0) or PacBio-like (platform 1) long reads from the given
+// sequences. Read lengths follow a gamma distribution and each read's identity is drawn from a
+// normal distribution. Each sequence gets reads to its own depth, so plasmids can be given a
+// higher depth than the chromosome. Reads from circular sequences can span the sequence's end.
+//
+// If an output filename is given, the reads are written there (gzipped if the name ends in .gz)
+// and the read count is returned, or -1 if the file couldn't be written. Otherwise the reads are
+// returned as a FASTQ string.
+char * simulateLongReads(unsigned int seed, char * sequences[], int circular[],
+                         double depths[], int sequenceCount, int platform, double meanLength,
+                         double lengthStdev, double meanIdentity, double identityStdev,
+                         char * outputFilename) {
+    std::mt19937 gen(seed);
+    bool fixedLength = lengthStdev <= 0.0;
+    double shape = fixedLength ? 1.0 : (meanLength / lengthStdev) * (meanLength / lengthStdev);
+    ErrorProfile profile = getErrorProfile(platform);
+
+    FastqWriter writer(outputFilename);
+    for (int i = 0; i < sequenceCount; ++i) {
+        std::string sequence(sequences[i]);
+        int seqLength = int(sequence.length());
+        if (seqLength == 0)
+            continue;
+        double targetBases = depths[i] * seqLength;
+        double bases = 0.0;
+        while (bases < targetBases) {
+            int readLength = fixedLength ? int(meanLength) :
+                                           int(randomGamma(gen, shape, meanLength / shape));
+            readLength = std::min(std::max(readLength, 100), seqLength);
+            int maxStart = circular[i] ? seqLength - 1 : seqLength - readLength;
+            int start = randomInt(gen, maxStart + 1);
+            bool forward = randomCoinFlip(gen);
+            double identity = randomNormal(gen, meanIdentity, identityStdev);
+            identity = std::min(std::max(identity, 0.5), 1.0);
+
+            std::string fragment = getFragment(sequence, circular[i] != 0, start, readLength,
+                                               forward);
+            std::string read = addLongReadErrors(gen, fragment, 1.0 - identity, profile);
+            std::string name = "read_" + std::to_string(writer.m_count + 1) + " seq=" +
+                               std::to_string(i + 1) + " start=" + std::to_string(start) +
+                               " strand=" + (forward ? "+" : "-");
+            writer.write(name, read, getQualityString(int(read.length()), 1.0 - identity));
+            bases += readLength;
+        }
+    }
+    if (outputFilename[0] != '\0')
+        return cppStringToCString(std::to_string(writer.close() ? writer.m_count : -1));
+    return cppStringToCString(writer.m_output);
+}
+
+
+// This function makes Illumina-like read pairs from the given sequences, with normally
+// distributed insert sizes and only substitution errors (more of them towards the read ends).
+// Reads go to the two output files (and the pair count is returned, or -1 if either file couldn't
+// be written), or if they aren't given, are returned as an interleaved FASTQ string.
+char * simulateShortReads(unsigned int seed, char * sequences[], int circular[],
+                          double depths[], int sequenceCount, int readLength,
+                          double insertMean, double insertStdev, double errorRate,
+                          char * outputFilename1, char * outputFilename2) {
+    std::mt19937 gen(seed);
+
+    bool toFiles = outputFilename1[0] != '\0';
+    FastqWriter writer1(outputFilename1);
+    FastqWriter writer2(toFiles ? outputFilename2 : "");
+    FastqWriter & pairWriter2 = toFiles ? writer2 : writer1;
+    long long pairCount = 0;
+    for (int i = 0; i < sequenceCount; ++i) {
+        std::string sequence(sequences[i]);
+        int seqLength = int(sequence.length());
+        if (seqLength < readLength)
+            continue;
+        long long pairs = (long long)(depths[i] * seqLength / (2.0 * readLength));
+        for (long long j = 0; j < pairs; ++j) {
+            int insertSize = int(randomNormal(gen, insertMean, insertStdev));
+            insertSize = std::min(std::max(insertSize, readLength), seqLength);
+            int maxStart = circular[i] ? seqLength - 1 : seqLength - insertSize;
+            int start = randomInt(gen, maxStart + 1);
+            bool forward = randomCoinFlip(gen);
+            std::string fragment = getFragment(sequence, circular[i] != 0, start, insertSize,
+                                               forward);
+            std::string reads[2] = {fragment.substr(0, readLength),
+                                    getReverseComplement(fragment).substr(0, readLength)};
+            ++pairCount;
+            for (int k = 0; k < 2; ++k) {
+                std::string qual(readLength, 'I');
+                for (int pos = 0; pos < readLength; ++pos) {
+                    double rate = errorRate * (0.5 + double(pos) / readLength);
+                    if (randomUnit(gen) < rate) {
+                        char base = randomBase(gen);
+                        while (base == reads[k][pos])
+                            base = randomBase(gen);
+                        reads[k][pos] = base;
+                        qual[pos] = '+';
+                    }
+                }
+                std::string name = "pair_" + std::to_string(pairCount) + "/" +
+                                   std::to_string(k + 1);
+                (k == 0 ? writer1 : pairWriter2).write(name, reads[k], qual);
+            }
+        }
+    }
+    if (toFiles) {
+        bool written = writer1.close();
+        written = writer2.close() && written;
+        return cppStringToCString(std::to_string(written ? pairCount : -1));
+    }
+    return cppStringToCString(writer1.m_output);
+}
+
+
+ErrorProfile getErrorProfile(int platform) {
+    if (platform == 1)  // PacBio: mostly insertions
+        return ErrorProfile{0.2, 0.5, 0.3, 1.0};
+    else                // ONT: mostly deletions, especially in homopolymers
+        return ErrorProfile{0.4, 0.2, 0.4, 3.0};
+}
+
+
+FastqWriter::FastqWriter(std::string filename) :
+    m_count(0), m_failed(false), m_file(0) {
+    if (filename.empty())
+        return;
+    bool gzipped = filename.length() > 3 && filename.substr(filename.length() - 3) == ".gz";
+    m_file = gzopen(filename.c_str(), gzipped ? "wb1" : "wT");
+    m_failed = m_file == 0;
+}
+
+FastqWriter::~FastqWriter() {
+    close();
+}
+
+void FastqWriter::write(const std::string & name, const std::string & seq,
+                        const std::string & qual) {
+    ++m_count;
+    if (m_failed)
+        return;
+    std::string record = "@" + name + "\n" + seq + "\n+\n" + qual + "\n";
+    if (m_file != 0)
+        m_failed = gzwrite(m_file, record.c_str(), unsigned(record.length())) <= 0;
+    else
+        m_output += record;
+}
+
+// Closes the file (if there is one) and returns whether everything was written.
+bool FastqWriter::close() {
+    if (m_file != 0) {
+        if (gzclose(m_file) != Z_OK)
+            m_failed = true;
+        m_file = 0;
+    }
+    return !m_failed;
+}
+
+
+// Returns length bases starting at start, wrapping around the end for circular sequences. The
+// reverse complement is returned for the reverse strand.
+std::string getFragment(const std::string & sequence, bool circular, int start, int length,
+                        bool forward) {
+    std::string fragment = sequence.substr(start, length);
+    if (circular && int(fragment.length()) < length)
+        fragment += sequence.substr(0, length - fragment.length());
+    if (forward)
+        return fragment;
+    return getReverseComplement(fragment);
+}
+
+
+std::string getQualityString(int length, double errorRate) {
+    int phred = int(std::round(-10.0 * std::log10(std::max(errorRate, 0.0001))));
+    return std::string(length, char(33 + std::min(phred, 40)));
+}
+
+
+// Adds errors to a long read at the given overall rate. A deletion is more likely (by the
+// profile's homopolymer factor) when the base repeats the previous one.
+std::string addLongReadErrors(std::mt19937 & gen, const std::string & fragment,
+                              double errorRate, ErrorProfile & profile) {
+    std::string read;
+    read.reserve(fragment.length() + fragment.length() / 5);
+    double subRate = errorRate * profile.substitution;
+    double insRate = errorRate * profile.insertion;
+    double delRate = errorRate * profile.deletion;
+    for (size_t i = 0; i < fragment.length(); ++i) {
+        char base = fragment[i];
+        bool homopolymer = i > 0 && fragment[i-1] == base;
+        double r = randomUnit(gen);
+        double thisDelRate = homopolymer ? delRate * profile.homopolymerDeletion : delRate;
+        if (r < thisDelRate)
+            continue;
+        r -= thisDelRate;
+        if (r < insRate) {
+            read.push_back(randomBase(gen));
+            read.push_back(base);
+        }
+        else if (r < insRate + subRate) {
+            char newBase = randomBase(gen);
+            while (newBase == base)
+                newBase = randomBase(gen);
+            read.push_back(newBase);
+        }
+        else
+            read.push_back(base);
+    }
+    return read;
+}
+
+
+// Adds substitutions, insertions and deletions (in equal proportions) at the given rate.
+std::string mutateSequence(std::mt19937 & gen, const std::string & seq, double divergence) {
+    ErrorProfile even{1.0 / 3.0, 1.0 / 3.0, 1.0 / 3.0, 1.0};
+    return addLongReadErrors(gen, seq, divergence, even);
+}
+
+
+// The C++ standard fixes the output of std::mt19937 but not the algorithms of its distributions
+// (e.g. std::normal_distribution and std::gamma_distribution differ between libstdc++, libc++ and
+// MSVC), so the simulator draws all of its samples from the raw engine output with these functions.
+// This way a seed gives the same genome and reads on every platform (the maths library's log, cos
+// and sqrt are the only remaining source of difference, and only in the last bit).
+
+// A uniform double in [0, 1), using 53 bits from two engine outputs.
+double randomUnit(std::mt19937 & gen) {
+    uint64_t a = gen() >> 5, b = gen() >> 6;
+    return (double(a) * 67108864.0 + double(b)) * (1.0 / 9007199254740992.0);
+}
+
+// A uniform integer in [0, n), without modulo bias.
+int randomInt(std::mt19937 & gen, int n) {
+    if (n <= 1)
+        return 0;
+    uint32_t range = uint32_t(n);
+    uint32_t limit = uint32_t(-range) % range;  // 2^32 mod n: this many low values are rejected
+    uint32_t x = uint32_t(gen());
+    while (x < limit)
+        x = uint32_t(gen());
+    return int(x % range);
+}
+
+bool randomCoinFlip(std::mt19937 & gen) {
+    return (gen() >> 31) != 0;
+}
+
+char randomBase(std::mt19937 & gen) {
+    return "ACGT"[gen() >> 30];
+}
+
+std::string randomSequence(std::mt19937 & gen, int length) {
+    std::string seq(std::max(length, 0), 'A');
+    for (auto & base : seq)
+        base = randomBase(gen);
+    return seq;
+}
+
+// A normal sample, from the Box-Muller transform (only one of the pair is used).
+double randomNormal(std::mt19937 & gen, double mean, double stdev) {
+    double u1 = 1.0 - randomUnit(gen);  // in (0, 1], so the log is finite
+    double u2 = randomUnit(gen);
+    return mean + stdev * std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+}
+
+// A gamma sample, from Marsaglia and Tsang's method. A shape below 1 is boosted by one and the
+// result scaled by U^(1/shape).
+double randomGamma(std::mt19937 & gen, double shape, double scale) {
+    if (shape < 1.0) {
+        double u = 1.0 - randomUnit(gen);
+        return randomGamma(gen, shape + 1.0, scale) * std::pow(u, 1.0 / shape);
+    }
+    double d = shape - 1.0 / 3.0;
+    double c = 1.0 / std::sqrt(9.0 * d);
+    while (true) {
+        double x, v;
+        do {
+            x = randomNormal(gen, 0.0, 1.0);
+            v = 1.0 + c * x;
+        } while (v <= 0.0);
+        v = v * v * v;
+        double u = 1.0 - randomUnit(gen);
+        if (u < 1.0 - 0.0331 * x * x * x * x ||
+                std::log(u) < 0.5 * x * x + d * (1.0 - v + std::log(v)))
+            return scale * d * v;
+    }
+}
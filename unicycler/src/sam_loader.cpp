@@ -0,0 +1,375 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#include "sam_loader.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <utility>
+#include "minimap/bseq.h"
+#include "scoredalignment.h"
+#include "string_functions.h"
+#include "thread_pool.h"
+#include "settings.h"
+
+
+// This function loads the alignments in a SAM or BAM file (either can be gzipped, and BGZF
+// compression is just gzip) and tallies up their matches, mismatches and indels. Reading is done
+// in one thread (decompression happens in the background), and the records of each block are
+// parsed and tallied in parallel.
+//
+// The first line of the returned string is the number of alignment records in the file. Then
+// there is one line per mapped record: the record's first six SAM columns, the length of its
+// sequence and its tally (comma-delimited matches, mismatches, insertions, deletions and raw
+// score), all tab-delimited. Records which can't be tallied here (no sequence, hard clips, an
+// unknown reference, etc.) have '*' for a tally and are left for the Python code to tally.
+char * loadSamAlignments(char * filename, SeqMap * refSeqs,
+                         int matchScore, int mismatchScore, int gapOpenScore,
+                         int gapExtensionScore, int threads) {
+    bseq_reader_t * reader = bseq_reader_open(filename);
+    if (reader == 0)
+        return cppStringToCString("0\n");
+
+    // data holds decompressed bytes which haven't been used yet.
+    std::string data;
+    std::vector<char> block(SAM_LOADER_BLOCK_BYTES);
+    bool more = true;
+    auto readBlock = [&]() {
+        int n = bseq_reader_read(reader, block.data(), int(block.size()));
+        if (n <= 0)
+            more = false;
+        else
+            data.append(block.data(), size_t(n));
+    };
+    auto readAtLeast = [&](size_t n) {
+        while (more && data.size() < n)
+            readBlock();
+        return data.size() >= n;
+    };
+    auto getInt32 = [&](size_t pos) {
+        int32_t value;
+        memcpy(&value, data.data() + pos, 4);
+        return value;
+    };
+
+    // A BAM file starts with its magic string, the header text and then the reference names.
+    bool bam = readAtLeast(4) && data.compare(0, 4, "BAM\1") == 0;
+    std::vector<std::string> bamRefNames;
+    if (bam) {
+        size_t pos = 4;
+        bool goodHeader = readAtLeast(pos + 4);
+        if (goodHeader) {
+            pos += 4 + size_t(getInt32(pos));
+            goodHeader = readAtLeast(pos + 4);
+        }
+        if (goodHeader) {
+            int32_t refCount = getInt32(pos);
+            pos += 4;
+            for (int32_t i = 0; i < refCount && goodHeader; ++i) {
+                goodHeader = readAtLeast(pos + 4);
+                if (!goodHeader)
+                    break;
+                size_t nameLength = size_t(getInt32(pos));
+                goodHeader = readAtLeast(pos + 8 + nameLength);
+                if (goodHeader && nameLength > 0)
+                    bamRefNames.push_back(std::string(data.data() + pos + 4, nameLength - 1));
+                pos += 8 + nameLength;
+            }
+        }
+        if (!goodHeader) {
+            bseq_reader_close(reader);
+            return cppStringToCString("0\n");
+        }
+        data.erase(0, pos);
+    }
+
+    long long recordCount = 0;
+    std::string output;
+    std::vector<std::pair<size_t, size_t> > records;
+    std::vector<std::string> recordOutputs;
+    while (more || !data.empty()) {
+        if (more)
+            readBlock();
+
+        // Cut the complete records out of the data. SAM records are lines (header lines and blank
+        // lines are skipped) and BAM records start with their length.
+        records.clear();
+        size_t pos = 0;
+        if (bam) {
+            while (data.size() - pos >= 4) {
+                size_t blockSize = size_t(uint32_t(getInt32(pos)));
+                if (data.size() - pos - 4 < blockSize)
+                    break;
+                records.push_back(std::pair<size_t, size_t>(pos + 4, blockSize));
+                pos += 4 + blockSize;
+            }
+            if (!more)  // any leftover bytes are a truncated record
+                pos = data.size();
+        }
+        else {
+            while (pos < data.size()) {
+                size_t lineEnd = data.find('\n', pos);
+                if (lineEnd == std::string::npos) {
+                    if (more)
+                        break;
+                    lineEnd = data.size();
+                }
+                size_t length = lineEnd - pos;
+                while (length > 0 && isspace((unsigned char)data[pos + length - 1]))
+                    --length;
+                if (length > 0 && data[pos] != '@')
+                    records.push_back(std::pair<size_t, size_t>(pos, length));
+                pos = std::min(lineEnd + 1, data.size());
+            }
+        }
+        recordCount += records.size();
+
+        recordOutputs.assign(records.size(), std::string());
+        parallelFor(threads, long(records.size()), [&](long i, int) {
+            const char * recordData = data.data() + records[i].first;
+            size_t recordLength = records[i].second;
+            SamRecord record;
+            std::string & recordOutput = recordOutputs[i];
+            if (bam) {
+                if (!parseBamRecord(recordData, recordLength, bamRefNames, record) ||
+                        record.refName == "*")
+                    return;
+                recordOutput = record.readName + "\t" + std::to_string(record.flag) + "\t" +
+                               record.refName + "\t" + std::to_string(record.refPos) + "\t" +
+                               std::to_string(record.mappingQuality) + "\t" +
+                               record.cigarString;
+            }
+            else {
+                size_t prefixLength;
+                bool parsed = parseSamLine(recordData, recordLength, record, prefixLength);
+                if (record.refName.empty() || record.refName == "*")
+                    return;
+                recordOutput = std::string(recordData, prefixLength);
+                if (!parsed) {
+                    recordOutput += "\t0\t*";
+                    return;
+                }
+            }
+            recordOutput += "\t" + tallySamRecord(record, refSeqs, matchScore, mismatchScore,
+                                                  gapOpenScore, gapExtensionScore);
+        });
+        for (size_t i = 0; i < recordOutputs.size(); ++i) {
+            if (!recordOutputs[i].empty()) {
+                output += recordOutputs[i];
+                output += "\n";
+            }
+        }
+        data.erase(0, pos);
+    }
+    bseq_reader_close(reader);
+
+    return cppStringToCString(std::to_string(recordCount) + "\n" + output);
+}
+
+
+// Splits a SAM line into a SamRecord. prefixLength is set to the length of the line's first six
+// columns. Returns false if the line is too short to be tallied (it may still have a reference
+// name set, so the caller can tell if it's mapped).
+bool parseSamLine(const char * line, size_t length, SamRecord & record, size_t & prefixLength) {
+    const char * columns[11];
+    size_t columnLengths[11];
+    int columnCount = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= length && columnCount < 11; ++i) {
+        if (i == length || line[i] == '\t') {
+            columns[columnCount] = line + start;
+            columnLengths[columnCount] = i - start;
+            ++columnCount;
+            start = i + 1;
+        }
+    }
+    prefixLength = length;
+    if (columnCount >= 3)
+        record.refName = std::string(columns[2], columnLengths[2]);
+    if (columnCount >= 6)
+        prefixLength = size_t(columns[5] + columnLengths[5] - line);
+    if (columnCount < 10)
+        return false;
+
+    record.readName = std::string(columns[0], columnLengths[0]);
+    record.flag = atoi(columns[1]);
+    record.refPos = atoll(columns[3]);
+    record.mappingQuality = atoi(columns[4]);
+    record.cigarString = std::string(columns[5], columnLengths[5]);
+    record.cigar = parseCigar(columns[5], columnLengths[5]);
+    record.seq = std::string(columns[9], columnLengths[9]);
+    return true;
+}
+
+
+// Decodes a BAM alignment record (everything after its block size) into a SamRecord.
+bool parseBamRecord(const char * data, size_t length, const std::vector<std::string> & refNames,
+                    SamRecord & record) {
+    if (length < 32)
+        return false;
+    int32_t refId, pos, seqLength;
+    uint16_t cigarLength, flag;
+    memcpy(&refId, data, 4);
+    memcpy(&pos, data + 4, 4);
+    uint8_t nameLength = uint8_t(data[8]);
+    uint8_t mappingQuality = uint8_t(data[9]);
+    memcpy(&cigarLength, data + 12, 2);
+    memcpy(&flag, data + 14, 2);
+    memcpy(&seqLength, data + 16, 4);
+    if (seqLength < 0 ||
+            32 + size_t(nameLength) + 4 * size_t(cigarLength) + (size_t(seqLength) + 1) / 2 >
+            length)
+        return false;
+
+    const char * p = data + 32;
+    record.readName = std::string(p, nameLength > 0 ? nameLength - 1 : 0);
+    p += nameLength;
+    record.flag = flag;
+    if (refId < 0 || size_t(refId) >= refNames.size())
+        record.refName = "*";
+    else
+        record.refName = refNames[size_t(refId)];
+    record.refPos = (long long)pos + 1;
+    record.mappingQuality = mappingQuality;
+    record.cigar.resize(cigarLength);
+    if (cigarLength > 0)
+        memcpy(record.cigar.data(), p, 4 * size_t(cigarLength));
+    p += 4 * size_t(cigarLength);
+    record.cigarString = cigarLength > 0 ? cigarToString(record.cigar.data(), cigarLength) : "*";
+
+    static const char * bamBases = "=ACMGRSVTWYHKDBN";
+    record.seq.resize(size_t(seqLength));
+    for (int32_t i = 0; i < seqLength; ++i) {
+        uint8_t packedBases = uint8_t(p[i / 2]);
+        record.seq[size_t(i)] = bamBases[(i % 2 == 0) ? (packedBases >> 4) : (packedBases & 0xf)];
+    }
+    if (seqLength == 0)
+        record.seq = "*";
+    p += (size_t(seqLength) + 1) / 2;
+
+    // BAM can only hold 65535 CIGAR ops in a record, so longer CIGARs are stored in a CG:B,I tag
+    // and the record's own CIGAR is a placeholder: <read length>S<reference length>N.
+    const uint32_t softClip = 4, refSkip = 3;
+    if (cigarLength == 2 && (record.cigar[0] & 0xf) == softClip &&
+            (record.cigar[0] >> 4) == uint32_t(seqLength) && (record.cigar[1] & 0xf) == refSkip &&
+            size_t(p - data) + size_t(seqLength) <= length) {
+        p += size_t(seqLength);  // qualities
+        if (getBamLongCigar(p, length - size_t(p - data), record.cigar))
+            record.cigarString = cigarToString(record.cigar.data(), record.cigar.size());
+    }
+    return true;
+}
+
+
+// Looks through a BAM record's optional fields for a CG:B,I tag and puts its CIGAR in cigar.
+// Returns false (leaving cigar alone) if there's no such tag or the fields are malformed.
+bool getBamLongCigar(const char * aux, size_t length, std::vector<uint32_t> & cigar) {
+    size_t i = 0;
+    while (i + 3 <= length) {
+        bool cgTag = aux[i] == 'C' && aux[i + 1] == 'G';
+        char type = aux[i + 2];
+        i += 3;
+        size_t valueSize = bamAuxValueSize(type);
+        if (type == 'Z' || type == 'H') {
+            const char * valueEnd = (const char *)memchr(aux + i, 0, length - i);
+            if (valueEnd == 0)
+                return false;
+            i = size_t(valueEnd - aux) + 1;
+        }
+        else if (type == 'B') {
+            if (i + 5 > length)
+                return false;
+            char subtype = aux[i];
+            int32_t count;
+            memcpy(&count, aux + i + 1, 4);
+            i += 5;
+            valueSize = bamAuxValueSize(subtype);
+            if (count < 0 || valueSize == 0 || i + valueSize * size_t(count) > length)
+                return false;
+            if (cgTag && subtype == 'I') {
+                cigar.resize(size_t(count));
+                if (count > 0)
+                    memcpy(cigar.data(), aux + i, 4 * size_t(count));
+                return true;
+            }
+            i += valueSize * size_t(count);
+        }
+        else if (valueSize > 0)
+            i += valueSize;
+        else
+            return false;
+    }
+    return false;
+}
+
+
+// Returns the size in bytes of a BAM optional field value of the given fixed-size type, or 0 if
+// the type doesn't have a fixed size.
+size_t bamAuxValueSize(char type) {
+    switch (type) {
+    case 'A': case 'c': case 'C':
+        return 1;
+    case 's': case 'S':
+        return 2;
+    case 'i': case 'I': case 'f':
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+
+// Returns the record's sequence length and its tally (see loadSamAlignments), or a '*' tally if
+// the record can't be tallied here. The SEQ column is already on the aligned strand, so no reverse
+// complementing is needed.
+std::string tallySamRecord(SamRecord & record, SeqMap * refSeqs,
+                           int matchScore, int mismatchScore, int gapOpenScore,
+                           int gapExtensionScore) {
+    const uint32_t softClip = 4, hardClip = 5, seqMatch = 7;
+    std::string noTally = "0\t*";
+    if (record.seq == "*" || record.cigar.empty() || record.refPos < 1)
+        return noTally;
+
+    // The Python code only sees CIGAR parts which match \d+\w (so it drops '=' parts) and treats
+    // hard clips as consuming read bases, so leave any such records to it.
+    for (size_t i = 0; i < record.cigarString.size(); ++i) {
+        char c = record.cigarString[i];
+        if (!isalnum((unsigned char)c) && c != '_')
+            return noTally;
+    }
+    for (size_t i = 0; i < record.cigar.size(); ++i) {
+        uint32_t op = record.cigar[i] & 0xf;
+        if (op == hardClip || op == seqMatch)
+            return noTally;
+    }
+    SeqMap::iterator ref = refSeqs->find(record.refName);
+    if (ref == refSeqs->end())
+        return noTally;
+
+    size_t readStart = 0;
+    if ((record.cigar[0] & 0xf) == softClip)
+        readStart = record.cigar[0] >> 4;
+    size_t refStart = size_t(record.refPos - 1);
+    const std::string & refSeq = ref->second;
+    const std::string & readSeq = record.seq;
+    long long counts[5];
+    tallyCigar(readSeq.data() + std::min(readStart, readSeq.size()),
+               readSeq.size() > readStart ? readSeq.size() - readStart : 0,
+               refSeq.data() + std::min(refStart, refSeq.size()),
+               refSeq.size() > refStart ? refSeq.size() - refStart : 0,
+               record.cigar.data(), record.cigar.size(),
+               matchScore, mismatchScore, gapOpenScore, gapExtensionScore, counts);
+    return std::to_string(readSeq.size()) + "\t" + std::to_string(counts[0]) + "," +
+           std::to_string(counts[1]) + "," + std::to_string(counts[2]) + "," +
+           std::to_string(counts[3]) + "," + std::to_string(counts[4]);
+}
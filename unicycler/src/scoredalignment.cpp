@@ -11,7 +11,11 @@
 
 #include "scoredalignment.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <vector>
+#include "string_functions.h"
 
 ScoredAlignment::ScoredAlignment(Align<Dna5String, ArrayGaps> & alignment, 
                                  std::string & readName, std::string & refName,
@@ -20,7 +24,8 @@ ScoredAlignment::ScoredAlignment(Align<Dna5String, ArrayGaps> & alignment,
                                  bool startImmediately, bool goToEndSeq1, bool goToEndSeq2,
                                  Score<int, Simple> & scoringScheme):
     m_readName(readName), m_refName(refName), m_readLength(readLength), m_refLength(refLength),
-    m_readStartPos(-1), m_refStartPos(-1), m_rawScore(0), m_bandSize(bandSize)
+    m_readStartPos(-1), m_refStartPos(-1), m_matchCount(0), m_mismatchCount(0),
+    m_insertionCount(0), m_deletionCount(0), m_rawScore(0), m_bandSize(bandSize)
 {
     // Extract the alignment sequences into C++ strings for constant time random access.
     std::ostringstream stream1;
@@ -152,7 +157,11 @@ std::string ScoredAlignment::getFullString() {
            std::to_string(m_rawScore) + "," +
            std::to_string(m_scaledScore) + "," +
            std::to_string(m_milliseconds) + "," +
-           m_cigar;
+           m_cigar + "," +
+           std::to_string(m_matchCount) + "," +
+           std::to_string(m_mismatchCount) + "," +
+           std::to_string(m_insertionCount) + "," +
+           std::to_string(m_deletionCount);
 }
 
 
@@ -205,8 +214,13 @@ int ScoredAlignment::getCigarScore(CigarType type, int length, Score<int, Simple
                                        int alignmentPos) {
 
     // Scoring indels is easy because we only need to know the length.
-    if (type == INSERTION || type == DELETION)
+    if (type == INSERTION || type == DELETION) {
+        if (type == INSERTION)
+            m_insertionCount += length;
+        else
+            m_deletionCount += length;
         return scoreGapOpen(scoringScheme) + ((length - 1) * scoreGapExtend(scoringScheme));
+    }
 
     // To score matches we must actually look at the bases.
     else if (type == MATCH) {
@@ -214,10 +228,14 @@ int ScoredAlignment::getCigarScore(CigarType type, int length, Score<int, Simple
         for (int i = 0; i < length; ++i) {
             int pos = alignmentPos + i;
             bool match = (readAlignment[pos] == refAlignment[pos]);
-            if (match)
+            if (match) {
                 score += scoreMatch(scoringScheme);
-            else
+                ++m_matchCount;
+            }
+            else {
                 score += scoreMismatch(scoringScheme);
+                ++m_mismatchCount;
+            }
         }
         return score;
     }
@@ -231,4 +249,99 @@ bool ScoredAlignment::isRevComp() {
 
 long long getTime() {
     return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-}
\ No newline at end of file
+}
+
+
+std::vector<uint32_t> parseCigar(const char * cigar, size_t length) {
+    static const std::string cigarOps = CIGAR_OPS;
+    std::vector<uint32_t> packed;
+    uint32_t count = 0;
+    for (size_t i = 0; i < length; ++i) {
+        char c = cigar[i];
+        if (c >= '0' && c <= '9')
+            count = count * 10 + (c - '0');
+        else {
+            // Anything that isn't a known operation is treated as a match/mismatch.
+            size_t op = cigarOps.find(c);
+            if (op == std::string::npos)
+                op = 0;
+            packed.push_back((count << 4) | uint32_t(op));
+            count = 0;
+        }
+    }
+    return packed;
+}
+
+
+std::string cigarToString(const uint32_t * cigar, size_t cigarLength) {
+    static const char * cigarOps = CIGAR_OPS;
+    std::string cigarString;
+    for (size_t i = 0; i < cigarLength; ++i) {
+        cigarString += std::to_string(cigar[i] >> 4);
+        cigarString += cigarOps[std::min(cigar[i] & 0xf, 8u)];
+    }
+    return cigarString;
+}
+
+
+void tallyCigar(const char * readSeq, size_t readLength, const char * refSeq, size_t refLength,
+                const uint32_t * cigar, size_t cigarLength,
+                int matchScore, int mismatchScore, int gapOpenScore, int gapExtensionScore,
+                long long * counts) {
+    const uint32_t softClip = 4, insertion = 1, deletion = 2;
+    size_t first = 0, last = cigarLength;
+    if (last > 0 && (cigar[0] & 0xf) == softClip)
+        ++first;
+    if (last > first && (cigar[last - 1] & 0xf) == softClip)
+        --last;
+
+    long long matches = 0, mismatches = 0, insertions = 0, deletions = 0, rawScore = 0;
+    size_t readI = 0, refI = 0;
+    for (size_t i = first; i < last; ++i) {
+        long long length = cigar[i] >> 4;
+        uint32_t type = cigar[i] & 0xf;
+        if (type == insertion) {
+            insertions += length;
+            readI += length;
+            rawScore += gapOpenScore + (length - 1) * gapExtensionScore;
+        }
+        else if (type == deletion) {
+            deletions += length;
+            refI += length;
+            rawScore += gapOpenScore + (length - 1) * gapExtensionScore;
+        }
+        else {  // match/mismatch
+            // A bad CIGAR could run off the end of a sequence, so stop if that happens.
+            for (long long j = 0; j < length && readI < readLength && refI < refLength; ++j) {
+                if (readSeq[readI] == refSeq[refI]) {
+                    ++matches;
+                    rawScore += matchScore;
+                }
+                else {
+                    ++mismatches;
+                    rawScore += mismatchScore;
+                }
+                ++readI;
+                ++refI;
+            }
+        }
+    }
+    counts[0] = matches;
+    counts[1] = mismatches;
+    counts[2] = insertions;
+    counts[3] = deletions;
+    counts[4] = rawScore;
+}
+
+
+char * cigarTally(char * readSeqC, char * refSeqC, char * cigarC,
+                  int matchScore, int mismatchScore, int gapOpenScore, int gapExtensionScore) {
+    std::vector<uint32_t> cigar = parseCigar(cigarC, strlen(cigarC));
+    long long counts[5];
+    tallyCigar(readSeqC, strlen(readSeqC), refSeqC, strlen(refSeqC), cigar.data(), cigar.size(),
+               matchScore, mismatchScore, gapOpenScore, gapExtensionScore, counts);
+    std::string returnString = std::to_string(counts[0]) + "," + std::to_string(counts[1]) + "," +
+                               std::to_string(counts[2]) + "," + std::to_string(counts[3]) + "," +
+                               std::to_string(counts[4]);
+    return cppStringToCString(returnString);
+}
@@ -17,8 +17,11 @@
 #include <algorithm>
 #include <utility>
 #include <math.h>
+#include <stdlib.h>
 
 #include "settings.h"
+#include "memory_budget.h"
+#include "minimap/minimap.h"
 
 
 char * semiGlobalAlignment(char * readNameC, char * readSeqC, int verbosity,
@@ -55,8 +58,10 @@ char * semiGlobalAlignment(char * readNameC, char * readSeqC, int verbosity,
     if (verbosity > 3)
         displayRFunctions(output);
 
-    // For each minimap alignment we find the appropriate part of the reference sequence.
+    // For each minimap alignment we find the appropriate part of the reference sequence. The hits
+    // themselves are kept too, for the fast path.
     RefRangeMap refRanges;
+    MinimapHitMap minimapHits;
     for (size_t i = 0; i < minimapAlignments.size(); ++i) {
         std::string minimapStr = minimapAlignments[i];
         std::vector<std::string> minimapStrParts = splitString(minimapStr, ',');
@@ -72,6 +77,10 @@ char * semiGlobalAlignment(char * readNameC, char * readSeqC, int verbosity,
         std::string & refSeq = refSeqs->at(refName);
         int refLength = int(refSeq.length());
 
+        int minimiserCount = 0;
+        if (minimapStrParts.size() > 6)
+            minimiserCount = std::stoi(minimapStrParts[6]);
+
         StartEndRange refRange = getRefRange(refStart, refEnd, refLength, readStart, readEnd,
                                              readLength, posStrand);
 
@@ -81,6 +90,14 @@ char * semiGlobalAlignment(char * readNameC, char * readSeqC, int verbosity,
             refRanges[refNameAndStrand] = std::vector<StartEndRange>();
 
         refRanges[refNameAndStrand].push_back(refRange);
+
+        MinimapHit hit;
+        hit.readStart = posStrand ? readStart : readLength - readEnd;
+        hit.readEnd = posStrand ? readEnd : readLength - readStart;
+        hit.refStart = refStart;
+        hit.refEnd = refEnd;
+        hit.minimiserCount = minimiserCount;
+        minimapHits[refNameAndStrand].push_back(hit);
     }
 
     // Simplify the reference ranges by combining overlapping ranges.
@@ -97,11 +114,12 @@ char * semiGlobalAlignment(char * readNameC, char * readSeqC, int verbosity,
     // Make a new KmerPositions object for the read. We'll actually add positions later as
     // necessary (because we may not need both the positive strand or the negative strand).
     KmerPositions readKmerPositions;
-    bool posPositions = false, negPositions = false;
+    int posHandle = -1, negHandle = -1;
 
     // Align to each reference range.
     for(auto const & r : simplifiedRefRanges) {
         std::string refName = r.first;
+        std::vector<MinimapHit> & hits = minimapHits[refName];
         char readStrand = refName.back();
         bool posStrand = readStrand == '+';
         refName.pop_back();
@@ -109,29 +127,61 @@ char * semiGlobalAlignment(char * readNameC, char * readSeqC, int verbosity,
         int refLength = int(refSeq.length());
         std::vector<StartEndRange> ranges = r.second;
 
-        // Prepare some stuff for the read.
+        // Prepare some stuff for the read. The k-mer positions are only needed (and so only made)
+        // if a range goes through the full line tracing path.
         std::string * readSeq;
-        KmerPosMap * kmerPositions;
-        if (posStrand) {
-            if (!posPositions) {
-                readKmerPositions.addPositions(posReadName, posReadSeq, kSize);
-                posPositions = true;
-            }
+        if (posStrand)
             readSeq = &posReadSeq;
-            kmerPositions = readKmerPositions.getKmerPositions(posReadName);
-        }
         else {  // negative strand
-            if (!negPositions) {
+            if (negReadSeq.empty())
                 negReadSeq = getReverseComplement(posReadSeq);
-                readKmerPositions.addPositions(negReadName, negReadSeq, kSize);
-                negPositions = true;
-            }
             readSeq = &negReadSeq;
-            kmerPositions = readKmerPositions.getKmerPositions(negReadName);
         }
+        KmerPosMap * kmerPositions = 0;
 
         // Work on each range (there's probably just one, but there could be more).
         for (auto const & range : ranges) {
+
+            // If the range has a single minimap hit which looks clean, try the fast path first.
+            const MinimapHit * rangeHit = 0;
+            int rangeHitCount = 0;
+            for (auto const & hit : hits) {
+                if (hit.refStart >= range.first && hit.refEnd <= range.second) {
+                    rangeHit = &hit;
+                    ++rangeHitCount;
+                }
+            }
+            if (rangeHitCount == 1) {
+                MinimapHit hit = *rangeHit;
+                if (minimapHitSuitsFastPath(hit, readLength, refLength)) {
+                    ScoredAlignment * fastAlignment =
+                        minimapHitAlignment(refSeqs, refName, range, refLength, readName,
+                                            readStrand, hit, readSeq, matchScore, mismatchScore,
+                                            gapOpenScore, gapExtensionScore, sensitivityLevel,
+                                            verbosity, output);
+                    if (fastAlignment != 0 &&
+                            fastAlignment->m_scaledScore >= FAST_PATH_MIN_SCALED_SCORE) {
+                        returnedAlignments.push_back(fastAlignment);
+                        continue;
+                    }
+                    if (verbosity > 2)
+                        output += "    fast path failed, using line tracing\n";
+                    delete fastAlignment;
+                }
+            }
+
+            if (kmerPositions == 0) {
+                if (posStrand) {
+                    if (posHandle < 0)
+                        posHandle = readKmerPositions.addPositions(posReadName, posReadSeq, kSize);
+                    kmerPositions = readKmerPositions.getKmerPositions(posHandle);
+                }
+                else {
+                    if (negHandle < 0)
+                        negHandle = readKmerPositions.addPositions(negReadName, negReadSeq, kSize);
+                    kmerPositions = readKmerPositions.getKmerPositions(negHandle);
+                }
+            }
             std::vector<ScoredAlignment *> a =
                 alignReadToReferenceRange(refSeqs, refName, range, refLength, readName, readStrand,
                                           kmerPositions, kSize, readSeq, matchScore, mismatchScore,
@@ -153,6 +203,21 @@ char * semiGlobalAlignment(char * readNameC, char * readSeqC, int verbosity,
 }
 
 
+AlignmentScratch::AlignmentScratch() :
+    index(2, cloud, KDTreeSingleIndexAdaptorParams(10)),
+    startingIndex(2, startingCloud, KDTreeSingleIndexAdaptorParams(10))
+{
+}
+
+
+// Each thread has one AlignmentScratch, so its containers keep their capacity from one call of
+// alignReadToReferenceRange to the next.
+AlignmentScratch & getAlignmentScratch() {
+    thread_local AlignmentScratch scratch;
+    return scratch;
+}
+
+
 std::vector<ScoredAlignment *> alignReadToReferenceRange(SeqMap * refSeqs, std::string refName,
                                                          StartEndRange refRange, int refLen,
                                                          std::string readName, char readStrand,
@@ -165,21 +230,18 @@ std::vector<ScoredAlignment *> alignReadToReferenceRange(SeqMap * refSeqs, std::
     long long startTime = getTime();
 
     // Set parameters based on the sensitivity level.
-    int bandSize = LEVEL_0_BAND_SIZE;
+    int bandSize = getBandSize(sensitivityLevel);
     int minLineTraceCount = LEVEL_0_MIN_LINE_TRACE_COUNT;
     int maxLineTraceCount = LEVEL_0_MAX_LINE_TRACE_COUNT;
     if (sensitivityLevel == 1) {
-        bandSize = LEVEL_1_BAND_SIZE;
         minLineTraceCount = LEVEL_1_MIN_LINE_TRACE_COUNT;
         maxLineTraceCount = LEVEL_1_MAX_LINE_TRACE_COUNT;
     }
     else if (sensitivityLevel == 2) {
-        bandSize = LEVEL_2_BAND_SIZE;
         minLineTraceCount = LEVEL_2_MIN_LINE_TRACE_COUNT;
         maxLineTraceCount = LEVEL_2_MAX_LINE_TRACE_COUNT;
     }
     else if (sensitivityLevel == 3) {
-        bandSize = LEVEL_3_BAND_SIZE;
         minLineTraceCount = LEVEL_3_MIN_LINE_TRACE_COUNT;
         maxLineTraceCount = LEVEL_3_MAX_LINE_TRACE_COUNT;
     }
@@ -195,7 +257,9 @@ std::vector<ScoredAlignment *> alignReadToReferenceRange(SeqMap * refSeqs, std::
         output += "Range: " + refName + ": " + std::to_string(refStart) + " - " + std::to_string(refEnd) + "\n";
 
     // Find all common k-mer positions.
-    std::vector<CommonKmer> commonKmers;
+    AlignmentScratch & scratch = getAlignmentScratch();
+    std::vector<CommonKmer> & commonKmers = scratch.commonKmers;
+    commonKmers.clear();
     int maxI = trimmedRefLen - kSize + 1;
     for (int i = 0; i < maxI; ++i) {
         std::string refKmer = trimmedRefSeq.substr(size_t(i), size_t(kSize));
@@ -211,10 +275,11 @@ std::vector<ScoredAlignment *> alignReadToReferenceRange(SeqMap * refSeqs, std::
         saveCommonKmersToFile(readName, readStrand, refName, commonKmers, output);
 
     // Build a nanoflann point cloud with all of the common k-mer points.
-    PointSet usedPoints;
-    PointCloud cloud;
+    PointSet & usedPoints = scratch.usedPoints;
+    usedPoints.clear();
+    PointCloud & cloud = scratch.cloud;
     addKmerPointsToNanoflann(cloud, commonKmers, usedPoints);
-    my_kd_tree_t index(2, cloud, KDTreeSingleIndexAdaptorParams(10));
+    my_kd_tree_t & index = scratch.index;
     index.buildIndex();
 
     // Use nanoflann and line tracing to get a set of common k-mer positions around a line.
@@ -281,37 +346,256 @@ std::vector<ScoredAlignment *> alignReadToReferenceRange(SeqMap * refSeqs, std::
             saveChainedSeedsToFile(readName, readStrand, refName, seedChain, output, maxLineNum,
                                    goodLineNum);
 
-        // If the seed chain contains too much gap area, then we don't proceed - it would take too
-        // long to align and is probably not a good alignment anyway.
         int seedChainLength = length(seedChain);
         if (seedChainLength == 0)
             return alignments;
-        long long gapArea = getMaxSeedChainGapArea(seedChain, readLen, trimmedRefLen);
-        if (gapArea > MAX_BANDED_ALIGNMENT_GAP_AREA)
+        bool tooBig = false;
+        ScoredAlignment * sgAlignment =
+            bandedSeedChainAlignment(seedChain, readSeq, trimmedRefSeq, readName, readStrand,
+                                     refName, refLen, refStart, startTime, bandSize, matchScore,
+                                     mismatchScore, gapOpenScore, gapExtensionScore, verbosity,
+                                     output, tooBig);
+        if (tooBig)
             return alignments;
+        if (sgAlignment != 0)
+            alignments.push_back(sgAlignment);
+    }
+
+    return alignments;
+}
+
+
+// This function is the fast path for aligning a read to a reference range with a single clean
+// minimap hit. Instead of collecting all common k-mers and tracing lines, it matches up the read's
+// and reference's minimisers (as minimap did) and uses the matches near the hit as seeds for the
+// banded alignment. It returns 0 if no alignment could be made.
+ScoredAlignment * minimapHitAlignment(SeqMap * refSeqs, std::string refName,
+                                      StartEndRange refRange, int refLen, std::string readName,
+                                      char readStrand, MinimapHit & hit, std::string * readSeq,
+                                      int matchScore, int mismatchScore, int gapOpenScore,
+                                      int gapExtensionScore, int sensitivityLevel, int verbosity,
+                                      std::string & output) {
+    long long startTime = getTime();
+    int refStart = refRange.first;
+    int refEnd = refRange.second;
+    int readLen = int(readSeq->length());
+    std::string trimmedRefSeq = refSeqs->at(refName).substr(size_t(refStart),
+                                                            size_t(refEnd - refStart));
+    int trimmedRefLen = int(trimmedRefSeq.length());
+    if (verbosity > 2)
+        output += "Range: " + refName + ": " + std::to_string(refStart) + " - " + std::to_string(refEnd) + " (fast path)\n";
+
+    // Sketch both sequences and sort their minimisers by hash, so shared ones can be found with a
+    // merge. Both sequences are on the same strand, so matching minimisers have the same strand bit.
+    mm128_v readMinimisers = {0, 0, 0}, refMinimisers = {0, 0, 0};
+    mm_sketch(readSeq->c_str(), readLen, FAST_PATH_WINDOW_SIZE, FAST_PATH_KMER_SIZE, 0,
+              &readMinimisers);
+    mm_sketch(trimmedRefSeq.c_str(), trimmedRefLen, FAST_PATH_WINDOW_SIZE, FAST_PATH_KMER_SIZE, 0,
+              &refMinimisers);
+    auto byHash = [](const mm128_t & a, const mm128_t & b) {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    };
+    std::sort(readMinimisers.a, readMinimisers.a + readMinimisers.n, byHash);
+    std::sort(refMinimisers.a, refMinimisers.a + refMinimisers.n, byHash);
+
+    // Matches are only kept if they are near the line of the minimap hit (in trimmed reference
+    // coordinates) and their minimiser isn't too repetitive.
+    double hitSlope = double(hit.refEnd - hit.refStart) / double(hit.readEnd - hit.readStart);
+    double hitRefStart = double(hit.refStart - refStart);
+    PointVector anchors;
+    size_t i = 0, j = 0;
+    while (i < readMinimisers.n && j < refMinimisers.n) {
+        uint64_t hash = readMinimisers.a[i].x;
+        if (hash < refMinimisers.a[j].x) {
+            ++i;
+            continue;
+        }
+        if (hash > refMinimisers.a[j].x) {
+            ++j;
+            continue;
+        }
+        size_t iEnd = i, jEnd = j;
+        while (iEnd < readMinimisers.n && readMinimisers.a[iEnd].x == hash)
+            ++iEnd;
+        while (jEnd < refMinimisers.n && refMinimisers.a[jEnd].x == hash)
+            ++jEnd;
+        if (iEnd - i <= FAST_PATH_MAX_MINIMISER_OCCURRENCES &&
+                jEnd - j <= FAST_PATH_MAX_MINIMISER_OCCURRENCES) {
+            for (size_t a = i; a < iEnd; ++a) {
+                for (size_t b = j; b < jEnd; ++b) {
+                    uint64_t readY = readMinimisers.a[a].y, refY = refMinimisers.a[b].y;
+                    if ((readY & 1) != (refY & 1))
+                        continue;
+                    int readPos = int(uint32_t(readY) >> 1) - FAST_PATH_KMER_SIZE + 1;
+                    int refPos = int(uint32_t(refY) >> 1) - FAST_PATH_KMER_SIZE + 1;
+                    double expectedRefPos = hitRefStart + (readPos - hit.readStart) * hitSlope;
+                    if (fabs(refPos - expectedRefPos) <= FAST_PATH_MAX_ANCHOR_DEVIATION)
+                        anchors.emplace_back(readPos, refPos);
+                }
+            }
+        }
+        i = iEnd;
+        j = jEnd;
+    }
+    free(readMinimisers.a);
+    free(refMinimisers.a);
+    std::sort(anchors.begin(), anchors.end());
+    PointVector consistentAnchors = getConsistentAnchors(anchors);
+    if (verbosity > 2)
+        output += "    minimiser anchors: " + std::to_string(anchors.size()) + " (" +
+                  std::to_string(consistentAnchors.size()) + " consistent)\n";
+    if (consistentAnchors.empty())
+        return 0;
+
+    // The anchors become seeds for a global chain, as in the line tracing path.
+    TSeedSet seedSet;
+    for (auto const & p : consistentAnchors) {
+        TSeed seed(size_t(p.x), size_t(p.y), size_t(FAST_PATH_KMER_SIZE));
+        if (!addSeed(seedSet, seed, 2, Merge()))
+            addSeed(seedSet, seed, Single());
+    }
+    String<TSeed> seedChain;
+    chainSeedsGlobally(seedChain, seedSet, SparseChaining());
+    if (length(seedChain) == 0)
+        return 0;
+
+    bool tooBig = false;
+    return bandedSeedChainAlignment(seedChain, readSeq, trimmedRefSeq, readName, readStrand,
+                                    refName, refLen, refStart, startTime,
+                                    getBandSize(sensitivityLevel), matchScore, mismatchScore,
+                                    gapOpenScore, gapExtensionScore, verbosity, output, tooBig);
+}
+
+
+// This function takes anchors (sorted by read position) and returns those whose diagonal is close
+// to the median diagonal of their neighbours. This drops matches from nearby repeats, which would
+// otherwise pull the seed chain (and so the alignment) off course.
+PointVector getConsistentAnchors(PointVector & anchors) {
+    int anchorCount = int(anchors.size());
+    PointVector consistentAnchors;
+    std::vector<int> diagonals;
+    for (int i = 0; i < anchorCount; ++i) {
+        int first = std::max(0, i - FAST_PATH_ANCHOR_NEIGHBOURS);
+        int last = std::min(anchorCount - 1, i + FAST_PATH_ANCHOR_NEIGHBOURS);
+        diagonals.clear();
+        for (int j = first; j <= last; ++j)
+            diagonals.push_back(anchors[j].x - anchors[j].y);
+        std::nth_element(diagonals.begin(), diagonals.begin() + diagonals.size() / 2,
+                         diagonals.end());
+        int medianDiagonal = diagonals[diagonals.size() / 2];
+        if (std::abs(anchors[i].x - anchors[i].y - medianDiagonal) <=
+                FAST_PATH_MAX_ANCHOR_DIAGONAL_DEVIATION)
+            consistentAnchors.push_back(anchors[i]);
+    }
+    return consistentAnchors;
+}
+
+
+// This function decides whether a minimap hit is clean enough for the fast path: it must cover
+// most of the overlap the read and reference could have, and have plenty of minimisers for its
+// length (low-identity hits have fewer).
+bool minimapHitSuitsFastPath(MinimapHit & hit, int readLen, int refLen) {
+    int readSpan = hit.readEnd - hit.readStart;
+    if (readSpan <= 0 || hit.refEnd <= hit.refStart)
+        return false;
+    int startOverhang = std::min(hit.readStart, hit.refStart);
+    int endOverhang = std::min(readLen - hit.readEnd, refLen - hit.refEnd);
+    double coverage = double(readSpan) / double(startOverhang + readSpan + endOverhang);
+    double minimisersPerKb = 1000.0 * hit.minimiserCount / readSpan;
+    return coverage >= FAST_PATH_MIN_HIT_COVERAGE &&
+           minimisersPerKb >= FAST_PATH_MIN_MINIMISERS_PER_KB;
+}
+
+
+// This function does a Seqan banded alignment of the read to the trimmed reference along a seed
+// chain. The band is sized to the chain, so accurate alignments can use a narrow one. If the
+// alignment runs along the band's edge, the band is widened and the alignment redone (and kept if
+// it scores better). It returns 0 if no alignment was made, and sets tooBig if that was because the
+// alignment would take too long or use too much memory.
+ScoredAlignment * bandedSeedChainAlignment(String<TSeed> & seedChain, std::string * readSeq,
+                                           std::string & trimmedRefSeq, std::string readName,
+                                           char readStrand, std::string refName, int refLen,
+                                           int refStart, long long startTime, int bandSize,
+                                           int matchScore, int mismatchScore, int gapOpenScore,
+                                           int gapExtensionScore, int verbosity,
+                                           std::string & output, bool & tooBig) {
+    int readLen = int(readSeq->length());
+    int trimmedRefLen = int(trimmedRefSeq.length());
+
+    // If the seed chain contains too much gap area, then we don't proceed - it would take too
+    // long to align and is probably not a good alignment anyway. With a memory budget, the
+    // limit may be lower and the alignment's memory is reserved before it runs.
+    long long gapArea = getMaxSeedChainGapArea(seedChain, readLen, trimmedRefLen);
+    if (gapArea > budgetedCount(MAX_BANDED_ALIGNMENT_GAP_AREA, DP_CELL_BYTES, 0)) {
+        tooBig = true;
+        return 0;
+    }
+
+    int chainBandSize = getAdaptiveBandSize(seedChain, bandSize);
+    Score<int, Simple> scoringScheme(matchScore, mismatchScore, gapExtensionScore, gapOpenScore);
+    AlignConfig<true, true, true, true> alignConfig;
+    Align<Dna5String, ArrayGaps> alignment;
+    int alignedBandSize = 0, alignedScore = 0;
+    for (int widening = 0; widening <= MAX_BAND_WIDENINGS; ++widening) {
+        long long dpBytes = (gapArea + (long long)readLen * (2 * chainBandSize + 1)) *
+                            DP_CELL_BYTES;
+        if (!fitsInMemoryBudget(dpBytes)) {
+            if (widening == 0) {
+                tooBig = true;
+                return 0;
+            }
+            break;
+        }
+        MemoryReservation reservation(dpBytes);
 
         // Finally we can actually do the Seqan alignment!
-        Align<Dna5String, ArrayGaps> alignment;
-        resize(rows(alignment), 2);
-        assignSource(row(alignment, 0), *readSeq);
-        assignSource(row(alignment, 1), trimmedRefSeq);
-        AlignConfig<true, true, true, true> alignConfig;
-        Score<int, Simple> scoringScheme(matchScore, mismatchScore, gapExtensionScore,
-                                         gapOpenScore);
-        ScoredAlignment *sgAlignment;
+        Align<Dna5String, ArrayGaps> attempt;
+        resize(rows(attempt), 2);
+        assignSource(row(attempt, 0), *readSeq);
+        assignSource(row(attempt, 1), trimmedRefSeq);
+        int score;
         try {
-            bandedChainAlignment(alignment, seedChain, scoringScheme, alignConfig,
-                                 (unsigned int) bandSize);
-            std::string signedReadName = readName + readStrand;
-            sgAlignment = new ScoredAlignment(alignment, signedReadName, refName, readLen, refLen,
-                                              refStart, startTime, bandSize, false, false, false,
-                                              scoringScheme);
-            alignments.push_back(sgAlignment);
+            score = bandedChainAlignment(attempt, seedChain, scoringScheme, alignConfig,
+                                         (unsigned int) chainBandSize);
+        }
+        catch (...) {
+            break;
         }
-        catch (...) {}
+        if (verbosity > 2)
+            output += "    band size: " + std::to_string(chainBandSize) + ", score: " +
+                      std::to_string(score) + "\n";
+
+        // A wider band doesn't always give Seqan's chain alignment a better score, so only keep
+        // the widened alignment if it improved.
+        if (alignedBandSize > 0 && score <= alignedScore)
+            break;
+        alignment = attempt;
+        alignedBandSize = chainBandSize;
+        alignedScore = score;
+        int widerBandSize = std::min(chainBandSize * 2, MAX_ADAPTIVE_BAND_SIZE);
+        if (widening == MAX_BAND_WIDENINGS || widerBandSize <= chainBandSize ||
+                !alignmentHitsBandEdge(alignment, seedChain, chainBandSize))
+            break;
+        chainBandSize = widerBandSize;
     }
+    if (alignedBandSize == 0)
+        return 0;
 
-    return alignments;
+    std::string signedReadName = readName + readStrand;
+    return new ScoredAlignment(alignment, signedReadName, refName, readLen, refLen, refStart,
+                               startTime, alignedBandSize, false, false, false, scoringScheme);
+}
+
+
+// Returns the (maximum) band size for the sensitivity level.
+int getBandSize(int sensitivityLevel) {
+    if (sensitivityLevel == 1)
+        return LEVEL_1_BAND_SIZE;
+    else if (sensitivityLevel == 2)
+        return LEVEL_2_BAND_SIZE;
+    else if (sensitivityLevel == 3)
+        return LEVEL_3_BAND_SIZE;
+    return LEVEL_0_BAND_SIZE;
 }
 
 
@@ -347,6 +631,82 @@ long long getMaxSeedChainGapArea(String<TSeed> & seedChain, int readLen, int tri
 }
 
 
+// This function chooses a band size for a seed chain. Most seeds lie close to the diagonal their
+// neighbours predict, so a narrow band is enough. The band grows with how far seeds stray from
+// that prediction (using a high percentile, so a single stray seed doesn't set the band for the
+// whole chain) and with the chain's indel drift (diagonal change per read base) over the gaps
+// between seeds.
+int getAdaptiveBandSize(String<TSeed> & seedChain, int maxBand) {
+    int seedChainLength = length(seedChain);
+    if (seedChainLength < 3)
+        return maxBand;
+    std::vector<double> diagonals(seedChainLength);
+    for (int i = 0; i < seedChainLength; ++i)
+        diagonals[i] = (double(lowerDiagonal(seedChain[i])) + upperDiagonal(seedChain[i])) / 2.0;
+
+    double totalDrift = 0.0;
+    for (int i = 1; i < seedChainLength; ++i)
+        totalDrift += std::abs(diagonals[i] - diagonals[i - 1]);
+    double span = double(endPositionH(seedChain[seedChainLength - 1])) -
+                  double(beginPositionH(seedChain[0]));
+    double driftRate = span > 0.0 ? totalDrift / span : 0.0;
+
+    std::vector<double> bandNeeds;
+    bandNeeds.reserve(seedChainLength - 2);
+    for (int i = 1; i < seedChainLength - 1; ++i) {
+        double h = beginPositionH(seedChain[i]);
+        double prevH = endPositionH(seedChain[i - 1]), nextH = beginPositionH(seedChain[i + 1]);
+        double fraction = nextH > prevH ? (h - prevH) / (nextH - prevH) : 0.5;
+        double expectedDiagonal = diagonals[i - 1] +
+                                  fraction * (diagonals[i + 1] - diagonals[i - 1]);
+        double gap = std::max(h - prevH, nextH - double(endPositionH(seedChain[i])));
+        bandNeeds.push_back(std::abs(diagonals[i] - expectedDiagonal) +
+                            driftRate * std::max(gap, 0.0));
+    }
+    size_t percentileIndex = size_t(ADAPTIVE_BAND_PERCENTILE * (bandNeeds.size() - 1));
+    std::nth_element(bandNeeds.begin(), bandNeeds.begin() + percentileIndex, bandNeeds.end());
+    double band = MIN_ADAPTIVE_BAND_SIZE + bandNeeds[percentileIndex];
+    return int(std::min(std::ceil(band), double(maxBand)));
+}
+
+
+// This function returns whether the alignment runs along the edge of the band anywhere. It only
+// looks at the parts of seeds where the band, not a gap between seeds, bounds the DP.
+bool alignmentHitsBandEdge(Align<Dna5String, ArrayGaps> & alignment, String<TSeed> & seedChain,
+                           int bandSize) {
+    typedef Gaps<Dna5String, ArrayGaps> TGaps;
+    typedef Iterator<TGaps>::Type TGapsIterator;
+    int seedChainLength = length(seedChain);
+    TGaps & readRow = row(alignment, 0);
+    TGaps & refRow = row(alignment, 1);
+    TGapsIterator readIt = begin(readRow), readEnd = end(readRow);
+    TGapsIterator refIt = begin(refRow), refEnd = end(refRow);
+    long long h = 0, v = 0;
+    int s = 0;
+    for (; readIt != readEnd && refIt != refEnd; ++readIt, ++refIt) {
+        bool readGap = isGap(readIt), refGap = isGap(refIt);
+        if (!readGap && !refGap) {
+            while (s < seedChainLength && (long long)endPositionH(seedChain[s]) - bandSize <= h)
+                ++s;
+            if (s == seedChainLength)
+                break;
+            TSeed & seed = seedChain[s];
+            if (h >= (long long)beginPositionH(seed) + bandSize) {
+                long long diagonal = h - v;
+                if (diagonal <= lowerDiagonal(seed) - bandSize ||
+                        diagonal >= upperDiagonal(seed) + bandSize)
+                    return true;
+            }
+        }
+        if (!readGap)
+            ++h;
+        if (!refGap)
+            ++v;
+    }
+    return false;
+}
+
+
 PointSet lineTracingWithNanoflann(std::vector<CommonKmer> & commonKmers, PointSet & usedPoints,
                                   PointCloud & cloud, my_kd_tree_t & index, std::string readName,
                                   char readStrand, std::string * readSeq, int readLen,
@@ -355,9 +715,10 @@ PointSet lineTracingWithNanoflann(std::vector<CommonKmer> & commonKmers, PointSe
                                   double & pointSetScore) {
 
     // First find the highest density point in the region, which we will use to start the trace.
-    PointCloud startingPointCloud;
+    AlignmentScratch & scratch = getAlignmentScratch();
+    PointCloud & startingPointCloud = scratch.startingCloud;
     addKmerPointsToNanoflann(startingPointCloud, commonKmers, usedPoints);
-    my_kd_tree_t startingPointIndex(2, startingPointCloud, KDTreeSingleIndexAdaptorParams(10));
+    my_kd_tree_t & startingPointIndex = scratch.startingIndex;
     startingPointIndex.buildIndex();
     Point startPoint = getHighestDensityPoint(LINE_TRACING_START_POINT_SEARCH_RADIUS,
                                               startingPointCloud, startingPointIndex,
@@ -367,8 +728,8 @@ PointSet lineTracingWithNanoflann(std::vector<CommonKmer> & commonKmers, PointSe
     traceDots.push_back(p);
 
     // Start the point collection using points around the starting point.
-    PointVector nearbyPoints = radiusSearchAroundPoint(p, TRACE_LINE_COLLECTION_DISTANCE, cloud,
-                                                       index);
+    PointVector & nearbyPoints = scratch.nearbyPoints;
+    radiusSearchAroundPoint(p, TRACE_LINE_COLLECTION_DISTANCE, cloud, index, nearbyPoints);
     PointSet pointSet(nearbyPoints.begin(), nearbyPoints.end());
 
     // Trace the line forward then backward.
@@ -391,7 +752,8 @@ PointSet lineTracingWithNanoflann(std::vector<CommonKmer> & commonKmers, PointSe
                 leftAlignmentRectangle = true;
 //            std::cout << "  leftAlignmentRectangle: " << leftAlignmentRectangle << "\n" << std::flush;  // TEMP
 
-            PointSet pointsNearLine;
+            PointSet & pointsNearLine = scratch.pointsNearLine;
+            pointsNearLine.clear();
             p = mutateLineToBestFitPoints(previousP, newP, cloud, index, pointsNearLine, leftAlignmentRectangle);
 //            std::cout << "  mutated point: " << p.x << "," << p.y << "\n" << std::flush;  // TEMP
 
@@ -445,10 +807,11 @@ Point mutateLineToBestFitPoints(Point p1, Point p2, PointCloud & cloud, my_kd_tr
                                 PointSet & pointsNearLine, bool leftAlignmentRectangle) {
 
     int radius = int(TRACE_LINE_STEP_DISTANCE * 1.1);
-    PointVector pointsNearP1 = radiusSearchAroundPoint(p1, radius, cloud, index);
-    PointVector pointsNearP2 = radiusSearchAroundPoint(p2, radius, cloud, index);
-    pointsNearLine.insert(pointsNearP1.begin(), pointsNearP1.end());
-    pointsNearLine.insert(pointsNearP2.begin(), pointsNearP2.end());
+    PointVector & nearbyPoints = getAlignmentScratch().nearbyPoints;
+    radiusSearchAroundPoint(p1, radius, cloud, index, nearbyPoints);
+    pointsNearLine.insert(nearbyPoints.begin(), nearbyPoints.end());
+    radiusSearchAroundPoint(p2, radius, cloud, index, nearbyPoints);
+    pointsNearLine.insert(nearbyPoints.begin(), nearbyPoints.end());
 
     if (leftAlignmentRectangle)
         return p2;
@@ -545,18 +908,12 @@ double distanceToLineSegment(Point p, Point l1, Point l2) {
 
 void addKmerPointsToNanoflann(PointCloud & cloud, std::vector<CommonKmer> & commonKmers,
                               PointSet & usedPoints) {
-    PointVector points;
+    cloud.pts.clear();
     for (size_t i = 0; i < commonKmers.size(); ++i) {
         Point p(commonKmers[i].m_hPosition, commonKmers[i].m_vPosition);
         bool alreadyUsed = usedPoints.find(p) != usedPoints.end();
         if (!alreadyUsed)
-            points.push_back(p);
-    }
-    size_t pCount = points.size();
-    cloud.pts.resize(pCount);
-    for (size_t i = 0; i < pCount; ++i) {
-        cloud.pts[i].x = points[i].x;
-        cloud.pts[i].y = points[i].y;
+            cloud.pts.push_back(p);
     }
 }
 
@@ -564,13 +921,22 @@ void addKmerPointsToNanoflann(PointCloud & cloud, std::vector<CommonKmer> & comm
 PointVector radiusSearchAroundPoint(Point point, int radius, PointCloud & cloud,
                                     my_kd_tree_t & index) {
     PointVector points;
+    radiusSearchAroundPoint(point, radius, cloud, index, points);
+    return points;
+}
+
+
+// This version puts the points in the given vector (replacing its contents), so a caller in a loop
+// can reuse one vector.
+void radiusSearchAroundPoint(Point point, int radius, PointCloud & cloud, my_kd_tree_t & index,
+                             PointVector & points) {
+    thread_local std::vector<std::pair<size_t,int> > ret_matches;
     nanoflann::SearchParams params;
-    std::vector<std::pair<size_t,int> > ret_matches;
     const int query_pt[2] = {point.x, point.y};
     index.radiusSearch(query_pt, radius, ret_matches, params);
+    points.clear();
     for (auto const & i : ret_matches)
         points.push_back(cloud.pts[i.first]);
-    return points;
 }
 
 
@@ -593,7 +959,8 @@ Point getHighestDensityPoint(int densityRadius, PointCloud & cloud, my_kd_tree_t
 // it rewards points that have lots of neighbours close to the diagonal, but it punishes points
 // with too many neighbours away from the diagonal.
 double getPointDensityScore(int densityRadius, Point p, PointCloud & cloud, my_kd_tree_t & index) {
-    PointVector neighbourPoints = radiusSearchAroundPoint(p, densityRadius, cloud, index);
+    PointVector & neighbourPoints = getAlignmentScratch().nearbyPoints;
+    radiusSearchAroundPoint(p, densityRadius, cloud, index, neighbourPoints);
     double a = 1.0 / SCORE_DISTANCE_FROM_DIAGONAL;
     double densityScore = 0.0;
     for (auto const & neighbourPoint : neighbourPoints) {
@@ -0,0 +1,57 @@
+// Copyright 2017 Ryan Wick (rrwick@gmail.com)
+// https://github.com/rrwick/Unicycler
+
+// This file is part of Unicycler. Unicycler is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later version. Unicycler is
+// distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the
+// implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+// Public License for more details. You should have received a copy of the GNU General Public
+// License along with Unicycler. If not, see <http://www.gnu.org/licenses/>.
+
+#include "thread_pool.h"
+
+#include "minimap/kthread.h"
+
+#include <atomic>
+#include <vector>
+
+
+static void parallelForCallback(void * data, long i, int threadIndex) {
+    const std::function<void(long, int)> * func = (const std::function<void(long, int)> *)data;
+    (*func)(i, threadIndex);
+}
+
+
+void parallelFor(int threadCount, long n, const std::function<void(long, int)> & func) {
+    kt_for(threadCount, parallelForCallback, (void *)&func, n);
+}
+
+
+void setThreadPinning(bool pin) {
+    kt_pool_pin_threads(pin ? 1 : 0);
+}
+
+
+long long parallelForSum(int threadCount, long n) {
+    int slots = threadCount < 1 ? 1 : threadCount;
+    std::vector<long long> sums(slots, 0);
+    std::vector<std::atomic<int>> inUse(slots);
+    for (auto & x : inUse)
+        x = 0;
+    std::atomic<bool> failed(false);
+    parallelFor(threadCount, n, [&](long i, int threadIndex) {
+        if (threadIndex < 0 || threadIndex >= slots || inUse[threadIndex].exchange(1) != 0) {
+            failed = true;
+            return;
+        }
+        sums[threadIndex] += i;
+        inUse[threadIndex] = 0;
+    });
+    if (failed)
+        return -1;
+    long long total = 0;
+    for (long long sum : sums)
+        total += sum;
+    return total;
+}
@@ -20,7 +20,6 @@ import os
 import sys
 import shutil
 import random
-import itertools
 import multiprocessing
 from .alignment import AlignmentScoringScheme
 from .assembly_graph import AssemblyGraph
@@ -31,6 +30,7 @@ from .bridge_miniasm import create_miniasm_bridges
 from .bridge_long_read import create_long_read_bridges
 from .bridge_spades_contig import create_spades_contig_bridges
 from .bridge_loop_unroll import create_loop_unrolling_bridges
+from .checkpoint import Checkpoints, FileCounter
 from .misc import int_to_str, float_to_str, quit_with_error, get_percentile, bold, \
     check_input_files, MyHelpFormatter, print_table, get_ascii_art, \
     get_default_thread_count, spades_path_and_version, makeblastdb_path_and_version, \
@@ -41,9 +41,17 @@ from .unicycler_align import fix_up_arguments, semi_global_align_long_reads, loa
     load_sam_alignments, print_alignment_summary_table
 from .read_ref import get_read_nickname_dict, load_long_reads
 from . import log
+from . import profiler
 from . import settings
 from .version import __version__
 
+try:
+    from .cpp_wrappers import new_read_sketches, delete_read_sketches, set_memory_budget, \
+        set_thread_pinning
+except AttributeError as e:
+    sys.exit('Error when importing C++ library: ' + str(e) + '\n'
+             'Have you successfully built the library file using make?')
+
 
 def main():
     """
@@ -58,13 +66,23 @@ def main():
     long_reads_available = bool(args.long)
 
     check_input_files(args)
+    set_memory_budget(int(args.max_memory * 1e9))
+    set_thread_pinning(args.pin_threads)
+    if args.profile:
+        profiler.enable()
     print_intro_message(args, full_command, out_dir_message)
     check_dependencies(args, short_reads_available, long_reads_available)
 
-    counter = itertools.count(start=1)  # Files are numbered in chronological order.
-    bridges = []
+    checkpoints = Checkpoints(args, enabled=not args.no_checkpoints)
+    state = checkpoints.resume()
+    counter = state.get('counter', FileCounter(start=1))  # Files are numbered chronologically.
+    bridges = state.get('bridges', [])
+    graph = state.get('graph')
+    anchor_segments = state.get('anchor_segments', [])
+
+    if short_reads_available and not checkpoints.reached('short_read_graph'):
+        profiler.begin_stage('spades_graph')
 
-    if short_reads_available:
         # Produce a SPAdes assembly graph with a k-mer that balances contig length and connectivity.
         spades_graph_prefix = gfa_path(args.out, next(counter), 'spades_graph')[:-4]
         best_spades_graph = gfa_path(args.out, next(counter), 'depth_filter')
@@ -79,11 +97,13 @@ def main():
                                           args.kmer_count, args.min_kmer_frac, args.max_kmer_frac,
                                           args.kmers, args.linear_seqs, args.largest_component,
                                           spades_graph_prefix, args.spades_options)
+        profiler.begin_stage('copy_depth')
         determine_copy_depth(graph)
         if args.keep > 0 and not os.path.isfile(best_spades_graph):
             graph.save_to_gfa(best_spades_graph, save_copy_depth_info=True, newline=True,
                               include_insert_size=True)
 
+        profiler.begin_stage('short_read_bridges')
         clean_up_spades_graph(graph)
         if args.keep > 0:
             overlap_removed_graph_filename = gfa_path(args.out, next(counter), 'overlaps_removed')
@@ -101,50 +121,98 @@ def main():
                 log.log('none found', 1)
 
         graph.paths = {}  # Now that we've made short read bridges, we no longer need the paths.
-
-    else:  # short reads not available
-        graph = None
-        anchor_segments = []
+        checkpoints.save('short_read_graph', counter=counter, graph=graph,
+                         anchor_segments=anchor_segments, bridges=bridges)
 
     scoring_scheme = AlignmentScoringScheme(args.scores)
 
     if long_reads_available:
+        profiler.begin_stage('long_read_loading')
         read_dict, read_names, long_read_filename = load_long_reads(args.long, output_dir=args.out)
         read_nicknames = get_read_nickname_dict(read_names)
     else:
         read_dict, read_names, long_read_filename, read_nicknames = {}, [], '', {}
 
-    if long_reads_available and not args.no_miniasm:
-        string_graph = make_miniasm_string_graph(graph, read_dict, long_read_filename,
-                                                 scoring_scheme, read_nicknames, counter, args,
-                                                 anchor_segments, args.existing_long_read_assembly)
+    # In a hybrid assembly, the long reads are mapped with minimap several times (miniasm, simple
+    # bridging and semi-global alignment). Their minimisers are cached so each pass can skip
+    # re-reading and re-sketching them. The cache takes 8 bytes per minimiser (about 1.5 bytes per
+    # read base), isn't limited by --max_memory and is freed after the last minimap pass.
+    if short_reads_available and long_reads_available:
+        read_sketches = new_read_sketches(long_read_filename)
     else:
-        string_graph = None
+        read_sketches = None
+
+    if checkpoints.reached('miniasm'):
+        string_graph = state.get('string_graph')
+    else:
+        if long_reads_available and not args.no_miniasm:
+            profiler.begin_stage('miniasm')
+            string_graph = make_miniasm_string_graph(graph, read_dict, long_read_filename,
+                                                     scoring_scheme, read_nicknames, counter,
+                                                     args, anchor_segments,
+                                                     args.existing_long_read_assembly,
+                                                     read_sketches)
+        else:
+            string_graph = None
+        if short_reads_available and long_reads_available and string_graph is not None and \
+                not args.no_miniasm:
+            bridges += create_miniasm_bridges(graph, string_graph, anchor_segments,
+                                              scoring_scheme, args.verbosity, args.min_bridge_qual)
+        if long_reads_available:
+            checkpoints.save('miniasm', counter=counter, graph=graph,
+                             anchor_segments=anchor_segments, bridges=bridges,
+                             string_graph=string_graph)
 
     if not short_reads_available and string_graph is None:
         quit_with_error('miniasm assembly failed')
 
     if short_reads_available and long_reads_available:
-        if string_graph is not None and not args.no_miniasm:
-            bridges += create_miniasm_bridges(graph, string_graph, anchor_segments,
-                                              scoring_scheme, args.verbosity, args.min_bridge_qual)
-
-        if not args.no_simple_bridges:
+        if not args.no_simple_bridges and not checkpoints.reached('simple_bridges'):
+            profiler.begin_stage('simple_bridges')
             bridges += create_simple_long_read_bridges(graph, args.out, args.keep, args.threads,
                                                        read_dict, long_read_filename,
-                                                       scoring_scheme, anchor_segments)
-        if not args.no_long_read_alignment:
-            read_names, min_scaled_score, min_alignment_length = \
-                align_long_reads_to_assembly_graph(graph, anchor_segments, args, full_command,
-                                                   read_dict, read_names, long_read_filename)
-
+                                                       scoring_scheme, anchor_segments,
+                                                       read_sketches)
+            checkpoints.save('simple_bridges', counter=counter, graph=graph,
+                             anchor_segments=anchor_segments, bridges=bridges,
+                             string_graph=string_graph)
+        if not args.no_long_read_alignment and not checkpoints.reached('long_read_bridges'):
+            if checkpoints.reached('long_read_alignment'):
+                read_dict, read_names = state['read_dict'], state['read_names']
+                min_scaled_score = state['min_scaled_score']
+                min_alignment_length = state['min_alignment_length']
+            else:
+                profiler.begin_stage('long_read_alignment')
+                read_names, min_scaled_score, min_alignment_length = \
+                    align_long_reads_to_assembly_graph(graph, anchor_segments, args, full_command,
+                                                       read_dict, read_names, long_read_filename,
+                                                       read_sketches)
+                checkpoints.save('long_read_alignment', counter=counter, graph=graph,
+                                 anchor_segments=anchor_segments, bridges=bridges,
+                                 string_graph=string_graph, read_dict=read_dict,
+                                 read_names=read_names, min_scaled_score=min_scaled_score,
+                                 min_alignment_length=min_alignment_length)
+
+            # Semi-global alignment was the last minimap pass, so the read sketches can go.
+            if read_sketches is not None:
+                delete_read_sketches(read_sketches)
+                read_sketches = None
+
+            profiler.begin_stage('long_read_bridges')
             expected_linear_seqs = args.linear_seqs > 0
             bridges += create_long_read_bridges(graph, read_dict, read_names, anchor_segments,
                                                 args.verbosity, min_scaled_score, args.threads,
                                                 scoring_scheme, min_alignment_length,
                                                 expected_linear_seqs, args.min_bridge_qual)
+            checkpoints.save('long_read_bridges', counter=counter, graph=graph,
+                             anchor_segments=anchor_segments, bridges=bridges,
+                             string_graph=string_graph)
 
-    if short_reads_available:
+    if read_sketches is not None:
+        delete_read_sketches(read_sketches)
+
+    if short_reads_available and not checkpoints.reached('bridged'):
+        profiler.begin_stage('bridge_application')
         seg_nums_used_in_bridges = graph.apply_bridges(bridges, args.verbosity,
                                                        args.min_bridge_qual)
         if args.keep > 0:
@@ -173,18 +241,23 @@ def main():
             graph.save_to_gfa(gfa_path(args.out, next(counter), 'final_clean'))
         log.log('')
         graph.print_component_table()
+        checkpoints.save('bridged', counter=counter, graph=graph)
 
-    else:  # only long reads available
+    elif not short_reads_available:  # only long reads available
         graph = string_graph
 
     if not args.no_rotate:
+        profiler.begin_stage('rotation')
         rotate_completed_replicons(graph, args, counter)
 
+    profiler.begin_stage('output')
     log.log_section_header('Assembly complete')
     final_assembly_fasta = os.path.join(args.out, 'assembly.fasta')
     final_assembly_gfa = os.path.join(args.out, 'assembly.gfa')
     graph.save_to_gfa(final_assembly_gfa)
     graph.save_to_fasta(final_assembly_fasta, min_length=args.min_fasta_length)
+    checkpoints.clean_up(args.keep)
+    profiler.save_report(os.path.join(args.out, 'unicycler_profile.json'))
 
     log.log('')
 
@@ -243,6 +316,15 @@ def get_arguments():
                                    '1 = also save graphs at main checkpoints, '
                                    '2 = also keep SAM (enables fast rerun in different mode), '
                                    '3 = keep all temp files and save all graphs (for debugging)')
+    output_group.add_argument('--no_checkpoints', action='store_true',
+                              help='Do not save pipeline checkpoints (default: save the state '
+                                   'after each major stage so an interrupted run can resume when '
+                                   'rerun with the same inputs and output directory)'
+                                   if show_all_args else argparse.SUPPRESS)
+    output_group.add_argument('--profile', action='store_true',
+                              help='Save the time, memory and C++ library usage of each pipeline '
+                                   'stage to unicycler_profile.json (default: do not profile)'
+                                   if show_all_args else argparse.SUPPRESS)
 
     other_group = parser.add_argument_group('Other')
     other_group.add_argument('-t', '--threads', type=int, required=False,
@@ -269,6 +351,16 @@ def get_arguments():
                              help='If set, Unicycler will not use segments shorter than this as '
                                   'scaffolding anchors (default: automatic threshold)'
                                   if show_all_args else argparse.SUPPRESS)
+    other_group.add_argument('--max_memory', type=float, required=False, default=0.0,
+                             help='Memory budget in gigabytes for the C++ alignment code: batch '
+                                  'sizes and alignment bands shrink to fit and alignments too big '
+                                  'for it are skipped. The long read minimiser cache and miniasm '
+                                  'read store are not included (default: 0, no limit)'
+                                  if show_all_args else argparse.SUPPRESS)
+    other_group.add_argument('--pin_threads', action='store_true',
+                             help='Pin the C++ worker threads to NUMA nodes, which can help on '
+                                  'multi-socket machines (default: do not pin threads)'
+                                  if show_all_args else argparse.SUPPRESS)
 
     spades_group = parser.add_argument_group('SPAdes assembly',
                                              'These options control the short-read SPAdes '
@@ -419,6 +511,9 @@ def get_arguments():
     if args.threads <= 0:
         quit_with_error('--threads must be at least 1')
 
+    if args.max_memory < 0.0:
+        quit_with_error('--max_memory cannot be negative')
+
     if args.kmer_count < 1:
         quit_with_error('--kmer_count must be at least 1')
 
@@ -805,7 +900,8 @@ def rotate_completed_replicons(graph, args, counter):
 
 
 def align_long_reads_to_assembly_graph(graph, anchor_segments, args, full_command,
-                                       read_dict, read_names, long_read_filename):
+                                       read_dict, read_names, long_read_filename,
+                                       read_sketches=None):
     alignment_dir = os.path.join(args.out, 'read_alignment')
     graph_fasta = os.path.join(alignment_dir, 'all_segments.fasta')
     anchor_segment_names = set(str(x.number) for x in anchor_segments)
@@ -825,7 +921,7 @@ def align_long_reads_to_assembly_graph(graph, anchor_segments, args, full_comman
                 'a new alignment:')
         log.log('  ' + alignments_sam)
         alignments = load_sam_alignments(alignments_sam, read_dict, reference_dict,
-                                         scoring_scheme)
+                                         scoring_scheme, args.threads)
         for alignment in alignments:
             read_dict[alignment.read.name].alignments.append(alignment)
         print_alignment_summary_table(read_dict, args.verbosity, False)
@@ -842,7 +938,8 @@ def align_long_reads_to_assembly_graph(graph, anchor_segments, args, full_comman
                                      low_score_threshold, False, min_alignment_length,
                                      alignments_in_progress, full_command, allowed_overlap,
                                      0, args.contamination, args.verbosity,
-                                     single_copy_segment_names=anchor_segment_names)
+                                     single_copy_segment_names=anchor_segment_names,
+                                     read_sketches=read_sketches)
         shutil.move(alignments_in_progress, alignments_sam)
 
         if args.keep < 2:
@@ -39,7 +39,7 @@ import math
 from multiprocessing.dummy import Pool as ThreadPool
 import threading
 from .misc import int_to_str, float_to_str, quit_with_error, weighted_average_list, \
-    get_sequence_file_type, dim, magenta, colour
+    get_sequence_file_type, dim, magenta, colour, get_nice_header
 from .read_ref import load_references
 from .alignment import Alignment
 from . import settings
@@ -48,7 +48,8 @@ from . import log
 
 try:
     from .cpp_wrappers import semi_global_alignment, new_ref_seqs, add_ref_seq, \
-        delete_ref_seqs, get_random_sequence_alignment_mean_and_std_dev, minimap_align_reads
+        delete_ref_seqs, get_random_sequence_alignment_mean_and_std_dev, minimap_align_reads, \
+        load_sam_file, screen_contamination
 except AttributeError as e:
     sys.exit('Error when importing C++ library: ' + str(e) + '\n'
              'Have you successfully built the library file using make?')
@@ -90,7 +91,7 @@ def semi_global_align_long_reads(references, ref_fasta, read_dict, read_names, r
                                  min_align_length, sam_filename, full_command, allowed_overlap,
                                  sensitivity_level, contamination_fasta, verbosity=None,
                                  stdout_header='Aligning reads', display_low_score=True,
-                                 single_copy_segment_names=None):
+                                 single_copy_segment_names=None, read_sketches=None):
     """
     This function does the primary work of this module: aligning long reads to references in an
     end-gap-free, semi-global manner. It returns a dictionary of Read objects which contain their
@@ -138,12 +139,16 @@ def semi_global_align_long_reads(references, ref_fasta, read_dict, read_names, r
     using_contamination = contamination_fasta is not None
     if using_contamination:
         references += load_references(contamination_fasta, contamination=True)
+        read_names = screen_reads_for_contamination(contamination_fasta, ref_fasta, read_dict,
+                                                    read_names, reads_fastq, threads,
+                                                    read_sketches, verbosity)
 
     reference_dict = {x.name: x for x in references}
 
     if verbosity > 0:
         log.log_section_header('Aligning reads with minimap', verbosity=2)
-    minimap_alignments_str = minimap_align_reads(ref_fasta, reads_fastq, threads, 0, 'default')
+    minimap_alignments_str = minimap_align_reads(ref_fasta, reads_fastq, threads, 0, 'default',
+                                                 read_sketches)
     minimap_alignments = load_minimap_alignments(minimap_alignments_str)
     if verbosity > 0:
         log.log('', 3)
@@ -235,6 +240,36 @@ def semi_global_align_long_reads(references, ref_fasta, read_dict, read_names, r
     return read_dict
 
 
+def screen_reads_for_contamination(contamination_fasta, ref_fasta, read_dict, read_names,
+                                   reads_fastq, threads, read_sketches, verbosity):
+    """
+    Reads which are clearly contaminants (by minimiser containment, compared to their containment
+    in the references) are marked as such and left out of the alignment. Returns the names of the
+    reads which still need aligning.
+    """
+    contaminants = screen_contamination(contamination_fasta, ref_fasta, reads_fastq, threads,
+                                        read_sketches)
+    remaining_read_names = []
+    screened_read_names = []
+    for read_name in read_names:
+        if read_name in contaminants:
+            read_dict[read_name].screened_as_contamination = True
+            screened_read_names.append(read_name)
+        else:
+            remaining_read_names.append(read_name)
+    if verbosity > 0:
+        log.log('')
+        log.log('Screened out ' + int_to_str(len(screened_read_names)) + ' of ' +
+                int_to_str(len(read_names)) + ' reads as contamination before alignment')
+        for read_name in screened_read_names:
+            containment, target_containment, coverage = contaminants[read_name]
+            log.log(dim('  ' + read_name + ': ' + float_to_str(100.0 * containment, 1) +
+                        '% of minimisers in contamination (' +
+                        float_to_str(100.0 * target_containment, 1) + '% in references), ' +
+                        float_to_str(100.0 * coverage, 1) + '% of read covered'), 3)
+    return remaining_read_names
+
+
 def get_percent_contamination(read_dict):
     """
     Returns the number and percentage of reads which mostly align to contamination, both by base
@@ -243,7 +278,7 @@ def get_percent_contamination(read_dict):
     contamination_count, some_alignment_count = 0, 0
     contamination_bases, some_alignment_bases = 0, 0
     for read in read_dict.values():
-        if read.get_fraction_aligned() > 0.0:
+        if read.screened_as_contamination or read.get_fraction_aligned() > 0.0:
             some_alignment_count += 1
             some_alignment_bases += read.get_length()
             if read.mostly_aligns_to_contamination():
@@ -310,34 +345,38 @@ def print_alignment_summary_table(read_dict, verbosity, using_contamination):
     log.log('Mean alignment identity: ' + float_to_str(mean_identity, 1, max_v) + '%')
 
 
-def load_sam_alignments(sam_filename, read_dict, reference_dict, scoring_scheme):
+def load_sam_alignments(sam_filename, read_dict, reference_dict, scoring_scheme, threads=1):
     """
-    This function returns a list of Alignment objects from the given SAM file.
+    This function returns a list of Alignment objects from the given SAM (or BAM) file. The file
+    is parsed and its alignments tallied in C++ using multiple threads, so only the Alignment
+    objects themselves are made here.
     """
     log.log_section_header('Loading alignments')
 
-    sam_lines = []
-    sam_file = open(sam_filename, 'rt')
-    for line in sam_file:
-        line = line.strip()
-        if line and not line.startswith('@') and line.split('\t', 3)[2] != '*':
-            sam_lines.append(line)
-    num_alignments = sum(1 for line in open(sam_filename) if not line.startswith('@'))
+    # The C++ loader only tallies alignments to references it can find by their SAM name, so only
+    # give it the references that Alignment will look up by that same name.
+    ref_seqs_ptr = new_ref_seqs()
+    for name, ref in reference_dict.items():
+        if get_nice_header(name) == name:
+            add_ref_seq(ref_seqs_ptr, name, ref.sequence)
+    num_alignments, sam_records = load_sam_file(sam_filename, ref_seqs_ptr, scoring_scheme,
+                                                threads)
+    delete_ref_seqs(ref_seqs_ptr)
     if not num_alignments:
         return []
     log.log_progress_line(0, num_alignments)
 
-    if not sam_lines:
+    if not sam_records:
         log.log('No alignments to load')
         return []
 
     sam_alignments = []
     last_progress = 0.0
     step = settings.LOADING_ALIGNMENTS_PROGRESS_STEP
-    for line in sam_lines:
-        sam_alignments.append(Alignment(sam_line=line, read_dict=read_dict,
+    for sam_line, sam_tally in sam_records:
+        sam_alignments.append(Alignment(sam_line=sam_line, read_dict=read_dict,
                                         reference_dict=reference_dict,
-                                        scoring_scheme=scoring_scheme))
+                                        scoring_scheme=scoring_scheme, sam_tally=sam_tally))
         progress = 100.0 * len(sam_alignments) / num_alignments
         progress_rounded_down = math.floor(progress / step) * step
         if progress == 100.0 or progress_rounded_down > last_progress: